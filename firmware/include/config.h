@@ -22,6 +22,14 @@
 #define SOUND_LOGGER_TAG "Sound"
 #define SOUND_LOGGER_LEVEL ESP_LOG_DEBUG
 
+// Memory budget
+// Heap left to the buffers allocated at startup, estimated after the static data, the drivers, lwIP and the task
+// stacks. Without PSRAM, like on the wESP32, the upload buffer, the record cache, the sample history and the impulse
+// response buffers must fit in the internal RAM budget, sound.c checks it. A buffer that cannot be allocated disables
+// its feature instead of aborting the startup.
+#define CONFIG_INTERNAL_RAM_BUDGET 188416 // bytes
+#define CONFIG_PSRAM_BUDGET 4194304 // bytes
+
 // Ethernet
 #define CONFIG_ETHERNET_PHY_CONFIG phy_lan8720_default_ethernet_config
 #define CONFIG_ETHERNET_PHY_ADDRESS PHY0
@@ -40,15 +48,71 @@
 #define CONFIG_COMMUNICATION_TCP_PORT 5001
 #define CONFIG_COMMUNICATION_UDP_PORT 5002
 #define CONFIG_COMMUNICATION_TIMEOUT_MS 1000
+#define CONFIG_COMMUNICATION_SENDING_TIMEOUT_MS 2000
 #define CONFIG_COMMUNICATION_HEARTBEAT_TIMEOUT_MS 20000
-#define CONFIG_COMMUNICATION_TCP_LISTENER_QUEUE_SIZE 1
+#define CONFIG_COMMUNICATION_MAX_CLIENT_COUNT 4
+#define CONFIG_COMMUNICATION_TCP_LISTENER_QUEUE_SIZE CONFIG_COMMUNICATION_MAX_CLIENT_COUNT
 #define CONFIG_COMMUNICATION_SOCKET_CREATION_INTERVAL_MS 100
-#define CONFIG_COMMUNICATION_RECEIVING_BUFFER_SIZE 10000
+#define CONFIG_COMMUNICATION_RECEIVING_BUFFER_SIZE 512
+
+// Each session receives at most this UDP packet rate, with bursts of CONFIG_COMMUNICATION_SESSION_UDP_PACKET_BURST
+// packets. The excess packets are dropped for this session only, so the maximum client count at the cap stays under
+// the 100 Mbit/s link with full 96 kHz stereo messages.
+#define CONFIG_COMMUNICATION_SESSION_MAX_UDP_PACKET_RATE 2000 // packets/s
+#define CONFIG_COMMUNICATION_SESSION_UDP_PACKET_BURST 64
+
+// The sound data is sent to a multicast group instead of the client address when it is enabled.
+#define CONFIG_COMMUNICATION_UDP_MULTICAST_ENABLED 0
+#define CONFIG_COMMUNICATION_UDP_MULTICAST_GROUP "239.255.0.1"
+#define CONFIG_COMMUNICATION_UDP_MULTICAST_PORT CONFIG_COMMUNICATION_UDP_PORT
+#define CONFIG_COMMUNICATION_UDP_MULTICAST_TTL 1
+#define CONFIG_COMMUNICATION_UDP_MULTICAST_INTERFACE TCPIP_ADAPTER_IF_ETH
 
 #define CONFIG_COMMUNICATION_TASK_STACK_SIZE 4096
 #define CONFIG_COMMUNICATION_TASK_PRIORITY 5
 
-// SNTP
+// Streaming
+#define CONFIG_STREAMING_PACKET_RING_SIZE 32 // Must be a power of two, includes the retransmission history
+#define CONFIG_STREAMING_PACKET_MAX_SIZE 1472
+
+// The sent packets are kept for the retransmissions until they are older than the duration or the history is full.
+#define CONFIG_STREAMING_RETRANSMISSION_HISTORY_SIZE 16 // packets
+#define CONFIG_STREAMING_RETRANSMISSION_HISTORY_DURATION_MS 100
+#define CONFIG_STREAMING_RETRANSMISSION_QUEUE_SIZE 32
+
+#define CONFIG_STREAMING_TASK_STACK_SIZE 4096
+#define CONFIG_STREAMING_TASK_PRIORITY 4
+
+// Upload
+// A record stays sample exact while a TCP stall lasts less than the sample history plus the upload buffer:
+// 0.28 s + 0.37 s at 44.1 kHz mono 32 bits and 64 ms + 85 ms at 96 kHz stereo 32 bits without PSRAM,
+// and 4.4 s + 8.9 s or 1 s + 2 s with PSRAM. The frames lost by a longer stall are replaced by silence.
+#define CONFIG_UPLOAD_BUFFER_SIZE 65536 // bytes
+#define CONFIG_UPLOAD_PSRAM_BUFFER_SIZE 1572864 // bytes, used when the PSRAM has room for it
+#define CONFIG_UPLOAD_MESSAGE_QUEUE_SIZE 16
+#define CONFIG_UPLOAD_POLL_INTERVAL_MS 10
+// A cached record is at most the cache size: 0.19 s at 44.1 kHz mono 32 bits without PSRAM and 8.9 s with PSRAM.
+// The fetch of a larger record is answered with the too large result.
+#define CONFIG_UPLOAD_RECORD_CACHE_SIZE 32768 // bytes
+#define CONFIG_UPLOAD_RECORD_PSRAM_CACHE_SIZE 1572864 // bytes
+#define CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT 4
+
+#define CONFIG_UPLOAD_TASK_STACK_SIZE 4096
+#define CONFIG_UPLOAD_TASK_PRIORITY 3
+
+// Time synchronization
+#define CONFIG_TIME_SYNC_PORT 5003
+#define CONFIG_TIME_SYNC_MASTER_ADDRESS "255.255.255.255" // The slaves broadcast their requests by default
+#define CONFIG_TIME_SYNC_INTERVAL_MS 1000
+#define CONFIG_TIME_SYNC_BURST_SIZE 4 // Exchanges per interval, the one with the smallest delay is used
+#define CONFIG_TIME_SYNC_TIMEOUT_MS 50
+#define CONFIG_TIME_SYNC_STEP_THRESHOLD_US 100000 // Larger offsets are stepped instead of slewed
+#define CONFIG_TIME_SYNC_SOCKET_CREATION_INTERVAL_MS 100
+
+#define CONFIG_TIME_SYNC_TASK_STACK_SIZE 4096
+#define CONFIG_TIME_SYNC_TASK_PRIORITY 6
+
+// SNTP, only used by the master probe
 #define CONFIG_SNTP_OPERATING_MODE SNTP_OPMODE_POLL
 #define CONFIG_SNTP_SERVER_NAME "pool.ntp.org"
 #define CONFIG_SNTP_TIME_ZONE "GMT" // UTC
@@ -62,8 +126,14 @@
 #define CONFIG_PROBE_IS_MASTER 1
 
 // Sound
-#define CONFIG_SOUND_SAMPLE_FREQUENCY 44100
-#define CONFIG_SOUND_SAMPLE_FORMAT 4 // signed 32 bits
+#define CONFIG_SOUND_SAMPLE_FREQUENCY 44100 // Default frequency until a client requests one
+#define CONFIG_SOUND_MAX_SAMPLE_FREQUENCY 96000
+#define CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY 80000000 // APB clock of the LEDC timer generating the ADC master clock
+#define CONFIG_SOUND_CLOCK_MAX_ERROR_PPM 1500 // Within the resampling correction
+#define CONFIG_SOUND_CLOCK_MAX_UNCORRECTED_ERROR_PPM 100 // The capture is resampled above: 48, 88.2 and 96 kHz
+#define CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24 2 // packed signed 24 bits, big endian
+#define CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32 4 // signed 32 bits
+#define CONFIG_SOUND_SAMPLE_FORMAT CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32 // Default format until a client requests one
 
 #define CONFIG_SOUND_GPIO_OUTPUT_IO_FMT0 18
 #define CONFIG_SOUND_GPIO_OUTPUT_IO_FMT1 13
@@ -73,6 +143,16 @@
 #define CONFIG_SOUND_GPIO_OUTPUT_IO_MODE1 15
 #define CONFIG_SOUND_GPIO_OUTPUT_IO_OSR 12
 
+// ADC mode and oversampling pins of each rate group, set while the ADC is powered down. The clock plans keep the
+// master clock at 256 fs, so only the oversampling ratio follows the rate group.
+#define CONFIG_SOUND_ADC_SINGLE_SPEED_MAX_SAMPLE_FREQUENCY 48000
+#define CONFIG_SOUND_ADC_SINGLE_SPEED_MODE0 1 // MODE 1/1: master 256 fs
+#define CONFIG_SOUND_ADC_SINGLE_SPEED_MODE1 1
+#define CONFIG_SOUND_ADC_SINGLE_SPEED_OSR 0 // x64
+#define CONFIG_SOUND_ADC_DOUBLE_SPEED_MODE0 1
+#define CONFIG_SOUND_ADC_DOUBLE_SPEED_MODE1 1
+#define CONFIG_SOUND_ADC_DOUBLE_SPEED_OSR 1 // Double speed filter
+
 #define CONFIG_SOUND_GPIO_OUTPUT_PIN_SEL  ((1ULL << CONFIG_SOUND_GPIO_OUTPUT_IO_BYPASS) | \
     (1ULL << CONFIG_SOUND_GPIO_OUTPUT_IO_MODE0) | \
     (1ULL << CONFIG_SOUND_GPIO_OUTPUT_IO_OSR) | \
@@ -83,8 +163,49 @@
 
 #define CONFIG_SOUND_CLOCK_IO 5
 #define CONFIG_SOUND_I2S_PORT_NUMBER 0
-
-#define CONFIG_SOUND_MESSAGE_SAMPLE_COUNT 256
+#define CONFIG_SOUND_I2S_DMA_BUFFER_COUNT 16 // 10.7 ms at the maximum sample frequency
+#define CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH 64 // frames
+
+#define CONFIG_SOUND_MESSAGE_SAMPLE_COUNT 256 // All channels, a message contains CONFIG_SOUND_MESSAGE_SAMPLE_COUNT / channel count frames
+#define CONFIG_SOUND_HIGH_RATE_MESSAGE_SAMPLE_COUNT 352 // Above CONFIG_SOUND_HIGH_RATE_SAMPLE_FREQUENCY, to limit the message rate
+#define CONFIG_SOUND_HIGH_RATE_SAMPLE_FREQUENCY 48000
+#define CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT CONFIG_SOUND_HIGH_RATE_MESSAGE_SAMPLE_COUNT
+#define CONFIG_SOUND_MAX_CHANNEL_COUNT 2
+#define CONFIG_SOUND_FEC_MAX_GROUP_SIZE 16 // sound data messages per FEC message
+
+#define CONFIG_SOUND_RECORD_SCHEDULE_SIZE 8
+#define CONFIG_SOUND_MAX_ACTIVE_RECORD_COUNT 3 // Overlapping records uploaded at the same time, 1.4 KB of message buffer each
+
+// Records can start up to the history duration before their request. With PSRAM, the history holds
+// CONFIG_SOUND_RECORD_HISTORY_DURATION_S at the maximum sample frequency and channel count. Without PSRAM, it takes
+// CONFIG_SOUND_RECORD_HISTORY_INTERNAL_SIZE of the internal RAM budget instead: 64 ms at 96 kHz stereo and 0.28 s at
+// 44.1 kHz mono. The records are disabled if the history cannot be allocated.
+#define CONFIG_SOUND_RECORD_HISTORY_DURATION_S 1
+#define CONFIG_SOUND_RECORD_HISTORY_INTERNAL_SIZE 49152 // bytes
+
+#define CONFIG_SOUND_SAMPLE_CLOCK_ANCHOR_INTERVAL_MS 1000
+#define CONFIG_SOUND_SAMPLE_CLOCK_RESYNCHRONIZATION_THRESHOLD_US 5000
+
+// Resamples the capture so the streamed frames follow the nominal sample frequency of the synchronized clock.
+// The capture is always resampled when the clock plan error exceeds CONFIG_SOUND_CLOCK_MAX_UNCORRECTED_ERROR_PPM.
+#define CONFIG_SOUND_RESAMPLING_ENABLED 0
+#define CONFIG_SOUND_RESAMPLING_MAX_CORRECTION_PPM 2000 // Covers the master clock error of the clock plans
+
+#define CONFIG_SOUND_FFT_MAX_SIZE 4096 // Must be a power of two, sizes the twiddle table shared by the analyses
+
+// Spectrum analysis
+#define CONFIG_SOUND_SPECTRUM_MAX_FFT_SIZE 1024 // Must be a power of two
+#define CONFIG_SOUND_SPECTRUM_MIN_INTERVAL_MS 50
+
+// Level meter
+#define CONFIG_SOUND_LEVEL_METER_MIN_INTERVAL_MS 50
+
+// Impulse response measurement, the buffers take about 36 bytes per impulse response frame. The measurement is
+// disabled if they cannot be allocated.
+#define CONFIG_SOUND_IMPULSE_RESPONSE_MAX_LENGTH 1024 // frames, at most CONFIG_SOUND_FFT_MAX_SIZE / 4
+#define CONFIG_SOUND_IMPULSE_RESPONSE_LEAD_FRAME_COUNT 64 // Frames before the sweep start, covers the clock synchronization error
+#define CONFIG_SOUND_IMPULSE_RESPONSE_MAX_SWEEP_DURATION_MS 30000
+#define CONFIG_SOUND_IMPULSE_RESPONSE_QUEUE_SIZE 2 // The measurements run one after the other
 
 #define CONFIG_SOUND_TASK_STACK_SIZE 4096
 #define CONFIG_SOUND_TASK_PRIORITY 5
@@ -4,17 +4,92 @@
 #include <stdint.h>
 #include <stddef.h>
 
-typedef void (*RecordMessageHandler)(uint8_t recordHour,
+#define SOUND_STREAM_MODE_RAW 0
+#define SOUND_STREAM_MODE_COMPRESSED 1
+#define SOUND_STREAM_MODE_NONE 2 // Only the analysis messages are sent
+
+#define SPECTRUM_CONTENT_BINS 1
+#define SPECTRUM_CONTENT_BANDS 2 // 1/3 octave
+
+#define LEVEL_METER_FREQUENCY_WEIGHTING_Z 0
+#define LEVEL_METER_FREQUENCY_WEIGHTING_A 1
+#define LEVEL_METER_FREQUENCY_WEIGHTING_C 2
+
+#define LEVEL_METER_TIME_WEIGHTING_FAST 0
+#define LEVEL_METER_TIME_WEIGHTING_SLOW 1
+
+typedef struct
+{
+    uint32_t sampleFrequency;
+    uint32_t sampleFormat;
+    uint8_t streamMode;
+    uint8_t channelCount;
+    uint8_t fecGroupSize; // 0 if the FEC is disabled
+    uint8_t decimationFactor; // 1 if the stream is not decimated
+} SoundConfiguration;
+
+typedef struct
+{
+    uint16_t fftSize; // 0 if the spectrum analysis is disabled
+    uint16_t hopSize; // frames
+    uint16_t intervalMs;
+    uint8_t content;
+    uint8_t channel;
+} SpectrumConfiguration;
+
+typedef struct
+{
+    uint16_t intervalMs; // 0 if the level meter is disabled
+    uint8_t frequencyWeighting;
+    uint8_t timeWeighting;
+    uint8_t channelCount;
+} LevelMeterConfiguration;
+
+// Exponential sine sweep sin(2 pi f1 T / ln(f2 / f1) (exp(t ln(f2 / f1) / T) - 1)) played from the start time.
+typedef struct
+{
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+    uint16_t ms;
+    uint8_t measurementId; // Shares the record ids
+    uint8_t channel;
+    uint16_t startFrequency; // Hz
+    uint16_t endFrequency; // Hz
+    uint16_t durationMs;
+    uint16_t length; // Impulse response frames
+} ImpulseResponseRequest;
+
+// Returns 1 if the requested configuration is compatible and applied, 0 otherwise.
+typedef int (*InitializationMessageHandler)(const SoundConfiguration* configuration);
+typedef int (*SpectrumMessageHandler)(const SpectrumConfiguration* configuration);
+typedef int (*LevelMeterMessageHandler)(const LevelMeterConfiguration* configuration);
+
+// Returns 1 if the measurement is queued, 0 otherwise.
+typedef int (*ImpulseResponseMessageHandler)(const ImpulseResponseRequest* request);
+
+// Returns 1 if the record is scheduled, 0 otherwise.
+typedef int (*RecordMessageHandler)(uint8_t recordHour,
     uint8_t recordMinute,
     uint8_t recordSecond,
     uint16_t recordMs,
     uint16_t durationMs,
     uint8_t recordId);
 
-void initializeCommunication(RecordMessageHandler recordMessageHandler);
+void initializeCommunication(InitializationMessageHandler initializationMessageHandler,
+    RecordMessageHandler recordMessageHandler,
+    SpectrumMessageHandler spectrumMessageHandler,
+    LevelMeterMessageHandler levelMeterMessageHandler,
+    ImpulseResponseMessageHandler impulseResponseMessageHandler);
 void startCommunication();
 
-void sendTcp(uint8_t* buffer, size_t size);
+// Returns 1 if the whole buffer is sent to the session, 0 otherwise.
+int sendTcp(uint32_t sessionId, const uint8_t* buffer, size_t size);
+
+// Sends the buffer to every connected client.
 void sendUdp(uint8_t* buffer, size_t size);
 
+// Returns 1 if the buffer is sent to the session, 0 otherwise.
+int sendUdpToSession(uint32_t sessionId, const uint8_t* buffer, size_t size);
+
 #endif
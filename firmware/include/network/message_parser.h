@@ -0,0 +1,55 @@
+#ifndef NETWORK_MESSAGE_PARSER_H
+#define NETWORK_MESSAGE_PARSER_H
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MESSAGE_PARSER_BUFFER_SIZE CONFIG_COMMUNICATION_RECEIVING_BUFFER_SIZE
+
+#define MESSAGE_HANDLER_CONTINUE 0
+#define MESSAGE_HANDLER_STOP 1 // Stops the dispatch, the remaining bytes stay in the parser
+#define MESSAGE_HANDLER_CLOSE 2
+
+// The message starts on a 32-bit boundary and contains its header.
+typedef int (*MessageHandler)(void* context, uint8_t* message, size_t size);
+
+// The framing of a message does not depend on the connection state, so a message without handler is skipped
+// by its size. A message missing from the format table closes the connection, since it cannot be framed.
+typedef struct
+{
+    uint32_t id;
+    int hasPayload;
+} MessageFormat;
+
+typedef struct
+{
+    uint32_t id;
+    size_t minSize;
+    size_t maxSize;
+    MessageHandler handler;
+} MessageHandlerEntry;
+
+// Incremental parser of the TCP message stream, the partial messages stay buffered between receptions.
+typedef struct
+{
+    uint8_t buffer[MESSAGE_PARSER_BUFFER_SIZE] __attribute__((aligned(4)));
+    size_t size;
+    const MessageFormat* formats;
+    size_t formatCount;
+} MessageParser;
+
+void initializeMessageParser(MessageParser* parser, const MessageFormat* formats, size_t formatCount);
+
+// Reads the available bytes with one recv and dispatches the complete messages.
+// Returns MESSAGE_HANDLER_CLOSE if the connection is closed, failed or does not follow the protocol, like an unknown
+// message id.
+int receiveMessages(MessageParser* parser,
+    int socketHandle,
+    const MessageHandlerEntry* handlers,
+    size_t handlerCount,
+    void* context);
+int dispatchMessages(MessageParser* parser, const MessageHandlerEntry* handlers, size_t handlerCount, void* context);
+
+#endif
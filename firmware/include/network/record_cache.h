@@ -0,0 +1,33 @@
+#ifndef NETWORK_RECORD_CACHE_H
+#define NETWORK_RECORD_CACHE_H
+
+#include <esp_err.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Memory-bounded cache of the last uploaded record payloads, keyed by record id.
+// It is only used by the upload task, the least recently used records are evicted first.
+// If the cache cannot be allocated, no record is cached.
+esp_err_t initializeRecordCache();
+
+// A record is cached while its messages are uploaded, its size is only known when it is finished.
+void startRecordCacheEntry(uint8_t recordId);
+void appendRecordCacheEntry(const uint8_t* data, size_t size);
+void finishRecordCacheEntry(uint8_t recordId, uint8_t status);
+
+// Only one record is filled at a time, a record uploaded at the same time as the one being filled is not cached.
+void skipRecordCacheEntry(uint8_t recordId);
+
+// Returns the data of a completely cached record or NULL. The data stays valid until the cache is modified.
+const uint8_t* findRecordCacheEntry(uint8_t recordId, size_t* size, uint8_t* status);
+
+// Returns 1 if the last record with this id was not cached because it is larger than the cache.
+int isRecordTooLargeForCache(uint8_t recordId);
+
+// Returns 1 if the last record with this id was not cached because it was uploaded at the same time as another one.
+int isRecordSkippedByCache(uint8_t recordId);
+
+void logRecordCacheStatistics();
+
+#endif
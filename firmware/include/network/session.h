@@ -0,0 +1,59 @@
+#ifndef NETWORK_SESSION_H
+#define NETWORK_SESSION_H
+
+#include "config.h"
+#include "network/message_parser.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <lwip/sockets.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SESSION_NO_ID 0
+
+typedef struct
+{
+    uint32_t id;
+    int isActive;
+    int tcpSocketHandle;
+    struct sockaddr_in udpAddress;
+    SemaphoreHandle_t tcpMutex; // Serializes the TCP sends and the socket closing
+    uint32_t lastHeartbeatTimestamp;
+    MessageParser parser;
+
+    uint32_t udpPacketBudget; // Token bucket of the UDP packet rate cap, in packets per 1000
+    uint32_t udpPacketBudgetTimestamp;
+
+    uint32_t sentPacketCount;
+    uint32_t failedPacketCount;
+    uint32_t cappedPacketCount;
+    uint32_t sentTcpByteCount;
+} Session;
+
+// Table of the connected clients. The sessions share one UDP socket and the stream configuration.
+void initializeSessions();
+
+// Returns NULL if the maximum client count is reached.
+Session* openSession(int tcpSocketHandle, const struct sockaddr_in* udpAddress);
+void closeSession(Session* session);
+size_t getSessionCount();
+
+// Fills the array with the active sessions and returns their count. The array must hold the maximum client count.
+size_t getActiveSessions(Session** activeSessions);
+
+// Returns 1 if the whole buffer is sent to the session, 0 otherwise.
+int sendSessionTcp(uint32_t sessionId, const uint8_t* buffer, size_t size);
+
+// Sends the same buffer to every session under its UDP packet rate cap, or once to the multicast group.
+void sendSessionsUdp(int udpSocketHandle, const struct sockaddr_in* multicastAddress, const uint8_t* buffer, size_t size);
+
+// Sends the buffer to the unicast address of one session under its UDP packet rate cap, even if the multicast is
+// enabled.
+int sendSessionUdp(int udpSocketHandle, uint32_t sessionId, const uint8_t* buffer, size_t size);
+
+void logSessionStatistics();
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef NETWORK_STREAMING_H
+#define NETWORK_STREAMING_H
+
+#include "packet_ring.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+void initializeStreaming();
+void startStreaming();
+
+// Places the packet data at dataOffset bytes from the start of each cache-line-aligned buffer.
+// It must be called before startStreaming.
+void initializeStreamingPackets(size_t dataOffset);
+
+// The acquired packet is written in place and sent without copy once committed. It never blocks,
+// the packet is dropped on commit if the ring is full.
+PacketRingSlot* acquireStreamingPacket();
+void commitStreamingPacket(PacketRingSlot* slot, size_t size);
+
+// Queues the retransmission of a sent packet to one session. Returns 0 if the request queue is full.
+// The packet is not sent again if it has left the history.
+int requestStreamingRetransmission(uint32_t sessionId, uint16_t sequenceId);
+
+void logStreamingStatistics();
+
+#endif
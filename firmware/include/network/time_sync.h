@@ -0,0 +1,16 @@
+#ifndef NETWORK_TIME_SYNC_H
+#define NETWORK_TIME_SYNC_H
+
+// Two-way time transfer between the probes over UDP.
+// The master probe answers the time requests and the slave probes slew their system clock to the master clock.
+//
+// For each exchange, the slave measures:
+//  - offset = ((t2 - t1) + (t3 - t4)) / 2
+//  - delay = (t4 - t1) - (t3 - t2)
+// t1 and t4 are the slave send and receive times and t2 and t3 are the master receive and send times.
+void initializeTimeSync();
+void startTimeSync();
+
+void logTimeSyncStatistics();
+
+#endif
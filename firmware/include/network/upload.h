@@ -0,0 +1,32 @@
+#ifndef NETWORK_UPLOAD_H
+#define NETWORK_UPLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UPLOAD_MESSAGE_MAX_SIZE 20 // The largest small message is the rejected impulse response status
+
+void initializeUpload();
+void startUpload();
+
+// Queues bulk data that is sent over TCP by the upload task. It never blocks, it returns 0 if the buffer is full.
+// The data is a sequence of messages with a payload, a message can be split across several calls.
+int queueUploadData(const uint8_t* data, size_t size);
+
+// Queues a small complete message for a session, it is sent between the messages of the bulk data.
+// It never blocks, so it can be called from the communication task, it returns 0 if the queue is full.
+int queueUploadMessage(uint32_t sessionId, const uint8_t* data, size_t size);
+
+// Queues the re-fetch of a byte range of a cached record, a size of 0 means up to the end of the record.
+int queueRecordFetch(uint32_t sessionId, uint8_t recordId, uint32_t offset, uint32_t size);
+
+// The record messages of the bulk data are sent to the session that requested the record.
+void setRecordSessionId(uint8_t recordId, uint32_t sessionId);
+
+// The impulse response messages of the bulk data are sent to the session that requested the measurement.
+// The measurement ids are separate from the record ids.
+void setMeasurementSessionId(uint8_t measurementId, uint32_t sessionId);
+
+void logUploadStatistics();
+
+#endif
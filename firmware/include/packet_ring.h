@@ -0,0 +1,66 @@
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include "config.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Single-producer/single-consumer lock-free ring of preallocated packet buffers.
+// The producer writes directly into the acquired slot and the consumer sends it from the same memory.
+// The popped slots stay in a history owned by the consumer until they are released, so they can be sent again.
+// The capacity must be a power of two.
+#define PACKET_RING_CAPACITY CONFIG_STREAMING_PACKET_RING_SIZE
+#define PACKET_RING_MASK (PACKET_RING_CAPACITY - 1)
+
+#define PACKET_RING_NO_SEQUENCE_ID UINT32_MAX // The packet is not retransmitted
+
+#define PACKET_RING_SLOT_ALIGNMENT 32 // ESP32 cache line size
+#define PACKET_RING_SLOT_BUFFER_SIZE (((CONFIG_STREAMING_PACKET_MAX_SIZE + PACKET_RING_SLOT_ALIGNMENT - 1) / \
+    PACKET_RING_SLOT_ALIGNMENT + 1) * PACKET_RING_SLOT_ALIGNMENT)
+
+typedef struct
+{
+    uint8_t buffer[PACKET_RING_SLOT_BUFFER_SIZE] __attribute__((aligned(PACKET_RING_SLOT_ALIGNMENT)));
+    uint8_t* data;
+    size_t size;
+    uint32_t headerId; // Identifies the header template stamped by the producer
+    uint32_t sequenceId; // Set by the producer
+    uint32_t sentTimestamp; // Set by the consumer
+} PacketRingSlot;
+
+typedef struct
+{
+    PacketRingSlot slots[PACKET_RING_CAPACITY];
+    PacketRingSlot overflowSlot;
+
+    atomic_uint writeIndex;
+    atomic_uint readIndex;
+    atomic_uint releaseIndex;
+
+    atomic_uint pushedPacketCount;
+    atomic_uint droppedPacketCount;
+    atomic_uint maxOccupancy;
+} PacketRing;
+
+// The packet data of every slot starts at dataOffset bytes from the aligned buffer.
+void initializePacketRing(PacketRing* ring, size_t dataOffset);
+
+// Producer side
+// When the ring is full, the overflow slot is returned and its packet is dropped on commit.
+PacketRingSlot* acquirePacketRingSlot(PacketRing* ring);
+void commitPacketRingSlot(PacketRing* ring, PacketRingSlot* slot, size_t size);
+
+// Consumer side
+PacketRingSlot* peekPacketRing(PacketRing* ring);
+void popPacketRing(PacketRing* ring);
+
+// Consumer side, history of the popped slots from the oldest one
+size_t getPacketRingHistorySize(PacketRing* ring);
+PacketRingSlot* getPacketRingHistorySlot(PacketRing* ring, size_t index);
+void releasePacketRingSlot(PacketRing* ring);
+
+size_t getPacketRingOccupancy(PacketRing* ring);
+
+#endif
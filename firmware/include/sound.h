@@ -1,16 +1,26 @@
 #ifndef SOUND_H
 #define SOUND_H
 
+#include "network/communication.h"
+
 #include <stdint.h>
 
 void initializeSound();
 void startSound();
 
-void recordSound(uint8_t recordHour,
+int configureSound(const SoundConfiguration* configuration);
+int configureSpectrum(const SpectrumConfiguration* configuration);
+int configureLevelMeter(const LevelMeterConfiguration* configuration);
+
+int recordSound(uint8_t recordHour,
     uint8_t recordMinute,
     uint8_t recordSecond,
     uint16_t recordMs,
     uint16_t durationMs,
     uint8_t recordId);
 
+int measureImpulseResponse(const ImpulseResponseRequest* request);
+
+void logSoundStatistics();
+
 #endif
@@ -0,0 +1,17 @@
+#ifndef SOUND_CHANNELS_H
+#define SOUND_CHANNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Keeps the first channelCount slots of each I2S frame, the output frames are interleaved.
+void extractChannels(const int32_t* i2sFrames,
+    size_t frameCount,
+    size_t i2sChannelCount,
+    size_t channelCount,
+    int32_t* frames);
+
+// Splits interleaved frames into one contiguous block of frameCount samples per channel.
+void deinterleaveFrames(const int32_t* frames, size_t frameCount, size_t channelCount, int32_t* channelSamples);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef SOUND_CLOCK_PLAN_H
+#define SOUND_CLOCK_PLAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CLOCK_PLAN_MCLK_RATIO 256 // The ADC is a master in 256 fs mode
+#define CLOCK_PLAN_LEDC_DIVIDER_FRACTIONAL_BIT_COUNT 8
+
+// The ADC master clock is generated by a LEDC timer from the APB clock.
+// The APLL is not used: its clock output is only routed to GPIO0, which receives the Ethernet RMII clock,
+// and to GPIO1 and GPIO3, which are used by UART0.
+//
+// The LEDC output frequency is sourceFrequency / (clockDivider / 2^8) / 2^dutyResolution. The plan keeps the
+// duty resolution and the rounded divider giving the smallest frequency error.
+typedef struct
+{
+    uint32_t sampleFrequency;
+    uint32_t mclkFrequency;
+    uint32_t ledcDutyResolution; // bits
+    uint32_t ledcDuty; // 50 %
+    uint32_t ledcClockDivider; // Fixed point with CLOCK_PLAN_LEDC_DIVIDER_FRACTIONAL_BIT_COUNT fractional bits
+    double actualMclkFrequency;
+    double errorPpm;
+} ClockPlan;
+
+// Returns 1 if the sample frequency is supported by the ADC and its clock error is within maxErrorPpm, 0 otherwise.
+int computeClockPlan(uint32_t sampleFrequency, uint32_t sourceFrequency, double maxErrorPpm, ClockPlan* plan);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SOUND_COMPRESSION_H
+#define SOUND_COMPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPRESSION_MAX_ORDER 4
+#define COMPRESSION_VERBATIM_ORDER 0xFF
+
+// Lossless compression of a block of 24-bit samples (left-justified in 32 bits), FLAC style.
+//
+// Block layout:
+//  - order (1 byte): fixed predictor order from 0 to COMPRESSION_MAX_ORDER or COMPRESSION_VERBATIM_ORDER
+//  - Rice parameter (1 byte)
+//  - warm-up samples: order samples as 24-bit big-endian values
+//  - residuals: zigzag-mapped and Rice coded, MSB first, the quotient in unary (zeros terminated by a one)
+//    followed by the Rice parameter low bits, padded with zeros to a byte boundary
+//
+// A verbatim block only contains the order byte, a zero Rice parameter byte and the packed 24-bit samples.
+// It is used when the residuals do not fit in the output or do not compress.
+//
+// The output capacity must be at least getMaxCompressedSize(sampleCount) and sampleCount must not be greater than
+// CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT. Returns the encoded block size.
+size_t compressSamples(const int32_t* samples, size_t sampleCount, uint8_t* output, size_t outputCapacity);
+
+size_t getMaxCompressedSize(size_t sampleCount);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef SOUND_DECIMATOR_H
+#define SOUND_DECIMATOR_H
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DECIMATOR_MAX_STAGE_COUNT 3 // Decimation by 8
+#define DECIMATOR_MAX_CHANNEL_COUNT CONFIG_SOUND_MAX_CHANNEL_COUNT
+#define DECIMATOR_MAX_INPUT_FRAME_COUNT (2 * CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH + 1)
+
+// The half-band FIR has DECIMATOR_HALF_BAND_ORDER + 1 taps. The even taps are zero except the center one,
+// so a stage costs (DECIMATOR_HALF_BAND_ORDER / 4 + 1) multiplications per channel and output frame.
+// The passband of each stage ends at about 0.32 of its output sample frequency.
+#define DECIMATOR_HALF_BAND_ORDER 30
+#define DECIMATOR_TAP_COUNT (DECIMATOR_HALF_BAND_ORDER + 1)
+
+typedef struct
+{
+    float frames[(DECIMATOR_TAP_COUNT + DECIMATOR_MAX_INPUT_FRAME_COUNT) * DECIMATOR_MAX_CHANNEL_COUNT];
+    size_t frameCount;
+} DecimatorStage;
+
+// Cascade of polyphase half-band stages decimating interleaved 24-bit samples (left-justified in 32 bits) by 2,
+// 4 or 8. Each stage only computes its output frames and skips the zero taps.
+typedef struct
+{
+    DecimatorStage stages[DECIMATOR_MAX_STAGE_COUNT];
+    size_t stageCount;
+    size_t channelCount;
+} Decimator;
+
+int isDecimationFactorSupported(uint8_t decimationFactor);
+
+// The factor must be supported. A factor of 1 copies the frames.
+void initializeDecimator(Decimator* decimator, uint8_t decimationFactor, size_t channelCount);
+
+// The input frame count must not be greater than DECIMATOR_MAX_INPUT_FRAME_COUNT. The output must hold
+// inputFrameCount / decimation factor + 1 frames. Returns the output frame count.
+size_t decimateFrames(Decimator* decimator, const int32_t* input, size_t inputFrameCount, int32_t* output);
+
+// Group delay of the cascade in input frames.
+size_t getDecimatorDelay(const Decimator* decimator);
+
+#endif
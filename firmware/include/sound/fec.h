@@ -0,0 +1,40 @@
+#ifndef SOUND_FEC_H
+#define SOUND_FEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// XOR forward error correction of the sound data messages.
+// A FEC message follows every group of sound data messages. The receiver rebuilds one lost message per group
+// from the other messages of the group and the FEC message.
+//
+// FEC message layout:
+//  - id (4 bytes): 13
+//  - payload size (4 bytes)
+//  - id of the first sound data message of the group (2 bytes)
+//  - sound data message count (1 byte)
+//  - reserved (1 byte)
+//  - XOR of the sound data message sizes (2 bytes)
+//  - reserved (2 bytes)
+//  - XOR of the sound data messages from their byte FEC_PROTECTED_DATA_OFFSET, the shorter ones padded with zeros
+//
+// The id and the payload size of a rebuilt message are derived from the stream mode and its size.
+#define FEC_MESSAGE_HEADER_SIZE 16
+#define FEC_PROTECTED_DATA_OFFSET 8
+
+// The FEC message is built at dataOffset bytes from a 32-bit boundary. When the sound data messages have the
+// same alignment, the parity is computed word by word.
+void initializeFec(size_t dataOffset);
+
+// Starts a new group. A zero group size disables the FEC.
+void resetFec(uint8_t groupSize);
+
+// Returns 1 if the group is complete and its FEC message must be sent.
+int addFecPacket(const uint8_t* packet, size_t size, uint16_t sequenceId);
+
+// Copies the FEC message of the complete group and starts the next group. Returns the message size.
+size_t writeFecMessage(uint8_t* buffer);
+
+void xorBytes(uint8_t* destination, const uint8_t* source, size_t size);
+
+#endif
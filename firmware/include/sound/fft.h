@@ -0,0 +1,23 @@
+#ifndef SOUND_FFT_H
+#define SOUND_FFT_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+#define FFT_MAX_SIZE CONFIG_SOUND_FFT_MAX_SIZE // Real samples
+
+// Radix-2 single precision FFT sharing one twiddle table sized for FFT_MAX_SIZE.
+void initializeFft();
+
+int isFftSizeSupported(size_t size);
+
+// In-place FFT of size interleaved complex values (real, imaginary). The size must be a power of two not greater than
+// FFT_MAX_SIZE / 2. The inverse transform is not scaled by 1 / size.
+void computeComplexFft(float* data, size_t size, int isInverse);
+
+// Squared magnitudes of the size / 2 + 1 first bins of the FFT of size real samples. The samples are overwritten.
+// The size must be a supported FFT size.
+void computeRealFftPower(float* samples, size_t size, float* power);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SOUND_IMPULSE_RESPONSE_H
+#define SOUND_IMPULSE_RESPONSE_H
+
+#include "config.h"
+#include "network/communication.h"
+
+#include <esp_err.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IMPULSE_RESPONSE_MESSAGE_ID 22
+
+#define IMPULSE_RESPONSE_STATUS_COMPLETE 0
+#define IMPULSE_RESPONSE_STATUS_FRAMES_MISSING 1 // Frames of the measurement were no longer in the history
+#define IMPULSE_RESPONSE_STATUS_UNSUPPORTED 2 // The request does not match the current sound configuration
+#define IMPULSE_RESPONSE_STATUS_REJECTED 3 // Sent by the communication, the measurement is not queued
+
+// Deconvolution of an exponential sine sweep, accumulated while the captured frames arrive. The recording is
+// correlated with the sweep weighted by its instantaneous frequency, so the energy of the sweep becomes flat. The correlation is computed per block with an FFT that transforms the recording and the sweep block
+// together, and only the first lags are kept.
+//
+// Message layout, uploaded like a record:
+//  - id (4 bytes), payload size (4 bytes)
+//  - measurement id (1 byte), status (1 byte), lead frame count (2 bytes), sample frequency (4 bytes),
+//    length (4 bytes)
+//  - impulse response as 32-bit big-endian IEEE floats, 0 if the status is not complete
+//
+// The impulse response starts CONFIG_SOUND_IMPULSE_RESPONSE_LEAD_FRAME_COUNT frames before the sweep start.
+// Its gain is relative to a full-scale sweep, so a unit system gives a band-limited unit impulse.
+//
+// The buffers are freed if the initialization fails, the measurements must then stay disabled.
+esp_err_t initializeImpulseResponse();
+
+// Size of the buffers allocated by initializeImpulseResponse.
+#define IMPULSE_RESPONSE_BUFFER_SIZE ((9 * CONFIG_SOUND_IMPULSE_RESPONSE_MAX_LENGTH + 7) * sizeof(float))
+
+int isImpulseResponseRequestSupported(const ImpulseResponseRequest* request);
+
+// The measurement stays active until its message is released. An unsupported measurement is finished at once.
+void startImpulseResponse(const ImpulseResponseRequest* request,
+    uint32_t sampleFrequency,
+    size_t historyChannelCount,
+    int64_t startSampleIndex);
+int isImpulseResponseActive();
+int isImpulseResponseFinished();
+
+// Next frames to be added, they are read from the sample history.
+int64_t getImpulseResponseFrameIndex();
+size_t getImpulseResponseRemainingFrameCount();
+
+// Adds the next frames of the history. The impulse response is computed with the last frames.
+void addImpulseResponseFrames(const int32_t* frames, size_t frameCount);
+void failImpulseResponse(uint8_t status);
+
+const uint8_t* getImpulseResponseMessage(size_t* size);
+void releaseImpulseResponse();
+
+#endif
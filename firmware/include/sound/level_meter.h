@@ -0,0 +1,41 @@
+#ifndef SOUND_LEVEL_METER_H
+#define SOUND_LEVEL_METER_H
+
+#include "config.h"
+#include "network/communication.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LEVEL_METER_MESSAGE_ID 20
+#define LEVEL_METER_MESSAGE_TIMESTAMP_OFFSET 8 // hour, minute, second, ms (16 bits), us (16 bits)
+
+// Incremental sound level meter of the first channels. The frequency weighting is applied before every level.
+//
+// Message layout:
+//  - id (4 bytes), payload size (4 bytes)
+//  - timestamp of the first frame of the interval (7 bytes)
+//  - frequency weighting (1 byte), time weighting (1 byte), channel count (1 byte),
+//    duration of the running Leq in ms (4 bytes)
+//  - for each channel, 16-bit big-endian values in 0.01 dB relative to a full scale:
+//    peak, time-weighted level at the end of the interval, maximum time-weighted level, interval Leq, running Leq
+//
+// The peak is relative to the full-scale amplitude, the other levels to the power of a full-scale sine.
+// The running Leq integrates from the last configuration.
+int isLevelMeterConfigurationSupported(const LevelMeterConfiguration* configuration);
+
+// Restarts the meter from the frame at sampleIndex. The meter is disabled if the interval is 0.
+void resetLevelMeter(const LevelMeterConfiguration* configuration, uint32_t sampleFrequency, uint64_t sampleIndex);
+int isLevelMeterEnabled();
+uint32_t getLevelMeterSampleFrequency();
+
+// Returns 1 when the interval of a message is complete.
+int addLevelMeterFrames(const int32_t* frames, size_t frameCount, size_t channelCount);
+
+uint64_t getLevelMeterMessageSampleIndex();
+
+// Writes the message except its timestamp and starts the next interval. It must only be called when
+// addLevelMeterFrames returned 1. Returns the message size.
+size_t writeLevelMeterMessage(uint8_t* buffer);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SOUND_RECORD_SCHEDULE_H
+#define SOUND_RECORD_SCHEDULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define US_IN_DAY_COUNT 86400000000LL
+
+int64_t getTimeOfDayUs(uint8_t hour, uint8_t minute, uint8_t second, uint32_t us);
+
+// Returns the delay from the current time of day to the requested one, wrapped in [-12 h, 12 h).
+// A negative delay means that the requested time is already passed.
+int64_t getTimeOfDayDelayUs(int64_t currentTimeOfDayUs, int64_t requestedTimeOfDayUs);
+
+typedef struct
+{
+    int64_t startSampleIndex;
+    size_t frameCount;
+    uint8_t recordId;
+} RecordRequest;
+
+// Bounded schedule of the pending records, ordered by start sample index.
+// The communication task schedules the records and the sound task pops them when they are due.
+// The schedule has no lock, the caller serializes the calls.
+int scheduleRecord(const RecordRequest* request);
+int popDueRecord(int64_t endSampleIndex, RecordRequest* request);
+size_t getScheduledRecordCount();
+
+#endif
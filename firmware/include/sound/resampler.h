@@ -0,0 +1,34 @@
+#ifndef SOUND_RESAMPLER_H
+#define SOUND_RESAMPLER_H
+
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RESAMPLER_HISTORY_FRAME_COUNT 3
+#define RESAMPLER_MAX_CHANNEL_COUNT 2
+#define RESAMPLER_MAX_INPUT_FRAME_COUNT CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH
+#define RESAMPLER_MAX_OUTPUT_FRAME_COUNT (2 * RESAMPLER_MAX_INPUT_FRAME_COUNT + 1)
+
+// Fractional resampler of interleaved 24-bit samples (left-justified in 32 bits).
+// The output samples are interpolated with a cubic Lagrange polynomial evaluated in Farrow form, so the ratio
+// can change at every block without recomputing a filter.
+typedef struct
+{
+    int32_t frames[(RESAMPLER_HISTORY_FRAME_COUNT + RESAMPLER_MAX_INPUT_FRAME_COUNT) * RESAMPLER_MAX_CHANNEL_COUNT];
+    size_t channelCount;
+    uint64_t position; // Input frame position of the next output frame, 32 fractional bits
+    uint64_t step; // Input frames per output frame, 32 fractional bits
+} Resampler;
+
+void initializeResampler(Resampler* resampler, size_t channelCount);
+
+// The ratio is the input frame count per output frame, it is clamped between 0.5 and 2.
+void setResamplerRatio(Resampler* resampler, double ratio);
+
+// The input frame count must not be greater than RESAMPLER_MAX_INPUT_FRAME_COUNT and the output must hold
+// RESAMPLER_MAX_OUTPUT_FRAME_COUNT frames. Returns the output frame count.
+size_t resampleFrames(Resampler* resampler, const int32_t* input, size_t inputFrameCount, int32_t* output);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SOUND_SAMPLE_CLOCK_H
+#define SOUND_SAMPLE_CLOCK_H
+
+#include <stdint.h>
+
+#include <sys/time.h>
+
+#define US_IN_S_COUNT 1000000LL
+
+// Maps the running sample counter of the sound task to the system clock.
+// The clock is anchored to gettimeofday every CONFIG_SOUND_SAMPLE_CLOCK_ANCHOR_INTERVAL_MS and a tracking loop
+// corrects the anchor time and the estimated sample frequency from the measured drift.
+void initializeSampleClock(uint32_t nominalSampleFrequency);
+
+// Restarts the tracking at a new nominal frequency, the next sample index is anchored to the current time.
+void resetSampleClock(uint32_t nominalSampleFrequency, uint64_t nextSampleIndex);
+
+// Called by the sound task once per DMA block with the index of the next sample to be captured.
+// It only reads the system clock when an anchor is due. Returns 1 if the estimated sample frequency is updated.
+int updateSampleClock(uint64_t nextSampleIndex);
+
+int64_t getTimevalUs(const struct timeval* tv);
+int64_t convertSampleIndexToTime(uint64_t sampleIndex);
+int64_t convertTimeToSampleIndex(int64_t timeUs);
+double getEstimatedSampleFrequency();
+uint32_t getNominalSampleFrequency();
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SOUND_SAMPLE_FORMAT_H
+#define SOUND_SAMPLE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SAMPLE_FORMAT_SIGNED_24_SIZE 3
+#define SAMPLE_FORMAT_SIGNED_32_SIZE 4
+
+int isSampleFormatSupported(uint32_t sampleFormat);
+size_t getSampleSize(uint32_t sampleFormat);
+
+// The I2S samples are left-justified 24-bit values in 32-bit words.
+// SIGNED_32 samples are written as is and SIGNED_24 samples are packed in 3 big-endian bytes.
+void writeSamples(uint32_t sampleFormat, const int32_t* samples, size_t sampleCount, uint8_t* output);
+void packSamples24(const int32_t* samples, size_t sampleCount, uint8_t* output);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SOUND_SAMPLE_HISTORY_H
+#define SOUND_SAMPLE_HISTORY_H
+
+#include <esp_err.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Ring of the most recent captured frames, indexed by absolute frame index.
+// The sound task is the only writer. The readers copy frames out and the copy is rejected if the writer
+// overwrote them in the meantime.
+//
+// The history holds psramSampleCapacity samples in the PSRAM when it is available, internalSampleCapacity samples
+// in the internal RAM otherwise. If neither can be allocated, it stays empty and every read is rejected.
+esp_err_t initializeSampleHistory(size_t psramSampleCapacity, size_t internalSampleCapacity);
+
+// Drops the content of the history, for example when the channel count changes.
+void resetSampleHistory(uint64_t nextFrameIndex, size_t channelCount);
+void writeSampleHistory(const int32_t* frames, size_t frameCount);
+
+uint64_t getSampleHistoryBeginIndex();
+uint64_t getSampleHistoryEndIndex();
+size_t getSampleHistoryChannelCount();
+
+// Returns 1 if the frames are available with channelCount channels and were not overwritten during the copy,
+// 0 otherwise. A reset to another channel count rejects the reads of the readers started before it.
+int readSampleHistory(uint64_t frameIndex, size_t frameCount, size_t channelCount, int32_t* frames);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SOUND_SPECTRUM_H
+#define SOUND_SPECTRUM_H
+
+#include "config.h"
+#include "network/communication.h"
+#include "sound/fft.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPECTRUM_MAX_FFT_SIZE CONFIG_SOUND_SPECTRUM_MAX_FFT_SIZE
+
+#define SPECTRUM_MESSAGE_ID 18
+#define SPECTRUM_MESSAGE_TIMESTAMP_OFFSET 8 // hour, minute, second, ms (16 bits), us (16 bits)
+
+// 1/3-octave bands from 20 Hz to 20 kHz, band i is centered on 1000 * 10^((i - 17) / 10) Hz.
+#define SPECTRUM_MAX_BAND_COUNT 31
+
+// Welch averaging of Hann-windowed power spectra of one channel, with the 1/3-octave band levels derived from the
+// averaged bins.
+//
+// Message layout:
+//  - id (4 bytes), payload size (4 bytes)
+//  - timestamp of the first frame of the first averaged window (7 bytes)
+//  - content (1 byte), sample frequency (4 bytes), FFT size (2 bytes), averaged window count (2 bytes),
+//    bin count (2 bytes), band count (2 bytes)
+//  - bin levels then band levels, 16-bit big-endian values in 0.01 dB relative to a full-scale sine
+//
+// A bin level is the power in one bin width, so a sine spreads over the window main lobe. The band levels sum the
+// overlapping bin widths, the bands above the Nyquist frequency are omitted.
+void initializeSpectrum();
+
+int isSpectrumConfigurationSupported(const SpectrumConfiguration* configuration);
+
+// Restarts the analysis from the frame at sampleIndex. The analysis is disabled if the FFT size is 0.
+void resetSpectrum(const SpectrumConfiguration* configuration, uint32_t sampleFrequency, uint64_t sampleIndex);
+int isSpectrumEnabled();
+uint32_t getSpectrumSampleFrequency();
+
+// Analyzes the configured channel of the interleaved frames. Returns 1 when the interval of a message is complete.
+int addSpectrumFrames(const int32_t* frames, size_t frameCount, size_t channelCount);
+
+uint64_t getSpectrumMessageSampleIndex();
+
+// Writes the message except its timestamp and starts the next averaging. It must only be called when
+// addSpectrumFrames returned 1. Returns the message size.
+size_t writeSpectrumMessage(uint8_t* buffer);
+
+#endif
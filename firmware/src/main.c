@@ -5,6 +5,11 @@
 #include "network/discovery.h"
 #include "network/communication.h"
 #include "network/communication.h"
+#include "network/streaming.h"
+#include "network/record_cache.h"
+#include "network/session.h"
+#include "network/time_sync.h"
+#include "network/upload.h"
 #include "sound.h"
 
 #include <time.h>
@@ -41,19 +46,34 @@ void app_main()
     ESP_LOGI(MAIN_LOGGER_TAG, "Initialization");
     initializeEvent();
     initializeEthernet();
-    initializeStnp();
+    if (CONFIG_PROBE_IS_MASTER)
+    {
+        initializeStnp();
+    }
+    initializeTimeSync();
     initializeDiscovery();
-    initializeCommunication(recordSound);
+    initializeCommunication(configureSound, recordSound, configureSpectrum, configureLevelMeter, measureImpulseResponse);
+    initializeStreaming();
+    initializeUpload();
     initializeSound();
 
     ESP_LOGI(MAIN_LOGGER_TAG, "Task start");
     startDiscovery();
+    startTimeSync();
     startCommunication();
+    startStreaming();
+    startUpload();
     startSound();
 
     while(1)
     {
         logCurrentUtc();
+        logTimeSyncStatistics();
+        logSoundStatistics();
+        logSessionStatistics();
+        logStreamingStatistics();
+        logUploadStatistics();
+        logRecordCacheStatistics();
         vTaskDelay(CONFIG_UTC_LOG_INTERVAL_MS / portTICK_PERIOD_MS);
     }
 }
@@ -1,4 +1,8 @@
 #include "network/communication.h"
+#include "network/message_parser.h"
+#include "network/session.h"
+#include "network/streaming.h"
+#include "network/upload.h"
 #include "network/utils.h"
 #include "config.h"
 
@@ -10,6 +14,8 @@
 #include <lwip/sys.h>
 #include <lwip/netdb.h>
 
+#include <tcpip_adapter.h>
+
 #include <string.h>
 
 #define INITIALIZATION_RESQUEST_SIZE 16
@@ -17,6 +23,12 @@
 #define INITIALIZATION_RESQUEST_SAMPLE_FREQUENCY_OFFSET 8
 #define INITIALIZATION_RESQUEST_SAMPLE_FORMAT_OFFSET 12
 
+// Optional fields, the default value is used when the request is too short to contain them.
+#define INITIALIZATION_RESQUEST_STREAM_MODE_OFFSET 16
+#define INITIALIZATION_RESQUEST_CHANNEL_COUNT_OFFSET 17
+#define INITIALIZATION_RESQUEST_FEC_GROUP_SIZE_OFFSET 18
+#define INITIALIZATION_RESQUEST_DECIMATION_FACTOR_OFFSET 19
+
 #define INITIALIZATION_RESPONSE_SIZE 14
 #define INITIALIZATION_RESPONSE_PROBE_ID_OFFSET 10
 
@@ -32,15 +44,106 @@
 #define RECORD_DURATION_MS_OFFSET 13
 #define RECORD_ID_OFFSET 15
 
+// Sent instead of the record response when the record is not scheduled, the other statuses follow the records.
+#define RECORD_STATUS_SIZE 10
+#define RECORD_STATUS_ID 9
+#define RECORD_STATUS_PAYLOAD_SIZE_OFFSET 4
+#define RECORD_STATUS_RECORD_ID_OFFSET 8
+#define RECORD_STATUS_STATUS_OFFSET 9
+#define RECORD_STATUS_REJECTED 2 // The request is invalid, the record schedule is full or the records are disabled
+
+#define RECORD_FETCH_SIZE 20
+#define RECORD_FETCH_ID 10
+#define RECORD_FETCH_RECORD_ID_OFFSET 8
+#define RECORD_FETCH_OFFSET_OFFSET 12
+#define RECORD_FETCH_DATA_SIZE_OFFSET 16
+
+// The payload is a list of 16-bit sound data message ids.
+#define NACK_MIN_SIZE 10
+#define NACK_ID 12
+#define NACK_SEQUENCE_IDS_OFFSET 8
+
+#define SPECTRUM_REQUEST_SIZE 16
+#define SPECTRUM_REQUEST_ID 17
+#define SPECTRUM_REQUEST_FFT_SIZE_OFFSET 8
+#define SPECTRUM_REQUEST_HOP_SIZE_OFFSET 10
+#define SPECTRUM_REQUEST_INTERVAL_MS_OFFSET 12
+#define SPECTRUM_REQUEST_CONTENT_OFFSET 14
+#define SPECTRUM_REQUEST_CHANNEL_OFFSET 15
+
+#define LEVEL_METER_REQUEST_SIZE 13
+#define LEVEL_METER_REQUEST_ID 19
+#define LEVEL_METER_REQUEST_INTERVAL_MS_OFFSET 8
+#define LEVEL_METER_REQUEST_FREQUENCY_WEIGHTING_OFFSET 10
+#define LEVEL_METER_REQUEST_TIME_WEIGHTING_OFFSET 11
+#define LEVEL_METER_REQUEST_CHANNEL_COUNT_OFFSET 12
+
+#define IMPULSE_RESPONSE_REQUEST_SIZE 24
+#define IMPULSE_RESPONSE_REQUEST_ID 21
+#define IMPULSE_RESPONSE_REQUEST_HOUR_OFFSET 8
+#define IMPULSE_RESPONSE_REQUEST_MINUTE_OFFSET 9
+#define IMPULSE_RESPONSE_REQUEST_SECOND_OFFSET 10
+#define IMPULSE_RESPONSE_REQUEST_MS_OFFSET 11
+#define IMPULSE_RESPONSE_REQUEST_MEASUREMENT_ID_OFFSET 13
+#define IMPULSE_RESPONSE_REQUEST_CHANNEL_OFFSET 14
+#define IMPULSE_RESPONSE_REQUEST_START_FREQUENCY_OFFSET 16
+#define IMPULSE_RESPONSE_REQUEST_END_FREQUENCY_OFFSET 18
+#define IMPULSE_RESPONSE_REQUEST_DURATION_MS_OFFSET 20
+#define IMPULSE_RESPONSE_REQUEST_LENGTH_OFFSET 22
+
+// Header-only impulse response sent when the measurement is not queued, the other ones follow the measurements.
+#define IMPULSE_RESPONSE_REJECTED_SIZE 20
+#define IMPULSE_RESPONSE_ID 22
+#define IMPULSE_RESPONSE_PAYLOAD_SIZE_OFFSET 4
+#define IMPULSE_RESPONSE_MEASUREMENT_ID_OFFSET 8
+#define IMPULSE_RESPONSE_STATUS_OFFSET 9
+#define IMPULSE_RESPONSE_STATUS_REJECTED 3 // The request is invalid, the queue is full or the measurement is disabled
+
+// The small messages are queued for the upload task.
+_Static_assert(HEARTBEAT_SIZE <= UPLOAD_MESSAGE_MAX_SIZE, "The heartbeat does not fit in an upload message");
+_Static_assert(RECORD_STATUS_SIZE <= UPLOAD_MESSAGE_MAX_SIZE, "The record status does not fit in an upload message");
+_Static_assert(IMPULSE_RESPONSE_REJECTED_SIZE <= UPLOAD_MESSAGE_MAX_SIZE,
+    "The impulse response status does not fit in an upload message");
+
+static InitializationMessageHandler initializationMessageHandler;
 static RecordMessageHandler recordMessageHandler;
+static SpectrumMessageHandler spectrumMessageHandler;
+static LevelMeterMessageHandler levelMeterMessageHandler;
+static ImpulseResponseMessageHandler impulseResponseMessageHandler;
 static struct sockaddr_in tcpListenerAddress;
 
-static struct sockaddr_in clientAddress;
-int tcpClientSocketHandle;
-int udpClientSocketHandle;
-SemaphoreHandle_t clientMutex;
+static struct sockaddr_in multicastAddress;
+static int udpSocketHandle = -1;
+
+// The sessions share the stream, so the clients after the first one must request the same configuration.
+static SoundConfiguration activeConfiguration;
+
+// Accepted connections waiting for their initialization request.
+typedef struct
+{
+    int socketHandle;
+    struct sockaddr_in address;
+    uint32_t acceptTimestamp;
+    MessageParser parser;
+    Session* session; // Opened by the initialization request
+} PendingConnection;
+
+static PendingConnection pendingConnections[CONFIG_COMMUNICATION_MAX_CLIENT_COUNT];
 
-static uint8_t receivingBuffer[CONFIG_COMMUNICATION_RECEIVING_BUFFER_SIZE];
+// Every message the probe can receive, whatever the connection state.
+static const MessageFormat MESSAGE_FORMATS[] =
+{
+    { INITIALIZATION_RESQUEST_ID, 1 },
+    { HEARTBEAT_ID, 0 },
+    { RECORD_ID, 1 },
+    { RECORD_FETCH_ID, 1 },
+    { NACK_ID, 1 },
+    { SPECTRUM_REQUEST_ID, 1 },
+    { LEVEL_METER_REQUEST_ID, 1 },
+    { IMPULSE_RESPONSE_REQUEST_ID, 1 }
+};
+
+#define MESSAGE_FORMAT_COUNT (sizeof(MESSAGE_FORMATS) / sizeof(MessageFormat))
 
 static int setReceivingTimeout(int socketHandle)
 {
@@ -51,6 +154,15 @@ static int setReceivingTimeout(int socketHandle)
     return setsockopt(socketHandle, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 }
 
+static int setSendingTimeout(int socketHandle)
+{
+    struct timeval tv;
+    tv.tv_sec = CONFIG_COMMUNICATION_SENDING_TIMEOUT_MS / 1000;
+    tv.tv_usec = (CONFIG_COMMUNICATION_SENDING_TIMEOUT_MS % 1000) * 1000;
+
+    return setsockopt(socketHandle, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
 static int createTcpListenerSocket()
 {
     int reuseaddr = 1;
@@ -92,85 +204,104 @@ static int createTcpListenerSocket()
     return socketHandle;
 }
 
-static int createUdpClientSocket()
+static int setMulticastOptions(int socketHandle)
 {
-    int socketHandle = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
-    if (socketHandle < 0)
+    uint8_t ttl = CONFIG_COMMUNICATION_UDP_MULTICAST_TTL;
+    if (setsockopt(socketHandle, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0)
     {
-        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to create socket: errno %d", errno);
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to set IP_MULTICAST_TTL: errno %d", errno);
         return -1;
     }
-    
-    return socketHandle;
-}
 
-static int hasPayload(uint32_t messageId)
-{
-    switch (messageId)
+    tcpip_adapter_ip_info_t ipInfo;
+    if (tcpip_adapter_get_ip_info(CONFIG_COMMUNICATION_UDP_MULTICAST_INTERFACE, &ipInfo) != ESP_OK)
     {
-        case 2:
-        case 3:
-        case 5:
-        case 6:
-        case 7:
-            return 1;
-
-        default:
-            return 0;
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to get the multicast interface address");
+        return -1;
     }
-}
 
-static int receiveMessage(int socketHandle, uint8_t* buffer, size_t bufferSize)
-{
-    int flags = 0;
-    size_t receivedDataSize = 0;
-    uint32_t messageId;    
-    if (recv(socketHandle, buffer + receivedDataSize, sizeof(messageId), flags) != sizeof(messageId))
+    struct in_addr interfaceAddress;
+    interfaceAddress.s_addr = ipInfo.ip.addr;
+    if (setsockopt(socketHandle, IPPROTO_IP, IP_MULTICAST_IF, &interfaceAddress, sizeof(interfaceAddress)) < 0)
     {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to set IP_MULTICAST_IF: errno %d", errno);
         return -1;
     }
-    messageId = ntohl(*(uint32_t*)(buffer + receivedDataSize));
-    receivedDataSize += sizeof(messageId);
 
-    if (!hasPayload(messageId))
-    {
-        return receivedDataSize;
-    }
+    return 0;
+}
 
-    uint32_t payloadSize;
-    if (recv(socketHandle, buffer + receivedDataSize, sizeof(payloadSize), flags) != sizeof(payloadSize))
+static int createUdpSocket()
+{
+    int socketHandle = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (socketHandle < 0)
     {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to create socket: errno %d", errno);
         return -1;
     }
-    payloadSize = ntohl(*(uint32_t*)(buffer + receivedDataSize));
-    receivedDataSize += sizeof(payloadSize);
 
-    uint32_t receivedPayloadSize = 0;
-    while (receivedPayloadSize < payloadSize && receivedDataSize < bufferSize)
+    if (CONFIG_COMMUNICATION_UDP_MULTICAST_ENABLED && setMulticastOptions(socketHandle) < 0)
     {
-        int size = recv(socketHandle, buffer + receivedDataSize, payloadSize - receivedPayloadSize, flags);
-        if (size < 0)
-        {
-            return -1;
-        }
-
-        receivedPayloadSize += size;
-        receivedDataSize += size;
+        freeSocket(socketHandle);
+        return -1;
     }
+    
+    return socketHandle;
+}
 
-    return receivedDataSize;
+static uint8_t getOptionalField(uint8_t* buffer, size_t size, size_t offset, uint8_t defaultValue)
+{
+    return size > offset ? buffer[offset] : defaultValue;
 }
 
-static int isInitializationRequest(uint8_t* buffer, int size)
+static void readInitializationRequest(uint8_t* initializationRequest, size_t size, SoundConfiguration* configuration)
 {
-    return size == INITIALIZATION_RESQUEST_SIZE && 
-        ntohl(*(uint32_t*)buffer) == INITIALIZATION_RESQUEST_ID;
+    configuration->sampleFrequency = ntohl(*(uint32_t*)(initializationRequest + INITIALIZATION_RESQUEST_SAMPLE_FREQUENCY_OFFSET));
+    configuration->sampleFormat = ntohl(*(uint32_t*)(initializationRequest + INITIALIZATION_RESQUEST_SAMPLE_FORMAT_OFFSET));
+    configuration->streamMode = getOptionalField(initializationRequest,
+        size,
+        INITIALIZATION_RESQUEST_STREAM_MODE_OFFSET,
+        SOUND_STREAM_MODE_RAW);
+    configuration->channelCount = getOptionalField(initializationRequest,
+        size,
+        INITIALIZATION_RESQUEST_CHANNEL_COUNT_OFFSET,
+        1);
+    configuration->fecGroupSize = getOptionalField(initializationRequest,
+        size,
+        INITIALIZATION_RESQUEST_FEC_GROUP_SIZE_OFFSET,
+        0);
+    configuration->decimationFactor = getOptionalField(initializationRequest,
+        size,
+        INITIALIZATION_RESQUEST_DECIMATION_FACTOR_OFFSET,
+        1);
 }
 
-static int isInitializationCompatible(uint8_t* initializationRequest)
+static int isSameConfiguration(const SoundConfiguration* a, const SoundConfiguration* b)
 {
-    return ntohl(*(uint32_t*)(initializationRequest + INITIALIZATION_RESQUEST_SAMPLE_FREQUENCY_OFFSET)) == CONFIG_SOUND_SAMPLE_FREQUENCY &&
-        ntohl(*(uint32_t*)(initializationRequest + INITIALIZATION_RESQUEST_SAMPLE_FORMAT_OFFSET)) == CONFIG_SOUND_SAMPLE_FORMAT;
+    return a->sampleFrequency == b->sampleFrequency &&
+        a->sampleFormat == b->sampleFormat &&
+        a->streamMode == b->streamMode &&
+        a->channelCount == b->channelCount &&
+        a->fecGroupSize == b->fecGroupSize &&
+        a->decimationFactor == b->decimationFactor;
+}
+
+static int callInitializationMessageHandler(uint8_t* initializationRequest, size_t size)
+{
+    SoundConfiguration configuration;
+    readInitializationRequest(initializationRequest, size, &configuration);
+
+    if (getSessionCount() > 0)
+    {
+        return isSameConfiguration(&configuration, &activeConfiguration);
+    }
+    if (!initializationMessageHandler(&configuration))
+    {
+        return 0;
+    }
+
+    activeConfiguration = configuration;
+    return 1;
 }
 
 static void sendInitializationResponse(int socketHandle, int isCompatible)
@@ -188,93 +319,127 @@ static void sendInitializationResponse(int socketHandle, int isCompatible)
     send(socketHandle, buffer, INITIALIZATION_RESPONSE_SIZE, flags);
 }
 
-static int acceptConnection(int tcpListenerSocketHandle)
+static void acceptConnection(int tcpListenerSocketHandle)
 {
     struct sockaddr_in sourceAddress;
     uint addressSize = sizeof(sourceAddress);
-    int tcpSocketHandle = -1;
-    
-    do
+    int tcpSocketHandle = accept(tcpListenerSocketHandle, (struct sockaddr*)&sourceAddress, &addressSize);
+    if (tcpSocketHandle < 0)
     {
-        tcpSocketHandle = accept(tcpListenerSocketHandle, (struct sockaddr*)&sourceAddress, &addressSize);
-        if (tcpSocketHandle < 0 && errno != EAGAIN)
-        {
-            ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to accept: errno %d", errno);
-            return 0;
-        }
-    } while (tcpSocketHandle < 0);
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to accept: errno %d", errno);
+        return;
+    }
 
     if (setReceivingTimeout(tcpSocketHandle) < 0)
     {
         ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to set SO_RCVTIMEO: errno %d", errno);
         freeSocket(tcpSocketHandle);
-        return 0;
+        return;
     }
 
-    int size = receiveMessage(tcpSocketHandle, receivingBuffer, CONFIG_COMMUNICATION_RECEIVING_BUFFER_SIZE);
-    if (size < 0 && !isInitializationRequest(receivingBuffer, size))
+    if (setSendingTimeout(tcpSocketHandle) < 0)
     {
-        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to receive the initialization request: errno %d", errno);
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to set SO_SNDTIMEO: errno %d", errno);
         freeSocket(tcpSocketHandle);
-        return 0;
+        return;
     }
 
-    int isCompatible = isInitializationCompatible(receivingBuffer);
-    sendInitializationResponse(tcpSocketHandle, isCompatible);
-
-    if (!isCompatible)
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
     {
-        ESP_LOGE(NETWORK_LOGGER_TAG, "Not compatible initialization");
-        freeSocket(tcpSocketHandle);
-        return 0;
+        if (pendingConnections[i].socketHandle < 0)
+        {
+            pendingConnections[i].socketHandle = tcpSocketHandle;
+            pendingConnections[i].address = sourceAddress;
+            pendingConnections[i].acceptTimestamp = esp_log_timestamp();
+            initializeMessageParser(&pendingConnections[i].parser, MESSAGE_FORMATS, MESSAGE_FORMAT_COUNT);
+            return;
+        }
     }
-    
-    xSemaphoreTake(clientMutex, portMAX_DELAY);
-    
-    int udpSocketHandle = createUdpClientSocket();
+
+    ESP_LOGE(NETWORK_LOGGER_TAG, "Too many pending connections");
+    freeSocket(tcpSocketHandle);
+}
+
+static void closePendingConnection(PendingConnection* connection)
+{
+    freeSocket(connection->socketHandle);
+    connection->socketHandle = -1;
+}
+
+// The pending connection becomes a session if its initialization request is compatible.
+static int handleInitializationMessage(void* context, uint8_t* message, size_t size)
+{
+    PendingConnection* connection = (PendingConnection*)context;
+
     if (udpSocketHandle < 0)
     {
-        freeSocket(tcpSocketHandle);
-        return 0;
+        udpSocketHandle = createUdpSocket();
     }
 
-    udpClientSocketHandle = udpSocketHandle;
-    memcpy(&clientAddress, &sourceAddress, sizeof(sourceAddress));
-    clientAddress.sin_port = htons(CONFIG_COMMUNICATION_UDP_PORT);
-    tcpClientSocketHandle = tcpSocketHandle;
-
-    xSemaphoreGive(clientMutex);
+    int isCompatible = udpSocketHandle >= 0 &&
+        getSessionCount() < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT &&
+        callInitializationMessageHandler(message, size);
+    if (isCompatible)
+    {
+        connection->address.sin_port = htons(CONFIG_COMMUNICATION_UDP_PORT);
+        connection->session = openSession(connection->socketHandle, &connection->address);
+    }
+    sendInitializationResponse(connection->socketHandle, connection->session != NULL);
 
-    ESP_LOGI(NETWORK_LOGGER_TAG, "Inbound connection accepted");
-    return 1;
-}
+    if (connection->session == NULL)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Not compatible initialization or too many clients");
+        return MESSAGE_HANDLER_CLOSE;
+    }
 
-static int isHeartbeatMessage(uint8_t* buffer, int size)
-{
-    return size == HEARTBEAT_SIZE && 
-        ntohl(*(uint32_t*)buffer) == HEARTBEAT_ID;
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Inbound connection accepted, session %u", connection->session->id);
+    return MESSAGE_HANDLER_STOP;
 }
 
-static void sendHeartbeatMessage(int socketHandle)
+// The heartbeat goes through the upload task so it is not interleaved with a record being uploaded.
+static void sendHeartbeatMessage(uint32_t sessionId)
 {
-    int flags = 0;
     uint8_t buffer[HEARTBEAT_SIZE] =
     { 
         0, 0, 0, 0
     };
     *(uint32_t*)(buffer) = htonl(HEARTBEAT_ID);
 
-    send(socketHandle, buffer, HEARTBEAT_SIZE, flags);
+    if (!queueUploadMessage(sessionId, buffer, HEARTBEAT_SIZE))
+    {
+        ESP_LOGW(NETWORK_LOGGER_TAG, "Unable to queue the heartbeat");
+    }
 }
 
-static int isRecordMessage(uint8_t* buffer, int size)
+static int handleHeartbeatMessage(void* context, uint8_t* message, size_t size)
 {
-    return size == RECORD_SIZE &&
-        ntohl(*(uint32_t*)buffer) == RECORD_ID;
+    Session* session = (Session*)context;
+
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Heartbeat received from session %u", session->id);
+    sendHeartbeatMessage(session->id);
+    session->lastHeartbeatTimestamp = esp_log_timestamp();
+    return MESSAGE_HANDLER_CONTINUE;
 }
 
-static void callRecordMessageHandler(uint8_t* buffer, int size)
+static void sendRecordRejectedMessage(uint32_t sessionId, uint8_t recordId)
 {
+    uint8_t buffer[RECORD_STATUS_SIZE] __attribute__((aligned(4))) = { 0 };
+    *(uint32_t*)buffer = htonl(RECORD_STATUS_ID);
+    *(uint32_t*)(buffer + RECORD_STATUS_PAYLOAD_SIZE_OFFSET) = htonl(RECORD_STATUS_SIZE - RECORD_STATUS_RECORD_ID_OFFSET);
+    buffer[RECORD_STATUS_RECORD_ID_OFFSET] = recordId;
+    buffer[RECORD_STATUS_STATUS_OFFSET] = RECORD_STATUS_REJECTED;
+
+    if (!queueUploadMessage(sessionId, buffer, RECORD_STATUS_SIZE))
+    {
+        ESP_LOGW(NETWORK_LOGGER_TAG, "Unable to queue the record %u status", recordId);
+    }
+}
+
+// The record responses are sent to the session that requested the record.
+// A rejected record gets its status at once, so the client can request it again.
+static int handleRecordMessage(void* context, uint8_t* buffer, size_t size)
+{
+    uint32_t sessionId = ((Session*)context)->id;
     uint8_t recordHour = buffer[RECORD_HOUR_OFFSET];
     uint8_t recordMinute = buffer[RECORD_MINUTE_OFFSET];
     uint8_t recordSecond = buffer[RECORD_SECOND_OFFSET];
@@ -282,91 +447,310 @@ static void callRecordMessageHandler(uint8_t* buffer, int size)
     uint16_t durationMs = ntohs(*(uint16_t*)(buffer + RECORD_DURATION_MS_OFFSET));
     uint8_t recordId = buffer[RECORD_ID_OFFSET];
 
-    recordMessageHandler(recordHour, recordMinute, recordSecond, recordMs, durationMs, recordId);
+    setRecordSessionId(recordId, sessionId);
+    if (!recordMessageHandler(recordHour, recordMinute, recordSecond, recordMs, durationMs, recordId))
+    {
+        sendRecordRejectedMessage(sessionId, recordId);
+    }
+    return MESSAGE_HANDLER_CONTINUE;
 }
 
-static void handleMessages()
+static int handleRecordFetchMessage(void* context, uint8_t* buffer, size_t size)
 {
-    uint32_t lastHeatbeatTimestamp = esp_log_timestamp();
-    while (1)
+    uint32_t sessionId = ((Session*)context)->id;
+    uint8_t recordId = buffer[RECORD_FETCH_RECORD_ID_OFFSET];
+    uint32_t offset = ntohl(*(uint32_t*)(buffer + RECORD_FETCH_OFFSET_OFFSET));
+    uint32_t dataSize = ntohl(*(uint32_t*)(buffer + RECORD_FETCH_DATA_SIZE_OFFSET));
+
+    if (!queueRecordFetch(sessionId, recordId, offset, dataSize))
     {
-        int size = receiveMessage(tcpClientSocketHandle, receivingBuffer, CONFIG_COMMUNICATION_RECEIVING_BUFFER_SIZE);
-        if (size < 0 && errno != EAGAIN)
-        {
-            ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to receive a request: errno %d", errno);
-            return;
-        }
+        ESP_LOGW(NETWORK_LOGGER_TAG, "Unable to queue the record %u fetch", recordId);
+    }
+    return MESSAGE_HANDLER_CONTINUE;
+}
+
+static int handleNackMessage(void* context, uint8_t* buffer, size_t size)
+{
+    uint32_t sessionId = ((Session*)context)->id;
 
-        if (isHeartbeatMessage(receivingBuffer, size))
+    for (size_t offset = NACK_SEQUENCE_IDS_OFFSET; offset + sizeof(uint16_t) <= size; offset += sizeof(uint16_t))
+    {
+        uint16_t sequenceId = ntohs(*(uint16_t*)(buffer + offset));
+        if (!requestStreamingRetransmission(sessionId, sequenceId))
         {
-            ESP_LOGI(NETWORK_LOGGER_TAG, "Heartbeat received");
-            sendHeartbeatMessage(tcpClientSocketHandle);
-            lastHeatbeatTimestamp = esp_log_timestamp();
+            ESP_LOGW(NETWORK_LOGGER_TAG, "Unable to queue the retransmission of the packet %u", sequenceId);
+            break;
         }
-        else if (isRecordMessage(receivingBuffer, size))
+    }
+    return MESSAGE_HANDLER_CONTINUE;
+}
+
+// The spectrum configuration is shared by the sessions, like the sound configuration.
+static int handleSpectrumMessage(void* context, uint8_t* buffer, size_t size)
+{
+    SpectrumConfiguration configuration;
+    configuration.fftSize = ntohs(*(uint16_t*)(buffer + SPECTRUM_REQUEST_FFT_SIZE_OFFSET));
+    configuration.hopSize = ntohs(*(uint16_t*)(buffer + SPECTRUM_REQUEST_HOP_SIZE_OFFSET));
+    configuration.intervalMs = ntohs(*(uint16_t*)(buffer + SPECTRUM_REQUEST_INTERVAL_MS_OFFSET));
+    configuration.content = buffer[SPECTRUM_REQUEST_CONTENT_OFFSET];
+    configuration.channel = buffer[SPECTRUM_REQUEST_CHANNEL_OFFSET];
+
+    if (!spectrumMessageHandler(&configuration))
+    {
+        ESP_LOGW(NETWORK_LOGGER_TAG, "Unsupported spectrum configuration from session %u", ((Session*)context)->id);
+    }
+    return MESSAGE_HANDLER_CONTINUE;
+}
+
+static int handleLevelMeterMessage(void* context, uint8_t* buffer, size_t size)
+{
+    LevelMeterConfiguration configuration;
+    configuration.intervalMs = ntohs(*(uint16_t*)(buffer + LEVEL_METER_REQUEST_INTERVAL_MS_OFFSET));
+    configuration.frequencyWeighting = buffer[LEVEL_METER_REQUEST_FREQUENCY_WEIGHTING_OFFSET];
+    configuration.timeWeighting = buffer[LEVEL_METER_REQUEST_TIME_WEIGHTING_OFFSET];
+    configuration.channelCount = buffer[LEVEL_METER_REQUEST_CHANNEL_COUNT_OFFSET];
+
+    if (!levelMeterMessageHandler(&configuration))
+    {
+        ESP_LOGW(NETWORK_LOGGER_TAG, "Unsupported level meter configuration from session %u", ((Session*)context)->id);
+    }
+    return MESSAGE_HANDLER_CONTINUE;
+}
+
+static void sendImpulseResponseRejectedMessage(uint32_t sessionId, uint8_t measurementId)
+{
+    uint8_t buffer[IMPULSE_RESPONSE_REJECTED_SIZE] __attribute__((aligned(4))) = { 0 };
+    *(uint32_t*)buffer = htonl(IMPULSE_RESPONSE_ID);
+    *(uint32_t*)(buffer + IMPULSE_RESPONSE_PAYLOAD_SIZE_OFFSET) =
+        htonl(IMPULSE_RESPONSE_REJECTED_SIZE - IMPULSE_RESPONSE_MEASUREMENT_ID_OFFSET);
+    buffer[IMPULSE_RESPONSE_MEASUREMENT_ID_OFFSET] = measurementId;
+    buffer[IMPULSE_RESPONSE_STATUS_OFFSET] = IMPULSE_RESPONSE_STATUS_REJECTED;
+
+    if (!queueUploadMessage(sessionId, buffer, IMPULSE_RESPONSE_REJECTED_SIZE))
+    {
+        ESP_LOGW(NETWORK_LOGGER_TAG, "Unable to queue the impulse response %u status", measurementId);
+    }
+}
+
+// The impulse response is uploaded like a record, so it is sent to the requesting session.
+// A rejected measurement gets its status at once, so the client does not wait for it.
+static int handleImpulseResponseMessage(void* context, uint8_t* buffer, size_t size)
+{
+    ImpulseResponseRequest request;
+    request.hour = buffer[IMPULSE_RESPONSE_REQUEST_HOUR_OFFSET];
+    request.minute = buffer[IMPULSE_RESPONSE_REQUEST_MINUTE_OFFSET];
+    request.second = buffer[IMPULSE_RESPONSE_REQUEST_SECOND_OFFSET];
+    request.ms = ntohs(*(uint16_t*)(buffer + IMPULSE_RESPONSE_REQUEST_MS_OFFSET));
+    request.measurementId = buffer[IMPULSE_RESPONSE_REQUEST_MEASUREMENT_ID_OFFSET];
+    request.channel = buffer[IMPULSE_RESPONSE_REQUEST_CHANNEL_OFFSET];
+    request.startFrequency = ntohs(*(uint16_t*)(buffer + IMPULSE_RESPONSE_REQUEST_START_FREQUENCY_OFFSET));
+    request.endFrequency = ntohs(*(uint16_t*)(buffer + IMPULSE_RESPONSE_REQUEST_END_FREQUENCY_OFFSET));
+    request.durationMs = ntohs(*(uint16_t*)(buffer + IMPULSE_RESPONSE_REQUEST_DURATION_MS_OFFSET));
+    request.length = ntohs(*(uint16_t*)(buffer + IMPULSE_RESPONSE_REQUEST_LENGTH_OFFSET));
+
+    uint32_t sessionId = ((Session*)context)->id;
+    setMeasurementSessionId(request.measurementId, sessionId);
+    if (!impulseResponseMessageHandler(&request))
+    {
+        sendImpulseResponseRejectedMessage(sessionId, request.measurementId);
+    }
+    return MESSAGE_HANDLER_CONTINUE;
+}
+
+static const MessageHandlerEntry PENDING_CONNECTION_MESSAGE_HANDLERS[] =
+{
+    { INITIALIZATION_RESQUEST_ID, INITIALIZATION_RESQUEST_SIZE, MESSAGE_PARSER_BUFFER_SIZE, handleInitializationMessage }
+};
+
+static const MessageHandlerEntry SESSION_MESSAGE_HANDLERS[] =
+{
+    { HEARTBEAT_ID, HEARTBEAT_SIZE, HEARTBEAT_SIZE, handleHeartbeatMessage },
+    { RECORD_ID, RECORD_SIZE, RECORD_SIZE, handleRecordMessage },
+    { RECORD_FETCH_ID, RECORD_FETCH_SIZE, RECORD_FETCH_SIZE, handleRecordFetchMessage },
+    { NACK_ID, NACK_MIN_SIZE, MESSAGE_PARSER_BUFFER_SIZE, handleNackMessage },
+    { SPECTRUM_REQUEST_ID, SPECTRUM_REQUEST_SIZE, SPECTRUM_REQUEST_SIZE, handleSpectrumMessage },
+    { LEVEL_METER_REQUEST_ID, LEVEL_METER_REQUEST_SIZE, LEVEL_METER_REQUEST_SIZE, handleLevelMeterMessage },
+    { IMPULSE_RESPONSE_REQUEST_ID, IMPULSE_RESPONSE_REQUEST_SIZE, IMPULSE_RESPONSE_REQUEST_SIZE, handleImpulseResponseMessage }
+};
+
+#define PENDING_CONNECTION_MESSAGE_HANDLER_COUNT (sizeof(PENDING_CONNECTION_MESSAGE_HANDLERS) / sizeof(MessageHandlerEntry))
+#define SESSION_MESSAGE_HANDLER_COUNT (sizeof(SESSION_MESSAGE_HANDLERS) / sizeof(MessageHandlerEntry))
+
+// The bytes received after the initialization request are kept for the session.
+static void handlePendingConnection(PendingConnection* connection)
+{
+    connection->session = NULL;
+    int result = receiveMessages(&connection->parser,
+        connection->socketHandle,
+        PENDING_CONNECTION_MESSAGE_HANDLERS,
+        PENDING_CONNECTION_MESSAGE_HANDLER_COUNT,
+        connection);
+
+    Session* session = connection->session;
+    if (session != NULL)
+    {
+        memcpy(&session->parser, &connection->parser, sizeof(MessageParser));
+        connection->socketHandle = -1;
+        if (dispatchMessages(&session->parser, SESSION_MESSAGE_HANDLERS, SESSION_MESSAGE_HANDLER_COUNT, session) == MESSAGE_HANDLER_CLOSE)
         {
-            callRecordMessageHandler(receivingBuffer, size);
+            closeSession(session);
         }
+    }
+    else if (result == MESSAGE_HANDLER_CLOSE)
+    {
+        closePendingConnection(connection);
+    }
+}
+
+static void addSocketToSet(int socketHandle, fd_set* readSet, int* maxSocketHandle)
+{
+    FD_SET(socketHandle, readSet);
+    if (socketHandle > *maxSocketHandle)
+    {
+        *maxSocketHandle = socketHandle;
+    }
+}
+
+static void updateNextDeadline(uint32_t deadline, uint32_t now, uint32_t* timeoutMs)
+{
+    uint32_t remainingMs = (int32_t)(deadline - now) > 0 ? deadline - now : 0;
+    if (remainingMs < *timeoutMs)
+    {
+        *timeoutMs = remainingMs;
+    }
+}
 
-        if ((esp_log_timestamp() - lastHeatbeatTimestamp) > CONFIG_COMMUNICATION_HEARTBEAT_TIMEOUT_MS)
+// Waits until a socket is readable or the next heartbeat or initialization deadline.
+static int waitForEvents(int tcpListenerSocketHandle, Session** sessions, size_t sessionCount, fd_set* readSet)
+{
+    int maxSocketHandle = -1;
+    uint32_t now = esp_log_timestamp();
+    uint32_t timeoutMs = CONFIG_COMMUNICATION_HEARTBEAT_TIMEOUT_MS;
+
+    FD_ZERO(readSet);
+    addSocketToSet(tcpListenerSocketHandle, readSet, &maxSocketHandle);
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
+    {
+        if (pendingConnections[i].socketHandle >= 0)
         {
-            ESP_LOGE(NETWORK_LOGGER_TAG, "Heartbeat timeout");
-            return;
+            addSocketToSet(pendingConnections[i].socketHandle, readSet, &maxSocketHandle);
+            updateNextDeadline(pendingConnections[i].acceptTimestamp + CONFIG_COMMUNICATION_TIMEOUT_MS, now, &timeoutMs);
         }
     }
+    for (size_t i = 0; i < sessionCount; i++)
+    {
+        addSocketToSet(sessions[i]->tcpSocketHandle, readSet, &maxSocketHandle);
+        updateNextDeadline(sessions[i]->lastHeartbeatTimestamp + CONFIG_COMMUNICATION_HEARTBEAT_TIMEOUT_MS, now, &timeoutMs);
+    }
+
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    return select(maxSocketHandle + 1, readSet, NULL, NULL, &tv);
 }
 
-static void communicationTask(void* parameters)
+static void handlePendingConnections(fd_set* readSet)
 {
-    while (1)
+    uint32_t now = esp_log_timestamp();
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
     {
-        int tcpListenerSocketHandle = createTcpListenerSocket();
-
-        if (tcpListenerSocketHandle > 0)
+        if (pendingConnections[i].socketHandle < 0)
         {
-            if (acceptConnection(tcpListenerSocketHandle))
-            {
-                handleMessages();
-            }
+            continue;
         }
 
-        xSemaphoreTake(clientMutex, portMAX_DELAY);
-        if (tcpClientSocketHandle > 0)
+        if (FD_ISSET(pendingConnections[i].socketHandle, readSet))
+        {
+            handlePendingConnection(&pendingConnections[i]);
+        }
+        else if (now - pendingConnections[i].acceptTimestamp > CONFIG_COMMUNICATION_TIMEOUT_MS)
         {
-            freeSocket(tcpClientSocketHandle);
-            freeSocket(udpClientSocketHandle);
-            tcpClientSocketHandle = -1;
-            udpClientSocketHandle = -1;
+            ESP_LOGE(NETWORK_LOGGER_TAG, "Initialization request timeout");
+            closePendingConnection(&pendingConnections[i]);
         }
-        xSemaphoreGive(clientMutex);
+    }
+}
 
-        if (tcpListenerSocketHandle > 0)
+static void handleSessions(Session** sessions, size_t sessionCount, fd_set* readSet)
+{
+    for (size_t i = 0; i < sessionCount; i++)
+    {
+        Session* session = sessions[i];
+        if (FD_ISSET(session->tcpSocketHandle, readSet) &&
+            receiveMessages(&session->parser,
+                session->tcpSocketHandle,
+                SESSION_MESSAGE_HANDLERS,
+                SESSION_MESSAGE_HANDLER_COUNT,
+                session) == MESSAGE_HANDLER_CLOSE)
         {
-            ESP_LOGE(NETWORK_LOGGER_TAG, "Shutting down socket and restarting...");            
-            freeSocket(tcpListenerSocketHandle);
+            closeSession(session);
         }
+        else if ((esp_log_timestamp() - session->lastHeartbeatTimestamp) > CONFIG_COMMUNICATION_HEARTBEAT_TIMEOUT_MS)
+        {
+            ESP_LOGE(NETWORK_LOGGER_TAG, "Heartbeat timeout of session %u", session->id);
+            closeSession(session);
+        }
+    }
+}
 
+// A single event loop serves the listener, the pending connections and all the sessions.
+static void communicationTask(void* parameters)
+{
+    int tcpListenerSocketHandle;
+    while ((tcpListenerSocketHandle = createTcpListenerSocket()) < 0)
+    {
         vTaskDelay(CONFIG_COMMUNICATION_SOCKET_CREATION_INTERVAL_MS / portTICK_PERIOD_MS);
     }
+
+    Session* sessions[CONFIG_COMMUNICATION_MAX_CLIENT_COUNT];
+    fd_set readSet;
+    while (1)
+    {
+        size_t sessionCount = getActiveSessions(sessions);
+        int eventCount = waitForEvents(tcpListenerSocketHandle, sessions, sessionCount, &readSet);
+        if (eventCount < 0)
+        {
+            ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to select: errno %d", errno);
+            vTaskDelay(CONFIG_COMMUNICATION_SOCKET_CREATION_INTERVAL_MS / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        handleSessions(sessions, sessionCount, &readSet);
+        handlePendingConnections(&readSet);
+        if (FD_ISSET(tcpListenerSocketHandle, &readSet))
+        {
+            acceptConnection(tcpListenerSocketHandle);
+        }
+    }
     vTaskDelete(NULL);
 }
 
-void initializeCommunication(RecordMessageHandler userRecordMessageHandler)
+void initializeCommunication(InitializationMessageHandler userInitializationMessageHandler,
+    RecordMessageHandler userRecordMessageHandler,
+    SpectrumMessageHandler userSpectrumMessageHandler,
+    LevelMeterMessageHandler userLevelMeterMessageHandler,
+    ImpulseResponseMessageHandler userImpulseResponseMessageHandler)
 {
     ESP_LOGI(NETWORK_LOGGER_TAG, "Communication initialization");
+    initializationMessageHandler = userInitializationMessageHandler;
     recordMessageHandler = userRecordMessageHandler;
+    spectrumMessageHandler = userSpectrumMessageHandler;
+    levelMeterMessageHandler = userLevelMeterMessageHandler;
+    impulseResponseMessageHandler = userImpulseResponseMessageHandler;
 
     tcpListenerAddress.sin_addr.s_addr = htonl(INADDR_ANY);
     tcpListenerAddress.sin_family = AF_INET;
     tcpListenerAddress.sin_port = htons(CONFIG_COMMUNICATION_TCP_PORT);
 
-    tcpClientSocketHandle = -1;
-    udpClientSocketHandle = -1;
-    clientMutex = xSemaphoreCreateMutex();
-    if (clientMutex == NULL)
+    multicastAddress.sin_addr.s_addr = inet_addr(CONFIG_COMMUNICATION_UDP_MULTICAST_GROUP);
+    multicastAddress.sin_family = AF_INET;
+    multicastAddress.sin_port = htons(CONFIG_COMMUNICATION_UDP_MULTICAST_PORT);
+
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
     {
-        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to create the client mutex");
+        pendingConnections[i].socketHandle = -1;
     }
+    initializeSessions();
 }
 
 void startCommunication()
@@ -379,29 +763,23 @@ void startCommunication()
         NULL);
 }
 
-void sendTcp(uint8_t* buffer, size_t size)
+int sendTcp(uint32_t sessionId, const uint8_t* buffer, size_t size)
 {
-    int flags = 0;
-    xSemaphoreTake(clientMutex, portMAX_DELAY);
-    if (tcpClientSocketHandle >= 0)
-    {
-        send(tcpClientSocketHandle, buffer, size, flags);
-    }
-    xSemaphoreGive(clientMutex);
+    return sendSessionTcp(sessionId, buffer, size);
 }
 
 void sendUdp(uint8_t* buffer, size_t size)
 {
-    int flags = 0;
-    xSemaphoreTake(clientMutex, portMAX_DELAY);
-    if (udpClientSocketHandle >= 0)
+    if (udpSocketHandle >= 0)
     {
-        sendto(udpClientSocketHandle,
+        sendSessionsUdp(udpSocketHandle,
+            CONFIG_COMMUNICATION_UDP_MULTICAST_ENABLED ? &multicastAddress : NULL,
             buffer,
-            size,
-            flags,
-            (struct sockaddr*)&clientAddress,
-            sizeof(clientAddress));
+            size);
     }
-    xSemaphoreGive(clientMutex);
+}
+
+int sendUdpToSession(uint32_t sessionId, const uint8_t* buffer, size_t size)
+{
+    return udpSocketHandle >= 0 && sendSessionUdp(udpSocketHandle, sessionId, buffer, size);
 }
@@ -0,0 +1,137 @@
+#include "network/message_parser.h"
+
+#include <lwip/sockets.h>
+
+#include <string.h>
+
+#define MESSAGE_ID_SIZE 4
+#define MESSAGE_HEADER_SIZE 8
+#define MESSAGE_PAYLOAD_SIZE_OFFSET 4
+
+void initializeMessageParser(MessageParser* parser, const MessageFormat* formats, size_t formatCount)
+{
+    parser->size = 0;
+    parser->formats = formats;
+    parser->formatCount = formatCount;
+}
+
+static const MessageFormat* findMessageFormat(const MessageParser* parser, uint32_t id)
+{
+    for (size_t i = 0; i < parser->formatCount; i++)
+    {
+        if (parser->formats[i].id == id)
+        {
+            return &parser->formats[i];
+        }
+    }
+    return NULL;
+}
+
+static const MessageHandlerEntry* findMessageHandler(const MessageHandlerEntry* handlers, size_t handlerCount, uint32_t id)
+{
+    for (size_t i = 0; i < handlerCount; i++)
+    {
+        if (handlers[i].id == id)
+        {
+            return &handlers[i];
+        }
+    }
+    return NULL;
+}
+
+// Returns the size of the first message, 0 if it is not complete yet or -1 if it cannot fit in the buffer.
+static int getMessageSize(const MessageParser* parser, const MessageFormat* format)
+{
+    if (parser->size < MESSAGE_ID_SIZE)
+    {
+        return 0;
+    }
+    if (!format->hasPayload)
+    {
+        return MESSAGE_ID_SIZE;
+    }
+    if (parser->size < MESSAGE_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    uint32_t payloadSize = ntohl(*(uint32_t*)(parser->buffer + MESSAGE_PAYLOAD_SIZE_OFFSET));
+    if (payloadSize > MESSAGE_PARSER_BUFFER_SIZE - MESSAGE_HEADER_SIZE)
+    {
+        return -1;
+    }
+    return MESSAGE_HEADER_SIZE + payloadSize;
+}
+
+// The dispatched message is removed from the front of the buffer, so the next one is aligned.
+int dispatchMessages(MessageParser* parser, const MessageHandlerEntry* handlers, size_t handlerCount, void* context)
+{
+    int result = MESSAGE_HANDLER_CONTINUE;
+    while (result == MESSAGE_HANDLER_CONTINUE && parser->size >= MESSAGE_ID_SIZE)
+    {
+        uint32_t id = ntohl(*(uint32_t*)parser->buffer);
+        const MessageFormat* format = findMessageFormat(parser, id);
+        if (format == NULL)
+        {
+            // The size of an unknown message is unknown, so the next message cannot be found.
+            ESP_LOGE(NETWORK_LOGGER_TAG, "Unknown message %u", id);
+            return MESSAGE_HANDLER_CLOSE;
+        }
+
+        const MessageHandlerEntry* handler = findMessageHandler(handlers, handlerCount, id);
+        int messageSize = getMessageSize(parser, format);
+        if (messageSize < 0)
+        {
+            ESP_LOGE(NETWORK_LOGGER_TAG, "The message %u is too large", id);
+            return MESSAGE_HANDLER_CLOSE;
+        }
+        if (messageSize == 0 || (size_t)messageSize > parser->size)
+        {
+            break;
+        }
+
+        if (handler == NULL)
+        {
+            ESP_LOGW(NETWORK_LOGGER_TAG, "Unexpected message %u", id);
+        }
+        else if ((size_t)messageSize < handler->minSize || (size_t)messageSize > handler->maxSize)
+        {
+            ESP_LOGW(NETWORK_LOGGER_TAG, "Invalid size of message %u", id);
+        }
+        else
+        {
+            result = handler->handler(context, parser->buffer, messageSize);
+        }
+
+        parser->size -= messageSize;
+        memmove(parser->buffer, parser->buffer + messageSize, parser->size);
+    }
+    return result;
+}
+
+int receiveMessages(MessageParser* parser,
+    int socketHandle,
+    const MessageHandlerEntry* handlers,
+    size_t handlerCount,
+    void* context)
+{
+    int flags = MSG_DONTWAIT;
+    int size = recv(socketHandle, parser->buffer + parser->size, MESSAGE_PARSER_BUFFER_SIZE - parser->size, flags);
+    if (size == 0)
+    {
+        ESP_LOGI(NETWORK_LOGGER_TAG, "Connection closed by the peer");
+        return MESSAGE_HANDLER_CLOSE;
+    }
+    if (size < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return MESSAGE_HANDLER_CONTINUE;
+        }
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to receive: errno %d", errno);
+        return MESSAGE_HANDLER_CLOSE;
+    }
+
+    parser->size += size;
+    return dispatchMessages(parser, handlers, handlerCount, context);
+}
@@ -0,0 +1,284 @@
+#include "network/record_cache.h"
+#include "config.h"
+
+#include <esp_heap_caps.h>
+
+#include <stdatomic.h>
+#include <string.h>
+
+typedef struct
+{
+    int isValid;
+    int isComplete;
+    uint8_t recordId;
+    uint8_t status;
+    size_t offset;
+    size_t size;
+    uint32_t lastUse;
+} RecordCacheEntry;
+
+static uint8_t* pool = NULL;
+static size_t poolSize = 0;
+static RecordCacheEntry entries[CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT];
+static RecordCacheEntry* currentEntry = NULL;
+static uint32_t tooLargeRecordIds[(UINT8_MAX + 1) / 32];
+static uint32_t skippedRecordIds[(UINT8_MAX + 1) / 32];
+static uint32_t useCounter = 0;
+
+static atomic_uint hitCount;
+static atomic_uint missCount;
+static atomic_uint evictionCount;
+
+esp_err_t initializeRecordCache()
+{
+    // The cache goes to PSRAM when it is available.
+    poolSize = CONFIG_UPLOAD_RECORD_PSRAM_CACHE_SIZE;
+    pool = heap_caps_malloc(poolSize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (pool == NULL)
+    {
+        poolSize = CONFIG_UPLOAD_RECORD_CACHE_SIZE;
+        pool = heap_caps_malloc(poolSize, MALLOC_CAP_8BIT);
+    }
+    if (pool == NULL)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to allocate the record cache");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Record cache size: %u bytes", (unsigned int)poolSize);
+    memset(entries, 0, sizeof(entries));
+    memset(tooLargeRecordIds, 0, sizeof(tooLargeRecordIds));
+    memset(skippedRecordIds, 0, sizeof(skippedRecordIds));
+    atomic_init(&hitCount, 0);
+    atomic_init(&missCount, 0);
+    atomic_init(&evictionCount, 0);
+    return ESP_OK;
+}
+
+static RecordCacheEntry* findEntry(uint8_t recordId)
+{
+    for (size_t i = 0; i < CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT; i++)
+    {
+        if (entries[i].isValid && entries[i].recordId == recordId)
+        {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t getUsedSize()
+{
+    size_t usedSize = 0;
+    for (size_t i = 0; i < CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT; i++)
+    {
+        if (entries[i].isValid)
+        {
+            usedSize += entries[i].size;
+        }
+    }
+    return usedSize;
+}
+
+// The entry being filled is never evicted.
+static RecordCacheEntry* findLeastRecentlyUsedEntry()
+{
+    RecordCacheEntry* leastRecentlyUsedEntry = NULL;
+    for (size_t i = 0; i < CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT; i++)
+    {
+        if (entries[i].isValid && &entries[i] != currentEntry &&
+            (leastRecentlyUsedEntry == NULL || entries[i].lastUse - leastRecentlyUsedEntry->lastUse > UINT32_MAX / 2))
+        {
+            leastRecentlyUsedEntry = &entries[i];
+        }
+    }
+    return leastRecentlyUsedEntry;
+}
+
+static void evictEntry(RecordCacheEntry* entry)
+{
+    entry->isValid = 0;
+    atomic_fetch_add(&evictionCount, 1);
+}
+
+// Moves the entries to the start of the pool in offset order, so the free space is contiguous at the end.
+static void compactPool()
+{
+    int isMoved[CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT] = { 0 };
+    size_t endOffset = 0;
+    while (1)
+    {
+        size_t nextIndex = CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT;
+        for (size_t i = 0; i < CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT; i++)
+        {
+            if (entries[i].isValid && !isMoved[i] &&
+                (nextIndex == CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT || entries[i].offset < entries[nextIndex].offset))
+            {
+                nextIndex = i;
+            }
+        }
+        if (nextIndex == CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT)
+        {
+            break;
+        }
+
+        // The entry being filled can be empty, so the moved entries are marked instead of compared to the end.
+        RecordCacheEntry* nextEntry = &entries[nextIndex];
+        memmove(pool + endOffset, pool + nextEntry->offset, nextEntry->size);
+        nextEntry->offset = endOffset;
+        endOffset += nextEntry->size;
+        isMoved[nextIndex] = 1;
+    }
+}
+
+static RecordCacheEntry* findFreeEntry()
+{
+    for (size_t i = 0; i < CONFIG_UPLOAD_RECORD_CACHE_ENTRY_COUNT; i++)
+    {
+        if (!entries[i].isValid)
+        {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void setRecordIdBit(uint32_t* recordIds, uint8_t recordId, int value)
+{
+    if (value)
+    {
+        recordIds[recordId / 32] |= 1u << (recordId % 32);
+    }
+    else
+    {
+        recordIds[recordId / 32] &= ~(1u << (recordId % 32));
+    }
+}
+
+static int getRecordIdBit(const uint32_t* recordIds, uint8_t recordId)
+{
+    return (recordIds[recordId / 32] >> (recordId % 32)) & 1;
+}
+
+// The previous record with the same id is replaced, even if the new one is not cached.
+static void invalidateEntry(uint8_t recordId)
+{
+    RecordCacheEntry* entry = findEntry(recordId);
+    if (entry != NULL)
+    {
+        entry->isValid = 0;
+    }
+    setRecordIdBit(tooLargeRecordIds, recordId, 0);
+    setRecordIdBit(skippedRecordIds, recordId, 0);
+}
+
+void startRecordCacheEntry(uint8_t recordId)
+{
+    invalidateEntry(recordId);
+    currentEntry = NULL;
+    if (pool == NULL)
+    {
+        return;
+    }
+
+    if (findFreeEntry() == NULL)
+    {
+        evictEntry(findLeastRecentlyUsedEntry());
+    }
+    compactPool();
+
+    // The entry is placed at the end of the pool, so it can grow until it reaches the pool size.
+    currentEntry = findFreeEntry();
+    currentEntry->offset = getUsedSize();
+    currentEntry->isValid = 1;
+    currentEntry->isComplete = 0;
+    currentEntry->recordId = recordId;
+    currentEntry->status = 0;
+    currentEntry->size = 0;
+    currentEntry->lastUse = useCounter++;
+}
+
+void appendRecordCacheEntry(const uint8_t* data, size_t size)
+{
+    if (currentEntry == NULL)
+    {
+        return;
+    }
+
+    if (currentEntry->size + size > poolSize)
+    {
+        ESP_LOGW(NETWORK_LOGGER_TAG, "Record %u is too large to be cached", currentEntry->recordId);
+        setRecordIdBit(tooLargeRecordIds, currentEntry->recordId, 1);
+        currentEntry->isValid = 0;
+        currentEntry = NULL;
+        return;
+    }
+    if (currentEntry->offset + currentEntry->size + size > poolSize)
+    {
+        while (getUsedSize() + size > poolSize)
+        {
+            evictEntry(findLeastRecentlyUsedEntry());
+        }
+        compactPool();
+    }
+
+    memcpy(pool + currentEntry->offset + currentEntry->size, data, size);
+    currentEntry->size += size;
+}
+
+void finishRecordCacheEntry(uint8_t recordId, uint8_t status)
+{
+    if (currentEntry != NULL && currentEntry->recordId == recordId)
+    {
+        currentEntry->isComplete = 1;
+        currentEntry->status = status;
+        currentEntry = NULL;
+    }
+}
+
+void skipRecordCacheEntry(uint8_t recordId)
+{
+    if (currentEntry != NULL && currentEntry->recordId == recordId)
+    {
+        currentEntry = NULL;
+    }
+    invalidateEntry(recordId);
+    setRecordIdBit(skippedRecordIds, recordId, 1);
+}
+
+const uint8_t* findRecordCacheEntry(uint8_t recordId, size_t* size, uint8_t* status)
+{
+    RecordCacheEntry* entry = findEntry(recordId);
+    if (entry == NULL || !entry->isComplete)
+    {
+        atomic_fetch_add(&missCount, 1);
+        return NULL;
+    }
+
+    atomic_fetch_add(&hitCount, 1);
+    entry->lastUse = useCounter++;
+    *size = entry->size;
+    *status = entry->status;
+    return pool + entry->offset;
+}
+
+int isRecordTooLargeForCache(uint8_t recordId)
+{
+    return getRecordIdBit(tooLargeRecordIds, recordId);
+}
+
+int isRecordSkippedByCache(uint8_t recordId)
+{
+    return getRecordIdBit(skippedRecordIds, recordId);
+}
+
+void logRecordCacheStatistics()
+{
+    unsigned int hits = atomic_load(&hitCount);
+    unsigned int misses = atomic_load(&missCount);
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Record cache: hits = %u, misses = %u, hit rate = %u%%, evictions = %u",
+        hits,
+        misses,
+        hits + misses > 0 ? 100 * hits / (hits + misses) : 0,
+        atomic_load(&evictionCount));
+}
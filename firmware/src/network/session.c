@@ -0,0 +1,358 @@
+#include "network/session.h"
+#include "network/utils.h"
+
+#include <string.h>
+
+#define MS_IN_S_COUNT 1000
+#define UDP_PACKET_COST MS_IN_S_COUNT
+#define MAX_UDP_PACKET_BUDGET (CONFIG_COMMUNICATION_SESSION_UDP_PACKET_BURST * UDP_PACKET_COST)
+
+static Session sessions[CONFIG_COMMUNICATION_MAX_CLIENT_COUNT];
+static SemaphoreHandle_t sessionMutex;
+static uint32_t nextSessionId = SESSION_NO_ID + 1;
+
+static uint32_t sentMulticastPacketCount = 0;
+static uint32_t failedMulticastPacketCount = 0;
+
+// The sends are done without the session mutex, so a slow socket never blocks the other sessions.
+// A TCP mutex can be held when the session mutex is taken, never the opposite.
+typedef struct
+{
+    uint32_t id;
+    struct sockaddr_in udpAddress;
+} SessionDestination;
+
+void initializeSessions()
+{
+    sessionMutex = xSemaphoreCreateMutex();
+    if (sessionMutex == NULL)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to create the session mutex");
+    }
+
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
+    {
+        memset(&sessions[i], 0, sizeof(Session));
+        sessions[i].id = SESSION_NO_ID;
+        sessions[i].tcpSocketHandle = -1;
+        sessions[i].tcpMutex = xSemaphoreCreateMutex();
+        if (sessions[i].tcpMutex == NULL)
+        {
+            ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to create the session TCP mutex");
+        }
+    }
+}
+
+Session* openSession(int tcpSocketHandle, const struct sockaddr_in* udpAddress)
+{
+    Session* session = NULL;
+
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT && session == NULL; i++)
+    {
+        // A closed session keeps its slot until its socket is freed.
+        if (!sessions[i].isActive && sessions[i].tcpSocketHandle < 0)
+        {
+            session = &sessions[i];
+        }
+    }
+
+    if (session != NULL)
+    {
+        session->id = nextSessionId++;
+        if (nextSessionId == SESSION_NO_ID)
+        {
+            nextSessionId++;
+        }
+        session->tcpSocketHandle = tcpSocketHandle;
+        memcpy(&session->udpAddress, udpAddress, sizeof(struct sockaddr_in));
+        session->lastHeartbeatTimestamp = esp_log_timestamp();
+        session->udpPacketBudget = MAX_UDP_PACKET_BUDGET;
+        session->udpPacketBudgetTimestamp = session->lastHeartbeatTimestamp;
+        session->sentPacketCount = 0;
+        session->failedPacketCount = 0;
+        session->cappedPacketCount = 0;
+        session->sentTcpByteCount = 0;
+        session->isActive = 1;
+    }
+    xSemaphoreGive(sessionMutex);
+
+    return session;
+}
+
+void closeSession(Session* session)
+{
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    session->isActive = 0;
+    xSemaphoreGive(sessionMutex);
+
+    // A send in progress returns at once, instead of holding the TCP mutex until its timeout.
+    // Only this task modifies the socket handle, so it is read without the TCP mutex.
+    shutdown(session->tcpSocketHandle, SHUT_RDWR);
+
+    xSemaphoreTake(session->tcpMutex, portMAX_DELAY);
+    freeSocket(session->tcpSocketHandle);
+    session->tcpSocketHandle = -1;
+    xSemaphoreGive(session->tcpMutex);
+
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Session %u closed", session->id);
+}
+
+size_t getSessionCount()
+{
+    size_t count = 0;
+
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
+    {
+        count += sessions[i].isActive;
+    }
+    xSemaphoreGive(sessionMutex);
+
+    return count;
+}
+
+size_t getActiveSessions(Session** activeSessions)
+{
+    size_t count = 0;
+
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
+    {
+        if (sessions[i].isActive)
+        {
+            activeSessions[count] = &sessions[i];
+            count++;
+        }
+    }
+    xSemaphoreGive(sessionMutex);
+
+    return count;
+}
+
+static Session* findSession(uint32_t sessionId)
+{
+    Session* session = NULL;
+
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
+    {
+        if (sessions[i].isActive && sessions[i].id == sessionId)
+        {
+            session = &sessions[i];
+            break;
+        }
+    }
+    xSemaphoreGive(sessionMutex);
+
+    return session;
+}
+
+// The session can be closed and its slot reused between the lookup and the lock, so it is checked again.
+static Session* lockSessionTcp(uint32_t sessionId)
+{
+    Session* session = findSession(sessionId);
+    if (session == NULL)
+    {
+        return NULL;
+    }
+
+    xSemaphoreTake(session->tcpMutex, portMAX_DELAY);
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    int isSameSession = session->isActive && session->id == sessionId;
+    xSemaphoreGive(sessionMutex);
+
+    if (!isSameSession)
+    {
+        xSemaphoreGive(session->tcpMutex);
+        return NULL;
+    }
+    return session;
+}
+
+int sendSessionTcp(uint32_t sessionId, const uint8_t* buffer, size_t size)
+{
+    int flags = 0;
+    size_t sentSize = 0;
+
+    Session* session = lockSessionTcp(sessionId);
+    if (session == NULL)
+    {
+        return 0;
+    }
+
+    while (session->tcpSocketHandle >= 0 && sentSize < size)
+    {
+        int result = send(session->tcpSocketHandle, buffer + sentSize, size - sentSize, flags);
+        if (result < 0)
+        {
+            ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to send to session %u: errno %d", sessionId, errno);
+            break;
+        }
+        sentSize += result;
+    }
+    session->sentTcpByteCount += sentSize; // Only modified with the TCP mutex
+    xSemaphoreGive(session->tcpMutex);
+
+    return sentSize == size;
+}
+
+static int sendUdpPacket(int udpSocketHandle, const struct sockaddr_in* address, const uint8_t* buffer, size_t size)
+{
+    int flags = 0;
+    return sendto(udpSocketHandle,
+        buffer,
+        size,
+        flags,
+        (const struct sockaddr*)address,
+        sizeof(struct sockaddr_in)) >= 0;
+}
+
+// The session mutex must be held. The budget is refilled at the maximum packet rate, up to the burst size.
+static int consumeUdpPacketBudget(Session* session, uint32_t timestamp)
+{
+    uint32_t elapsedMs = timestamp - session->udpPacketBudgetTimestamp;
+    if (elapsedMs > MAX_UDP_PACKET_BUDGET / CONFIG_COMMUNICATION_SESSION_MAX_UDP_PACKET_RATE)
+    {
+        elapsedMs = MAX_UDP_PACKET_BUDGET / CONFIG_COMMUNICATION_SESSION_MAX_UDP_PACKET_RATE;
+    }
+    session->udpPacketBudgetTimestamp = timestamp;
+    session->udpPacketBudget += elapsedMs * CONFIG_COMMUNICATION_SESSION_MAX_UDP_PACKET_RATE;
+    if (session->udpPacketBudget > MAX_UDP_PACKET_BUDGET)
+    {
+        session->udpPacketBudget = MAX_UDP_PACKET_BUDGET;
+    }
+
+    if (session->udpPacketBudget < UDP_PACKET_COST)
+    {
+        session->cappedPacketCount++;
+        return 0;
+    }
+    session->udpPacketBudget -= UDP_PACKET_COST;
+    return 1;
+}
+
+// Returns the destination count. The array must hold the maximum client count, or one destination when the
+// session id is given. The sessions over their UDP packet rate cap are skipped if the cap is applied.
+static size_t getSessionDestinations(uint32_t sessionId, int isCapApplied, SessionDestination* destinations)
+{
+    size_t count = 0;
+    uint32_t timestamp = esp_log_timestamp();
+
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
+    {
+        if (sessions[i].isActive && (sessionId == SESSION_NO_ID || sessions[i].id == sessionId) &&
+            (!isCapApplied || consumeUdpPacketBudget(&sessions[i], timestamp)))
+        {
+            destinations[count].id = sessions[i].id;
+            memcpy(&destinations[count].udpAddress, &sessions[i].udpAddress, sizeof(struct sockaddr_in));
+            count++;
+        }
+    }
+    xSemaphoreGive(sessionMutex);
+
+    return count;
+}
+
+// The session mutex must be held.
+static void updateSessionPacketCount(uint32_t sessionId, int isSent)
+{
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
+    {
+        if (sessions[i].isActive && sessions[i].id == sessionId)
+        {
+            if (isSent)
+            {
+                sessions[i].sentPacketCount++;
+            }
+            else
+            {
+                sessions[i].failedPacketCount++;
+            }
+            break;
+        }
+    }
+}
+
+void sendSessionsUdp(int udpSocketHandle, const struct sockaddr_in* multicastAddress, const uint8_t* buffer, size_t size)
+{
+    SessionDestination destinations[CONFIG_COMMUNICATION_MAX_CLIENT_COUNT];
+    size_t destinationCount = getSessionDestinations(SESSION_NO_ID, multicastAddress == NULL, destinations);
+    int isSent[CONFIG_COMMUNICATION_MAX_CLIENT_COUNT];
+
+    if (multicastAddress != NULL)
+    {
+        if (destinationCount > 0)
+        {
+            isSent[0] = sendUdpPacket(udpSocketHandle, multicastAddress, buffer, size);
+
+            xSemaphoreTake(sessionMutex, portMAX_DELAY);
+            if (isSent[0])
+            {
+                sentMulticastPacketCount++;
+            }
+            else
+            {
+                failedMulticastPacketCount++;
+            }
+            xSemaphoreGive(sessionMutex);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < destinationCount; i++)
+    {
+        isSent[i] = sendUdpPacket(udpSocketHandle, &destinations[i].udpAddress, buffer, size);
+    }
+
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    for (size_t i = 0; i < destinationCount; i++)
+    {
+        updateSessionPacketCount(destinations[i].id, isSent[i]);
+    }
+    xSemaphoreGive(sessionMutex);
+}
+
+int sendSessionUdp(int udpSocketHandle, uint32_t sessionId, const uint8_t* buffer, size_t size)
+{
+    SessionDestination destination;
+    if (getSessionDestinations(sessionId, 1, &destination) == 0)
+    {
+        return 0;
+    }
+
+    int isSent = sendUdpPacket(udpSocketHandle, &destination.udpAddress, buffer, size);
+
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    updateSessionPacketCount(sessionId, isSent);
+    xSemaphoreGive(sessionMutex);
+
+    return isSent;
+}
+
+void logSessionStatistics()
+{
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    for (size_t i = 0; i < CONFIG_COMMUNICATION_MAX_CLIENT_COUNT; i++)
+    {
+        if (sessions[i].isActive)
+        {
+            ESP_LOGI(NETWORK_LOGGER_TAG,
+                "Session %u (%s): sent packets = %u, failed packets = %u, capped packets = %u, sent TCP bytes = %u",
+                sessions[i].id,
+                inet_ntoa(sessions[i].udpAddress.sin_addr),
+                sessions[i].sentPacketCount,
+                sessions[i].failedPacketCount,
+                sessions[i].cappedPacketCount,
+                sessions[i].sentTcpByteCount);
+        }
+    }
+    if (CONFIG_COMMUNICATION_UDP_MULTICAST_ENABLED)
+    {
+        ESP_LOGI(NETWORK_LOGGER_TAG, "Multicast: sent packets = %u, failed packets = %u",
+            sentMulticastPacketCount,
+            failedMulticastPacketCount);
+    }
+    xSemaphoreGive(sessionMutex);
+}
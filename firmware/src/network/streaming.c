@@ -0,0 +1,181 @@
+#include "network/streaming.h"
+#include "network/communication.h"
+#include "packet_ring.h"
+#include "config.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <stdatomic.h>
+
+_Static_assert(CONFIG_STREAMING_RETRANSMISSION_HISTORY_SIZE < CONFIG_STREAMING_PACKET_RING_SIZE,
+    "The retransmission history must leave free slots in the packet ring");
+
+typedef struct
+{
+    uint32_t sessionId;
+    uint16_t sequenceId;
+} RetransmissionRequest;
+
+static PacketRing packetRing;
+static TaskHandle_t streamingTaskHandle = NULL;
+static QueueHandle_t retransmissionQueue = NULL;
+
+static atomic_uint requestedRetransmissionCount;
+static atomic_uint droppedRetransmissionCount;
+static uint32_t retransmittedPacketCount = 0;
+static uint32_t expiredRetransmissionCount = 0;
+
+// The history is released from its oldest packet, so the producer always has free slots.
+static void releaseExpiredPackets()
+{
+    uint32_t now = esp_log_timestamp();
+    while (getPacketRingHistorySize(&packetRing) > 0)
+    {
+        PacketRingSlot* slot = getPacketRingHistorySlot(&packetRing, 0);
+        if (getPacketRingHistorySize(&packetRing) <= CONFIG_STREAMING_RETRANSMISSION_HISTORY_SIZE &&
+            now - slot->sentTimestamp <= CONFIG_STREAMING_RETRANSMISSION_HISTORY_DURATION_MS)
+        {
+            break;
+        }
+        releasePacketRingSlot(&packetRing);
+    }
+}
+
+static void sendPackets()
+{
+    PacketRingSlot* slot;
+    while ((slot = peekPacketRing(&packetRing)) != NULL)
+    {
+        sendUdp(slot->data, slot->size);
+        slot->sentTimestamp = esp_log_timestamp();
+        popPacketRing(&packetRing);
+        releaseExpiredPackets();
+    }
+}
+
+static PacketRingSlot* findSentPacket(uint16_t sequenceId)
+{
+    size_t historySize = getPacketRingHistorySize(&packetRing);
+    for (size_t i = 0; i < historySize; i++)
+    {
+        PacketRingSlot* slot = getPacketRingHistorySlot(&packetRing, i);
+        if (slot->sequenceId == sequenceId)
+        {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+static void retransmitPackets()
+{
+    RetransmissionRequest request;
+    releaseExpiredPackets();
+    while (xQueueReceive(retransmissionQueue, &request, 0) == pdTRUE)
+    {
+        PacketRingSlot* slot = findSentPacket(request.sequenceId);
+        if (slot == NULL)
+        {
+            expiredRetransmissionCount++;
+        }
+        else if (sendUdpToSession(request.sessionId, slot->data, slot->size))
+        {
+            retransmittedPacketCount++;
+        }
+    }
+}
+
+static void streamingTask(void* parameters)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // The retransmissions are late already, so the new packets go first.
+        sendPackets();
+        retransmitPackets();
+    }
+    vTaskDelete(NULL);
+}
+
+void initializeStreaming()
+{
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Streaming initialization");
+    initializePacketRing(&packetRing, 0);
+
+    retransmissionQueue = xQueueCreate(CONFIG_STREAMING_RETRANSMISSION_QUEUE_SIZE, sizeof(RetransmissionRequest));
+    if (retransmissionQueue == NULL)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to create the retransmission queue");
+    }
+    atomic_init(&requestedRetransmissionCount, 0);
+    atomic_init(&droppedRetransmissionCount, 0);
+}
+
+void startStreaming()
+{
+    xTaskCreate(streamingTask,
+        "streaming",
+        CONFIG_STREAMING_TASK_STACK_SIZE,
+        NULL,
+        CONFIG_STREAMING_TASK_PRIORITY,
+        &streamingTaskHandle);
+}
+
+void initializeStreamingPackets(size_t dataOffset)
+{
+    initializePacketRing(&packetRing, dataOffset);
+}
+
+PacketRingSlot* acquireStreamingPacket()
+{
+    return acquirePacketRingSlot(&packetRing);
+}
+
+void commitStreamingPacket(PacketRingSlot* slot, size_t size)
+{
+    commitPacketRingSlot(&packetRing, slot, size);
+    if (streamingTaskHandle != NULL)
+    {
+        xTaskNotifyGive(streamingTaskHandle);
+    }
+}
+
+int requestStreamingRetransmission(uint32_t sessionId, uint16_t sequenceId)
+{
+    RetransmissionRequest request;
+    request.sessionId = sessionId;
+    request.sequenceId = sequenceId;
+
+    atomic_fetch_add_explicit(&requestedRetransmissionCount, 1, memory_order_relaxed);
+    if (retransmissionQueue == NULL || xQueueSend(retransmissionQueue, &request, 0) != pdTRUE)
+    {
+        atomic_fetch_add_explicit(&droppedRetransmissionCount, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    if (streamingTaskHandle != NULL)
+    {
+        xTaskNotifyGive(streamingTaskHandle);
+    }
+    return 1;
+}
+
+void logStreamingStatistics()
+{
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Streaming ring: occupancy = %u/%u, max occupancy = %u, pushed = %u, dropped = %u",
+        (unsigned int)getPacketRingOccupancy(&packetRing),
+        (unsigned int)PACKET_RING_CAPACITY,
+        atomic_load(&packetRing.maxOccupancy),
+        atomic_load(&packetRing.pushedPacketCount),
+        atomic_load(&packetRing.droppedPacketCount));
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Retransmissions: history = %u/%u, requested = %u, retransmitted = %u, expired = %u, dropped = %u",
+        (unsigned int)getPacketRingHistorySize(&packetRing),
+        (unsigned int)CONFIG_STREAMING_RETRANSMISSION_HISTORY_SIZE,
+        atomic_load(&requestedRetransmissionCount),
+        retransmittedPacketCount,
+        expiredRetransmissionCount,
+        atomic_load(&droppedRetransmissionCount));
+}
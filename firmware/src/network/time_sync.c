@@ -0,0 +1,325 @@
+#include "network/time_sync.h"
+#include "network/utils.h"
+#include "config.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <lwip/err.h>
+#include <lwip/sockets.h>
+#include <lwip/sys.h>
+#include <lwip/netdb.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define US_IN_S_COUNT 1000000LL
+
+#define TIME_SYNC_REQUEST_SIZE 20
+#define TIME_SYNC_REQUEST_ID 14
+#define TIME_SYNC_RESPONSE_SIZE 36
+#define TIME_SYNC_RESPONSE_ID 15
+#define TIME_SYNC_PAYLOAD_SIZE_OFFSET 4
+#define TIME_SYNC_SEQUENCE_OFFSET 8
+#define TIME_SYNC_T1_OFFSET 12
+#define TIME_SYNC_T2_OFFSET 20
+#define TIME_SYNC_T3_OFFSET 28
+
+static struct sockaddr_in bindAddress;
+static struct sockaddr_in masterAddress;
+static uint8_t receivingBuffer[TIME_SYNC_RESPONSE_SIZE] __attribute__((aligned(4)));
+
+static uint32_t exchangeCount = 0;
+static uint32_t timeoutCount = 0;
+static uint32_t stepCount = 0;
+static int32_t lastOffsetUs = 0;
+static int32_t lastDelayUs = 0;
+static int32_t minDelayUs = INT32_MAX;
+static int32_t maxAbsOffsetUs = 0; // Since the last statistics log
+
+static int64_t getTimeUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * US_IN_S_COUNT + tv.tv_usec;
+}
+
+static void writeInt64(uint8_t* buffer, int64_t value)
+{
+    *(uint32_t*)buffer = htonl((uint32_t)((uint64_t)value >> 32));
+    *(uint32_t*)(buffer + sizeof(uint32_t)) = htonl((uint32_t)value);
+}
+
+static int64_t readInt64(const uint8_t* buffer)
+{
+    uint64_t high = ntohl(*(const uint32_t*)buffer);
+    uint64_t low = ntohl(*(const uint32_t*)(buffer + sizeof(uint32_t)));
+    return (int64_t)(high << 32 | low);
+}
+
+static int createSocket()
+{
+    int broadcast = 1;
+    int socketHandle = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (socketHandle < 0)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to create socket: errno %d", errno);
+        return -1;
+    }
+
+    if (!CONFIG_PROBE_IS_MASTER && setsockopt(socketHandle, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to enable broadcast: errno %d", errno);
+        freeSocket(socketHandle);
+        return -1;
+    }
+
+    if (CONFIG_PROBE_IS_MASTER && bind(socketHandle, (struct sockaddr*)&bindAddress, sizeof(bindAddress)) < 0)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to bind: errno %d", errno);
+        freeSocket(socketHandle);
+        return -1;
+    }
+
+    return socketHandle;
+}
+
+// The master side. The receive time is read as soon as recvfrom returns and the send time just before sendto.
+static int handleTimeSyncRequest(int socketHandle)
+{
+    int flags = 0;
+    struct sockaddr_in sourceAddress;
+    socklen_t socklen = sizeof(sourceAddress);
+
+    int size = recvfrom(socketHandle,
+        receivingBuffer,
+        sizeof(receivingBuffer),
+        flags,
+        (struct sockaddr*)&sourceAddress,
+        &socklen);
+    int64_t receiveTimeUs = getTimeUs();
+
+    if (size < 0)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "recvfrom failed: errno %d", errno);
+        return 0;
+    }
+    if (size != TIME_SYNC_REQUEST_SIZE || ntohl(*(uint32_t*)receivingBuffer) != TIME_SYNC_REQUEST_ID)
+    {
+        return 1;
+    }
+
+    uint8_t buffer[TIME_SYNC_RESPONSE_SIZE] __attribute__((aligned(4)));
+    *(uint32_t*)buffer = htonl(TIME_SYNC_RESPONSE_ID);
+    *(uint32_t*)(buffer + TIME_SYNC_PAYLOAD_SIZE_OFFSET) = htonl(TIME_SYNC_RESPONSE_SIZE - TIME_SYNC_SEQUENCE_OFFSET);
+    memcpy(buffer + TIME_SYNC_SEQUENCE_OFFSET, receivingBuffer + TIME_SYNC_SEQUENCE_OFFSET, sizeof(uint32_t) + sizeof(int64_t));
+    writeInt64(buffer + TIME_SYNC_T2_OFFSET, receiveTimeUs);
+    writeInt64(buffer + TIME_SYNC_T3_OFFSET, getTimeUs());
+
+    if (sendto(socketHandle, buffer, TIME_SYNC_RESPONSE_SIZE, flags, (struct sockaddr*)&sourceAddress, socklen) < 0)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "sendto failed: errno %d", errno);
+        return 0;
+    }
+    return 1;
+}
+
+// Waits until the socket is readable or the deadline is reached. Returns 0 on timeout or error.
+static int waitForResponse(int socketHandle, int64_t deadlineUs)
+{
+    int64_t remainingUs = deadlineUs - getTimeUs();
+    if (remainingUs <= 0)
+    {
+        return 0;
+    }
+
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(socketHandle, &readSet);
+
+    struct timeval tv;
+    tv.tv_sec = remainingUs / US_IN_S_COUNT;
+    tv.tv_usec = remainingUs % US_IN_S_COUNT;
+    return select(socketHandle + 1, &readSet, NULL, NULL, &tv) > 0;
+}
+
+// The slave side. Returns 0 if no valid response is received before the timeout.
+// The timeout applies to the whole exchange, so a stream of other packets cannot extend it.
+static int exchangeTimeSyncMessages(int socketHandle, uint32_t sequence, int64_t* offsetUs, int64_t* delayUs)
+{
+    int flags = 0;
+    uint8_t buffer[TIME_SYNC_REQUEST_SIZE] __attribute__((aligned(4)));
+    *(uint32_t*)buffer = htonl(TIME_SYNC_REQUEST_ID);
+    *(uint32_t*)(buffer + TIME_SYNC_PAYLOAD_SIZE_OFFSET) = htonl(TIME_SYNC_REQUEST_SIZE - TIME_SYNC_SEQUENCE_OFFSET);
+    *(uint32_t*)(buffer + TIME_SYNC_SEQUENCE_OFFSET) = htonl(sequence);
+
+    int64_t t1 = getTimeUs();
+    writeInt64(buffer + TIME_SYNC_T1_OFFSET, t1);
+    if (sendto(socketHandle, buffer, TIME_SYNC_REQUEST_SIZE, flags, (struct sockaddr*)&masterAddress, sizeof(masterAddress)) < 0)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "sendto failed: errno %d", errno);
+        return 0;
+    }
+
+    // The late responses of the previous exchanges are skipped.
+    int64_t deadlineUs = t1 + CONFIG_TIME_SYNC_TIMEOUT_MS * 1000LL;
+    while (waitForResponse(socketHandle, deadlineUs))
+    {
+        int size = recv(socketHandle, receivingBuffer, sizeof(receivingBuffer), flags);
+        int64_t t4 = getTimeUs();
+        if (size < 0)
+        {
+            return 0;
+        }
+
+        if (size == TIME_SYNC_RESPONSE_SIZE &&
+            ntohl(*(uint32_t*)receivingBuffer) == TIME_SYNC_RESPONSE_ID &&
+            ntohl(*(uint32_t*)(receivingBuffer + TIME_SYNC_SEQUENCE_OFFSET)) == sequence)
+        {
+            int64_t t2 = readInt64(receivingBuffer + TIME_SYNC_T2_OFFSET);
+            int64_t t3 = readInt64(receivingBuffer + TIME_SYNC_T3_OFFSET);
+            *offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+            *delayUs = (t4 - t1) - (t3 - t2);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void adjustClock(int64_t offsetUs)
+{
+    struct timeval tv;
+    if (llabs(offsetUs) > CONFIG_TIME_SYNC_STEP_THRESHOLD_US)
+    {
+        int64_t timeUs = getTimeUs() + offsetUs;
+        tv.tv_sec = timeUs / US_IN_S_COUNT;
+        tv.tv_usec = timeUs % US_IN_S_COUNT;
+        settimeofday(&tv, NULL);
+        stepCount++;
+        ESP_LOGW(NETWORK_LOGGER_TAG, "Clock stepped by %lld us", (long long)offsetUs);
+    }
+    else
+    {
+        // The new correction replaces the remaining one, which is already included in the measured offset.
+        tv.tv_sec = offsetUs / US_IN_S_COUNT;
+        tv.tv_usec = offsetUs % US_IN_S_COUNT;
+        adjtime(&tv, NULL);
+    }
+}
+
+// The exchange with the smallest delay of each burst is the least affected by the queuing delays.
+static void synchronizeClock(int socketHandle)
+{
+    static uint32_t sequence = 0;
+    int64_t bestOffsetUs = 0;
+    int64_t bestDelayUs = INT64_MAX;
+
+    for (size_t i = 0; i < CONFIG_TIME_SYNC_BURST_SIZE; i++)
+    {
+        int64_t offsetUs;
+        int64_t delayUs;
+        sequence++;
+        if (!exchangeTimeSyncMessages(socketHandle, sequence, &offsetUs, &delayUs))
+        {
+            timeoutCount++;
+            continue;
+        }
+
+        exchangeCount++;
+        if (delayUs >= 0 && delayUs < bestDelayUs)
+        {
+            bestOffsetUs = offsetUs;
+            bestDelayUs = delayUs;
+        }
+    }
+
+    if (bestDelayUs == INT64_MAX)
+    {
+        return;
+    }
+
+    adjustClock(bestOffsetUs);
+
+    lastOffsetUs = (int32_t)bestOffsetUs;
+    lastDelayUs = (int32_t)bestDelayUs;
+    if (lastDelayUs < minDelayUs)
+    {
+        minDelayUs = lastDelayUs;
+    }
+    if (abs(lastOffsetUs) > maxAbsOffsetUs)
+    {
+        maxAbsOffsetUs = abs(lastOffsetUs);
+    }
+}
+
+static void timeSyncTask(void* parameters)
+{
+    while (1)
+    {
+        int socketHandle = createSocket();
+
+        if (CONFIG_PROBE_IS_MASTER)
+        {
+            while (socketHandle >= 0 && handleTimeSyncRequest(socketHandle));
+        }
+        else
+        {
+            while (socketHandle >= 0)
+            {
+                synchronizeClock(socketHandle);
+                vTaskDelay(CONFIG_TIME_SYNC_INTERVAL_MS / portTICK_PERIOD_MS);
+            }
+        }
+
+        if (socketHandle >= 0)
+        {
+            ESP_LOGE(NETWORK_LOGGER_TAG, "Shutting down socket and restarting...");
+            freeSocket(socketHandle);
+        }
+
+        vTaskDelay(CONFIG_TIME_SYNC_SOCKET_CREATION_INTERVAL_MS / portTICK_PERIOD_MS);
+    }
+    vTaskDelete(NULL);
+}
+
+void initializeTimeSync()
+{
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Time synchronization initialization (%s)", CONFIG_PROBE_IS_MASTER ? "master" : "slave");
+    bindAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    bindAddress.sin_family = AF_INET;
+    bindAddress.sin_port = htons(CONFIG_TIME_SYNC_PORT);
+
+    masterAddress.sin_addr.s_addr = inet_addr(CONFIG_TIME_SYNC_MASTER_ADDRESS);
+    masterAddress.sin_family = AF_INET;
+    masterAddress.sin_port = htons(CONFIG_TIME_SYNC_PORT);
+}
+
+void startTimeSync()
+{
+    xTaskCreate(timeSyncTask,
+        "time_sync",
+        CONFIG_TIME_SYNC_TASK_STACK_SIZE,
+        NULL,
+        CONFIG_TIME_SYNC_TASK_PRIORITY,
+        NULL);
+}
+
+void logTimeSyncStatistics()
+{
+    if (CONFIG_PROBE_IS_MASTER)
+    {
+        return;
+    }
+
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Time sync: offset = %d us, max offset = %d us, delay = %d us, min delay = %d us, "
+        "exchanges = %u, timeouts = %u, steps = %u",
+        lastOffsetUs,
+        maxAbsOffsetUs,
+        lastDelayUs,
+        minDelayUs,
+        exchangeCount,
+        timeoutCount,
+        stepCount);
+    maxAbsOffsetUs = 0;
+}
@@ -0,0 +1,390 @@
+#include "network/upload.h"
+#include "network/communication.h"
+#include "network/record_cache.h"
+#include "config.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/ringbuf.h>
+#include <freertos/task.h>
+
+#include <esp_heap_caps.h>
+
+#include <stdatomic.h>
+#include <string.h>
+
+#define UPLOAD_MESSAGE_HEADER_SIZE 8
+#define UPLOAD_MESSAGE_PAYLOAD_SIZE_OFFSET 4
+
+#define UPLOAD_MESSAGE_TYPE_DATA 0
+#define UPLOAD_MESSAGE_TYPE_RECORD_FETCH 1
+
+#define RECORD_RESPONSE_ID 6
+#define RECORD_RESPONSE_HEADER_SIZE 9
+#define RECORD_RESPONSE_RECORD_ID_OFFSET 8
+
+#define RECORD_STATUS_ID 9
+#define RECORD_STATUS_RECORD_ID_OFFSET 8
+#define RECORD_STATUS_STATUS_OFFSET 9
+
+#define IMPULSE_RESPONSE_ID 22
+#define IMPULSE_RESPONSE_MEASUREMENT_ID_OFFSET 8
+
+#define RECORD_FETCH_RESPONSE_HEADER_SIZE 16
+#define RECORD_FETCH_RESPONSE_ID 11
+#define RECORD_FETCH_RESPONSE_RECORD_ID_OFFSET 8
+#define RECORD_FETCH_RESPONSE_RESULT_OFFSET 9
+#define RECORD_FETCH_RESPONSE_RECORD_STATUS_OFFSET 10
+#define RECORD_FETCH_RESPONSE_OFFSET_OFFSET 12
+
+#define RECORD_FETCH_RESULT_FOUND 0
+#define RECORD_FETCH_RESULT_NOT_FOUND 1
+#define RECORD_FETCH_RESULT_INVALID_RANGE 2
+#define RECORD_FETCH_RESULT_TOO_LARGE 3 // The record was not cached because it is larger than the cache
+#define RECORD_FETCH_RESULT_SKIPPED 4 // The record was not cached because it was uploaded at the same time as another one
+
+typedef struct
+{
+    uint8_t recordId;
+    uint32_t offset;
+    uint32_t size;
+} RecordFetch;
+
+typedef struct
+{
+    uint8_t type;
+    uint32_t sessionId;
+    uint8_t data[UPLOAD_MESSAGE_MAX_SIZE];
+    size_t size;
+    RecordFetch fetch;
+} UploadMessage;
+
+static RingbufHandle_t uploadRingbuffer;
+static size_t uploadBufferSize;
+static QueueHandle_t uploadMessageQueue;
+
+// Bytes left in the bulk message being sent, the small messages are only sent when it is 0.
+// The bulk messages are at most one sound message long, so a small message waits for at most one of them.
+static size_t remainingMessageSize = 0;
+static int isMessageDiscarded = 0;
+static uint32_t messageSessionId;
+
+static volatile uint32_t recordSessionIds[UINT8_MAX + 1];
+static volatile uint32_t measurementSessionIds[UINT8_MAX + 1];
+
+// The record payloads are cached while they are uploaded, even if the upload fails.
+// The messages of overlapping records are interleaved, only the first one is cached.
+static uint32_t currentMessageId;
+static uint8_t currentRecordId;
+static size_t currentMessageOffset = 0;
+static int isRecordCached = 0;
+static uint8_t cachedRecordId;
+static uint32_t uploadedRecordIds[(UINT8_MAX + 1) / 32]; // The records with a response message and no status yet
+
+static atomic_uint queuedByteCount;
+static atomic_uint fullCount;
+static atomic_uint minFreeSize;
+static atomic_uint sentMessageCount;
+static atomic_uint discardedMessageCount;
+
+static void updateMinFreeSize()
+{
+    unsigned int freeSize = xRingbufferGetCurFreeSize(uploadRingbuffer);
+    unsigned int currentMinFreeSize = atomic_load(&minFreeSize);
+    while (freeSize < currentMinFreeSize &&
+        !atomic_compare_exchange_weak(&minFreeSize, &currentMinFreeSize, freeSize))
+    {
+    }
+}
+
+static void sendRecordFetchResponse(uint32_t sessionId, const RecordFetch* fetch)
+{
+    uint8_t header[RECORD_FETCH_RESPONSE_HEADER_SIZE] __attribute__((aligned(4))) = { 0 };
+    uint8_t result = RECORD_FETCH_RESULT_FOUND;
+    uint8_t recordStatus = 0;
+    size_t recordSize = 0;
+    size_t size = fetch->size;
+
+    const uint8_t* record = findRecordCacheEntry(fetch->recordId, &recordSize, &recordStatus);
+    if (record == NULL)
+    {
+        result = RECORD_FETCH_RESULT_NOT_FOUND;
+        if (isRecordTooLargeForCache(fetch->recordId))
+        {
+            result = RECORD_FETCH_RESULT_TOO_LARGE;
+        }
+        else if (isRecordSkippedByCache(fetch->recordId))
+        {
+            result = RECORD_FETCH_RESULT_SKIPPED;
+        }
+        size = 0;
+    }
+    else if (fetch->offset > recordSize)
+    {
+        result = RECORD_FETCH_RESULT_INVALID_RANGE;
+        size = 0;
+    }
+    else if (size == 0 || size > recordSize - fetch->offset)
+    {
+        size = recordSize - fetch->offset;
+    }
+
+    *(uint32_t*)header = htonl(RECORD_FETCH_RESPONSE_ID);
+    *(uint32_t*)(header + UPLOAD_MESSAGE_PAYLOAD_SIZE_OFFSET) =
+        htonl(RECORD_FETCH_RESPONSE_HEADER_SIZE - UPLOAD_MESSAGE_HEADER_SIZE + size);
+    header[RECORD_FETCH_RESPONSE_RECORD_ID_OFFSET] = fetch->recordId;
+    header[RECORD_FETCH_RESPONSE_RESULT_OFFSET] = result;
+    header[RECORD_FETCH_RESPONSE_RECORD_STATUS_OFFSET] = recordStatus;
+    *(uint32_t*)(header + RECORD_FETCH_RESPONSE_OFFSET_OFFSET) = htonl(fetch->offset);
+
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Record %u fetch, result: %u", fetch->recordId, result);
+    if (sendTcp(sessionId, header, RECORD_FETCH_RESPONSE_HEADER_SIZE) && size > 0)
+    {
+        sendTcp(sessionId, record + fetch->offset, size);
+    }
+}
+
+static void sendUploadMessages()
+{
+    UploadMessage message;
+    while (xQueueReceive(uploadMessageQueue, &message, 0) == pdTRUE)
+    {
+        if (message.type == UPLOAD_MESSAGE_TYPE_RECORD_FETCH)
+        {
+            sendRecordFetchResponse(message.sessionId, &message.fetch);
+        }
+        else
+        {
+            sendTcp(message.sessionId, message.data, message.size);
+        }
+    }
+}
+
+static void startRecordUpload(uint8_t recordId)
+{
+    if ((uploadedRecordIds[recordId / 32] >> (recordId % 32)) & 1)
+    {
+        return;
+    }
+    uploadedRecordIds[recordId / 32] |= 1u << (recordId % 32);
+
+    if (isRecordCached)
+    {
+        skipRecordCacheEntry(recordId);
+    }
+    else
+    {
+        cachedRecordId = recordId;
+        isRecordCached = 1;
+        startRecordCacheEntry(recordId);
+    }
+}
+
+static void finishRecordUpload(uint8_t recordId, uint8_t status)
+{
+    uploadedRecordIds[recordId / 32] &= ~(1u << (recordId % 32));
+    if (isRecordCached && cachedRecordId == recordId)
+    {
+        finishRecordCacheEntry(recordId, status);
+        isRecordCached = 0;
+    }
+}
+
+// A record is uploaded as several record response messages followed by its record status message.
+// The messages of the records uploaded at the same time are interleaved.
+static void cacheUploadData(const uint8_t* data, size_t size)
+{
+    if (currentMessageOffset == 0)
+    {
+        currentMessageId = ntohl(*(uint32_t*)data);
+        if (currentMessageId == RECORD_RESPONSE_ID && size >= RECORD_RESPONSE_HEADER_SIZE)
+        {
+            currentRecordId = data[RECORD_RESPONSE_RECORD_ID_OFFSET];
+            startRecordUpload(currentRecordId);
+        }
+        else if (currentMessageId == RECORD_STATUS_ID && size > RECORD_STATUS_STATUS_OFFSET)
+        {
+            finishRecordUpload(data[RECORD_STATUS_RECORD_ID_OFFSET], data[RECORD_STATUS_STATUS_OFFSET]);
+        }
+    }
+
+    if (currentMessageId == RECORD_RESPONSE_ID && isRecordCached && currentRecordId == cachedRecordId)
+    {
+        size_t headerSize = 0;
+        if (currentMessageOffset < RECORD_RESPONSE_HEADER_SIZE)
+        {
+            headerSize = RECORD_RESPONSE_HEADER_SIZE - currentMessageOffset;
+            headerSize = headerSize > size ? size : headerSize;
+        }
+        appendRecordCacheEntry(data + headerSize, size - headerSize);
+    }
+
+    currentMessageOffset += size;
+}
+
+// A message that cannot be sent completely is discarded, the next one starts on a message boundary.
+static void sendUploadData(uint8_t* data, size_t size)
+{
+    if (remainingMessageSize == 0)
+    {
+        remainingMessageSize = UPLOAD_MESSAGE_HEADER_SIZE + ntohl(*(uint32_t*)(data + UPLOAD_MESSAGE_PAYLOAD_SIZE_OFFSET));
+        isMessageDiscarded = 0;
+
+        // The impulse responses are routed by measurement id. The record response and status messages both have
+        // the record id at the same offset.
+        if (ntohl(*(uint32_t*)data) == IMPULSE_RESPONSE_ID)
+        {
+            messageSessionId = measurementSessionIds[data[IMPULSE_RESPONSE_MEASUREMENT_ID_OFFSET]];
+        }
+        else
+        {
+            messageSessionId = recordSessionIds[data[RECORD_RESPONSE_RECORD_ID_OFFSET]];
+        }
+    }
+
+    if (size > remainingMessageSize)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "The upload data exceeds its message");
+        size = remainingMessageSize;
+    }
+    cacheUploadData(data, size);
+    remainingMessageSize -= size;
+    if (remainingMessageSize == 0)
+    {
+        currentMessageOffset = 0;
+    }
+
+    if (!isMessageDiscarded && !sendTcp(messageSessionId, data, size))
+    {
+        isMessageDiscarded = 1;
+        atomic_fetch_add(&discardedMessageCount, 1);
+    }
+    if (remainingMessageSize == 0 && !isMessageDiscarded)
+    {
+        atomic_fetch_add(&sentMessageCount, 1);
+    }
+}
+
+static void uploadTask(void* parameters)
+{
+    while (1)
+    {
+        if (remainingMessageSize == 0)
+        {
+            sendUploadMessages();
+        }
+
+        size_t size;
+        uint8_t* data = xRingbufferReceive(uploadRingbuffer, &size, CONFIG_UPLOAD_POLL_INTERVAL_MS / portTICK_PERIOD_MS);
+        if (data != NULL)
+        {
+            sendUploadData(data, size);
+            vRingbufferReturnItem(uploadRingbuffer, data);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+void initializeUpload()
+{
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Upload initialization");
+
+    // The ring buffer is allocated with malloc, so it goes to PSRAM when malloc can use it.
+    uploadBufferSize = CONFIG_UPLOAD_BUFFER_SIZE;
+    if (heap_caps_get_free_size(MALLOC_CAP_SPIRAM) > CONFIG_UPLOAD_PSRAM_BUFFER_SIZE)
+    {
+        uploadBufferSize = CONFIG_UPLOAD_PSRAM_BUFFER_SIZE;
+    }
+    uploadRingbuffer = xRingbufferCreate(uploadBufferSize, RINGBUF_TYPE_NOSPLIT);
+    if (uploadRingbuffer == NULL && uploadBufferSize != CONFIG_UPLOAD_BUFFER_SIZE)
+    {
+        uploadBufferSize = CONFIG_UPLOAD_BUFFER_SIZE;
+        uploadRingbuffer = xRingbufferCreate(uploadBufferSize, RINGBUF_TYPE_NOSPLIT);
+    }
+    uploadMessageQueue = xQueueCreate(CONFIG_UPLOAD_MESSAGE_QUEUE_SIZE, sizeof(UploadMessage));
+    if (uploadRingbuffer == NULL || uploadMessageQueue == NULL)
+    {
+        ESP_LOGE(NETWORK_LOGGER_TAG, "Unable to create the upload buffers");
+    }
+    if (initializeRecordCache() != ESP_OK)
+    {
+        ESP_LOGW(NETWORK_LOGGER_TAG, "The record cache is disabled");
+    }
+
+    atomic_init(&queuedByteCount, 0);
+    atomic_init(&fullCount, 0);
+    atomic_init(&minFreeSize, uploadBufferSize);
+    atomic_init(&sentMessageCount, 0);
+    atomic_init(&discardedMessageCount, 0);
+}
+
+void startUpload()
+{
+    xTaskCreate(uploadTask,
+        "upload",
+        CONFIG_UPLOAD_TASK_STACK_SIZE,
+        NULL,
+        CONFIG_UPLOAD_TASK_PRIORITY,
+        NULL);
+}
+
+int queueUploadData(const uint8_t* data, size_t size)
+{
+    if (xRingbufferSend(uploadRingbuffer, data, size, 0) != pdTRUE)
+    {
+        atomic_fetch_add(&fullCount, 1);
+        return 0;
+    }
+
+    atomic_fetch_add(&queuedByteCount, size);
+    updateMinFreeSize();
+    return 1;
+}
+
+int queueUploadMessage(uint32_t sessionId, const uint8_t* data, size_t size)
+{
+    UploadMessage message;
+    if (size > UPLOAD_MESSAGE_MAX_SIZE)
+    {
+        return 0;
+    }
+
+    memcpy(message.data, data, size);
+    message.type = UPLOAD_MESSAGE_TYPE_DATA;
+    message.sessionId = sessionId;
+    message.size = size;
+    return xQueueSend(uploadMessageQueue, &message, 0) == pdTRUE;
+}
+
+int queueRecordFetch(uint32_t sessionId, uint8_t recordId, uint32_t offset, uint32_t size)
+{
+    UploadMessage message;
+    message.type = UPLOAD_MESSAGE_TYPE_RECORD_FETCH;
+    message.sessionId = sessionId;
+    message.size = 0;
+    message.fetch.recordId = recordId;
+    message.fetch.offset = offset;
+    message.fetch.size = size;
+    return xQueueSend(uploadMessageQueue, &message, 0) == pdTRUE;
+}
+
+void setRecordSessionId(uint8_t recordId, uint32_t sessionId)
+{
+    recordSessionIds[recordId] = sessionId;
+}
+
+void setMeasurementSessionId(uint8_t measurementId, uint32_t sessionId)
+{
+    measurementSessionIds[measurementId] = sessionId;
+}
+
+void logUploadStatistics()
+{
+    ESP_LOGI(NETWORK_LOGGER_TAG, "Upload buffer: min free size = %u/%u, queued bytes = %u, full = %u, sent messages = %u, discarded messages = %u",
+        atomic_load(&minFreeSize),
+        (unsigned int)uploadBufferSize,
+        atomic_load(&queuedByteCount),
+        atomic_load(&fullCount),
+        atomic_load(&sentMessageCount),
+        atomic_load(&discardedMessageCount));
+}
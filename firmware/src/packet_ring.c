@@ -0,0 +1,103 @@
+#include "packet_ring.h"
+
+_Static_assert((PACKET_RING_CAPACITY & PACKET_RING_MASK) == 0, "The packet ring capacity must be a power of two");
+
+static void initializePacketRingSlot(PacketRingSlot* slot, size_t dataOffset)
+{
+    slot->data = slot->buffer + dataOffset;
+    slot->size = 0;
+    slot->headerId = 0;
+    slot->sequenceId = PACKET_RING_NO_SEQUENCE_ID;
+    slot->sentTimestamp = 0;
+}
+
+void initializePacketRing(PacketRing* ring, size_t dataOffset)
+{
+    for (size_t i = 0; i < PACKET_RING_CAPACITY; i++)
+    {
+        initializePacketRingSlot(&ring->slots[i], dataOffset);
+    }
+    initializePacketRingSlot(&ring->overflowSlot, dataOffset);
+
+    atomic_init(&ring->writeIndex, 0);
+    atomic_init(&ring->readIndex, 0);
+    atomic_init(&ring->releaseIndex, 0);
+    atomic_init(&ring->pushedPacketCount, 0);
+    atomic_init(&ring->droppedPacketCount, 0);
+    atomic_init(&ring->maxOccupancy, 0);
+}
+
+PacketRingSlot* acquirePacketRingSlot(PacketRing* ring)
+{
+    unsigned int writeIndex = atomic_load_explicit(&ring->writeIndex, memory_order_relaxed);
+    unsigned int releaseIndex = atomic_load_explicit(&ring->releaseIndex, memory_order_acquire);
+
+    if (writeIndex - releaseIndex >= PACKET_RING_CAPACITY)
+    {
+        return &ring->overflowSlot;
+    }
+    return &ring->slots[writeIndex & PACKET_RING_MASK];
+}
+
+void commitPacketRingSlot(PacketRing* ring, PacketRingSlot* slot, size_t size)
+{
+    if (slot == &ring->overflowSlot || size > CONFIG_STREAMING_PACKET_MAX_SIZE)
+    {
+        atomic_fetch_add_explicit(&ring->droppedPacketCount, 1, memory_order_relaxed);
+        return;
+    }
+
+    slot->size = size;
+
+    unsigned int writeIndex = atomic_load_explicit(&ring->writeIndex, memory_order_relaxed);
+    atomic_store_explicit(&ring->writeIndex, writeIndex + 1, memory_order_release);
+    atomic_fetch_add_explicit(&ring->pushedPacketCount, 1, memory_order_relaxed);
+
+    unsigned int occupancy = writeIndex + 1 - atomic_load_explicit(&ring->readIndex, memory_order_acquire);
+    if (occupancy > atomic_load_explicit(&ring->maxOccupancy, memory_order_relaxed))
+    {
+        atomic_store_explicit(&ring->maxOccupancy, occupancy, memory_order_relaxed);
+    }
+}
+
+PacketRingSlot* peekPacketRing(PacketRing* ring)
+{
+    unsigned int readIndex = atomic_load_explicit(&ring->readIndex, memory_order_relaxed);
+    unsigned int writeIndex = atomic_load_explicit(&ring->writeIndex, memory_order_acquire);
+
+    if (readIndex == writeIndex)
+    {
+        return NULL;
+    }
+    return &ring->slots[readIndex & PACKET_RING_MASK];
+}
+
+void popPacketRing(PacketRing* ring)
+{
+    unsigned int readIndex = atomic_load_explicit(&ring->readIndex, memory_order_relaxed);
+    atomic_store_explicit(&ring->readIndex, readIndex + 1, memory_order_release);
+}
+
+size_t getPacketRingOccupancy(PacketRing* ring)
+{
+    return atomic_load_explicit(&ring->writeIndex, memory_order_acquire) -
+        atomic_load_explicit(&ring->readIndex, memory_order_acquire);
+}
+
+size_t getPacketRingHistorySize(PacketRing* ring)
+{
+    return atomic_load_explicit(&ring->readIndex, memory_order_relaxed) -
+        atomic_load_explicit(&ring->releaseIndex, memory_order_relaxed);
+}
+
+PacketRingSlot* getPacketRingHistorySlot(PacketRing* ring, size_t index)
+{
+    unsigned int releaseIndex = atomic_load_explicit(&ring->releaseIndex, memory_order_relaxed);
+    return &ring->slots[(releaseIndex + index) & PACKET_RING_MASK];
+}
+
+void releasePacketRingSlot(PacketRing* ring)
+{
+    unsigned int releaseIndex = atomic_load_explicit(&ring->releaseIndex, memory_order_relaxed);
+    atomic_store_explicit(&ring->releaseIndex, releaseIndex + 1, memory_order_release);
+}
@@ -1,47 +1,111 @@
 #include "sound.h"
 #include "config.h"
 #include "network/communication.h"
+#include "network/streaming.h"
+#include "network/upload.h"
+#include "sound/channels.h"
+#include "sound/clock_plan.h"
+#include "sound/compression.h"
+#include "sound/decimator.h"
+#include "sound/fec.h"
+#include "sound/impulse_response.h"
+#include "sound/level_meter.h"
+#include "sound/record_schedule.h"
+#include "sound/resampler.h"
+#include "sound/sample_clock.h"
+#include "sound/sample_format.h"
+#include "sound/sample_history.h"
+#include "sound/spectrum.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 
 #include <driver/gpio.h>
 #include <driver/ledc.h>
 #include <driver/i2s.h>
 
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
 #define MS_IN_S_COUNT 1000
 #define US_IN_MS_COUNT 1000
+#define S_IN_MINUTE_COUNT 60
+#define S_IN_HOUR_COUNT 3600
+#define S_IN_DAY_COUNT 86400
 
-#define I2S_READ_DATA_SIZE 8
+#define I2S_CHANNEL_COUNT 2
+#define I2S_FRAME_SIZE (I2S_CHANNEL_COUNT * sizeof(int32_t))
+#define I2S_READ_DATA_SIZE (CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH * I2S_FRAME_SIZE)
 
 #define SOUND_DATA_MESSAGE_FULL_HEADER_SIZE 17
 #define SOUND_DATA_MESSAGE_PAYLOAD_HEADER_SIZE 9
-#define SOUND_DATA_MESSAGE_SIZE (SOUND_DATA_MESSAGE_FULL_HEADER_SIZE + CONFIG_SOUND_MESSAGE_SAMPLE_COUNT * sizeof(int32_t))
 #define SOUND_DATA_MESSAGE_ID 7
+#define COMPRESSED_SOUND_DATA_MESSAGE_ID 8
+#define DECIMATED_SOUND_DATA_MESSAGE_ID 16 // Same layout as the raw messages, at the sample frequency divided by the decimation factor
 #define SOUND_DATA_MESSAGE_CURRENT_PAYLOAD_SIZE_OFFSET 4
 #define SOUND_DATA_MESSAGE_CURRENT_ID_OFFSET 8
-#define SOUND_DATA_MESSAGE_CURRENT_HOUR_OFFSET 10
-#define SOUND_DATA_MESSAGE_CURRENT_MINUTE_OFFSET 11
-#define SOUND_DATA_MESSAGE_CURRENT_SECOND_OFFSET 12
-#define SOUND_DATA_MESSAGE_CURRENT_MS_OFFSET 13
-#define SOUND_DATA_MESSAGE_CURRENT_US_OFFSET 15
+#define SOUND_DATA_MESSAGE_CURRENT_TIMESTAMP_OFFSET 10
+
+#define TIMESTAMP_HOUR_OFFSET 0
+#define TIMESTAMP_MINUTE_OFFSET 1
+#define TIMESTAMP_SECOND_OFFSET 2
+#define TIMESTAMP_MS_OFFSET 3
+#define TIMESTAMP_US_OFFSET 5
+
+// Places the samples on a 32-bit boundary inside the cache-line-aligned packet buffers.
+#define SOUND_DATA_MESSAGE_DATA_OFFSET ((sizeof(int32_t) - SOUND_DATA_MESSAGE_FULL_HEADER_SIZE % sizeof(int32_t)) % sizeof(int32_t))
+
+_Static_assert(SOUND_DATA_MESSAGE_FULL_HEADER_SIZE + CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT * sizeof(int32_t) <= CONFIG_STREAMING_PACKET_MAX_SIZE,
+    "The sound data messages must fit in the streaming packets");
+
+_Static_assert(FEC_MESSAGE_HEADER_SIZE - FEC_PROTECTED_DATA_OFFSET + SOUND_DATA_MESSAGE_FULL_HEADER_SIZE +
+    CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT * sizeof(int32_t) <= CONFIG_STREAMING_PACKET_MAX_SIZE,
+    "The FEC messages must fit in the streaming packets");
 
+_Static_assert(CONFIG_SOUND_MESSAGE_SAMPLE_COUNT <= CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT &&
+    CONFIG_SOUND_HIGH_RATE_MESSAGE_SAMPLE_COUNT <= CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT,
+    "The message buffers are too small");
+
+_Static_assert(CONFIG_SOUND_MAX_CHANNEL_COUNT <= I2S_CHANNEL_COUNT, "The I2S frames do not contain enough channels");
+_Static_assert(I2S_CHANNEL_COUNT <= RESAMPLER_MAX_CHANNEL_COUNT, "The resampler does not support the I2S frames");
+_Static_assert(CONFIG_SOUND_CLOCK_MAX_ERROR_PPM <= CONFIG_SOUND_RESAMPLING_MAX_CORRECTION_PPM,
+    "The resampler cannot correct the clock plan error");
+_Static_assert(RESAMPLER_MAX_OUTPUT_FRAME_COUNT <= DECIMATOR_MAX_INPUT_FRAME_COUNT, "The decimator does not support the resampled blocks");
+
+#define RECORD_RESPONSE_ID 6
 #define RECORD_HEADER_SIZE 9
+#define RECORD_DATA_OFFSET 12 // The header is placed just before the aligned samples
 #define RECORD_PAYLOAD_SIZE_OFFSET 4
+#define RECORD_ID_OFFSET 8
 
-static const ledc_timer_config_t LEDC_TIMER_CONFIG =
-{
-    .speed_mode = LEDC_HIGH_SPEED_MODE,
-    .timer_num = LEDC_TIMER_0,
-    .duty_resolution = 2,
-    .freq_hz = 11289600
-};
- 
-static const ledc_channel_config_t LEDC_CHANNEL_CONFIG =
-{
-    .channel = LEDC_CHANNEL_0,
-    .gpio_num = CONFIG_SOUND_CLOCK_IO,
-    .speed_mode = LEDC_HIGH_SPEED_MODE,
-    .timer_sel = LEDC_TIMER_0,
-    .duty = 2
-};
+#define RECORD_STATUS_ID 9
+#define RECORD_STATUS_SIZE 10
+#define RECORD_STATUS_PAYLOAD_OFFSET 8
+#define RECORD_STATUS_OFFSET 9
+#define RECORD_STATUS_COMPLETE 0
+#define RECORD_STATUS_INCOMPLETE 1 // Some frames were missing from the history and are replaced by silence
+#define RECORD_MAX_MESSAGE_COUNT_PER_UPDATE 4 // Lets a record started in the past catch up with the capture
+#define RECORD_FRAME_DATA_SAMPLE_COUNT CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT
+
+#define IMPULSE_RESPONSE_READ_FRAME_COUNT CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH
+#define IMPULSE_RESPONSE_MAX_FRAME_COUNT_PER_UPDATE (4 * IMPULSE_RESPONSE_READ_FRAME_COUNT)
+
+#define SAMPLE_HISTORY_PSRAM_SAMPLE_COUNT \
+    ((size_t)CONFIG_SOUND_MAX_SAMPLE_FREQUENCY * CONFIG_SOUND_RECORD_HISTORY_DURATION_S * CONFIG_SOUND_MAX_CHANNEL_COUNT)
+#define SAMPLE_HISTORY_INTERNAL_SAMPLE_COUNT (CONFIG_SOUND_RECORD_HISTORY_INTERNAL_SIZE / sizeof(int32_t))
+
+#define PPM_IN_ONE_COUNT 1000000.0
+#define RESAMPLING_RATIO_GAIN 0.25
+
+_Static_assert(SAMPLE_HISTORY_INTERNAL_SAMPLE_COUNT >= 2 * CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT, "The sample history is too small");
+
+// The buffers allocated at startup, in the PSRAM when it is available and in the internal RAM otherwise.
+_Static_assert(CONFIG_UPLOAD_BUFFER_SIZE + CONFIG_UPLOAD_RECORD_CACHE_SIZE + CONFIG_SOUND_RECORD_HISTORY_INTERNAL_SIZE +
+    IMPULSE_RESPONSE_BUFFER_SIZE <= CONFIG_INTERNAL_RAM_BUDGET, "The startup buffers exceed the internal RAM budget");
+_Static_assert(CONFIG_UPLOAD_PSRAM_BUFFER_SIZE + CONFIG_UPLOAD_RECORD_PSRAM_CACHE_SIZE +
+    SAMPLE_HISTORY_PSRAM_SAMPLE_COUNT * sizeof(int32_t) + IMPULSE_RESPONSE_BUFFER_SIZE <= CONFIG_PSRAM_BUDGET,
+    "The startup buffers exceed the PSRAM budget");
 
 static const gpio_config_t ADC_IO_CONFIG =
 {
@@ -60,8 +124,8 @@ static const i2s_config_t I2S_CONFIG =
      .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
      .communication_format = I2S_COMM_FORMAT_I2S | I2S_COMM_FORMAT_I2S_MSB,
      .intr_alloc_flags = 0,
-     .dma_buf_count = 8,
-     .dma_buf_len = 64,
+     .dma_buf_count = CONFIG_SOUND_I2S_DMA_BUFFER_COUNT,
+     .dma_buf_len = CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH,
      .use_apll = 0
 };
 
@@ -73,23 +137,105 @@ static const i2s_pin_config_t I2S_PIN_CONFIG =
     .data_in_num = 36
 };
 
-static uint8_t soundDataMessageData[SOUND_DATA_MESSAGE_SIZE];
-static int32_t* soundDataSampleData;
-static size_t currentSoundDataSampleDataIndex = 0;
+static QueueHandle_t configurationQueue;
+static QueueHandle_t spectrumConfigurationQueue;
+static QueueHandle_t levelMeterConfigurationQueue;
+static QueueHandle_t impulseResponseQueue;
+static portMUX_TYPE recordScheduleMux = portMUX_INITIALIZER_UNLOCKED;
+static SoundConfiguration configuration =
+{
+    .sampleFrequency = CONFIG_SOUND_SAMPLE_FREQUENCY,
+    .sampleFormat = CONFIG_SOUND_SAMPLE_FORMAT,
+    .streamMode = SOUND_STREAM_MODE_RAW,
+    .channelCount = 1,
+    .fecGroupSize = 0,
+    .decimationFactor = 1
+};
+static size_t sampleSize = SAMPLE_FORMAT_SIGNED_32_SIZE;
+static size_t messageSampleCount = CONFIG_SOUND_MESSAGE_SAMPLE_COUNT;
+static size_t messageFrameCount = CONFIG_SOUND_MESSAGE_SAMPLE_COUNT;
+
+static PacketRingSlot* soundDataMessageSlot;
+static uint32_t soundDataMessageHeaderId = 1;
+static uint8_t* soundDataSampleData;
+static size_t currentSoundDataFrameIndex = 0;
+static int32_t blockSampleData[CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT];
+static int32_t channelSampleData[CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT];
+
+static int isSampleHistoryEnabled = 0; // The records and the impulse responses read the history
+// The active records read the same captured frames from the history, each one builds its own messages.
+typedef struct
+{
+    int isEnabled;
+    int isIncomplete;
+    int isAborted;
+    int isStatusQueued;
+    uint8_t id;
+
+    uint32_t sampleFormat;
+    size_t sampleSize;
+    size_t channelCount;
+    size_t messageFrameCount;
+    uint64_t frameIndex;
+    size_t currentFrameIndex;
+    size_t recordedFrameCount;
+    size_t frameCountToBeRecorded;
+
+    const uint8_t* pendingData;
+    size_t pendingDataSize;
+    uint8_t messageData[RECORD_DATA_OFFSET + CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT * sizeof(int32_t)] __attribute__((aligned(4)));
+    uint8_t statusData[RECORD_STATUS_SIZE] __attribute__((aligned(4)));
+} Record;
 
-static volatile int isRecordEnabled = 0;
-static volatile int isRecordPending = 0;
-static volatile int recordHour = 0;
-static volatile int recordMinute = 0;
-static volatile int recordSecond = 0;
-static volatile int recordMs = 0;
-static volatile uint8_t recordId = 0;
+static Record records[CONFIG_SOUND_MAX_ACTIVE_RECORD_COUNT];
+static int32_t recordFrameData[RECORD_FRAME_DATA_SAMPLE_COUNT];
 
-static int32_t recordedSampleData[CONFIG_SOUND_MESSAGE_SAMPLE_COUNT];
-static size_t currentRecordSampleDataIndex = 0;
-static size_t recordedSampleCount = 0;
-static size_t sampleCountToBeRecorded = 0;
+static uint64_t currentSampleIndex = 0;
+static uint64_t streamSampleIndex = 0; // Captured frame index of the next streamed frame, before the decimator delay
 
+static int32_t i2sData[CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH * I2S_CHANNEL_COUNT];
+static int32_t frameData[RESAMPLER_MAX_OUTPUT_FRAME_COUNT * CONFIG_SOUND_MAX_CHANNEL_COUNT];
+
+static Resampler resampler;
+static double resamplingRatio = 1.0; // ADC frames per streamed frame
+static int isResamplingEnabled = CONFIG_SOUND_RESAMPLING_ENABLED;
+static int32_t resampledI2sData[RESAMPLER_MAX_OUTPUT_FRAME_COUNT * I2S_CHANNEL_COUNT];
+
+static SpectrumConfiguration spectrumConfiguration;
+static int isSpectrumMessagePending = 0;
+
+static LevelMeterConfiguration levelMeterConfiguration;
+static int isLevelMeterMessagePending = 0;
+
+typedef struct
+{
+    ImpulseResponseRequest request;
+    int64_t startSampleIndex;
+} ImpulseResponseMeasurement;
+
+static int isImpulseResponseEnabled = 0; // The buffers may not fit in the internal RAM
+static size_t impulseResponseChannelCount;
+static int32_t impulseResponseFrameData[IMPULSE_RESPONSE_READ_FRAME_COUNT * CONFIG_SOUND_MAX_CHANNEL_COUNT];
+
+static Decimator decimator;
+static int32_t decimatedFrameData[(RESAMPLER_MAX_OUTPUT_FRAME_COUNT / 2 + 1) * CONFIG_SOUND_MAX_CHANNEL_COUNT];
+
+// The ADC must be powered down.
+static void setAdcRateGroup(uint32_t sampleFrequency)
+{
+    if (sampleFrequency <= CONFIG_SOUND_ADC_SINGLE_SPEED_MAX_SAMPLE_FREQUENCY)
+    {
+        ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_MODE0, CONFIG_SOUND_ADC_SINGLE_SPEED_MODE0));
+        ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_MODE1, CONFIG_SOUND_ADC_SINGLE_SPEED_MODE1));
+        ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_OSR, CONFIG_SOUND_ADC_SINGLE_SPEED_OSR));
+    }
+    else
+    {
+        ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_MODE0, CONFIG_SOUND_ADC_DOUBLE_SPEED_MODE0));
+        ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_MODE1, CONFIG_SOUND_ADC_DOUBLE_SPEED_MODE1));
+        ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_OSR, CONFIG_SOUND_ADC_DOUBLE_SPEED_OSR));
+    }
+}
 
 static void initAdc()
 {
@@ -97,141 +243,780 @@ static void initAdc()
 
     ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_PDWN, 0));
 
-    // Set MODE to master 256 fs
-    ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_MODE0, 1));
-    ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_MODE1, 1));
+    setAdcRateGroup(CONFIG_SOUND_SAMPLE_FREQUENCY);
 
     // Set format to I2S
     ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_FMT0, 1));
     ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_FMT1, 0));
     
-    ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_OSR, 0)); // Set OSR to x64
     ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_BYPASS, 0)); // Set BYPAS to normal mode (HPF activated)
 }
 
-static void initializeSoundDataMessageHeader()
+static int isCompressionEnabled()
 {
-    *(uint32_t*)soundDataMessageData = htonl(SOUND_DATA_MESSAGE_ID);
-    *(uint32_t*)(soundDataMessageData + SOUND_DATA_MESSAGE_CURRENT_PAYLOAD_SIZE_OFFSET) =
-        htonl(SOUND_DATA_MESSAGE_PAYLOAD_HEADER_SIZE + CONFIG_SOUND_MESSAGE_SAMPLE_COUNT * sizeof(int32_t));
-    
-    soundDataSampleData = (int32_t*)(soundDataMessageData + SOUND_DATA_MESSAGE_FULL_HEADER_SIZE);
+    return configuration.streamMode == SOUND_STREAM_MODE_COMPRESSED;
+}
+
+static int isStreamEnabled()
+{
+    return configuration.streamMode != SOUND_STREAM_MODE_NONE;
 }
 
-static void updateSoundDataMessageIdAndTimestamp()
+static int isDecimationEnabled()
+{
+    return configuration.decimationFactor > 1;
+}
+
+static uint32_t getSoundDataMessageId()
+{
+    if (isCompressionEnabled())
+    {
+        return COMPRESSED_SOUND_DATA_MESSAGE_ID;
+    }
+    return isDecimationEnabled() ? DECIMATED_SOUND_DATA_MESSAGE_ID : SOUND_DATA_MESSAGE_ID;
+}
+
+// The constant header fields are only stamped when the buffer holds the template of a previous configuration.
+// The payload size of the compressed messages is written when they are committed.
+static void stampSoundDataMessageHeader(PacketRingSlot* slot)
+{
+    if (slot->headerId != soundDataMessageHeaderId)
+    {
+        *(uint32_t*)slot->data = htonl(getSoundDataMessageId());
+        *(uint32_t*)(slot->data + SOUND_DATA_MESSAGE_CURRENT_PAYLOAD_SIZE_OFFSET) =
+            htonl(SOUND_DATA_MESSAGE_PAYLOAD_HEADER_SIZE + messageSampleCount * sampleSize);
+        slot->headerId = soundDataMessageHeaderId;
+    }
+}
+
+static void setMasterClock(const ClockPlan* plan)
+{
+    // ledc_timer_config truncates the divider, the plan rounds it to the nearest value.
+    ESP_ERROR_CHECK(ledc_timer_set(LEDC_HIGH_SPEED_MODE,
+        LEDC_TIMER_0,
+        plan->ledcClockDivider,
+        plan->ledcDutyResolution,
+        LEDC_APB_CLK));
+    ESP_ERROR_CHECK(ledc_set_duty(LEDC_HIGH_SPEED_MODE, LEDC_CHANNEL_0, plan->ledcDuty));
+    ESP_ERROR_CHECK(ledc_update_duty(LEDC_HIGH_SPEED_MODE, LEDC_CHANNEL_0));
+
+    ESP_LOGI(SOUND_LOGGER_TAG, "Master clock: %u Hz, actual = %.1f Hz (%+.1f ppm)",
+        plan->mclkFrequency,
+        plan->actualMclkFrequency,
+        plan->errorPpm);
+}
+
+static void initializeMasterClock(const ClockPlan* plan)
+{
+    ledc_timer_config_t timerConfig =
+    {
+        .speed_mode = LEDC_HIGH_SPEED_MODE,
+        .timer_num = LEDC_TIMER_0,
+        .duty_resolution = plan->ledcDutyResolution,
+        .freq_hz = plan->mclkFrequency
+    };
+    ledc_channel_config_t channelConfig =
+    {
+        .channel = LEDC_CHANNEL_0,
+        .gpio_num = CONFIG_SOUND_CLOCK_IO,
+        .speed_mode = LEDC_HIGH_SPEED_MODE,
+        .timer_sel = LEDC_TIMER_0,
+        .duty = plan->ledcDuty
+    };
+
+    ESP_ERROR_CHECK(ledc_timer_config(&timerConfig));
+    ESP_ERROR_CHECK(ledc_channel_config(&channelConfig));
+    setMasterClock(plan);
+}
+
+// The resampler corrects the clock plan error when it is too large, starting from the known error.
+static void resetResampling(const ClockPlan* plan)
+{
+    isResamplingEnabled = CONFIG_SOUND_RESAMPLING_ENABLED ||
+        fabs(plan->errorPpm) > CONFIG_SOUND_CLOCK_MAX_UNCORRECTED_ERROR_PPM;
+    initializeResampler(&resampler, I2S_CHANNEL_COUNT);
+    resamplingRatio = isResamplingEnabled ? plan->actualMclkFrequency / plan->mclkFrequency : 1.0;
+    setResamplerRatio(&resampler, resamplingRatio);
+}
+
+// The ADC is powered down while its master clock and rate group change, it restarts its digital filter on power up.
+// The history and the sample clock restart at the new frequency from the next frame.
+static void updateSampleFrequency(uint32_t sampleFrequency)
+{
+    ClockPlan plan;
+    if (!computeClockPlan(sampleFrequency, CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY, CONFIG_SOUND_CLOCK_MAX_ERROR_PPM, &plan))
+    {
+        ESP_LOGE(SOUND_LOGGER_TAG, "No clock plan for %u Hz", sampleFrequency);
+        return;
+    }
+
+    ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_PDWN, 0));
+    setAdcRateGroup(sampleFrequency);
+    setMasterClock(&plan);
+    ESP_ERROR_CHECK(i2s_set_sample_rates(CONFIG_SOUND_I2S_PORT_NUMBER, sampleFrequency));
+    ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_PDWN, 1));
+
+    resetSampleClock(sampleFrequency, currentSampleIndex);
+    resetSampleHistory(currentSampleIndex, configuration.channelCount);
+    resetResampling(&plan);
+}
+
+// The messages are larger at the high sample frequencies, so the message rate stays reasonable.
+static size_t getMessageSampleCount(uint32_t sampleFrequency)
+{
+    return sampleFrequency > CONFIG_SOUND_HIGH_RATE_SAMPLE_FREQUENCY ?
+        CONFIG_SOUND_HIGH_RATE_MESSAGE_SAMPLE_COUNT :
+        CONFIG_SOUND_MESSAGE_SAMPLE_COUNT;
+}
+
+static void updateConfiguration()
+{
+    SoundConfiguration requestedConfiguration;
+    if (xQueueReceive(configurationQueue, &requestedConfiguration, 0) == pdTRUE)
+    {
+        uint32_t previousSampleFrequency = configuration.sampleFrequency;
+
+        configuration = requestedConfiguration;
+        sampleSize = getSampleSize(configuration.sampleFormat);
+        messageSampleCount = getMessageSampleCount(configuration.sampleFrequency);
+        messageFrameCount = messageSampleCount / configuration.channelCount;
+        soundDataMessageHeaderId++;
+        resetFec(configuration.fecGroupSize);
+        initializeDecimator(&decimator, configuration.decimationFactor, configuration.channelCount);
+        streamSampleIndex = currentSampleIndex;
+        if (configuration.sampleFrequency != previousSampleFrequency)
+        {
+            updateSampleFrequency(configuration.sampleFrequency);
+        }
+        else if (configuration.channelCount != getSampleHistoryChannelCount())
+        {
+            resetSampleHistory(currentSampleIndex, configuration.channelCount);
+        }
+        ESP_LOGI(SOUND_LOGGER_TAG, "Sample frequency: %u, sample format: %u, stream mode: %u, channel count: %u, FEC group size: %u, "
+            "decimation factor: %u",
+            configuration.sampleFrequency,
+            configuration.sampleFormat,
+            configuration.streamMode,
+            configuration.channelCount,
+            configuration.fecGroupSize,
+            configuration.decimationFactor);
+    }
+}
+
+// The time zone is UTC, so the time of day is derived without localtime_r.
+static void writeTimestamp(uint8_t* timestamp, int64_t sampleIndex)
+{
+    int64_t timeUs = convertSampleIndexToTime(sampleIndex);
+    uint32_t secondOfDay = (uint32_t)((timeUs / US_IN_S_COUNT) % S_IN_DAY_COUNT);
+    uint32_t us = (uint32_t)(timeUs % US_IN_S_COUNT);
+
+    timestamp[TIMESTAMP_HOUR_OFFSET] = (uint8_t)(secondOfDay / S_IN_HOUR_COUNT);
+    timestamp[TIMESTAMP_MINUTE_OFFSET] = (uint8_t)(secondOfDay / S_IN_MINUTE_COUNT % S_IN_MINUTE_COUNT);
+    timestamp[TIMESTAMP_SECOND_OFFSET] = (uint8_t)(secondOfDay % S_IN_MINUTE_COUNT);
+    *(uint16_t*)(timestamp + TIMESTAMP_MS_OFFSET) = htons(us / US_IN_MS_COUNT);
+    *(uint16_t*)(timestamp + TIMESTAMP_US_OFFSET) = htons(us % US_IN_MS_COUNT);
+}
+
+// The id also identifies the packet in the retransmission history.
+static void updateSoundDataMessageIdAndTimestamp(PacketRingSlot* slot)
 {
     static uint16_t currentId = 0;
-    
-    *(uint16_t*)(soundDataMessageData + SOUND_DATA_MESSAGE_CURRENT_ID_OFFSET) = htons(currentId);
+    uint8_t* soundDataMessageData = slot->data;
 
-    struct timeval tv;
-    struct tm timeinfo;
-    gettimeofday(&tv, NULL);
-    localtime_r(&tv.tv_sec, &timeinfo);
+    *(uint16_t*)(soundDataMessageData + SOUND_DATA_MESSAGE_CURRENT_ID_OFFSET) = htons(currentId);
+    slot->sequenceId = currentId;
 
-    soundDataMessageData[SOUND_DATA_MESSAGE_CURRENT_HOUR_OFFSET] = (uint8_t)timeinfo.tm_hour;
-    soundDataMessageData[SOUND_DATA_MESSAGE_CURRENT_MINUTE_OFFSET] = (uint8_t)timeinfo.tm_min;
-    soundDataMessageData[SOUND_DATA_MESSAGE_CURRENT_SECOND_OFFSET] = (uint8_t)timeinfo.tm_sec;
-    *(uint16_t*)(soundDataMessageData + SOUND_DATA_MESSAGE_CURRENT_MS_OFFSET) = htons(tv.tv_usec / US_IN_MS_COUNT);
-    *(uint16_t*)(soundDataMessageData + SOUND_DATA_MESSAGE_CURRENT_US_OFFSET) = htons(tv.tv_usec % US_IN_MS_COUNT);
+    // The timestamp is the capture time of the first sample of the message, the decimated frames are late by the filter delay.
+    writeTimestamp(soundDataMessageData + SOUND_DATA_MESSAGE_CURRENT_TIMESTAMP_OFFSET,
+        (int64_t)streamSampleIndex - (int64_t)getDecimatorDelay(&decimator));
 
     currentId++;
 }
 
-static void updateSoundDataMessage(int32_t sampleValue)
+static void acquireSoundDataMessage()
 {
-    soundDataSampleData[currentSoundDataSampleDataIndex] = sampleValue;
+    updateConfiguration();
 
-    currentSoundDataSampleDataIndex++;
+    soundDataMessageSlot = acquireStreamingPacket();
+    stampSoundDataMessageHeader(soundDataMessageSlot);
+    soundDataSampleData = soundDataMessageSlot->data + SOUND_DATA_MESSAGE_FULL_HEADER_SIZE;
+    currentSoundDataFrameIndex = 0;
 
-    if (currentSoundDataSampleDataIndex == CONFIG_SOUND_MESSAGE_SAMPLE_COUNT)
+    updateSoundDataMessageIdAndTimestamp(soundDataMessageSlot);
+}
+
+// Each channel is compressed as a separate block, the blocks follow each other in channel order.
+static size_t compressSoundDataSamples()
+{
+    size_t compressedSize = 0;
+    size_t capacity = CONFIG_STREAMING_PACKET_MAX_SIZE - SOUND_DATA_MESSAGE_FULL_HEADER_SIZE;
+
+    deinterleaveFrames(blockSampleData, messageFrameCount, configuration.channelCount, channelSampleData);
+    for (size_t channel = 0; channel < configuration.channelCount; channel++)
     {
-        sendUdp(soundDataMessageData, SOUND_DATA_MESSAGE_SIZE);
-        updateSoundDataMessageIdAndTimestamp();
-        currentSoundDataSampleDataIndex = 0;
+        compressedSize += compressSamples(channelSampleData + channel * messageFrameCount,
+            messageFrameCount,
+            soundDataSampleData + compressedSize,
+            capacity - compressedSize);
     }
+    return compressedSize;
 }
 
-static void sendRecordHeader()
+// The FEC messages are not retransmitted and their slot must be stamped again before holding a sound data message.
+static void sendFecMessage()
 {
-    uint8_t buffer[RECORD_HEADER_SIZE] =
+    PacketRingSlot* slot = acquireStreamingPacket();
+    size_t size = writeFecMessage(slot->data);
+    slot->headerId = 0;
+    slot->sequenceId = PACKET_RING_NO_SEQUENCE_ID;
+    commitStreamingPacket(slot, size);
+}
+
+// Without stream, the message is built but never committed, so its slot is reused.
+static void commitSoundDataMessage()
+{
+    if (!isStreamEnabled())
     {
-        0, 0, 0, 6,
-        0, 0, 0, 0,
-        recordId
-    };
-    *(uint32_t*)(buffer + RECORD_PAYLOAD_SIZE_OFFSET) =
-        htonl(sampleCountToBeRecorded * sizeof(int32_t) + 1);
-    sendTcp(buffer, RECORD_HEADER_SIZE);
+        return;
+    }
+
+    size_t payloadSize = messageSampleCount * sampleSize;
+    if (isCompressionEnabled())
+    {
+        payloadSize = compressSoundDataSamples();
+        *(uint32_t*)(soundDataMessageSlot->data + SOUND_DATA_MESSAGE_CURRENT_PAYLOAD_SIZE_OFFSET) =
+            htonl(SOUND_DATA_MESSAGE_PAYLOAD_HEADER_SIZE + payloadSize);
+    }
+
+    // A message dropped by the streaming ring is still protected, so the receiver can rebuild it.
+    size_t size = SOUND_DATA_MESSAGE_FULL_HEADER_SIZE + payloadSize;
+    int isFecGroupComplete = addFecPacket(soundDataMessageSlot->data, size, soundDataMessageSlot->sequenceId);
+    commitStreamingPacket(soundDataMessageSlot, size);
+
+    if (isFecGroupComplete)
+    {
+        sendFecMessage();
+    }
+}
+
+static void setPendingRecordData(Record* record, const uint8_t* data, size_t size)
+{
+    record->pendingData = data;
+    record->pendingDataSize = size;
+}
+
+// The record data is queued without blocking, it is retried at the next update if the upload buffer is full.
+static int flushPendingRecordData(Record* record)
+{
+    if (record->pendingDataSize > 0 && !queueUploadData(record->pendingData, record->pendingDataSize))
+    {
+        return 0;
+    }
+    record->pendingDataSize = 0;
+    return 1;
+}
+
+// A record is uploaded as several record response messages of at most one sound message and its status message,
+// so the upload task can send the small messages between them.
+static void queueRecordMessage(Record* record, size_t dataSize)
+{
+    uint8_t* header = record->messageData + RECORD_DATA_OFFSET - RECORD_HEADER_SIZE;
+    uint32_t id = htonl(RECORD_RESPONSE_ID);
+    uint32_t payloadSize = htonl(dataSize + 1);
+    memcpy(header, &id, sizeof(id));
+    memcpy(header + RECORD_PAYLOAD_SIZE_OFFSET, &payloadSize, sizeof(payloadSize));
+    header[RECORD_ID_OFFSET] = record->id;
+    setPendingRecordData(record, header, RECORD_HEADER_SIZE + dataSize);
+}
+
+static void queueRecordStatus(Record* record)
+{
+    *(uint32_t*)record->statusData = htonl(RECORD_STATUS_ID);
+    *(uint32_t*)(record->statusData + RECORD_PAYLOAD_SIZE_OFFSET) = htonl(RECORD_STATUS_SIZE - RECORD_STATUS_PAYLOAD_OFFSET);
+    record->statusData[RECORD_ID_OFFSET] = record->id;
+    record->statusData[RECORD_STATUS_OFFSET] = record->isIncomplete ? RECORD_STATUS_INCOMPLETE : RECORD_STATUS_COMPLETE;
+    setPendingRecordData(record, record->statusData, RECORD_STATUS_SIZE);
+}
+
+static void startRecord(Record* record, const RecordRequest* request, uint64_t startFrameIndex, int isStartMissing)
+{
+    record->isEnabled = 1;
+    record->isIncomplete = isStartMissing;
+    record->isAborted = 0;
+    record->isStatusQueued = 0;
+    record->id = request->recordId;
+    record->frameCountToBeRecorded = request->frameCount;
+    record->sampleFormat = configuration.sampleFormat;
+    record->sampleSize = sampleSize;
+    record->channelCount = configuration.channelCount;
+    record->messageFrameCount = messageFrameCount;
+    record->frameIndex = startFrameIndex;
+    record->currentFrameIndex = 0;
+    record->recordedFrameCount = 0;
+    record->pendingDataSize = 0;
+    ESP_LOGI(SOUND_LOGGER_TAG, "Record %u started", record->id);
 }
 
-static void updateRecordPending()
+// The status message follows the record data, the record is finished once it is queued.
+static void finishRecord(Record* record)
 {
-    if (isRecordPending)
+    if (!record->isStatusQueued)
+    {
+        queueRecordStatus(record);
+        record->isStatusQueued = 1;
+    }
+    else
     {
-        struct timeval tv;
-        struct tm timeinfo;
-        gettimeofday(&tv, NULL);
-        localtime_r(&tv.tv_sec, &timeinfo);
+        record->isEnabled = 0;
+        ESP_LOGI(SOUND_LOGGER_TAG, "Record %u finished, status: %u", record->id, record->isIncomplete);
+    }
+}
+
+// The remaining frames of an aborted record are uploaded as silence without waiting for the capture,
+// so the record keeps its requested length.
+static void abortRecord(Record* record)
+{
+    ESP_LOGW(SOUND_LOGGER_TAG, "The channel count changed during record %u, the record is aborted", record->id);
+    record->isAborted = 1;
+    record->isIncomplete = 1;
+}
 
-        if (timeinfo.tm_hour >= recordHour &&
-            timeinfo.tm_min >= recordMinute &&
-            timeinfo.tm_sec >= recordSecond &&
-            (tv.tv_usec / US_IN_MS_COUNT) >= recordMs)
+// The recorded frames are read from the sample history, so a record can start before the current sample.
+static void readRecordFrames(Record* record, size_t frameCount)
+{
+    if (record->isAborted || !readSampleHistory(record->frameIndex, frameCount, record->channelCount, recordFrameData))
+    {
+        // The missing frames are replaced by silence, so the following frames keep their position.
+        if (!record->isIncomplete)
         {
-            isRecordPending = 0;
-            isRecordEnabled = 1;
-            currentRecordSampleDataIndex = 0;
-            recordedSampleCount = 0;
-            sendRecordHeader();
-            ESP_LOGI(SOUND_LOGGER_TAG, "Record started");
+            ESP_LOGW(SOUND_LOGGER_TAG, "The frames of record %u are no longer in the history", record->id);
         }
+        record->isIncomplete = 1;
+        memset(recordFrameData, 0, frameCount * record->channelCount * sizeof(int32_t));
     }
+    record->frameIndex += frameCount;
 }
 
-static void updateRecordEnabled(int32_t sampleValue)
+static void updateRecord(Record* record)
 {
-    if (isRecordEnabled)
+    uint64_t historyEndIndex = getSampleHistoryEndIndex();
+    uint8_t* recordedSampleData = record->messageData + RECORD_DATA_OFFSET;
+    size_t queuedMessageCount = 0;
+
+    if (record->isEnabled && !record->isAborted && getSampleHistoryChannelCount() != record->channelCount)
     {
-        recordedSampleData[currentRecordSampleDataIndex] = sampleValue;
+        abortRecord(record);
+    }
 
-        currentRecordSampleDataIndex++;
-        recordedSampleCount++;
+    while (record->isEnabled && flushPendingRecordData(record))
+    {
+        if (record->recordedFrameCount == record->frameCountToBeRecorded)
+        {
+            finishRecord(record);
+            continue;
+        }
+        if ((!record->isAborted && record->frameIndex >= historyEndIndex) ||
+            queuedMessageCount == RECORD_MAX_MESSAGE_COUNT_PER_UPDATE)
+        {
+            break;
+        }
 
-        if (currentRecordSampleDataIndex == CONFIG_SOUND_MESSAGE_SAMPLE_COUNT)
+        size_t copiedFrameCount = record->messageFrameCount - record->currentFrameIndex;
+        if (!record->isAborted && copiedFrameCount > historyEndIndex - record->frameIndex)
         {
-            sendTcp((uint8_t*)recordedSampleData, CONFIG_SOUND_MESSAGE_SAMPLE_COUNT * sizeof(int32_t));
-            currentRecordSampleDataIndex = 0;
+            copiedFrameCount = historyEndIndex - record->frameIndex;
+        }
+        if (copiedFrameCount > record->frameCountToBeRecorded - record->recordedFrameCount)
+        {
+            copiedFrameCount = record->frameCountToBeRecorded - record->recordedFrameCount;
+        }
+        if (copiedFrameCount > RECORD_FRAME_DATA_SAMPLE_COUNT / record->channelCount)
+        {
+            copiedFrameCount = RECORD_FRAME_DATA_SAMPLE_COUNT / record->channelCount;
         }
 
-        if (recordedSampleCount == sampleCountToBeRecorded)
+        size_t frameSize = record->channelCount * record->sampleSize;
+        readRecordFrames(record, copiedFrameCount);
+        writeSamples(record->sampleFormat,
+            recordFrameData,
+            copiedFrameCount * record->channelCount,
+            recordedSampleData + record->currentFrameIndex * frameSize);
+        record->currentFrameIndex += copiedFrameCount;
+        record->recordedFrameCount += copiedFrameCount;
+
+        if (record->currentFrameIndex == record->messageFrameCount ||
+            record->recordedFrameCount == record->frameCountToBeRecorded)
         {
-            sendTcp((uint8_t*)recordedSampleData, currentRecordSampleDataIndex * sizeof(int32_t));
-            isRecordEnabled = 0;
+            queueRecordMessage(record, record->currentFrameIndex * frameSize);
+            record->currentFrameIndex = 0;
+            queuedMessageCount++;
         }
     }
 }
 
-static void updateRecordMessage(int32_t sampleValue)
+static Record* findFreeRecord()
 {
-    updateRecordPending();
-    updateRecordEnabled(sampleValue);
+    for (size_t i = 0; i < CONFIG_SOUND_MAX_ACTIVE_RECORD_COUNT; i++)
+    {
+        if (!records[i].isEnabled)
+        {
+            return &records[i];
+        }
+    }
+    return NULL;
+}
+
+// Overlapping records are uploaded at the same time, so their start is still in the history when they are due.
+// A record due while every record is active waits for a free one, its frames older than the history are missing
+// and it is reported as incomplete.
+static void updateRecordMessage()
+{
+    RecordRequest request;
+    Record* record;
+    while ((record = findFreeRecord()) != NULL)
+    {
+        portENTER_CRITICAL(&recordScheduleMux);
+        int isRecordDue = popDueRecord(getSampleHistoryEndIndex(), &request);
+        portEXIT_CRITICAL(&recordScheduleMux);
+        if (!isRecordDue)
+        {
+            break;
+        }
+
+        int64_t startFrameIndex = request.startSampleIndex;
+        int64_t historyBeginIndex = getSampleHistoryBeginIndex();
+        if (startFrameIndex < historyBeginIndex)
+        {
+            ESP_LOGW(SOUND_LOGGER_TAG, "The start of record %u is older than the history, %lld frames are missing",
+                request.recordId, historyBeginIndex - startFrameIndex);
+            startFrameIndex = historyBeginIndex;
+        }
+        startRecord(record, &request, startFrameIndex, startFrameIndex != request.startSampleIndex);
+    }
+
+    for (size_t i = 0; i < CONFIG_SOUND_MAX_ACTIVE_RECORD_COUNT; i++)
+    {
+        updateRecord(&records[i]);
+    }
+}
+
+// The 32-bit samples are extracted straight into the packet that will be sent.
+// The compressed messages are encoded from a block of frames when they are complete.
+static int32_t* writeSoundDataFrames(const int32_t* sourceFrames, size_t frameCount, size_t sourceChannelCount)
+{
+    size_t sampleIndex = currentSoundDataFrameIndex * configuration.channelCount;
+    int32_t* frames = frameData;
+
+    if (isCompressionEnabled())
+    {
+        frames = blockSampleData + sampleIndex;
+    }
+    else if (configuration.sampleFormat == CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32)
+    {
+        frames = (int32_t*)(soundDataSampleData + sampleIndex * sampleSize);
+    }
+
+    extractChannels(sourceFrames, frameCount, sourceChannelCount, configuration.channelCount, frames);
+
+    if (!isCompressionEnabled() && configuration.sampleFormat == CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24)
+    {
+        packSamples24(frames, frameCount * configuration.channelCount, soundDataSampleData + sampleIndex * sampleSize);
+    }
+    return frames;
+}
+
+static void sendSpectrumMessage()
+{
+    PacketRingSlot* slot = acquireStreamingPacket();
+    size_t size = writeSpectrumMessage(slot->data);
+    writeTimestamp(slot->data + SPECTRUM_MESSAGE_TIMESTAMP_OFFSET, getSpectrumMessageSampleIndex());
+    slot->headerId = 0;
+    slot->sequenceId = PACKET_RING_NO_SEQUENCE_ID;
+    commitStreamingPacket(slot, size);
+}
+
+static void sendLevelMeterMessage()
+{
+    PacketRingSlot* slot = acquireStreamingPacket();
+    size_t size = writeLevelMeterMessage(slot->data);
+    writeTimestamp(slot->data + LEVEL_METER_MESSAGE_TIMESTAMP_OFFSET, getLevelMeterMessageSampleIndex());
+    slot->headerId = 0;
+    slot->sequenceId = PACKET_RING_NO_SEQUENCE_ID;
+    commitStreamingPacket(slot, size);
+}
+
+// The streaming ring has one producer slot, so the analysis messages wait for the sound data message boundaries.
+static void sendAnalysisMessages()
+{
+    if (isSpectrumMessagePending)
+    {
+        sendSpectrumMessage();
+        isSpectrumMessagePending = 0;
+    }
+    if (isLevelMeterMessagePending)
+    {
+        sendLevelMeterMessage();
+        isLevelMeterMessagePending = 0;
+    }
+}
+
+static void startNextImpulseResponse()
+{
+    ImpulseResponseMeasurement measurement;
+    if (xQueueReceive(impulseResponseQueue, &measurement, 0) == pdTRUE)
+    {
+        impulseResponseChannelCount = getSampleHistoryChannelCount();
+        startImpulseResponse(&measurement.request,
+            configuration.sampleFrequency,
+            impulseResponseChannelCount,
+            measurement.startSampleIndex);
+        ESP_LOGI(SOUND_LOGGER_TAG, "Impulse response %u started", measurement.request.measurementId);
+    }
+}
+
+// The frames are read from the history like the records, so a measurement can start before its request.
+// A configuration change resets the history, so the measurement fails with the missing frames.
+static void updateImpulseResponseFrames()
+{
+    int64_t historyEndIndex = getSampleHistoryEndIndex();
+    size_t addedFrameCount = 0;
+
+    while (isImpulseResponseActive() && !isImpulseResponseFinished() &&
+        addedFrameCount < IMPULSE_RESPONSE_MAX_FRAME_COUNT_PER_UPDATE)
+    {
+        int64_t frameIndex = getImpulseResponseFrameIndex();
+        if (frameIndex >= historyEndIndex)
+        {
+            break;
+        }
+
+        size_t frameCount = getImpulseResponseRemainingFrameCount();
+        if (frameCount > IMPULSE_RESPONSE_READ_FRAME_COUNT)
+        {
+            frameCount = IMPULSE_RESPONSE_READ_FRAME_COUNT;
+        }
+        if ((int64_t)frameCount > historyEndIndex - frameIndex)
+        {
+            frameCount = historyEndIndex - frameIndex;
+        }
+
+        if (frameIndex < (int64_t)getSampleHistoryBeginIndex() ||
+            !readSampleHistory(frameIndex, frameCount, impulseResponseChannelCount, impulseResponseFrameData))
+        {
+            ESP_LOGW(SOUND_LOGGER_TAG, "The frames of the impulse response are no longer in the history");
+            failImpulseResponse(IMPULSE_RESPONSE_STATUS_FRAMES_MISSING);
+            break;
+        }
+        addImpulseResponseFrames(impulseResponseFrameData, frameCount);
+        addedFrameCount += frameCount;
+    }
+}
+
+static void updateImpulseResponse()
+{
+    if (!isImpulseResponseActive())
+    {
+        startNextImpulseResponse();
+    }
+    updateImpulseResponseFrames();
+
+    size_t size;
+    if (isImpulseResponseFinished() && queueUploadData(getImpulseResponseMessage(&size), size))
+    {
+        ESP_LOGI(SOUND_LOGGER_TAG, "Impulse response finished");
+        releaseImpulseResponse();
+    }
+}
+
+static void writeSoundDataMessageFrames(size_t frameCount)
+{
+    currentSoundDataFrameIndex += frameCount;
+    if (currentSoundDataFrameIndex == messageFrameCount)
+    {
+        commitSoundDataMessage();
+        sendAnalysisMessages();
+        acquireSoundDataMessage();
+    }
+}
+
+// The history keeps the full-rate frames for the records, only the stream is decimated.
+// The decimated frames left when the configuration changes belong to the previous stream, so they are dropped.
+static void updateDecimatedSoundDataMessage(const int32_t* i2sFrames, size_t i2sFrameCount)
+{
+    size_t channelCount = configuration.channelCount;
+    size_t decimationFactor = configuration.decimationFactor;
+    uint32_t headerId = soundDataMessageHeaderId;
+
+    extractChannels(i2sFrames, i2sFrameCount, I2S_CHANNEL_COUNT, channelCount, frameData);
+    writeSampleHistory(frameData, i2sFrameCount);
+    currentSampleIndex += i2sFrameCount;
+
+    size_t decimatedFrameCount = decimateFrames(&decimator, frameData, i2sFrameCount, decimatedFrameData);
+    const int32_t* decimatedFrames = decimatedFrameData;
+    while (decimatedFrameCount > 0 && headerId == soundDataMessageHeaderId)
+    {
+        size_t frameCount = messageFrameCount - currentSoundDataFrameIndex;
+        if (frameCount > decimatedFrameCount)
+        {
+            frameCount = decimatedFrameCount;
+        }
+
+        writeSoundDataFrames(decimatedFrames, frameCount, channelCount);
+
+        streamSampleIndex += frameCount * decimationFactor;
+        decimatedFrames += frameCount * channelCount;
+        decimatedFrameCount -= frameCount;
+        writeSoundDataMessageFrames(frameCount);
+    }
+}
+
+// The sample indexes count frames, all channels of a frame share the same index.
+static void updateFullRateSoundDataMessage(const int32_t* i2sFrames, size_t i2sFrameCount)
+{
+    uint32_t headerId = soundDataMessageHeaderId;
+    while (i2sFrameCount > 0 && headerId == soundDataMessageHeaderId)
+    {
+        size_t frameCount = messageFrameCount - currentSoundDataFrameIndex;
+        if (frameCount > i2sFrameCount)
+        {
+            frameCount = i2sFrameCount;
+        }
+
+        int32_t* frames = writeSoundDataFrames(i2sFrames, frameCount, I2S_CHANNEL_COUNT);
+        writeSampleHistory(frames, frameCount);
+
+        currentSampleIndex += frameCount;
+        streamSampleIndex += frameCount;
+        i2sFrames += frameCount * I2S_CHANNEL_COUNT;
+        i2sFrameCount -= frameCount;
+        writeSoundDataMessageFrames(frameCount);
+    }
+
+    // A configuration change can enable the decimation, so the rest of the block follows the new configuration.
+    if (i2sFrameCount > 0 && isDecimationEnabled())
+    {
+        updateDecimatedSoundDataMessage(i2sFrames, i2sFrameCount);
+    }
+    else if (i2sFrameCount > 0)
+    {
+        updateFullRateSoundDataMessage(i2sFrames, i2sFrameCount);
+    }
+}
+
+static void updateSoundDataMessage(const int32_t* i2sFrames, size_t i2sFrameCount)
+{
+    if (isDecimationEnabled())
+    {
+        updateDecimatedSoundDataMessage(i2sFrames, i2sFrameCount);
+    }
+    else
+    {
+        updateFullRateSoundDataMessage(i2sFrames, i2sFrameCount);
+    }
+
+    updateRecordMessage();
+    updateImpulseResponse();
+}
+
+// The sample clock measures the streamed frames, so the ratio integrates their remaining frequency error
+// until they follow the nominal sample frequency.
+static void updateResamplingRatio()
+{
+    double maxCorrection = CONFIG_SOUND_RESAMPLING_MAX_CORRECTION_PPM / PPM_IN_ONE_COUNT;
+    double frequencyError = getEstimatedSampleFrequency() / getNominalSampleFrequency() - 1.0;
+
+    resamplingRatio *= 1.0 + frequencyError * RESAMPLING_RATIO_GAIN;
+    if (resamplingRatio > 1.0 + maxCorrection)
+    {
+        resamplingRatio = 1.0 + maxCorrection;
+    }
+    else if (resamplingRatio < 1.0 - maxCorrection)
+    {
+        resamplingRatio = 1.0 - maxCorrection;
+    }
+    setResamplerRatio(&resampler, resamplingRatio);
+}
+
+// The analysis restarts when its configuration or the sample frequency changes.
+static void updateSpectrum(const int32_t* i2sFrames, size_t frameCount)
+{
+    SpectrumConfiguration requestedConfiguration;
+    if (xQueueReceive(spectrumConfigurationQueue, &requestedConfiguration, 0) == pdTRUE)
+    {
+        spectrumConfiguration = requestedConfiguration;
+        resetSpectrum(&spectrumConfiguration, configuration.sampleFrequency, currentSampleIndex);
+        isSpectrumMessagePending = 0;
+        ESP_LOGI(SOUND_LOGGER_TAG, "Spectrum FFT size: %u, hop size: %u, interval: %u ms, content: %u, channel: %u",
+            spectrumConfiguration.fftSize,
+            spectrumConfiguration.hopSize,
+            spectrumConfiguration.intervalMs,
+            spectrumConfiguration.content,
+            spectrumConfiguration.channel);
+    }
+    else if (isSpectrumEnabled() && getSpectrumSampleFrequency() != configuration.sampleFrequency)
+    {
+        resetSpectrum(&spectrumConfiguration, configuration.sampleFrequency, currentSampleIndex);
+        isSpectrumMessagePending = 0;
+    }
+
+    if (addSpectrumFrames(i2sFrames, frameCount, I2S_CHANNEL_COUNT))
+    {
+        isSpectrumMessagePending = 1;
+    }
+}
+
+// The meter restarts when its configuration or the sample frequency changes.
+static void updateLevelMeter(const int32_t* i2sFrames, size_t frameCount)
+{
+    LevelMeterConfiguration requestedConfiguration;
+    if (xQueueReceive(levelMeterConfigurationQueue, &requestedConfiguration, 0) == pdTRUE)
+    {
+        levelMeterConfiguration = requestedConfiguration;
+        resetLevelMeter(&levelMeterConfiguration, configuration.sampleFrequency, currentSampleIndex);
+        isLevelMeterMessagePending = 0;
+        ESP_LOGI(SOUND_LOGGER_TAG, "Level meter interval: %u ms, frequency weighting: %u, time weighting: %u, channel count: %u",
+            levelMeterConfiguration.intervalMs,
+            levelMeterConfiguration.frequencyWeighting,
+            levelMeterConfiguration.timeWeighting,
+            levelMeterConfiguration.channelCount);
+    }
+    else if (isLevelMeterEnabled() && getLevelMeterSampleFrequency() != configuration.sampleFrequency)
+    {
+        resetLevelMeter(&levelMeterConfiguration, configuration.sampleFrequency, currentSampleIndex);
+        isLevelMeterMessagePending = 0;
+    }
+
+    if (addLevelMeterFrames(i2sFrames, frameCount, I2S_CHANNEL_COUNT))
+    {
+        isLevelMeterMessagePending = 1;
+    }
 }
 
 static void soundTask(void* parameters)
 {
-    uint8_t data[I2S_READ_DATA_SIZE];
     size_t readSize;
 
-    currentSoundDataSampleDataIndex = 0;
-    updateSoundDataMessageIdAndTimestamp();
+    acquireSoundDataMessage();
     while (1)
     {
-        i2s_read(CONFIG_SOUND_I2S_PORT_NUMBER, data, I2S_READ_DATA_SIZE, &readSize, portMAX_DELAY);
-        int32_t sampleValue = *(int32_t*)data;
+        // Read whole DMA buffers at once instead of one frame per call.
+        i2s_read(CONFIG_SOUND_I2S_PORT_NUMBER, i2sData, I2S_READ_DATA_SIZE, &readSize, portMAX_DELAY);
+        size_t frameCount = readSize / I2S_FRAME_SIZE;
+        const int32_t* frames = i2sData;
+
+        if (isResamplingEnabled)
+        {
+            frameCount = resampleFrames(&resampler, i2sData, frameCount, resampledI2sData);
+            frames = resampledI2sData;
+        }
 
-        updateSoundDataMessage(sampleValue);
-        updateRecordMessage(sampleValue);
+        if (updateSampleClock(currentSampleIndex + frameCount) && isResamplingEnabled)
+        {
+            updateResamplingRatio();
+        }
+        updateSpectrum(frames, frameCount);
+        updateLevelMeter(frames, frameCount);
+        updateSoundDataMessage(frames, frameCount);
     }
     vTaskDelete(NULL);
 }
@@ -239,8 +1024,13 @@ static void soundTask(void* parameters)
 void initializeSound()
 {
     ESP_LOGI(SOUND_LOGGER_TAG, "Sound initialization");
-    ESP_ERROR_CHECK(ledc_timer_config(&LEDC_TIMER_CONFIG));
-    ESP_ERROR_CHECK(ledc_channel_config(&LEDC_CHANNEL_CONFIG));
+    ClockPlan plan;
+    if (!computeClockPlan(CONFIG_SOUND_SAMPLE_FREQUENCY, CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY, CONFIG_SOUND_CLOCK_MAX_ERROR_PPM, &plan))
+    {
+        ESP_LOGE(SOUND_LOGGER_TAG, "No clock plan for the default sample frequency");
+        abort();
+    }
+    initializeMasterClock(&plan);
     initAdc();
 
     ESP_ERROR_CHECK(i2s_driver_install(CONFIG_SOUND_I2S_PORT_NUMBER, &I2S_CONFIG, 0, NULL));
@@ -248,7 +1038,29 @@ void initializeSound()
 
     ESP_ERROR_CHECK(gpio_set_level(CONFIG_SOUND_GPIO_OUTPUT_IO_PDWN, 1));
 
-    initializeSoundDataMessageHeader();
+    configurationQueue = xQueueCreate(1, sizeof(SoundConfiguration));
+    spectrumConfigurationQueue = xQueueCreate(1, sizeof(SpectrumConfiguration));
+    levelMeterConfigurationQueue = xQueueCreate(1, sizeof(LevelMeterConfiguration));
+    impulseResponseQueue = xQueueCreate(CONFIG_SOUND_IMPULSE_RESPONSE_QUEUE_SIZE, sizeof(ImpulseResponseMeasurement));
+    initializeStreamingPackets(SOUND_DATA_MESSAGE_DATA_OFFSET);
+    initializeFec(SOUND_DATA_MESSAGE_DATA_OFFSET);
+    initializeSampleClock(CONFIG_SOUND_SAMPLE_FREQUENCY);
+    resetResampling(&plan);
+    initializeDecimator(&decimator, configuration.decimationFactor, configuration.channelCount);
+    initializeSpectrum();
+
+    // Without memory, the features using the buffers are disabled instead of aborting the startup.
+    isSampleHistoryEnabled = initializeSampleHistory(SAMPLE_HISTORY_PSRAM_SAMPLE_COUNT, SAMPLE_HISTORY_INTERNAL_SAMPLE_COUNT) == ESP_OK;
+    resetSampleHistory(currentSampleIndex, configuration.channelCount);
+    if (!isSampleHistoryEnabled)
+    {
+        ESP_LOGW(SOUND_LOGGER_TAG, "The records are disabled");
+    }
+    isImpulseResponseEnabled = isSampleHistoryEnabled && initializeImpulseResponse() == ESP_OK;
+    if (!isImpulseResponseEnabled)
+    {
+        ESP_LOGW(SOUND_LOGGER_TAG, "The impulse response measurement is disabled");
+    }
 }
 
 void startSound()
@@ -261,26 +1073,154 @@ void startSound()
         NULL);
 }
 
-void recordSound(uint8_t requestedRecordHour,
+int configureSound(const SoundConfiguration* requestedConfiguration)
+{
+    ClockPlan plan;
+    if (!computeClockPlan(requestedConfiguration->sampleFrequency,
+            CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY,
+            CONFIG_SOUND_CLOCK_MAX_ERROR_PPM,
+            &plan) ||
+        !isSampleFormatSupported(requestedConfiguration->sampleFormat) ||
+        requestedConfiguration->streamMode > SOUND_STREAM_MODE_NONE ||
+        requestedConfiguration->channelCount < 1 ||
+        requestedConfiguration->channelCount > CONFIG_SOUND_MAX_CHANNEL_COUNT ||
+        requestedConfiguration->fecGroupSize > CONFIG_SOUND_FEC_MAX_GROUP_SIZE ||
+        !isDecimationFactorSupported(requestedConfiguration->decimationFactor) ||
+        (requestedConfiguration->decimationFactor > 1 && requestedConfiguration->streamMode != SOUND_STREAM_MODE_RAW))
+    {
+        return 0;
+    }
+
+    // The sound task applies the configuration at the next message boundary.
+    xQueueOverwrite(configurationQueue, requestedConfiguration);
+    return 1;
+}
+
+int configureSpectrum(const SpectrumConfiguration* requestedConfiguration)
+{
+    if (!isSpectrumConfigurationSupported(requestedConfiguration))
+    {
+        return 0;
+    }
+
+    // The sound task applies the configuration at the next block.
+    xQueueOverwrite(spectrumConfigurationQueue, requestedConfiguration);
+    return 1;
+}
+
+int configureLevelMeter(const LevelMeterConfiguration* requestedConfiguration)
+{
+    if (!isLevelMeterConfigurationSupported(requestedConfiguration))
+    {
+        return 0;
+    }
+
+    // The sound task applies the configuration at the next block.
+    xQueueOverwrite(levelMeterConfigurationQueue, requestedConfiguration);
+    return 1;
+}
+
+// The wall-clock start is converted once to a sample index, the sound task only compares sample indexes.
+static int64_t convertTimeOfDayToSampleIndex(uint8_t hour, uint8_t minute, uint8_t second, uint16_t ms, int64_t* delayUs)
+{
+    struct timeval tv;
+    struct tm timeinfo;
+    gettimeofday(&tv, NULL);
+    localtime_r(&tv.tv_sec, &timeinfo);
+
+    int64_t currentTimeOfDayUs = getTimeOfDayUs(timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec, tv.tv_usec);
+    int64_t requestedTimeOfDayUs = getTimeOfDayUs(hour, minute, second, (uint32_t)ms * US_IN_MS_COUNT);
+    *delayUs = getTimeOfDayDelayUs(currentTimeOfDayUs, requestedTimeOfDayUs);
+    return convertTimeToSampleIndex(getTimevalUs(&tv) + *delayUs);
+}
+
+int recordSound(uint8_t requestedRecordHour,
     uint8_t requestedRecordMinute,
     uint8_t requestedRecordSecond,
     uint16_t requestedRecordMs,
     uint16_t requestedRecordDurationMs,
     uint8_t requestedRecordRecordId)
 {
+    if (!isSampleHistoryEnabled)
+    {
+        ESP_LOGE(SOUND_LOGGER_TAG, "The records are disabled, record %u is dropped", requestedRecordRecordId);
+        return 0;
+    }
     if (requestedRecordDurationMs == 0)
     {
         ESP_LOGE(SOUND_LOGGER_TAG, "Invalid duration");
-        return;
+        return 0;
+    }
+
+    int64_t delayUs;
+    int64_t startSampleIndex = convertTimeOfDayToSampleIndex(requestedRecordHour,
+        requestedRecordMinute,
+        requestedRecordSecond,
+        requestedRecordMs,
+        &delayUs);
+    if (delayUs < 0)
+    {
+        ESP_LOGI(SOUND_LOGGER_TAG, "The record start time is passed, the record starts from the history");
     }
 
-    recordHour = requestedRecordHour;
-    recordMinute = requestedRecordMinute;
-    recordSecond = requestedRecordSecond;
-    recordMs = requestedRecordMs;
-    sampleCountToBeRecorded = (size_t)(CONFIG_SOUND_SAMPLE_FREQUENCY) * requestedRecordDurationMs / MS_IN_S_COUNT;
-    recordId = requestedRecordRecordId;
-    isRecordPending = 1;
+    RecordRequest request =
+    {
+        .startSampleIndex = startSampleIndex,
+        .frameCount = (size_t)getNominalSampleFrequency() * requestedRecordDurationMs / MS_IN_S_COUNT,
+        .recordId = requestedRecordRecordId
+    };
+    portENTER_CRITICAL(&recordScheduleMux);
+    int isScheduled = scheduleRecord(&request);
+    portEXIT_CRITICAL(&recordScheduleMux);
+
+    if (!isScheduled)
+    {
+        ESP_LOGE(SOUND_LOGGER_TAG, "The record schedule is full, record %u is dropped", requestedRecordRecordId);
+        return 0;
+    }
+
+    ESP_LOGI(SOUND_LOGGER_TAG, "Record %u requested", requestedRecordRecordId);
+    return 1;
+}
+
+int measureImpulseResponse(const ImpulseResponseRequest* request)
+{
+    if (!isImpulseResponseEnabled)
+    {
+        ESP_LOGE(SOUND_LOGGER_TAG, "The impulse response measurement is disabled, measurement %u is dropped", request->measurementId);
+        return 0;
+    }
+    if (!isImpulseResponseRequestSupported(request))
+    {
+        ESP_LOGE(SOUND_LOGGER_TAG, "Invalid impulse response request");
+        return 0;
+    }
+
+    int64_t delayUs;
+    ImpulseResponseMeasurement measurement =
+    {
+        .request = *request,
+        .startSampleIndex = convertTimeOfDayToSampleIndex(request->hour, request->minute, request->second, request->ms, &delayUs)
+    };
+    if (xQueueSend(impulseResponseQueue, &measurement, 0) != pdTRUE)
+    {
+        ESP_LOGE(SOUND_LOGGER_TAG, "The impulse response queue is full, measurement %u is dropped", request->measurementId);
+        return 0;
+    }
+
+    ESP_LOGI(SOUND_LOGGER_TAG, "Impulse response %u requested", request->measurementId);
+    return 1;
+}
+
+// Without resampling, the ratio stays at 1 and the streamed frequency is the ADC frequency.
+void logSoundStatistics()
+{
+    double streamedSampleFrequency = getEstimatedSampleFrequency();
+    double adcSampleFrequency = streamedSampleFrequency * resamplingRatio;
 
-    ESP_LOGI(SOUND_LOGGER_TAG, "Record requested");
+    ESP_LOGI(SOUND_LOGGER_TAG, "Sample clock: ADC frequency = %.3f Hz (%+.1f ppm), streamed frequency = %.3f Hz, resampling ratio = %.7f",
+        adcSampleFrequency,
+        (adcSampleFrequency / getNominalSampleFrequency() - 1.0) * PPM_IN_ONE_COUNT,
+        streamedSampleFrequency,
+        resamplingRatio);
 }
@@ -0,0 +1,61 @@
+#include "sound/channels.h"
+
+#include <string.h>
+
+void extractChannels(const int32_t* i2sFrames,
+    size_t frameCount,
+    size_t i2sChannelCount,
+    size_t channelCount,
+    int32_t* frames)
+{
+    if (channelCount == i2sChannelCount)
+    {
+        memcpy(frames, i2sFrames, frameCount * channelCount * sizeof(int32_t));
+    }
+    else if (channelCount == 1)
+    {
+        for (size_t i = 0; i < frameCount; i++)
+        {
+            frames[i] = i2sFrames[i * i2sChannelCount];
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < frameCount; i++)
+        {
+            memcpy(frames + i * channelCount, i2sFrames + i * i2sChannelCount, channelCount * sizeof(int32_t));
+        }
+    }
+}
+
+static void deinterleaveStereoFrames(const int32_t* frames, size_t frameCount, int32_t* left, int32_t* right)
+{
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        left[i] = frames[2 * i];
+        right[i] = frames[2 * i + 1];
+    }
+}
+
+void deinterleaveFrames(const int32_t* frames, size_t frameCount, size_t channelCount, int32_t* channelSamples)
+{
+    if (channelCount == 1)
+    {
+        memcpy(channelSamples, frames, frameCount * sizeof(int32_t));
+    }
+    else if (channelCount == 2)
+    {
+        deinterleaveStereoFrames(frames, frameCount, channelSamples, channelSamples + frameCount);
+    }
+    else
+    {
+        for (size_t channel = 0; channel < channelCount; channel++)
+        {
+            int32_t* samples = channelSamples + channel * frameCount;
+            for (size_t i = 0; i < frameCount; i++)
+            {
+                samples[i] = frames[i * channelCount + channel];
+            }
+        }
+    }
+}
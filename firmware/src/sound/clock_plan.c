@@ -0,0 +1,70 @@
+#include "sound/clock_plan.h"
+
+#include <math.h>
+
+#define PPM_IN_ONE_COUNT 1000000.0
+
+#define LEDC_MIN_DUTY_RESOLUTION 1
+#define LEDC_MAX_DUTY_RESOLUTION 4
+#define LEDC_MIN_CLOCK_DIVIDER (1 << CLOCK_PLAN_LEDC_DIVIDER_FRACTIONAL_BIT_COUNT) // Divides by 1
+#define LEDC_MAX_CLOCK_DIVIDER ((1 << 18) - 1) // 10 integer bits
+
+static const uint32_t SUPPORTED_SAMPLE_FREQUENCIES[] = { 44100, 48000, 88200, 96000 };
+
+#define SUPPORTED_SAMPLE_FREQUENCY_COUNT (sizeof(SUPPORTED_SAMPLE_FREQUENCIES) / sizeof(uint32_t))
+
+static int isSampleFrequencySupported(uint32_t sampleFrequency)
+{
+    for (size_t i = 0; i < SUPPORTED_SAMPLE_FREQUENCY_COUNT; i++)
+    {
+        if (SUPPORTED_SAMPLE_FREQUENCIES[i] == sampleFrequency)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static double getLedcFrequency(uint32_t sourceFrequency, uint32_t clockDivider, uint32_t dutyResolution)
+{
+    return (double)sourceFrequency * (1 << CLOCK_PLAN_LEDC_DIVIDER_FRACTIONAL_BIT_COUNT) /
+        clockDivider / (1 << dutyResolution);
+}
+
+int computeClockPlan(uint32_t sampleFrequency, uint32_t sourceFrequency, double maxErrorPpm, ClockPlan* plan)
+{
+    if (!isSampleFrequencySupported(sampleFrequency))
+    {
+        return 0;
+    }
+
+    uint32_t mclkFrequency = sampleFrequency * CLOCK_PLAN_MCLK_RATIO;
+    int isFound = 0;
+
+    for (uint32_t dutyResolution = LEDC_MIN_DUTY_RESOLUTION; dutyResolution <= LEDC_MAX_DUTY_RESOLUTION; dutyResolution++)
+    {
+        double exactDivider = (double)sourceFrequency * (1 << CLOCK_PLAN_LEDC_DIVIDER_FRACTIONAL_BIT_COUNT) /
+            mclkFrequency / (1 << dutyResolution);
+        uint32_t clockDivider = (uint32_t)lround(exactDivider);
+        if (clockDivider < LEDC_MIN_CLOCK_DIVIDER || clockDivider > LEDC_MAX_CLOCK_DIVIDER)
+        {
+            continue;
+        }
+
+        double actualMclkFrequency = getLedcFrequency(sourceFrequency, clockDivider, dutyResolution);
+        double errorPpm = (actualMclkFrequency / mclkFrequency - 1.0) * PPM_IN_ONE_COUNT;
+        if (!isFound || fabs(errorPpm) < fabs(plan->errorPpm))
+        {
+            plan->sampleFrequency = sampleFrequency;
+            plan->mclkFrequency = mclkFrequency;
+            plan->ledcDutyResolution = dutyResolution;
+            plan->ledcDuty = 1 << (dutyResolution - 1);
+            plan->ledcClockDivider = clockDivider;
+            plan->actualMclkFrequency = actualMclkFrequency;
+            plan->errorPpm = errorPpm;
+            isFound = 1;
+        }
+    }
+
+    return isFound && fabs(plan->errorPpm) <= maxErrorPpm;
+}
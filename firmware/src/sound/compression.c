@@ -0,0 +1,224 @@
+#include "sound/compression.h"
+#include "sound/sample_format.h"
+#include "config.h"
+
+#include <stdlib.h>
+
+#define BLOCK_HEADER_SIZE 2
+#define SAMPLE_SHIFT 8 // The I2S samples are left-justified 24-bit values
+#define MAX_RICE_PARAMETER 23
+#define MAX_SAMPLE_COUNT CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT
+
+static int32_t x[MAX_SAMPLE_COUNT];
+static uint32_t residuals[MAX_SAMPLE_COUNT];
+
+typedef struct
+{
+    uint8_t* data;
+    size_t capacity;
+    size_t size;
+    uint32_t accumulator;
+    int accumulatorBitCount;
+    int isOverflowed;
+} BitWriter;
+
+static void initializeBitWriter(BitWriter* writer, uint8_t* data, size_t capacity)
+{
+    writer->data = data;
+    writer->capacity = capacity;
+    writer->size = 0;
+    writer->accumulator = 0;
+    writer->accumulatorBitCount = 0;
+    writer->isOverflowed = 0;
+}
+
+static void flushBitWriterBytes(BitWriter* writer)
+{
+    while (writer->accumulatorBitCount >= 8)
+    {
+        if (writer->size >= writer->capacity)
+        {
+            writer->isOverflowed = 1;
+            return;
+        }
+
+        writer->accumulatorBitCount -= 8;
+        writer->data[writer->size++] = (uint8_t)(writer->accumulator >> writer->accumulatorBitCount);
+    }
+}
+
+// bitCount must not be greater than 24.
+static void writeBits(BitWriter* writer, uint32_t value, int bitCount)
+{
+    writer->accumulator = (writer->accumulator << bitCount) | (value & ((1u << bitCount) - 1));
+    writer->accumulatorBitCount += bitCount;
+    flushBitWriterBytes(writer);
+}
+
+static void writeUnary(BitWriter* writer, uint32_t value)
+{
+    while (value >= 24 && !writer->isOverflowed)
+    {
+        writeBits(writer, 0, 24);
+        value -= 24;
+    }
+    writeBits(writer, 1, value + 1);
+}
+
+static void flushBitWriter(BitWriter* writer)
+{
+    int paddingBitCount = (8 - writer->accumulatorBitCount % 8) % 8;
+    writeBits(writer, 0, paddingBitCount);
+}
+
+static int32_t getResidual(const int32_t* x, size_t n, int order)
+{
+    switch (order)
+    {
+        case 0:
+            return x[n];
+        case 1:
+            return x[n] - x[n - 1];
+        case 2:
+            return x[n] - 2 * x[n - 1] + x[n - 2];
+        case 3:
+            return x[n] - 3 * x[n - 1] + 3 * x[n - 2] - x[n - 3];
+        default:
+            return x[n] - 4 * x[n - 1] + 6 * x[n - 2] - 4 * x[n - 3] + x[n - 4];
+    }
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int selectOrder(const int32_t* x, size_t sampleCount)
+{
+    uint64_t errorSums[COMPRESSION_MAX_ORDER + 1] = { 0 };
+    for (size_t n = COMPRESSION_MAX_ORDER; n < sampleCount; n++)
+    {
+        for (int order = 0; order <= COMPRESSION_MAX_ORDER; order++)
+        {
+            errorSums[order] += abs(getResidual(x, n, order));
+        }
+    }
+
+    int bestOrder = 0;
+    for (int order = 1; order <= COMPRESSION_MAX_ORDER; order++)
+    {
+        if (errorSums[order] < errorSums[bestOrder])
+        {
+            bestOrder = order;
+        }
+    }
+    return bestOrder;
+}
+
+static uint64_t getRiceBitCount(const uint32_t* residuals, size_t residualCount, int riceParameter)
+{
+    uint64_t bitCount = (uint64_t)residualCount * (riceParameter + 1);
+    for (size_t i = 0; i < residualCount; i++)
+    {
+        bitCount += residuals[i] >> riceParameter;
+    }
+    return bitCount;
+}
+
+static int selectRiceParameter(const uint32_t* residuals, size_t residualCount)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < residualCount; i++)
+    {
+        sum += residuals[i];
+    }
+
+    // The mean gives a first estimate, the neighbouring parameters are also evaluated.
+    int estimatedParameter = 0;
+    while (estimatedParameter < MAX_RICE_PARAMETER && ((uint64_t)residualCount << (estimatedParameter + 1)) <= sum)
+    {
+        estimatedParameter++;
+    }
+
+    int bestParameter = estimatedParameter;
+    uint64_t bestBitCount = getRiceBitCount(residuals, residualCount, bestParameter);
+    for (int parameter = estimatedParameter - 1; parameter <= estimatedParameter + 1; parameter += 2)
+    {
+        if (parameter < 0 || parameter > MAX_RICE_PARAMETER)
+        {
+            continue;
+        }
+
+        uint64_t bitCount = getRiceBitCount(residuals, residualCount, parameter);
+        if (bitCount < bestBitCount)
+        {
+            bestBitCount = bitCount;
+            bestParameter = parameter;
+        }
+    }
+    return bestParameter;
+}
+
+static size_t writeVerbatimBlock(const int32_t* samples, size_t sampleCount, uint8_t* output)
+{
+    output[0] = COMPRESSION_VERBATIM_ORDER;
+    output[1] = 0;
+    packSamples24(samples, sampleCount, output + BLOCK_HEADER_SIZE);
+    return getMaxCompressedSize(sampleCount);
+}
+
+size_t getMaxCompressedSize(size_t sampleCount)
+{
+    return BLOCK_HEADER_SIZE + sampleCount * SAMPLE_FORMAT_SIGNED_24_SIZE;
+}
+
+size_t compressSamples(const int32_t* samples, size_t sampleCount, uint8_t* output, size_t outputCapacity)
+{
+    if (sampleCount > MAX_SAMPLE_COUNT)
+    {
+        sampleCount = MAX_SAMPLE_COUNT;
+    }
+
+    for (size_t n = 0; n < sampleCount; n++)
+    {
+        x[n] = samples[n] >> SAMPLE_SHIFT;
+    }
+
+    int order = sampleCount > COMPRESSION_MAX_ORDER ? selectOrder(x, sampleCount) : 0;
+    size_t residualCount = sampleCount - order;
+    for (size_t n = order; n < sampleCount; n++)
+    {
+        residuals[n - order] = zigzag(getResidual(x, n, order));
+    }
+    int riceParameter = selectRiceParameter(residuals, residualCount);
+
+    // The verbatim block is the upper bound, a larger compressed block is useless.
+    size_t capacity = getMaxCompressedSize(sampleCount);
+    if (capacity > outputCapacity)
+    {
+        capacity = outputCapacity;
+    }
+
+    output[0] = (uint8_t)order;
+    output[1] = (uint8_t)riceParameter;
+    packSamples24(samples, order, output + BLOCK_HEADER_SIZE);
+
+    size_t headerSize = BLOCK_HEADER_SIZE + order * SAMPLE_FORMAT_SIGNED_24_SIZE;
+    BitWriter writer;
+    initializeBitWriter(&writer, output + headerSize, capacity - headerSize);
+    for (size_t i = 0; i < residualCount && !writer.isOverflowed; i++)
+    {
+        writeUnary(&writer, residuals[i] >> riceParameter);
+        if (riceParameter > 0)
+        {
+            writeBits(&writer, residuals[i], riceParameter);
+        }
+    }
+    flushBitWriter(&writer);
+
+    if (writer.isOverflowed || headerSize + writer.size >= capacity)
+    {
+        return writeVerbatimBlock(samples, sampleCount, output);
+    }
+    return headerSize + writer.size;
+}
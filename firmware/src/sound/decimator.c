@@ -0,0 +1,150 @@
+#include "sound/decimator.h"
+
+#include <math.h>
+#include <string.h>
+
+#define HALF_BAND_CENTER (DECIMATOR_HALF_BAND_ORDER / 2)
+#define HALF_BAND_COEFFICIENT_COUNT ((HALF_BAND_CENTER + 1) / 2) // Odd distances from the center
+
+#define SAMPLE_SHIFT 8 // 24-bit samples in the most significant bits
+#define SAMPLE_MAX ((1 << 23) - 1)
+#define SAMPLE_MIN (-(1 << 23))
+
+_Static_assert(DECIMATOR_HALF_BAND_ORDER % 4 == 2, "The half-band order must be 4k + 2 so the outer taps are not zero");
+
+// coefficients[i] is the tap at distance 2i + 1 from the center, the center tap is 0.5.
+static float coefficients[HALF_BAND_COEFFICIENT_COUNT];
+static int areCoefficientsInitialized = 0;
+
+// Blackman-windowed sinc with its cutoff at a quarter of the input sample frequency.
+static void initializeCoefficients()
+{
+    double sum = 0.5;
+    for (size_t i = 0; i < HALF_BAND_COEFFICIENT_COUNT; i++)
+    {
+        int distance = 2 * i + 1;
+        double x = M_PI * distance / 2.0;
+        double phase = 2.0 * M_PI * (HALF_BAND_CENTER + distance) / DECIMATOR_HALF_BAND_ORDER;
+        double window = 0.42 - 0.5 * cos(phase) + 0.08 * cos(2.0 * phase);
+        coefficients[i] = (float)(0.5 * sin(x) / x * window);
+        sum += 2.0 * coefficients[i];
+    }
+
+    // Unity gain at DC
+    for (size_t i = 0; i < HALF_BAND_COEFFICIENT_COUNT; i++)
+    {
+        coefficients[i] = (float)(coefficients[i] / sum);
+    }
+    areCoefficientsInitialized = 1;
+}
+
+int isDecimationFactorSupported(uint8_t decimationFactor)
+{
+    return decimationFactor == 1 || decimationFactor == 2 || decimationFactor == 4 || decimationFactor == 8;
+}
+
+void initializeDecimator(Decimator* decimator, uint8_t decimationFactor, size_t channelCount)
+{
+    if (!areCoefficientsInitialized)
+    {
+        initializeCoefficients();
+    }
+
+    decimator->stageCount = 0;
+    while ((1 << decimator->stageCount) < decimationFactor && decimator->stageCount < DECIMATOR_MAX_STAGE_COUNT)
+    {
+        decimator->stageCount++;
+    }
+    decimator->channelCount = channelCount;
+
+    for (size_t i = 0; i < DECIMATOR_MAX_STAGE_COUNT; i++)
+    {
+        memset(decimator->stages[i].frames, 0, sizeof(decimator->stages[i].frames));
+        decimator->stages[i].frameCount = DECIMATOR_TAP_COUNT - 1;
+    }
+}
+
+// The stage keeps the frames that are not consumed yet, so its blocks can have any size.
+static size_t decimateStage(DecimatorStage* stage, size_t channelCount, float* frames, size_t frameCount)
+{
+    memcpy(stage->frames + stage->frameCount * channelCount, frames, frameCount * channelCount * sizeof(float));
+    stage->frameCount += frameCount;
+
+    size_t outputFrameCount = 0;
+    size_t startIndex = 0;
+    for (; startIndex + DECIMATOR_TAP_COUNT <= stage->frameCount; startIndex += 2)
+    {
+        const float* center = stage->frames + (startIndex + HALF_BAND_CENTER) * channelCount;
+        for (size_t channel = 0; channel < channelCount; channel++)
+        {
+            float y = 0.5f * center[channel];
+            for (size_t i = 0; i < HALF_BAND_COEFFICIENT_COUNT; i++)
+            {
+                size_t offset = (2 * i + 1) * channelCount;
+                y += coefficients[i] * (center[channel - offset] + center[channel + offset]);
+            }
+            frames[outputFrameCount * channelCount + channel] = y;
+        }
+        outputFrameCount++;
+    }
+
+    stage->frameCount -= startIndex;
+    memmove(stage->frames, stage->frames + startIndex * channelCount, stage->frameCount * channelCount * sizeof(float));
+    return outputFrameCount;
+}
+
+static int32_t convertToSample(float value)
+{
+    int32_t sample = (int32_t)(value < 0.0f ? value - 0.5f : value + 0.5f);
+    if (sample > SAMPLE_MAX)
+    {
+        sample = SAMPLE_MAX;
+    }
+    else if (sample < SAMPLE_MIN)
+    {
+        sample = SAMPLE_MIN;
+    }
+    return (int32_t)((uint32_t)sample << SAMPLE_SHIFT);
+}
+
+size_t decimateFrames(Decimator* decimator, const int32_t* input, size_t inputFrameCount, int32_t* output)
+{
+    static float frames[DECIMATOR_MAX_INPUT_FRAME_COUNT * DECIMATOR_MAX_CHANNEL_COUNT];
+    size_t channelCount = decimator->channelCount;
+    size_t sampleCount = inputFrameCount * channelCount;
+
+    if (decimator->stageCount == 0)
+    {
+        memcpy(output, input, sampleCount * sizeof(int32_t));
+        return inputFrameCount;
+    }
+
+    for (size_t i = 0; i < sampleCount; i++)
+    {
+        frames[i] = (float)(input[i] >> SAMPLE_SHIFT);
+    }
+
+    // Each stage decimates the output of the previous one in place.
+    size_t frameCount = inputFrameCount;
+    for (size_t i = 0; i < decimator->stageCount; i++)
+    {
+        frameCount = decimateStage(&decimator->stages[i], channelCount, frames, frameCount);
+    }
+
+    for (size_t i = 0; i < frameCount * channelCount; i++)
+    {
+        output[i] = convertToSample(frames[i]);
+    }
+    return frameCount;
+}
+
+size_t getDecimatorDelay(const Decimator* decimator)
+{
+    // The delay of a stage is its center tap, in frames of its own input.
+    size_t delay = 0;
+    for (size_t i = 0; i < decimator->stageCount; i++)
+    {
+        delay += HALF_BAND_CENTER << i;
+    }
+    return delay;
+}
@@ -0,0 +1,103 @@
+#include "sound/fec.h"
+#include "config.h"
+
+#include <string.h>
+
+#define FEC_MESSAGE_ID 13
+#define FEC_MESSAGE_PAYLOAD_SIZE_OFFSET 4
+#define FEC_MESSAGE_FIRST_ID_OFFSET 8
+#define FEC_MESSAGE_PACKET_COUNT_OFFSET 10
+#define FEC_MESSAGE_SIZE_XOR_OFFSET 12
+
+#define FEC_MAX_PARITY_SIZE (CONFIG_STREAMING_PACKET_MAX_SIZE - FEC_MESSAGE_HEADER_SIZE)
+
+static uint8_t fecBuffer[CONFIG_STREAMING_PACKET_MAX_SIZE + sizeof(uint32_t)] __attribute__((aligned(4)));
+static uint8_t* fecMessage = fecBuffer;
+static uint8_t* parityData = fecBuffer + FEC_MESSAGE_HEADER_SIZE;
+
+static uint8_t fecGroupSize = 0;
+static uint8_t packetCount = 0;
+static uint16_t firstSequenceId = 0;
+static uint16_t sizeXor = 0;
+static size_t paritySize = 0;
+
+void initializeFec(size_t dataOffset)
+{
+    fecMessage = fecBuffer + dataOffset % sizeof(uint32_t);
+    parityData = fecMessage + FEC_MESSAGE_HEADER_SIZE;
+    resetFec(0);
+}
+
+void resetFec(uint8_t groupSize)
+{
+    fecGroupSize = groupSize;
+    packetCount = 0;
+    sizeXor = 0;
+    paritySize = 0;
+}
+
+int addFecPacket(const uint8_t* packet, size_t size, uint16_t sequenceId)
+{
+    if (fecGroupSize == 0 || size <= FEC_PROTECTED_DATA_OFFSET ||
+        size - FEC_PROTECTED_DATA_OFFSET > FEC_MAX_PARITY_SIZE)
+    {
+        return 0;
+    }
+
+    if (packetCount == 0)
+    {
+        firstSequenceId = sequenceId;
+    }
+
+    // The parity beyond the current size is still zero, so the longer packet is XORed with zeros.
+    size_t protectedSize = size - FEC_PROTECTED_DATA_OFFSET;
+    if (protectedSize > paritySize)
+    {
+        memset(parityData + paritySize, 0, protectedSize - paritySize);
+        paritySize = protectedSize;
+    }
+    xorBytes(parityData, packet + FEC_PROTECTED_DATA_OFFSET, protectedSize);
+    sizeXor ^= (uint16_t)size;
+    packetCount++;
+
+    return packetCount == fecGroupSize;
+}
+
+size_t writeFecMessage(uint8_t* buffer)
+{
+    size_t size = FEC_MESSAGE_HEADER_SIZE + paritySize;
+
+    // The protected data offset is the size of the id and the payload size.
+    *(uint32_t*)fecMessage = htonl(FEC_MESSAGE_ID);
+    *(uint32_t*)(fecMessage + FEC_MESSAGE_PAYLOAD_SIZE_OFFSET) = htonl(size - FEC_PROTECTED_DATA_OFFSET);
+    *(uint16_t*)(fecMessage + FEC_MESSAGE_FIRST_ID_OFFSET) = htons(firstSequenceId);
+    fecMessage[FEC_MESSAGE_PACKET_COUNT_OFFSET] = packetCount;
+    fecMessage[FEC_MESSAGE_PACKET_COUNT_OFFSET + 1] = 0;
+    *(uint16_t*)(fecMessage + FEC_MESSAGE_SIZE_XOR_OFFSET) = htons(sizeXor);
+    *(uint16_t*)(fecMessage + FEC_MESSAGE_SIZE_XOR_OFFSET + 2) = 0;
+
+    memcpy(buffer, fecMessage, size);
+
+    resetFec(fecGroupSize);
+    return size;
+}
+
+void xorBytes(uint8_t* destination, const uint8_t* source, size_t size)
+{
+    size_t i = 0;
+    if (((uintptr_t)destination - (uintptr_t)source) % sizeof(uint32_t) == 0)
+    {
+        for (; i < size && (uintptr_t)(destination + i) % sizeof(uint32_t) != 0; i++)
+        {
+            destination[i] ^= source[i];
+        }
+        for (; i + sizeof(uint32_t) <= size; i += sizeof(uint32_t))
+        {
+            *(uint32_t*)(destination + i) ^= *(const uint32_t*)(source + i);
+        }
+    }
+    for (; i < size; i++)
+    {
+        destination[i] ^= source[i];
+    }
+}
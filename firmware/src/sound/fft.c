@@ -0,0 +1,107 @@
+#include "sound/fft.h"
+
+#include <math.h>
+
+_Static_assert((FFT_MAX_SIZE & (FFT_MAX_SIZE - 1)) == 0, "The maximum FFT size must be a power of two");
+
+#define FFT_MIN_SIZE 4
+#define TWIDDLE_COUNT (FFT_MAX_SIZE / 2)
+
+// twiddles[2k] + i twiddles[2k + 1] = exp(-2 pi i k / FFT_MAX_SIZE)
+static float twiddles[2 * TWIDDLE_COUNT];
+
+void initializeFft()
+{
+    for (size_t k = 0; k < TWIDDLE_COUNT; k++)
+    {
+        double phase = -2.0 * M_PI * k / FFT_MAX_SIZE;
+        twiddles[2 * k] = (float)cos(phase);
+        twiddles[2 * k + 1] = (float)sin(phase);
+    }
+}
+
+int isFftSizeSupported(size_t size)
+{
+    return size >= FFT_MIN_SIZE && size <= FFT_MAX_SIZE && (size & (size - 1)) == 0;
+}
+
+static void reverseBits(float* data, size_t size)
+{
+    for (size_t i = 1, j = 0; i < size; i++)
+    {
+        size_t bit = size >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j |= bit;
+
+        if (i < j)
+        {
+            float re = data[2 * i];
+            float im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+}
+
+void computeComplexFft(float* data, size_t size, int isInverse)
+{
+    float sign = isInverse ? -1.0f : 1.0f;
+
+    reverseBits(data, size);
+    for (size_t length = 2; length <= size; length <<= 1)
+    {
+        size_t halfLength = length / 2;
+        size_t twiddleStride = FFT_MAX_SIZE / length;
+        for (size_t start = 0; start < size; start += length)
+        {
+            for (size_t k = 0; k < halfLength; k++)
+            {
+                float wRe = twiddles[2 * k * twiddleStride];
+                float wIm = sign * twiddles[2 * k * twiddleStride + 1];
+
+                float* a = data + 2 * (start + k);
+                float* b = a + 2 * halfLength;
+                float re = b[0] * wRe - b[1] * wIm;
+                float im = b[0] * wIm + b[1] * wRe;
+                b[0] = a[0] - re;
+                b[1] = a[1] - im;
+                a[0] += re;
+                a[1] += im;
+            }
+        }
+    }
+}
+
+// The even and odd samples are transformed as the real and imaginary parts of one complex FFT of half the size,
+// then the two spectra are separated and combined.
+void computeRealFftPower(float* samples, size_t size, float* power)
+{
+    size_t halfSize = size / 2;
+    size_t twiddleStride = FFT_MAX_SIZE / size;
+
+    computeComplexFft(samples, halfSize, 0);
+
+    power[0] = (samples[0] + samples[1]) * (samples[0] + samples[1]);
+    power[halfSize] = (samples[0] - samples[1]) * (samples[0] - samples[1]);
+    for (size_t k = 1; k < halfSize; k++)
+    {
+        const float* z = samples + 2 * k;
+        const float* zConjugate = samples + 2 * (halfSize - k);
+
+        float evenRe = 0.5f * (z[0] + zConjugate[0]);
+        float evenIm = 0.5f * (z[1] - zConjugate[1]);
+        float oddRe = 0.5f * (z[1] + zConjugate[1]);
+        float oddIm = -0.5f * (z[0] - zConjugate[0]);
+
+        float wRe = twiddles[2 * k * twiddleStride];
+        float wIm = twiddles[2 * k * twiddleStride + 1];
+        float re = evenRe + oddRe * wRe - oddIm * wIm;
+        float im = evenIm + oddRe * wIm + oddIm * wRe;
+        power[k] = re * re + im * im;
+    }
+}
@@ -0,0 +1,320 @@
+#include "sound/impulse_response.h"
+#include "sound/fft.h"
+
+#include <arpa/inet.h>
+#include <esp_heap_caps.h>
+
+#include <math.h>
+#include <string.h>
+
+#define IMPULSE_RESPONSE_MESSAGE_PAYLOAD_SIZE_OFFSET 4
+#define IMPULSE_RESPONSE_MESSAGE_PAYLOAD_OFFSET 8
+#define IMPULSE_RESPONSE_MESSAGE_MEASUREMENT_ID_OFFSET 8
+#define IMPULSE_RESPONSE_MESSAGE_STATUS_OFFSET 9
+#define IMPULSE_RESPONSE_MESSAGE_LEAD_FRAME_COUNT_OFFSET 10
+#define IMPULSE_RESPONSE_MESSAGE_SAMPLE_FREQUENCY_OFFSET 12
+#define IMPULSE_RESPONSE_MESSAGE_LENGTH_OFFSET 16
+#define IMPULSE_RESPONSE_MESSAGE_HEADER_SIZE 20
+
+#define MAX_LENGTH CONFIG_SOUND_IMPULSE_RESPONSE_MAX_LENGTH
+#define MAX_FFT_SIZE (2 * MAX_LENGTH) // Complex values
+#define MS_IN_S_COUNT 1000
+#define SAMPLE_SCALE (1.0f / 2147483648.0f)
+
+_Static_assert((MAX_LENGTH & (MAX_LENGTH - 1)) == 0, "The maximum impulse response length must be a power of two");
+_Static_assert(MAX_FFT_SIZE <= FFT_MAX_SIZE / 2, "The impulse response FFT size is not supported by the FFT");
+_Static_assert((MAX_FFT_SIZE + 2 * MAX_FFT_SIZE + MAX_FFT_SIZE + 2) * sizeof(float) + IMPULSE_RESPONSE_MESSAGE_HEADER_SIZE +
+    MAX_LENGTH * sizeof(float) == IMPULSE_RESPONSE_BUFFER_SIZE, "The impulse response buffer size is wrong");
+
+#define STATE_INACTIVE 0
+#define STATE_MEASURING 1
+#define STATE_FINISHED 2
+
+typedef struct
+{
+    uint8_t measurementId;
+    uint8_t channel;
+    size_t channelCount;
+    uint32_t sampleFrequency;
+    size_t length;
+
+    double sweepRate; // ln(f2 / f1) per frame
+    double sweepPhaseScale; // Phase of the sweep at frame n: sweepPhaseScale * (exp(sweepRate * n) - 1)
+    size_t sweepFrameCount;
+    double gain; // Passband gain of the correlation
+
+    size_t fftSize; // Complex values, the recording segment has fftSize frames
+    size_t blockSize; // Sweep frames per FFT, fftSize - length
+    size_t blockIndex;
+    size_t blockCount;
+    size_t segmentFrameCount;
+
+    int64_t frameIndex;
+    size_t remainingFrameCount;
+} Measurement;
+
+static int state = STATE_INACTIVE;
+static Measurement measurement;
+static uint8_t status;
+
+// The buffers go to PSRAM when it is available.
+static float* segment; // Recording from the first lag of the current block
+static float* fftData; // Recording and sweep block as the real and imaginary parts
+static float* spectrum; // Accumulated cross spectrum, bins 0 to fftSize / 2
+static uint8_t* message;
+
+static void* allocateBuffer(size_t size)
+{
+    void* buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer == NULL)
+    {
+        buffer = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    return buffer;
+}
+
+esp_err_t initializeImpulseResponse()
+{
+    segment = allocateBuffer(MAX_FFT_SIZE * sizeof(float));
+    fftData = allocateBuffer(2 * MAX_FFT_SIZE * sizeof(float));
+    spectrum = allocateBuffer((MAX_FFT_SIZE + 2) * sizeof(float));
+    message = allocateBuffer(IMPULSE_RESPONSE_MESSAGE_HEADER_SIZE + MAX_LENGTH * sizeof(float));
+    if (segment == NULL || fftData == NULL || spectrum == NULL || message == NULL)
+    {
+        ESP_LOGE(SOUND_LOGGER_TAG, "Unable to allocate the impulse response buffers");
+        heap_caps_free(segment);
+        heap_caps_free(fftData);
+        heap_caps_free(spectrum);
+        heap_caps_free(message);
+        segment = NULL;
+        fftData = NULL;
+        spectrum = NULL;
+        message = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+int isImpulseResponseRequestSupported(const ImpulseResponseRequest* request)
+{
+    return request->startFrequency > 0 &&
+        request->startFrequency < request->endFrequency &&
+        request->durationMs > 0 &&
+        request->durationMs <= CONFIG_SOUND_IMPULSE_RESPONSE_MAX_SWEEP_DURATION_MS &&
+        request->length > 0 &&
+        request->length <= MAX_LENGTH;
+}
+
+static size_t getFftSize(size_t length)
+{
+    size_t fftSize = 2;
+    while (fftSize < 2 * length)
+    {
+        fftSize <<= 1;
+    }
+    return fftSize;
+}
+
+void startImpulseResponse(const ImpulseResponseRequest* request,
+    uint32_t sampleFrequency,
+    size_t historyChannelCount,
+    int64_t startSampleIndex)
+{
+    state = STATE_MEASURING;
+    measurement.measurementId = request->measurementId;
+    measurement.channel = request->channel;
+    measurement.channelCount = historyChannelCount;
+    measurement.sampleFrequency = sampleFrequency;
+    measurement.length = request->length;
+    if (request->channel >= historyChannelCount || 2 * request->endFrequency > sampleFrequency)
+    {
+        failImpulseResponse(IMPULSE_RESPONSE_STATUS_UNSUPPORTED);
+        return;
+    }
+
+    measurement.sweepFrameCount = (size_t)((uint64_t)sampleFrequency * request->durationMs / MS_IN_S_COUNT);
+    measurement.sweepRate = log((double)request->endFrequency / request->startFrequency) / measurement.sweepFrameCount;
+    measurement.sweepPhaseScale = 2.0 * M_PI * request->startFrequency / (sampleFrequency * measurement.sweepRate);
+
+    // The sweep spectrum times the weighted sweep spectrum is flat, at sampleFrequency / (4 sweepRate f1)
+    // for a full-scale sweep.
+    measurement.gain = sampleFrequency / (4.0 * measurement.sweepRate * request->startFrequency);
+
+    measurement.fftSize = getFftSize(measurement.length);
+    measurement.blockSize = measurement.fftSize - measurement.length;
+    measurement.blockIndex = 0;
+    measurement.blockCount = (measurement.sweepFrameCount + measurement.blockSize - 1) / measurement.blockSize;
+    measurement.segmentFrameCount = 0;
+
+    // The last block correlates its sweep frames with the length following frames.
+    measurement.frameIndex = startSampleIndex - CONFIG_SOUND_IMPULSE_RESPONSE_LEAD_FRAME_COUNT;
+    measurement.remainingFrameCount = measurement.blockCount * measurement.blockSize + measurement.length;
+
+    memset(spectrum, 0, (measurement.fftSize + 2) * sizeof(float));
+}
+
+int isImpulseResponseActive()
+{
+    return state != STATE_INACTIVE;
+}
+
+int isImpulseResponseFinished()
+{
+    return state == STATE_FINISHED;
+}
+
+int64_t getImpulseResponseFrameIndex()
+{
+    return measurement.frameIndex;
+}
+
+size_t getImpulseResponseRemainingFrameCount()
+{
+    return measurement.remainingFrameCount;
+}
+
+// The phase is computed in double precision at the block start, it exceeds the float precision in long sweeps.
+// Inside the block, expm1f keeps the phase increment accurate. The weight is the instantaneous frequency relative
+// to the start frequency, it compensates the energy of the sweep that decreases with the frequency.
+static void writeSweepBlock(float* data, size_t firstFrame, size_t frameCount)
+{
+    double blockGrowth = exp(measurement.sweepRate * firstFrame);
+    double blockPhase = fmod(measurement.sweepPhaseScale * (blockGrowth - 1.0), 2.0 * M_PI);
+    float phaseScale = (float)(measurement.sweepPhaseScale * blockGrowth);
+    float weightScale = (float)blockGrowth;
+    float rate = (float)measurement.sweepRate;
+
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        float growth = expm1f(rate * i);
+        data[2 * i + 1] = sinf((float)blockPhase + phaseScale * growth) * weightScale * (1.0f + growth);
+    }
+}
+
+// The recording and the sweep spectra are separated from the spectrum of their complex sum, then the cross
+// spectrum is accumulated. The lags from 0 to length - 1 do not wrap around.
+static void correlateBlock()
+{
+    size_t fftSize = measurement.fftSize;
+    size_t firstFrame = measurement.blockIndex * measurement.blockSize;
+    size_t sweepFrameCount = measurement.blockSize;
+    if (sweepFrameCount > measurement.sweepFrameCount - firstFrame)
+    {
+        sweepFrameCount = measurement.sweepFrameCount - firstFrame;
+    }
+
+    memset(fftData, 0, 2 * fftSize * sizeof(float));
+    for (size_t i = 0; i < fftSize; i++)
+    {
+        fftData[2 * i] = segment[i];
+    }
+    writeSweepBlock(fftData, firstFrame, sweepFrameCount);
+    computeComplexFft(fftData, fftSize, 0);
+
+    for (size_t k = 0; k <= fftSize / 2; k++)
+    {
+        const float* z = fftData + 2 * k;
+        const float* zMirror = fftData + 2 * ((fftSize - k) & (fftSize - 1));
+
+        float recordingRe = 0.5f * (z[0] + zMirror[0]);
+        float recordingIm = 0.5f * (z[1] - zMirror[1]);
+        float sweepConjugateRe = 0.5f * (z[1] + zMirror[1]);
+        float sweepConjugateIm = 0.5f * (z[0] - zMirror[0]);
+
+        spectrum[2 * k] += recordingRe * sweepConjugateRe - recordingIm * sweepConjugateIm;
+        spectrum[2 * k + 1] += recordingRe * sweepConjugateIm + recordingIm * sweepConjugateRe;
+    }
+
+    measurement.blockIndex++;
+}
+
+static void writeFloat(uint8_t* buffer, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits = htonl(bits);
+    memcpy(buffer, &bits, sizeof(bits));
+}
+
+static void computeImpulseResponse()
+{
+    size_t fftSize = measurement.fftSize;
+    float scale = (float)(1.0 / (measurement.gain * fftSize)); // The inverse FFT is not scaled
+
+    // The cross spectrum of real signals is Hermitian, the inverse FFT takes the full spectrum.
+    for (size_t k = 0; k <= fftSize / 2; k++)
+    {
+        fftData[2 * k] = spectrum[2 * k];
+        fftData[2 * k + 1] = spectrum[2 * k + 1];
+    }
+    for (size_t k = fftSize / 2 + 1; k < fftSize; k++)
+    {
+        fftData[2 * k] = spectrum[2 * (fftSize - k)];
+        fftData[2 * k + 1] = -spectrum[2 * (fftSize - k) + 1];
+    }
+    computeComplexFft(fftData, fftSize, 1);
+
+    uint8_t* samples = message + IMPULSE_RESPONSE_MESSAGE_HEADER_SIZE;
+    for (size_t i = 0; i < measurement.length; i++)
+    {
+        writeFloat(samples + i * sizeof(float), fftData[2 * i] * scale);
+    }
+}
+
+static void writeMessageHeader(size_t length)
+{
+    *(uint32_t*)message = htonl(IMPULSE_RESPONSE_MESSAGE_ID);
+    *(uint32_t*)(message + IMPULSE_RESPONSE_MESSAGE_PAYLOAD_SIZE_OFFSET) =
+        htonl(IMPULSE_RESPONSE_MESSAGE_HEADER_SIZE - IMPULSE_RESPONSE_MESSAGE_PAYLOAD_OFFSET + length * sizeof(float));
+    message[IMPULSE_RESPONSE_MESSAGE_MEASUREMENT_ID_OFFSET] = measurement.measurementId;
+    message[IMPULSE_RESPONSE_MESSAGE_STATUS_OFFSET] = status;
+    *(uint16_t*)(message + IMPULSE_RESPONSE_MESSAGE_LEAD_FRAME_COUNT_OFFSET) = htons(CONFIG_SOUND_IMPULSE_RESPONSE_LEAD_FRAME_COUNT);
+    *(uint32_t*)(message + IMPULSE_RESPONSE_MESSAGE_SAMPLE_FREQUENCY_OFFSET) = htonl(measurement.sampleFrequency);
+    *(uint32_t*)(message + IMPULSE_RESPONSE_MESSAGE_LENGTH_OFFSET) = htonl(length);
+}
+
+void addImpulseResponseFrames(const int32_t* frames, size_t frameCount)
+{
+    const int32_t* samples = frames + measurement.channel;
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        segment[measurement.segmentFrameCount] = samples[i * measurement.channelCount] * SAMPLE_SCALE;
+        measurement.segmentFrameCount++;
+
+        if (measurement.segmentFrameCount == measurement.fftSize)
+        {
+            correlateBlock();
+            memmove(segment, segment + measurement.blockSize, measurement.length * sizeof(float));
+            measurement.segmentFrameCount = measurement.length;
+        }
+    }
+    measurement.frameIndex += frameCount;
+    measurement.remainingFrameCount -= frameCount;
+
+    if (measurement.remainingFrameCount == 0)
+    {
+        status = IMPULSE_RESPONSE_STATUS_COMPLETE;
+        computeImpulseResponse();
+        writeMessageHeader(measurement.length);
+        state = STATE_FINISHED;
+    }
+}
+
+void failImpulseResponse(uint8_t failureStatus)
+{
+    status = failureStatus;
+    writeMessageHeader(0);
+    state = STATE_FINISHED;
+}
+
+const uint8_t* getImpulseResponseMessage(size_t* size)
+{
+    size_t length = status == IMPULSE_RESPONSE_STATUS_COMPLETE ? measurement.length : 0;
+    *size = IMPULSE_RESPONSE_MESSAGE_HEADER_SIZE + length * sizeof(float);
+    return message;
+}
+
+void releaseImpulseResponse()
+{
+    state = STATE_INACTIVE;
+}
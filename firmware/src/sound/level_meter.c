@@ -0,0 +1,295 @@
+#include "sound/level_meter.h"
+
+#include <arpa/inet.h>
+
+#include <math.h>
+#include <string.h>
+
+#define LEVEL_METER_MESSAGE_PAYLOAD_SIZE_OFFSET 4
+#define LEVEL_METER_MESSAGE_PAYLOAD_OFFSET 8
+#define LEVEL_METER_MESSAGE_FREQUENCY_WEIGHTING_OFFSET 15
+#define LEVEL_METER_MESSAGE_TIME_WEIGHTING_OFFSET 16
+#define LEVEL_METER_MESSAGE_CHANNEL_COUNT_OFFSET 17
+#define LEVEL_METER_MESSAGE_RUNNING_DURATION_MS_OFFSET 18
+#define LEVEL_METER_MESSAGE_HEADER_SIZE 22
+#define LEVEL_METER_CHANNEL_LEVEL_COUNT 5
+
+#define MS_IN_S_COUNT 1000
+#define FAST_TIME_CONSTANT_S 0.125
+#define SLOW_TIME_CONSTANT_S 1.0
+
+// Pole frequencies of the A and C weightings (IEC 61672-1)
+#define WEIGHTING_F1 20.598997
+#define WEIGHTING_F2 107.65265
+#define WEIGHTING_F3 737.86223
+#define WEIGHTING_F4 12194.217
+#define WEIGHTING_REFERENCE_FREQUENCY 1000.0
+#define MAX_SECTION_COUNT 6
+
+#define SAMPLE_SCALE (1.0f / 2147483648.0f)
+#define LEVEL_SCALE 100.0 // 0.01 dB
+#define MIN_LEVEL INT16_MIN
+
+// First-order sections keep the poles close to z = 1 accurate in single precision, unlike biquads.
+typedef struct
+{
+    float b0;
+    float b1;
+    float a1;
+} FirstOrderSection;
+
+typedef struct
+{
+    float x1[MAX_SECTION_COUNT];
+    float y1[MAX_SECTION_COUNT];
+
+    float timeWeightedPower;
+    float maxTimeWeightedPower;
+    float peak;
+    double intervalPowerSum;
+    double runningPowerSum;
+} ChannelLevels;
+
+static LevelMeterConfiguration configuration;
+static uint32_t sampleFrequency;
+
+static FirstOrderSection sections[MAX_SECTION_COUNT];
+static size_t sectionCount;
+static float timeWeightingAlpha;
+
+static ChannelLevels channelLevels[CONFIG_SOUND_MAX_CHANNEL_COUNT];
+static size_t intervalFrameCount;
+static size_t elapsedFrameCount;
+static uint64_t runningFrameCount;
+static uint64_t messageSampleIndex;
+
+int isLevelMeterConfigurationSupported(const LevelMeterConfiguration* requestedConfiguration)
+{
+    if (requestedConfiguration->intervalMs == 0)
+    {
+        return 1;
+    }
+    return requestedConfiguration->intervalMs >= CONFIG_SOUND_LEVEL_METER_MIN_INTERVAL_MS &&
+        requestedConfiguration->frequencyWeighting <= LEVEL_METER_FREQUENCY_WEIGHTING_C &&
+        requestedConfiguration->timeWeighting <= LEVEL_METER_TIME_WEIGHTING_SLOW &&
+        requestedConfiguration->channelCount >= 1 &&
+        requestedConfiguration->channelCount <= CONFIG_SOUND_MAX_CHANNEL_COUNT;
+}
+
+// Bilinear transform of (b0 s + b1) / (s + w). The pole frequency is prewarped, so the digital pole keeps its frequency.
+static void addSection(double b0, double b1, double poleFrequency)
+{
+    double k = 2.0 * sampleFrequency;
+    double w = k * tan(M_PI * poleFrequency / sampleFrequency);
+
+    sections[sectionCount].b0 = (float)((b0 * k + b1) / (k + w));
+    sections[sectionCount].b1 = (float)((b1 - b0 * k) / (k + w));
+    sections[sectionCount].a1 = (float)((w - k) / (k + w));
+    sectionCount++;
+}
+
+static void addHighPassSection(double poleFrequency)
+{
+    addSection(1.0, 0.0, poleFrequency);
+}
+
+static void addLowPassSection(double poleFrequency)
+{
+    addSection(0.0, 2.0 * sampleFrequency * tan(M_PI * poleFrequency / sampleFrequency), poleFrequency);
+}
+
+static double getSectionGain(const FirstOrderSection* section, double frequency)
+{
+    double phase = 2.0 * M_PI * frequency / sampleFrequency;
+    double numeratorRe = section->b0 + section->b1 * cos(phase);
+    double numeratorIm = -section->b1 * sin(phase);
+    double denominatorRe = 1.0 + section->a1 * cos(phase);
+    double denominatorIm = -section->a1 * sin(phase);
+    return sqrt((numeratorRe * numeratorRe + numeratorIm * numeratorIm) /
+        (denominatorRe * denominatorRe + denominatorIm * denominatorIm));
+}
+
+// The weightings are within 0.7 dB of IEC 61672-1 up to 10 kHz at 44.1 kHz, inside the class 1 tolerances.
+// The gain is normalized to 0 dB at 1 kHz.
+static void initializeWeighting(uint8_t frequencyWeighting)
+{
+    sectionCount = 0;
+    if (frequencyWeighting == LEVEL_METER_FREQUENCY_WEIGHTING_Z)
+    {
+        return;
+    }
+
+    addHighPassSection(WEIGHTING_F1);
+    addHighPassSection(WEIGHTING_F1);
+    if (frequencyWeighting == LEVEL_METER_FREQUENCY_WEIGHTING_A)
+    {
+        addHighPassSection(WEIGHTING_F2);
+        addHighPassSection(WEIGHTING_F3);
+    }
+    addLowPassSection(WEIGHTING_F4);
+    addLowPassSection(WEIGHTING_F4);
+
+    double gain = 1.0;
+    for (size_t i = 0; i < sectionCount; i++)
+    {
+        gain *= getSectionGain(&sections[i], WEIGHTING_REFERENCE_FREQUENCY);
+    }
+    sections[0].b0 = (float)(sections[0].b0 / gain);
+    sections[0].b1 = (float)(sections[0].b1 / gain);
+}
+
+static void startInterval()
+{
+    for (size_t i = 0; i < CONFIG_SOUND_MAX_CHANNEL_COUNT; i++)
+    {
+        channelLevels[i].maxTimeWeightedPower = channelLevels[i].timeWeightedPower;
+        channelLevels[i].peak = 0.0f;
+        channelLevels[i].intervalPowerSum = 0.0;
+    }
+}
+
+void resetLevelMeter(const LevelMeterConfiguration* requestedConfiguration, uint32_t requestedSampleFrequency, uint64_t sampleIndex)
+{
+    configuration = *requestedConfiguration;
+    sampleFrequency = requestedSampleFrequency;
+    if (!isLevelMeterEnabled())
+    {
+        return;
+    }
+
+    initializeWeighting(configuration.frequencyWeighting);
+    double timeConstant = configuration.timeWeighting == LEVEL_METER_TIME_WEIGHTING_SLOW ?
+        SLOW_TIME_CONSTANT_S :
+        FAST_TIME_CONSTANT_S;
+    timeWeightingAlpha = (float)(1.0 - exp(-1.0 / (timeConstant * sampleFrequency)));
+
+    memset(channelLevels, 0, sizeof(channelLevels));
+    intervalFrameCount = (size_t)((uint64_t)sampleFrequency * configuration.intervalMs / MS_IN_S_COUNT);
+    elapsedFrameCount = 0;
+    runningFrameCount = 0;
+    messageSampleIndex = sampleIndex;
+    startInterval();
+}
+
+int isLevelMeterEnabled()
+{
+    return configuration.intervalMs > 0;
+}
+
+uint32_t getLevelMeterSampleFrequency()
+{
+    return sampleFrequency;
+}
+
+static float filterSample(ChannelLevels* levels, float x)
+{
+    for (size_t i = 0; i < sectionCount; i++)
+    {
+        float y = sections[i].b0 * x + sections[i].b1 * levels->x1[i] - sections[i].a1 * levels->y1[i];
+        levels->x1[i] = x;
+        levels->y1[i] = y;
+        x = y;
+    }
+    return x;
+}
+
+// The interval sums are accumulated per block in single precision, then added to the double precision totals.
+static void addChannelFrames(ChannelLevels* levels, const int32_t* samples, size_t frameCount, size_t channelCount)
+{
+    float timeWeightedPower = levels->timeWeightedPower;
+    float maxTimeWeightedPower = levels->maxTimeWeightedPower;
+    float peak = levels->peak;
+    float powerSum = 0.0f;
+
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        float x = filterSample(levels, samples[i * channelCount] * SAMPLE_SCALE);
+        float power = x * x;
+
+        peak = fmaxf(peak, fabsf(x));
+        powerSum += power;
+        timeWeightedPower += (power - timeWeightedPower) * timeWeightingAlpha;
+        maxTimeWeightedPower = fmaxf(maxTimeWeightedPower, timeWeightedPower);
+    }
+
+    levels->timeWeightedPower = timeWeightedPower;
+    levels->maxTimeWeightedPower = maxTimeWeightedPower;
+    levels->peak = peak;
+    levels->intervalPowerSum += powerSum;
+    levels->runningPowerSum += powerSum;
+}
+
+int addLevelMeterFrames(const int32_t* frames, size_t frameCount, size_t channelCount)
+{
+    if (!isLevelMeterEnabled())
+    {
+        return 0;
+    }
+
+    for (size_t channel = 0; channel < configuration.channelCount; channel++)
+    {
+        addChannelFrames(&channelLevels[channel], frames + channel, frameCount, channelCount);
+    }
+    elapsedFrameCount += frameCount;
+    runningFrameCount += frameCount;
+    return elapsedFrameCount >= intervalFrameCount;
+}
+
+uint64_t getLevelMeterMessageSampleIndex()
+{
+    return messageSampleIndex;
+}
+
+static uint8_t* writeLevel(uint8_t* buffer, double level)
+{
+    int16_t value = MIN_LEVEL;
+    if (level * LEVEL_SCALE > INT16_MAX)
+    {
+        value = INT16_MAX;
+    }
+    else if (level * LEVEL_SCALE > MIN_LEVEL)
+    {
+        value = (int16_t)lrint(level * LEVEL_SCALE);
+    }
+
+    buffer[0] = (uint8_t)((uint16_t)value >> 8);
+    buffer[1] = (uint8_t)value;
+    return buffer + sizeof(int16_t);
+}
+
+// The reference is the power of a full-scale sine, 0.5.
+static uint8_t* writePowerLevel(uint8_t* buffer, double power)
+{
+    return writeLevel(buffer, power > 0.0 ? 10.0 * log10(2.0 * power) : MIN_LEVEL);
+}
+
+size_t writeLevelMeterMessage(uint8_t* buffer)
+{
+    size_t size = LEVEL_METER_MESSAGE_HEADER_SIZE +
+        configuration.channelCount * LEVEL_METER_CHANNEL_LEVEL_COUNT * sizeof(int16_t);
+
+    *(uint32_t*)buffer = htonl(LEVEL_METER_MESSAGE_ID);
+    *(uint32_t*)(buffer + LEVEL_METER_MESSAGE_PAYLOAD_SIZE_OFFSET) = htonl(size - LEVEL_METER_MESSAGE_PAYLOAD_OFFSET);
+    buffer[LEVEL_METER_MESSAGE_FREQUENCY_WEIGHTING_OFFSET] = configuration.frequencyWeighting;
+    buffer[LEVEL_METER_MESSAGE_TIME_WEIGHTING_OFFSET] = configuration.timeWeighting;
+    buffer[LEVEL_METER_MESSAGE_CHANNEL_COUNT_OFFSET] = configuration.channelCount;
+    *(uint32_t*)(buffer + LEVEL_METER_MESSAGE_RUNNING_DURATION_MS_OFFSET) =
+        htonl((uint32_t)(runningFrameCount * MS_IN_S_COUNT / sampleFrequency));
+
+    uint8_t* levels = buffer + LEVEL_METER_MESSAGE_HEADER_SIZE;
+    for (size_t channel = 0; channel < configuration.channelCount; channel++)
+    {
+        const ChannelLevels* channelLevel = &channelLevels[channel];
+        levels = writeLevel(levels, channelLevel->peak > 0.0f ? 20.0 * log10(channelLevel->peak) : MIN_LEVEL);
+        levels = writePowerLevel(levels, channelLevel->timeWeightedPower);
+        levels = writePowerLevel(levels, channelLevel->maxTimeWeightedPower);
+        levels = writePowerLevel(levels, channelLevel->intervalPowerSum / elapsedFrameCount);
+        levels = writePowerLevel(levels, channelLevel->runningPowerSum / runningFrameCount);
+    }
+
+    // The next interval starts after the frames of this one, including the frames added while it was pending.
+    messageSampleIndex += elapsedFrameCount;
+    elapsedFrameCount = 0;
+    startInterval();
+    return size;
+}
@@ -0,0 +1,70 @@
+#include "sound/record_schedule.h"
+#include "config.h"
+
+#define S_IN_MINUTE_COUNT 60
+#define S_IN_HOUR_COUNT 3600
+#define US_IN_S_COUNT 1000000LL
+
+static RecordRequest scheduledRecords[CONFIG_SOUND_RECORD_SCHEDULE_SIZE];
+static size_t scheduledRecordCount = 0;
+
+int64_t getTimeOfDayUs(uint8_t hour, uint8_t minute, uint8_t second, uint32_t us)
+{
+    int64_t s = (int64_t)hour * S_IN_HOUR_COUNT + (int64_t)minute * S_IN_MINUTE_COUNT + second;
+    return s * US_IN_S_COUNT + us;
+}
+
+int64_t getTimeOfDayDelayUs(int64_t currentTimeOfDayUs, int64_t requestedTimeOfDayUs)
+{
+    int64_t delayUs = (requestedTimeOfDayUs - currentTimeOfDayUs) % US_IN_DAY_COUNT;
+    if (delayUs < -US_IN_DAY_COUNT / 2)
+    {
+        delayUs += US_IN_DAY_COUNT;
+    }
+    else if (delayUs >= US_IN_DAY_COUNT / 2)
+    {
+        delayUs -= US_IN_DAY_COUNT;
+    }
+    return delayUs;
+}
+
+int scheduleRecord(const RecordRequest* request)
+{
+    if (scheduledRecordCount == CONFIG_SOUND_RECORD_SCHEDULE_SIZE)
+    {
+        return 0;
+    }
+
+    // The records with the same start keep their request order.
+    size_t i = scheduledRecordCount;
+    while (i > 0 && scheduledRecords[i - 1].startSampleIndex > request->startSampleIndex)
+    {
+        scheduledRecords[i] = scheduledRecords[i - 1];
+        i--;
+    }
+    scheduledRecords[i] = *request;
+    scheduledRecordCount++;
+    return 1;
+}
+
+// Pops the earliest record if it starts before endSampleIndex.
+int popDueRecord(int64_t endSampleIndex, RecordRequest* request)
+{
+    if (scheduledRecordCount == 0 || scheduledRecords[0].startSampleIndex >= endSampleIndex)
+    {
+        return 0;
+    }
+
+    *request = scheduledRecords[0];
+    scheduledRecordCount--;
+    for (size_t i = 0; i < scheduledRecordCount; i++)
+    {
+        scheduledRecords[i] = scheduledRecords[i + 1];
+    }
+    return 1;
+}
+
+size_t getScheduledRecordCount()
+{
+    return scheduledRecordCount;
+}
@@ -0,0 +1,96 @@
+#include "sound/resampler.h"
+
+#include <string.h>
+
+#define POSITION_FRACTIONAL_BIT_COUNT 32
+#define POSITION_ONE (1ULL << POSITION_FRACTIONAL_BIT_COUNT)
+#define POSITION_FRACTION_MASK (POSITION_ONE - 1)
+
+#define SAMPLE_SHIFT 8 // 24-bit samples in the most significant bits
+#define SAMPLE_MAX ((1 << 23) - 1)
+#define SAMPLE_MIN (-(1 << 23))
+
+#define MIN_RATIO 0.5
+#define MAX_RATIO 2.0
+
+void initializeResampler(Resampler* resampler, size_t channelCount)
+{
+    memset(resampler->frames, 0, sizeof(resampler->frames));
+    resampler->channelCount = channelCount;
+
+    // The first output frame is interpolated between the first two frames of history.
+    resampler->position = POSITION_ONE;
+    resampler->step = POSITION_ONE;
+}
+
+void setResamplerRatio(Resampler* resampler, double ratio)
+{
+    if (ratio < MIN_RATIO)
+    {
+        ratio = MIN_RATIO;
+    }
+    else if (ratio > MAX_RATIO)
+    {
+        ratio = MAX_RATIO;
+    }
+    resampler->step = (uint64_t)(ratio * (double)POSITION_ONE);
+}
+
+static int32_t interpolate(const int32_t* frames, size_t channelCount, float mu)
+{
+    float xm1 = (float)(frames[0] >> SAMPLE_SHIFT);
+    float x0 = (float)(frames[channelCount] >> SAMPLE_SHIFT);
+    float x1 = (float)(frames[2 * channelCount] >> SAMPLE_SHIFT);
+    float x2 = (float)(frames[3 * channelCount] >> SAMPLE_SHIFT);
+
+    float c1 = x1 - xm1 / 3.0f - x0 / 2.0f - x2 / 6.0f;
+    float c2 = (xm1 + x1) / 2.0f - x0;
+    float c3 = (x2 - xm1) / 6.0f + (x0 - x1) / 2.0f;
+    float y = ((c3 * mu + c2) * mu + c1) * mu + x0;
+
+    int32_t sample = (int32_t)(y < 0.0f ? y - 0.5f : y + 0.5f);
+    if (sample > SAMPLE_MAX)
+    {
+        sample = SAMPLE_MAX;
+    }
+    else if (sample < SAMPLE_MIN)
+    {
+        sample = SAMPLE_MIN;
+    }
+    return (int32_t)((uint32_t)sample << SAMPLE_SHIFT);
+}
+
+// The frame buffer starts with the last frames of the previous block, so the interpolation never crosses a block.
+size_t resampleFrames(Resampler* resampler, const int32_t* input, size_t inputFrameCount, int32_t* output)
+{
+    size_t channelCount = resampler->channelCount;
+    size_t frameCount = RESAMPLER_HISTORY_FRAME_COUNT + inputFrameCount;
+    size_t outputFrameCount = 0;
+
+    memcpy(resampler->frames + RESAMPLER_HISTORY_FRAME_COUNT * channelCount,
+        input,
+        inputFrameCount * channelCount * sizeof(int32_t));
+
+    // The frame before the position and the two after it must be available.
+    while ((resampler->position >> POSITION_FRACTIONAL_BIT_COUNT) + 2 < frameCount)
+    {
+        size_t index = resampler->position >> POSITION_FRACTIONAL_BIT_COUNT;
+        float mu = (float)(resampler->position & POSITION_FRACTION_MASK) / (float)POSITION_ONE;
+        const int32_t* frames = resampler->frames + (index - 1) * channelCount;
+
+        for (size_t channel = 0; channel < channelCount; channel++)
+        {
+            output[outputFrameCount * channelCount + channel] = interpolate(frames + channel, channelCount, mu);
+        }
+
+        outputFrameCount++;
+        resampler->position += resampler->step;
+    }
+
+    resampler->position -= (uint64_t)inputFrameCount << POSITION_FRACTIONAL_BIT_COUNT;
+    memmove(resampler->frames,
+        resampler->frames + inputFrameCount * channelCount,
+        RESAMPLER_HISTORY_FRAME_COUNT * channelCount * sizeof(int32_t));
+
+    return outputFrameCount;
+}
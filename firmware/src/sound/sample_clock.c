@@ -0,0 +1,130 @@
+#include "sound/sample_clock.h"
+#include "config.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <stdlib.h>
+
+#define MS_IN_S_COUNT 1000
+#define SAMPLE_PERIOD_FRACTIONAL_BIT_COUNT 32
+
+// Tracking loop gains
+#define PHASE_GAIN 0.125
+#define FREQUENCY_GAIN 0.0625
+
+static portMUX_TYPE sampleClockMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t nominalSampleFrequency;
+static uint64_t anchorIntervalSampleCount;
+static int isSynchronized = 0;
+
+static uint64_t anchorSampleIndex;
+static int64_t anchorTimeUs;
+static double estimatedSampleFrequency;
+static int64_t samplePeriodUsQ32; // Fixed point with SAMPLE_PERIOD_FRACTIONAL_BIT_COUNT fractional bits
+
+static int64_t getSamplePeriodUsQ32(double sampleFrequency)
+{
+    return (int64_t)((double)US_IN_S_COUNT / sampleFrequency * (double)(1LL << SAMPLE_PERIOD_FRACTIONAL_BIT_COUNT));
+}
+
+static void setAnchor(uint64_t sampleIndex, int64_t timeUs, double sampleFrequency)
+{
+    portENTER_CRITICAL(&sampleClockMux);
+    anchorSampleIndex = sampleIndex;
+    anchorTimeUs = timeUs;
+    estimatedSampleFrequency = sampleFrequency;
+    samplePeriodUsQ32 = getSamplePeriodUsQ32(sampleFrequency);
+    portEXIT_CRITICAL(&sampleClockMux);
+}
+
+void initializeSampleClock(uint32_t frequency)
+{
+    resetSampleClock(frequency, 0);
+}
+
+void resetSampleClock(uint32_t frequency, uint64_t nextSampleIndex)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    nominalSampleFrequency = frequency;
+    anchorIntervalSampleCount = (uint64_t)frequency * CONFIG_SOUND_SAMPLE_CLOCK_ANCHOR_INTERVAL_MS / MS_IN_S_COUNT;
+    isSynchronized = 0;
+    setAnchor(nextSampleIndex, getTimevalUs(&tv), frequency);
+}
+
+int updateSampleClock(uint64_t nextSampleIndex)
+{
+    if (isSynchronized && nextSampleIndex - anchorSampleIndex < anchorIntervalSampleCount)
+    {
+        return 0;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t measuredTimeUs = getTimevalUs(&tv);
+
+    int64_t elapsedSampleCount = nextSampleIndex - anchorSampleIndex;
+    int64_t predictedTimeUs = convertSampleIndexToTime(nextSampleIndex);
+    int64_t errorUs = measuredTimeUs - predictedTimeUs;
+
+    // The first anchor and the system clock steps (SNTP) restart the tracking from the nominal frequency.
+    if (!isSynchronized || llabs(errorUs) > CONFIG_SOUND_SAMPLE_CLOCK_RESYNCHRONIZATION_THRESHOLD_US)
+    {
+        if (isSynchronized)
+        {
+            ESP_LOGW(SOUND_LOGGER_TAG, "Sample clock resynchronization (error = %lld us)", (long long)errorUs);
+        }
+        isSynchronized = 1;
+        setAnchor(nextSampleIndex, measuredTimeUs, nominalSampleFrequency);
+        return 0;
+    }
+
+    double measuredSampleFrequency = (double)elapsedSampleCount * US_IN_S_COUNT / (double)(measuredTimeUs - anchorTimeUs);
+    double sampleFrequency = estimatedSampleFrequency + (measuredSampleFrequency - estimatedSampleFrequency) * FREQUENCY_GAIN;
+    setAnchor(nextSampleIndex, predictedTimeUs + (int64_t)(errorUs * PHASE_GAIN), sampleFrequency);
+    return 1;
+}
+
+int64_t getTimevalUs(const struct timeval* tv)
+{
+    return (int64_t)tv->tv_sec * US_IN_S_COUNT + tv->tv_usec;
+}
+
+int64_t convertSampleIndexToTime(uint64_t sampleIndex)
+{
+    portENTER_CRITICAL(&sampleClockMux);
+    int64_t sampleCount = (int64_t)(sampleIndex - anchorSampleIndex);
+    int64_t timeUs = anchorTimeUs;
+    int64_t periodUsQ32 = samplePeriodUsQ32;
+    portEXIT_CRITICAL(&sampleClockMux);
+
+    // The sample count stays in the order of one anchor interval, so the product does not overflow.
+    return timeUs + ((sampleCount * periodUsQ32) >> SAMPLE_PERIOD_FRACTIONAL_BIT_COUNT);
+}
+
+int64_t convertTimeToSampleIndex(int64_t timeUs)
+{
+    portENTER_CRITICAL(&sampleClockMux);
+    uint64_t sampleIndex = anchorSampleIndex;
+    int64_t elapsedUs = timeUs - anchorTimeUs;
+    double sampleFrequency = estimatedSampleFrequency;
+    portEXIT_CRITICAL(&sampleClockMux);
+
+    return (int64_t)sampleIndex + (int64_t)((double)elapsedUs * sampleFrequency / US_IN_S_COUNT);
+}
+
+double getEstimatedSampleFrequency()
+{
+    portENTER_CRITICAL(&sampleClockMux);
+    double sampleFrequency = estimatedSampleFrequency;
+    portEXIT_CRITICAL(&sampleClockMux);
+
+    return sampleFrequency;
+}
+
+uint32_t getNominalSampleFrequency()
+{
+    return nominalSampleFrequency;
+}
@@ -0,0 +1,68 @@
+#include "sound/sample_format.h"
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#define PACKED_GROUP_SAMPLE_COUNT 4
+
+int isSampleFormatSupported(uint32_t sampleFormat)
+{
+    return sampleFormat == CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24 ||
+        sampleFormat == CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32;
+}
+
+size_t getSampleSize(uint32_t sampleFormat)
+{
+    return sampleFormat == CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24 ? SAMPLE_FORMAT_SIGNED_24_SIZE : SAMPLE_FORMAT_SIGNED_32_SIZE;
+}
+
+void writeSamples(uint32_t sampleFormat, const int32_t* samples, size_t sampleCount, uint8_t* output)
+{
+    if (sampleFormat == CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24)
+    {
+        packSamples24(samples, sampleCount, output);
+    }
+    else
+    {
+        memcpy(output, samples, sampleCount * sizeof(int32_t));
+    }
+}
+
+static void packSample24(int32_t sample, uint8_t* output)
+{
+    uint32_t value = (uint32_t)sample;
+    output[0] = (uint8_t)(value >> 24);
+    output[1] = (uint8_t)(value >> 16);
+    output[2] = (uint8_t)(value >> 8);
+}
+
+void packSamples24(const int32_t* samples, size_t sampleCount, uint8_t* output)
+{
+    // Groups of 4 samples are packed in 3 aligned 32-bit words.
+    if (((uintptr_t)output & (sizeof(uint32_t) - 1)) == 0)
+    {
+        uint32_t* words = (uint32_t*)output;
+        while (sampleCount >= PACKED_GROUP_SAMPLE_COUNT)
+        {
+            uint32_t a = (uint32_t)samples[0];
+            uint32_t b = (uint32_t)samples[1];
+            uint32_t c = (uint32_t)samples[2];
+            uint32_t d = (uint32_t)samples[3];
+
+            words[0] = htonl((a & 0xFFFFFF00) | (b >> 24));
+            words[1] = htonl(((b << 8) & 0xFFFF0000) | (c >> 16));
+            words[2] = htonl(((c << 16) & 0xFF000000) | (d >> 8));
+
+            samples += PACKED_GROUP_SAMPLE_COUNT;
+            words += 3;
+            sampleCount -= PACKED_GROUP_SAMPLE_COUNT;
+        }
+        output = (uint8_t*)words;
+    }
+
+    for (size_t i = 0; i < sampleCount; i++)
+    {
+        packSample24(samples[i], output + i * SAMPLE_FORMAT_SIGNED_24_SIZE);
+    }
+}
@@ -0,0 +1,151 @@
+#include "sound/sample_history.h"
+#include "config.h"
+
+#include <freertos/FreeRTOS.h>
+#include <esp_heap_caps.h>
+
+#include <string.h>
+
+static portMUX_TYPE sampleHistoryMux = portMUX_INITIALIZER_UNLOCKED;
+
+static int32_t* samples = NULL;
+static size_t sampleCapacity = 0;
+static size_t channelCount = 1;
+static size_t frameCapacity = 0;
+
+// The frames in [beginIndex, endIndex) are valid.
+// The frames before reservedEndIndex - frameCapacity may be overwritten by the write in progress.
+static uint64_t beginIndex = 0;
+static uint64_t endIndex = 0;
+static uint64_t reservedEndIndex = 0;
+
+esp_err_t initializeSampleHistory(size_t psramSampleCapacity, size_t internalSampleCapacity)
+{
+    size_t capacity = psramSampleCapacity;
+    samples = heap_caps_malloc(capacity * sizeof(int32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (samples == NULL)
+    {
+        capacity = internalSampleCapacity;
+        samples = heap_caps_malloc(capacity * sizeof(int32_t), MALLOC_CAP_8BIT);
+    }
+    if (samples == NULL)
+    {
+        ESP_LOGE(SOUND_LOGGER_TAG, "Unable to allocate the sample history");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(SOUND_LOGGER_TAG, "Sample history size: %u samples", (unsigned int)capacity);
+    sampleCapacity = capacity;
+    resetSampleHistory(0, 1);
+    return ESP_OK;
+}
+
+void resetSampleHistory(uint64_t nextFrameIndex, size_t historyChannelCount)
+{
+    portENTER_CRITICAL(&sampleHistoryMux);
+    channelCount = historyChannelCount;
+    frameCapacity = sampleCapacity / historyChannelCount;
+    beginIndex = nextFrameIndex;
+    endIndex = nextFrameIndex;
+    reservedEndIndex = nextFrameIndex;
+    portEXIT_CRITICAL(&sampleHistoryMux);
+}
+
+static void copyFramesToHistory(uint64_t frameIndex, const int32_t* frames, size_t frameCount)
+{
+    size_t position = frameIndex % frameCapacity;
+    size_t firstFrameCount = frameCapacity - position;
+    if (firstFrameCount > frameCount)
+    {
+        firstFrameCount = frameCount;
+    }
+
+    memcpy(samples + position * channelCount, frames, firstFrameCount * channelCount * sizeof(int32_t));
+    memcpy(samples, frames + firstFrameCount * channelCount, (frameCount - firstFrameCount) * channelCount * sizeof(int32_t));
+}
+
+void writeSampleHistory(const int32_t* frames, size_t frameCount)
+{
+    if (frameCapacity == 0)
+    {
+        return;
+    }
+
+    while (frameCount > 0)
+    {
+        size_t writtenFrameCount = frameCount > frameCapacity ? frameCapacity : frameCount;
+
+        portENTER_CRITICAL(&sampleHistoryMux);
+        uint64_t frameIndex = endIndex;
+        reservedEndIndex = endIndex + writtenFrameCount;
+        if (reservedEndIndex - beginIndex > frameCapacity)
+        {
+            beginIndex = reservedEndIndex - frameCapacity;
+        }
+        portEXIT_CRITICAL(&sampleHistoryMux);
+
+        copyFramesToHistory(frameIndex, frames, writtenFrameCount);
+
+        portENTER_CRITICAL(&sampleHistoryMux);
+        endIndex = reservedEndIndex;
+        portEXIT_CRITICAL(&sampleHistoryMux);
+
+        frames += writtenFrameCount * channelCount;
+        frameCount -= writtenFrameCount;
+    }
+}
+
+uint64_t getSampleHistoryBeginIndex()
+{
+    portENTER_CRITICAL(&sampleHistoryMux);
+    uint64_t index = beginIndex;
+    portEXIT_CRITICAL(&sampleHistoryMux);
+
+    return index;
+}
+
+uint64_t getSampleHistoryEndIndex()
+{
+    portENTER_CRITICAL(&sampleHistoryMux);
+    uint64_t index = endIndex;
+    portEXIT_CRITICAL(&sampleHistoryMux);
+
+    return index;
+}
+
+size_t getSampleHistoryChannelCount()
+{
+    return channelCount;
+}
+
+int readSampleHistory(uint64_t frameIndex, size_t frameCount, size_t frameChannelCount, int32_t* frames)
+{
+    portENTER_CRITICAL(&sampleHistoryMux);
+    int isAvailable = frameCapacity > 0 &&
+        frameChannelCount == channelCount &&
+        frameIndex >= beginIndex &&
+        frameIndex + frameCount <= endIndex;
+    portEXIT_CRITICAL(&sampleHistoryMux);
+
+    if (!isAvailable)
+    {
+        return 0;
+    }
+
+    size_t position = frameIndex % frameCapacity;
+    size_t firstFrameCount = frameCapacity - position;
+    if (firstFrameCount > frameCount)
+    {
+        firstFrameCount = frameCount;
+    }
+
+    memcpy(frames, samples + position * channelCount, firstFrameCount * channelCount * sizeof(int32_t));
+    memcpy(frames + firstFrameCount * channelCount, samples, (frameCount - firstFrameCount) * channelCount * sizeof(int32_t));
+
+    // The frames are valid if the writer did not reach them during the copy.
+    portENTER_CRITICAL(&sampleHistoryMux);
+    isAvailable = reservedEndIndex <= frameIndex + frameCapacity;
+    portEXIT_CRITICAL(&sampleHistoryMux);
+
+    return isAvailable;
+}
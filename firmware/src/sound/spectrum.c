@@ -0,0 +1,270 @@
+#include "sound/spectrum.h"
+
+#include <arpa/inet.h>
+
+#include <math.h>
+#include <string.h>
+
+#define SPECTRUM_MESSAGE_CONTENT_OFFSET 15
+#define SPECTRUM_MESSAGE_SAMPLE_FREQUENCY_OFFSET 16
+#define SPECTRUM_MESSAGE_FFT_SIZE_OFFSET 20
+#define SPECTRUM_MESSAGE_WINDOW_COUNT_OFFSET 22
+#define SPECTRUM_MESSAGE_BIN_COUNT_OFFSET 24
+#define SPECTRUM_MESSAGE_BAND_COUNT_OFFSET 26
+#define SPECTRUM_MESSAGE_HEADER_SIZE 28
+#define SPECTRUM_MESSAGE_PAYLOAD_SIZE_OFFSET 4
+#define SPECTRUM_MESSAGE_PAYLOAD_OFFSET 8
+
+#define MIN_FFT_SIZE 64
+#define MAX_WINDOW_OVERLAP_FACTOR 4 // 75 % overlap
+#define MS_IN_S_COUNT 1000
+
+#define BAND_REFERENCE_FREQUENCY 1000.0
+#define BAND_REFERENCE_INDEX 17
+#define BAND_WIDTH_EXPONENT 0.05 // Half of a 1/3 octave in decades (base 10 bands)
+
+#define SAMPLE_SCALE (1.0f / 2147483648.0f)
+#define LEVEL_SCALE 100.0 // 0.01 dB
+#define MIN_LEVEL INT16_MIN
+
+_Static_assert(SPECTRUM_MAX_FFT_SIZE <= FFT_MAX_SIZE, "The spectrum FFT size is not supported by the FFT");
+_Static_assert(SPECTRUM_MESSAGE_HEADER_SIZE + (SPECTRUM_MAX_FFT_SIZE / 2 + 1 + SPECTRUM_MAX_BAND_COUNT) * sizeof(int16_t) <=
+    CONFIG_STREAMING_PACKET_MAX_SIZE, "The spectrum messages must fit in the streaming packets");
+
+static SpectrumConfiguration configuration;
+static uint32_t sampleFrequency;
+
+static float window[SPECTRUM_MAX_FFT_SIZE];
+static float windowPowerSum;
+
+static float frames[SPECTRUM_MAX_FFT_SIZE];
+static size_t frameCount;
+static uint64_t frameSampleIndex; // Sample index of frames[0]
+
+static float fftData[SPECTRUM_MAX_FFT_SIZE];
+static float power[SPECTRUM_MAX_FFT_SIZE / 2 + 1];
+static float powerSum[SPECTRUM_MAX_FFT_SIZE / 2 + 1];
+static size_t windowCount;
+
+static size_t intervalFrameCount;
+static size_t elapsedFrameCount;
+static uint64_t messageSampleIndex;
+
+void initializeSpectrum()
+{
+    initializeFft();
+    memset(&configuration, 0, sizeof(configuration));
+}
+
+int isSpectrumConfigurationSupported(const SpectrumConfiguration* requestedConfiguration)
+{
+    if (requestedConfiguration->fftSize == 0)
+    {
+        return 1;
+    }
+    return isFftSizeSupported(requestedConfiguration->fftSize) &&
+        requestedConfiguration->fftSize >= MIN_FFT_SIZE &&
+        requestedConfiguration->fftSize <= SPECTRUM_MAX_FFT_SIZE &&
+        requestedConfiguration->hopSize >= requestedConfiguration->fftSize / MAX_WINDOW_OVERLAP_FACTOR &&
+        requestedConfiguration->hopSize <= requestedConfiguration->fftSize &&
+        requestedConfiguration->intervalMs >= CONFIG_SOUND_SPECTRUM_MIN_INTERVAL_MS &&
+        (requestedConfiguration->content & (SPECTRUM_CONTENT_BINS | SPECTRUM_CONTENT_BANDS)) != 0 &&
+        (requestedConfiguration->content & ~(SPECTRUM_CONTENT_BINS | SPECTRUM_CONTENT_BANDS)) == 0 &&
+        requestedConfiguration->channel < CONFIG_SOUND_MAX_CHANNEL_COUNT;
+}
+
+static void startAveraging()
+{
+    memset(powerSum, 0, sizeof(powerSum));
+    windowCount = 0;
+}
+
+// Periodic Hann window, so the overlapped windows at 50 % and 75 % sum to a constant.
+static void initializeWindow(size_t size)
+{
+    windowPowerSum = 0.0f;
+    for (size_t i = 0; i < size; i++)
+    {
+        window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / size));
+        windowPowerSum += window[i] * window[i];
+    }
+}
+
+void resetSpectrum(const SpectrumConfiguration* requestedConfiguration, uint32_t requestedSampleFrequency, uint64_t sampleIndex)
+{
+    configuration = *requestedConfiguration;
+    sampleFrequency = requestedSampleFrequency;
+    if (!isSpectrumEnabled())
+    {
+        return;
+    }
+
+    initializeWindow(configuration.fftSize);
+    frameCount = 0;
+    frameSampleIndex = sampleIndex;
+    intervalFrameCount = (size_t)((uint64_t)sampleFrequency * configuration.intervalMs / MS_IN_S_COUNT);
+    elapsedFrameCount = 0;
+    startAveraging();
+}
+
+int isSpectrumEnabled()
+{
+    return configuration.fftSize > 0;
+}
+
+uint32_t getSpectrumSampleFrequency()
+{
+    return sampleFrequency;
+}
+
+static void analyzeWindow()
+{
+    for (size_t i = 0; i < configuration.fftSize; i++)
+    {
+        fftData[i] = frames[i] * window[i];
+    }
+    computeRealFftPower(fftData, configuration.fftSize, power);
+
+    if (windowCount == 0)
+    {
+        messageSampleIndex = frameSampleIndex;
+    }
+    for (size_t k = 0; k <= configuration.fftSize / 2; k++)
+    {
+        powerSum[k] += power[k];
+    }
+    windowCount++;
+}
+
+int addSpectrumFrames(const int32_t* inputFrames, size_t inputFrameCount, size_t channelCount)
+{
+    if (!isSpectrumEnabled())
+    {
+        return 0;
+    }
+
+    const int32_t* samples = inputFrames + configuration.channel;
+    size_t fftSize = configuration.fftSize;
+    size_t hopSize = configuration.hopSize;
+    for (size_t i = 0; i < inputFrameCount; i++)
+    {
+        frames[frameCount] = samples[i * channelCount] * SAMPLE_SCALE;
+        frameCount++;
+
+        if (frameCount == fftSize)
+        {
+            analyzeWindow();
+            memmove(frames, frames + hopSize, (fftSize - hopSize) * sizeof(float));
+            frameCount -= hopSize;
+            frameSampleIndex += hopSize;
+        }
+    }
+
+    elapsedFrameCount += inputFrameCount;
+    return windowCount > 0 && elapsedFrameCount >= intervalFrameCount;
+}
+
+uint64_t getSpectrumMessageSampleIndex()
+{
+    return messageSampleIndex;
+}
+
+static int16_t convertToLevel(double power)
+{
+    // The reference is the power of a full-scale sine, 0.5.
+    double level = power > 0.0 ? LEVEL_SCALE * 10.0 * log10(2.0 * power) : MIN_LEVEL;
+    if (level < MIN_LEVEL)
+    {
+        return MIN_LEVEL;
+    }
+    return level > INT16_MAX ? INT16_MAX : (int16_t)lrint(level);
+}
+
+static uint8_t* writeLevel(uint8_t* buffer, double power)
+{
+    uint16_t level = (uint16_t)convertToLevel(power);
+    buffer[0] = (uint8_t)(level >> 8);
+    buffer[1] = (uint8_t)level;
+    return buffer + sizeof(int16_t);
+}
+
+// Mean power of the bin over the averaged windows, scaled so the sum over the one-sided bins is the signal power.
+static double getBinPower(size_t k)
+{
+    double scale = (k == 0 || k == configuration.fftSize / 2 ? 1.0 : 2.0) /
+        ((double)configuration.fftSize * windowPowerSum * windowCount);
+    return powerSum[k] * scale;
+}
+
+static double getBandPower(double lowFrequency, double highFrequency)
+{
+    double binWidth = (double)sampleFrequency / configuration.fftSize;
+    size_t lastBin = configuration.fftSize / 2;
+    size_t firstK = (size_t)(lowFrequency / binWidth + 0.5);
+    size_t lastK = (size_t)(highFrequency / binWidth + 0.5);
+    if (lastK > lastBin)
+    {
+        lastK = lastBin;
+    }
+
+    double bandPower = 0.0;
+    for (size_t k = firstK; k <= lastK; k++)
+    {
+        double binLow = fmax((k - 0.5) * binWidth, lowFrequency);
+        double binHigh = fmin((k + 0.5) * binWidth, highFrequency);
+        if (binHigh > binLow)
+        {
+            bandPower += getBinPower(k) * (binHigh - binLow) / binWidth;
+        }
+    }
+    return bandPower;
+}
+
+static size_t getBandCount()
+{
+    double nyquistFrequency = sampleFrequency / 2.0;
+    size_t bandCount = 0;
+    while (bandCount < SPECTRUM_MAX_BAND_COUNT &&
+        BAND_REFERENCE_FREQUENCY * pow(10.0, ((double)bandCount - BAND_REFERENCE_INDEX) / 10.0 + BAND_WIDTH_EXPONENT) <= nyquistFrequency)
+    {
+        bandCount++;
+    }
+    return bandCount;
+}
+
+size_t writeSpectrumMessage(uint8_t* buffer)
+{
+    size_t binCount = configuration.content & SPECTRUM_CONTENT_BINS ? configuration.fftSize / 2 + 1 : 0;
+    size_t bandCount = configuration.content & SPECTRUM_CONTENT_BANDS ? getBandCount() : 0;
+    size_t size = SPECTRUM_MESSAGE_HEADER_SIZE + (binCount + bandCount) * sizeof(int16_t);
+
+    *(uint32_t*)buffer = htonl(SPECTRUM_MESSAGE_ID);
+    *(uint32_t*)(buffer + SPECTRUM_MESSAGE_PAYLOAD_SIZE_OFFSET) = htonl(size - SPECTRUM_MESSAGE_PAYLOAD_OFFSET);
+    buffer[SPECTRUM_MESSAGE_CONTENT_OFFSET] = configuration.content;
+    *(uint32_t*)(buffer + SPECTRUM_MESSAGE_SAMPLE_FREQUENCY_OFFSET) = htonl(sampleFrequency);
+    *(uint16_t*)(buffer + SPECTRUM_MESSAGE_FFT_SIZE_OFFSET) = htons(configuration.fftSize);
+    *(uint16_t*)(buffer + SPECTRUM_MESSAGE_WINDOW_COUNT_OFFSET) = htons(windowCount);
+    *(uint16_t*)(buffer + SPECTRUM_MESSAGE_BIN_COUNT_OFFSET) = htons(binCount);
+    *(uint16_t*)(buffer + SPECTRUM_MESSAGE_BAND_COUNT_OFFSET) = htons(bandCount);
+
+    uint8_t* levels = buffer + SPECTRUM_MESSAGE_HEADER_SIZE;
+    for (size_t k = 0; k < binCount; k++)
+    {
+        levels = writeLevel(levels, getBinPower(k));
+    }
+    for (size_t i = 0; i < bandCount; i++)
+    {
+        double exponent = ((double)i - BAND_REFERENCE_INDEX) / 10.0;
+        levels = writeLevel(levels, getBandPower(BAND_REFERENCE_FREQUENCY * pow(10.0, exponent - BAND_WIDTH_EXPONENT),
+            BAND_REFERENCE_FREQUENCY * pow(10.0, exponent + BAND_WIDTH_EXPONENT)));
+    }
+
+    // The excess is kept so the message rate follows the interval, unless a whole interval is late.
+    elapsedFrameCount -= intervalFrameCount;
+    if (elapsedFrameCount >= intervalFrameCount)
+    {
+        elapsedFrameCount = 0;
+    }
+    startAveraging();
+    return size;
+}
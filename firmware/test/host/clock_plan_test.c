@@ -0,0 +1,94 @@
+#include "host_test.h"
+#include "sound/clock_plan.h"
+#include "config.h"
+
+#include <math.h>
+
+// Checks the clock plans of the supported sample frequencies against an exhaustive search of the LEDC settings,
+// and the rejection of the unsupported frequencies and of the plans outside the error limit.
+
+#define MIN_DUTY_RESOLUTION 1
+#define MAX_DUTY_RESOLUTION 4
+#define MIN_CLOCK_DIVIDER 256
+#define MAX_CLOCK_DIVIDER ((1 << 18) - 1)
+
+static double getMclkFrequency(uint32_t sourceFrequency, uint32_t clockDivider, uint32_t dutyResolution)
+{
+    return sourceFrequency * 256.0 / clockDivider / (1 << dutyResolution);
+}
+
+// Returns the smallest error of all the LEDC settings, in ppm.
+static double findMinErrorPpm(uint32_t mclkFrequency, uint32_t sourceFrequency)
+{
+    double minErrorPpm = INFINITY;
+    for (uint32_t dutyResolution = MIN_DUTY_RESOLUTION; dutyResolution <= MAX_DUTY_RESOLUTION; dutyResolution++)
+    {
+        for (uint32_t clockDivider = MIN_CLOCK_DIVIDER; clockDivider <= MAX_CLOCK_DIVIDER; clockDivider++)
+        {
+            double errorPpm = fabs(getMclkFrequency(sourceFrequency, clockDivider, dutyResolution) / mclkFrequency - 1) * 1e6;
+            minErrorPpm = errorPpm < minErrorPpm ? errorPpm : minErrorPpm;
+        }
+    }
+    return minErrorPpm;
+}
+
+static void testSupportedFrequencies()
+{
+    static const uint32_t SAMPLE_FREQUENCIES[] = { 44100, 48000, 88200, 96000 };
+    static const uint32_t SOURCE_FREQUENCIES[] = { CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY, 40000000 };
+
+    for (size_t i = 0; i < sizeof(SOURCE_FREQUENCIES) / sizeof(SOURCE_FREQUENCIES[0]); i++)
+    {
+        for (size_t j = 0; j < sizeof(SAMPLE_FREQUENCIES) / sizeof(SAMPLE_FREQUENCIES[0]); j++)
+        {
+            ClockPlan plan;
+            uint32_t mclkFrequency = SAMPLE_FREQUENCIES[j] * CLOCK_PLAN_MCLK_RATIO;
+            int isFound = computeClockPlan(SAMPLE_FREQUENCIES[j], SOURCE_FREQUENCIES[i], CONFIG_SOUND_CLOCK_MAX_ERROR_PPM, &plan);
+
+            // The LEDC output is at most half of its source frequency.
+            HOST_TEST_CHECK(isFound == (2 * mclkFrequency <= SOURCE_FREQUENCIES[i]));
+            if (!isFound)
+            {
+                continue;
+            }
+
+            double actualMclkFrequency = getMclkFrequency(SOURCE_FREQUENCIES[i], plan.ledcClockDivider, plan.ledcDutyResolution);
+            double minErrorPpm = findMinErrorPpm(mclkFrequency, SOURCE_FREQUENCIES[i]);
+            printf("%u Hz from %u Hz: duty resolution = %u, divider = %u/256, MCLK = %.1f Hz, error = %+.1f ppm\n",
+                SAMPLE_FREQUENCIES[j],
+                SOURCE_FREQUENCIES[i],
+                plan.ledcDutyResolution,
+                plan.ledcClockDivider,
+                plan.actualMclkFrequency,
+                plan.errorPpm);
+
+            HOST_TEST_CHECK(plan.sampleFrequency == SAMPLE_FREQUENCIES[j]);
+            HOST_TEST_CHECK(plan.mclkFrequency == mclkFrequency);
+            HOST_TEST_CHECK(plan.ledcDuty * 2 == 1u << plan.ledcDutyResolution);
+            HOST_TEST_CHECK(plan.ledcClockDivider >= MIN_CLOCK_DIVIDER && plan.ledcClockDivider <= MAX_CLOCK_DIVIDER);
+            HOST_TEST_CHECK(fabs(plan.actualMclkFrequency - actualMclkFrequency) < 1e-6);
+            HOST_TEST_CHECK(fabs(plan.errorPpm - (actualMclkFrequency / mclkFrequency - 1) * 1e6) < 1e-6);
+            HOST_TEST_CHECK(fabs(fabs(plan.errorPpm) - minErrorPpm) < 1e-6);
+        }
+    }
+}
+
+static void testRejectedPlans()
+{
+    ClockPlan plan;
+    HOST_TEST_CHECK(!computeClockPlan(32000, CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY, CONFIG_SOUND_CLOCK_MAX_ERROR_PPM, &plan));
+    HOST_TEST_CHECK(!computeClockPlan(192000, CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY, CONFIG_SOUND_CLOCK_MAX_ERROR_PPM, &plan));
+    HOST_TEST_CHECK(!computeClockPlan(0, CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY, CONFIG_SOUND_CLOCK_MAX_ERROR_PPM, &plan));
+
+    // The error of 44.1 kHz from the APB clock is not zero, so a stricter limit rejects it.
+    HOST_TEST_CHECK(computeClockPlan(44100, CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY, CONFIG_SOUND_CLOCK_MAX_ERROR_PPM, &plan));
+    HOST_TEST_CHECK(!computeClockPlan(44100, CONFIG_SOUND_CLOCK_SOURCE_FREQUENCY, fabs(plan.errorPpm) / 2, &plan));
+}
+
+int main()
+{
+    testSupportedFrequencies();
+    testRejectedPlans();
+
+    return getHostTestResult();
+}
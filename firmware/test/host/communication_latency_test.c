@@ -0,0 +1,295 @@
+#include "host_test.h"
+#include "network/communication.h"
+#include "network/session.h"
+#include "network/streaming.h"
+#include "network/upload.h"
+#include "config.h"
+
+#include <lwip/sockets.h>
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs the communication event loop against the POSIX sockets of the loopback interface and measures its reaction
+// time: heartbeat round trips, record request dispatch, disconnect detection and reconnection. It also checks the
+// UDP packet rate cap of the sessions.
+// The upload task is replaced by direct sends, so the round trips only measure the event loop.
+
+#define INITIALIZATION_REQUEST_SIZE 16
+#define INITIALIZATION_RESPONSE_SIZE 14
+#define INITIALIZATION_RESPONSE_IS_COMPATIBLE_OFFSET 8
+#define HEARTBEAT_SIZE 4
+#define RECORD_REQUEST_SIZE 16
+#define HEARTBEAT_COUNT 2000
+#define CONNECTION_TIMEOUT_MS 2000
+#define POLL_INTERVAL_US 100
+
+static atomic_uint recordRequestCount;
+
+static int handleInitialization(const SoundConfiguration* configuration)
+{
+    return configuration->sampleFrequency == 44100 && configuration->sampleFormat == CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32;
+}
+
+static int handleRecord(uint8_t recordHour,
+    uint8_t recordMinute,
+    uint8_t recordSecond,
+    uint16_t recordMs,
+    uint16_t durationMs,
+    uint8_t recordId)
+{
+    atomic_fetch_add(&recordRequestCount, 1);
+    return 1;
+}
+
+static int handleSpectrum(const SpectrumConfiguration* configuration)
+{
+    return 1;
+}
+
+static int handleLevelMeter(const LevelMeterConfiguration* configuration)
+{
+    return 1;
+}
+
+static int handleImpulseResponse(const ImpulseResponseRequest* request)
+{
+    return 1;
+}
+
+int queueUploadMessage(uint32_t sessionId, const uint8_t* data, size_t size)
+{
+    return sendTcp(sessionId, data, size);
+}
+
+int queueRecordFetch(uint32_t sessionId, uint8_t recordId, uint32_t offset, uint32_t size)
+{
+    return 1;
+}
+
+void setRecordSessionId(uint8_t recordId, uint32_t sessionId)
+{
+}
+
+void setMeasurementSessionId(uint8_t measurementId, uint32_t sessionId)
+{
+}
+
+int requestStreamingRetransmission(uint32_t sessionId, uint16_t sequenceId)
+{
+    return 1;
+}
+
+static int compareDoubles(const void* a, const void* b)
+{
+    double difference = *(const double*)a - *(const double*)b;
+    return (difference > 0) - (difference < 0);
+}
+
+static int receiveAll(int socketHandle, uint8_t* buffer, size_t size)
+{
+    size_t receivedSize = 0;
+    while (receivedSize < size)
+    {
+        ssize_t result = recv(socketHandle, buffer + receivedSize, size - receivedSize, 0);
+        if (result <= 0)
+        {
+            return 0;
+        }
+        receivedSize += result;
+    }
+    return 1;
+}
+
+static int waitForSessionCount(size_t sessionCount)
+{
+    double startTimeS = getHostTestTimeS();
+    while (getSessionCount() != sessionCount)
+    {
+        if (getHostTestTimeS() - startTimeS > CONNECTION_TIMEOUT_MS / 1000.0)
+        {
+            return 0;
+        }
+        usleep(POLL_INTERVAL_US);
+    }
+    return 1;
+}
+
+// Returns the socket of a new session, or -1.
+static int connectClient()
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(CONFIG_COMMUNICATION_TCP_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int socketHandle = -1;
+    double startTimeS = getHostTestTimeS();
+    while (socketHandle < 0 && getHostTestTimeS() - startTimeS < CONNECTION_TIMEOUT_MS / 1000.0)
+    {
+        socketHandle = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(socketHandle, (struct sockaddr*)&address, sizeof(address)) < 0)
+        {
+            close(socketHandle);
+            socketHandle = -1;
+            usleep(10 * POLL_INTERVAL_US);
+        }
+    }
+    if (socketHandle < 0)
+    {
+        return -1;
+    }
+
+    int isNoDelay = 1;
+    setsockopt(socketHandle, IPPROTO_TCP, TCP_NODELAY, &isNoDelay, sizeof(isNoDelay));
+
+    uint8_t request[INITIALIZATION_REQUEST_SIZE] =
+    {
+        0, 0, 0, 2,
+        0, 0, 0, INITIALIZATION_REQUEST_SIZE - 8,
+        0, 0, 0xAC, 0x44,
+        0, 0, 0, CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32
+    };
+    uint8_t response[INITIALIZATION_RESPONSE_SIZE];
+    if (send(socketHandle, request, sizeof(request), 0) != sizeof(request) ||
+        !receiveAll(socketHandle, response, sizeof(response)) ||
+        !response[INITIALIZATION_RESPONSE_IS_COMPATIBLE_OFFSET])
+    {
+        close(socketHandle);
+        return -1;
+    }
+    return socketHandle;
+}
+
+static void testHeartbeatLatency(int socketHandle)
+{
+    static double latenciesUs[HEARTBEAT_COUNT];
+    uint8_t heartbeat[HEARTBEAT_SIZE] = { 0, 0, 0, 4 };
+    uint8_t response[HEARTBEAT_SIZE];
+    size_t heartbeatCount = getHostBenchmarkIterationCount(HEARTBEAT_COUNT);
+    heartbeatCount = heartbeatCount > HEARTBEAT_COUNT ? HEARTBEAT_COUNT : heartbeatCount;
+
+    for (size_t i = 0; i < heartbeatCount; i++)
+    {
+        double startTimeS = getHostTestTimeS();
+        HOST_TEST_CHECK(send(socketHandle, heartbeat, sizeof(heartbeat), 0) == sizeof(heartbeat));
+        HOST_TEST_CHECK(receiveAll(socketHandle, response, sizeof(response)));
+        HOST_TEST_CHECK(memcmp(response, heartbeat, sizeof(heartbeat)) == 0);
+        latenciesUs[i] = (getHostTestTimeS() - startTimeS) * 1e6;
+    }
+
+    qsort(latenciesUs, heartbeatCount, sizeof(double), compareDoubles);
+    printf("Heartbeat round trip: median = %.0f us, p99 = %.0f us, max = %.0f us\n",
+        latenciesUs[heartbeatCount / 2],
+        latenciesUs[heartbeatCount * 99 / 100],
+        latenciesUs[heartbeatCount - 1]);
+
+    // The previous loop only reacted after its 1 s receive timeout.
+    HOST_TEST_CHECK(latenciesUs[heartbeatCount - 1] < CONFIG_COMMUNICATION_TIMEOUT_MS * 1000.0);
+}
+
+// The message is dispatched once its last byte is received, even if it arrives in several segments.
+static void testRecordRequestLatency(int socketHandle)
+{
+    uint8_t request[RECORD_REQUEST_SIZE] =
+    {
+        0, 0, 0, 5,
+        0, 0, 0, RECORD_REQUEST_SIZE - 8,
+        12, 0, 0, 0, 0, 0, 100, 1
+    };
+    unsigned int initialCount = atomic_load(&recordRequestCount);
+
+    HOST_TEST_CHECK(send(socketHandle, request, 7, 0) == 7);
+    usleep(20000);
+    HOST_TEST_CHECK(atomic_load(&recordRequestCount) == initialCount);
+
+    double startTimeS = getHostTestTimeS();
+    HOST_TEST_CHECK(send(socketHandle, request + 7, sizeof(request) - 7, 0) == sizeof(request) - 7);
+    while (atomic_load(&recordRequestCount) == initialCount && getHostTestTimeS() - startTimeS < 1)
+    {
+        usleep(POLL_INTERVAL_US);
+    }
+    HOST_TEST_CHECK(atomic_load(&recordRequestCount) == initialCount + 1);
+    printf("Record request dispatch: %.0f us\n", (getHostTestTimeS() - startTimeS) * 1e6);
+}
+
+// The packets sent faster than the cap are dropped once the burst is used.
+static void testUdpPacketRateCap()
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(CONFIG_COMMUNICATION_UDP_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int socketHandle = socket(AF_INET, SOCK_DGRAM, 0);
+    HOST_TEST_CHECK(bind(socketHandle, (struct sockaddr*)&address, sizeof(address)) == 0);
+    struct timeval timeout = { 0, 100000 };
+    setsockopt(socketHandle, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t packet[HEARTBEAT_SIZE] = { 0 };
+    for (size_t i = 0; i < 2 * CONFIG_COMMUNICATION_SESSION_UDP_PACKET_BURST; i++)
+    {
+        sendUdp(packet, sizeof(packet));
+    }
+
+    size_t receivedCount = 0;
+    while (recv(socketHandle, packet, sizeof(packet), 0) > 0)
+    {
+        receivedCount++;
+    }
+    printf("UDP packets received under the cap: %zu of %d\n", receivedCount, 2 * CONFIG_COMMUNICATION_SESSION_UDP_PACKET_BURST);
+    HOST_TEST_CHECK(receivedCount >= CONFIG_COMMUNICATION_SESSION_UDP_PACKET_BURST);
+    HOST_TEST_CHECK(receivedCount < 2 * CONFIG_COMMUNICATION_SESSION_UDP_PACKET_BURST);
+    close(socketHandle);
+}
+
+static void testReconnection(int socketHandle)
+{
+    int otherSocketHandle = connectClient();
+    HOST_TEST_CHECK(otherSocketHandle >= 0);
+    HOST_TEST_CHECK(waitForSessionCount(2));
+
+    double startTimeS = getHostTestTimeS();
+    close(socketHandle);
+    HOST_TEST_CHECK(waitForSessionCount(1));
+    printf("Disconnect detection: %.0f us\n", (getHostTestTimeS() - startTimeS) * 1e6);
+
+    // The listener is kept, so a client can reconnect at once.
+    startTimeS = getHostTestTimeS();
+    socketHandle = connectClient();
+    HOST_TEST_CHECK(socketHandle >= 0);
+    printf("Reconnection: %.0f us\n", (getHostTestTimeS() - startTimeS) * 1e6);
+    HOST_TEST_CHECK(waitForSessionCount(2));
+
+    close(socketHandle);
+    close(otherSocketHandle);
+    HOST_TEST_CHECK(waitForSessionCount(0));
+}
+
+int main()
+{
+    signal(SIGPIPE, SIG_IGN);
+    atomic_init(&recordRequestCount, 0);
+
+    initializeCommunication(handleInitialization, handleRecord, handleSpectrum, handleLevelMeter, handleImpulseResponse);
+    startCommunication();
+
+    int socketHandle = connectClient();
+    HOST_TEST_CHECK(socketHandle >= 0);
+    if (socketHandle < 0)
+    {
+        return getHostTestResult();
+    }
+
+    HOST_TEST_CHECK(waitForSessionCount(1));
+    testHeartbeatLatency(socketHandle);
+    testRecordRequestLatency(socketHandle);
+    testUdpPacketRateCap();
+    testReconnection(socketHandle);
+
+    return getHostTestResult();
+}
@@ -0,0 +1,290 @@
+#include "host_test.h"
+#include "sound/compression.h"
+#include "config.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Round-trip test of the lossless compression with a reference decoder, and compression ratio and throughput
+// benchmark. The benchmark uses a synthetic program signal, or the first channel of a 16-bit or 24-bit PCM
+// WAV recording given as the first argument.
+
+#define BLOCK_SAMPLE_COUNT CONFIG_SOUND_MESSAGE_SAMPLE_COUNT
+#define MAX_BLOCK_SAMPLE_COUNT CONFIG_SOUND_MAX_MESSAGE_SAMPLE_COUNT
+#define MAX_BLOCK_SIZE (2 + MAX_BLOCK_SAMPLE_COUNT * 3)
+#define ROUND_TRIP_BLOCK_COUNT 20000
+#define SYNTHETIC_SAMPLE_COUNT (44100 * 10)
+#define SAMPLE_SHIFT 8
+
+typedef struct
+{
+    const uint8_t* data;
+    size_t size;
+    size_t bitIndex;
+} BitReader;
+
+static int readBit(BitReader* reader)
+{
+    if (reader->bitIndex / 8 >= reader->size)
+    {
+        reader->bitIndex++;
+        return 1; // Terminates the unary codes read past the end
+    }
+    int bit = (reader->data[reader->bitIndex / 8] >> (7 - reader->bitIndex % 8)) & 1;
+    reader->bitIndex++;
+    return bit;
+}
+
+static int32_t readSample24(const uint8_t* data)
+{
+    return (int32_t)(((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8)) >> SAMPLE_SHIFT;
+}
+
+static int64_t predict(const int32_t* x, size_t n, int order)
+{
+    switch (order)
+    {
+        case 0:
+            return 0;
+        case 1:
+            return x[n - 1];
+        case 2:
+            return 2LL * x[n - 1] - x[n - 2];
+        case 3:
+            return 3LL * x[n - 1] - 3LL * x[n - 2] + x[n - 3];
+        default:
+            return 4LL * x[n - 1] - 6LL * x[n - 2] + 4LL * x[n - 3] - x[n - 4];
+    }
+}
+
+// Returns 1 if the block is valid and its size matches the encoded size. The samples are 24-bit values.
+static int decompressSamples(const uint8_t* block, size_t size, int32_t* x, size_t sampleCount)
+{
+    int order = block[0];
+    int riceParameter = block[1];
+    size_t offset = 2;
+
+    if (order == COMPRESSION_VERBATIM_ORDER)
+    {
+        for (size_t n = 0; n < sampleCount; n++, offset += 3)
+        {
+            x[n] = readSample24(block + offset);
+        }
+        return offset == size && riceParameter == 0;
+    }
+    if (order > COMPRESSION_MAX_ORDER || (size_t)order > sampleCount)
+    {
+        return 0;
+    }
+
+    for (int n = 0; n < order; n++, offset += 3)
+    {
+        x[n] = readSample24(block + offset);
+    }
+
+    BitReader reader = { block + offset, size - offset, 0 };
+    for (size_t n = order; n < sampleCount; n++)
+    {
+        uint32_t quotient = 0;
+        while (!readBit(&reader))
+        {
+            quotient++;
+        }
+        uint32_t value = quotient << riceParameter;
+        for (int bit = riceParameter - 1; bit >= 0; bit--)
+        {
+            value |= (uint32_t)readBit(&reader) << bit;
+        }
+
+        int32_t residual = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+        x[n] = (int32_t)(predict(x, n, order) + residual);
+    }
+    return offset + (reader.bitIndex + 7) / 8 == size;
+}
+
+static int32_t createRandomSample(int mode, size_t n, size_t block)
+{
+    int32_t value;
+    switch (mode)
+    {
+        case 0:
+            value = (int32_t)(8388607 * sin(n * 0.01 * (block % 13 + 1)));
+            break;
+        case 1:
+            value = rand() % (1 << 24) - (1 << 23);
+            break;
+        case 2:
+            value = n % 2 == 0 ? 8388607 : -8388608;
+            break;
+        case 3:
+            value = (int32_t)(1000 * sin(n * 0.05)) + rand() % 5;
+            break;
+        default:
+            value = 0;
+            break;
+    }
+    return (int32_t)((uint32_t)value << SAMPLE_SHIFT);
+}
+
+static void testRoundTrip()
+{
+    int32_t samples[MAX_BLOCK_SAMPLE_COUNT];
+    int32_t decodedSamples[MAX_BLOCK_SAMPLE_COUNT];
+    uint8_t block[MAX_BLOCK_SIZE];
+    int failureCount = 0;
+
+    srand(1);
+    for (size_t i = 0; i < ROUND_TRIP_BLOCK_COUNT; i++)
+    {
+        size_t sampleCount = i % 7 == 0 ? (size_t)(rand() % (MAX_BLOCK_SAMPLE_COUNT + 1)) : BLOCK_SAMPLE_COUNT;
+        for (size_t n = 0; n < sampleCount; n++)
+        {
+            samples[n] = createRandomSample(i % 5, n, i);
+        }
+
+        // Some blocks are encoded in an output smaller than the verbatim size.
+        size_t capacity = i % 11 == 0 ? getMaxCompressedSize(sampleCount) / 2 + 2 : sizeof(block);
+        size_t size = compressSamples(samples, sampleCount, block, capacity);
+
+        int isValid = size <= getMaxCompressedSize(sampleCount) &&
+            (size <= capacity || block[0] == COMPRESSION_VERBATIM_ORDER) &&
+            decompressSamples(block, size, decodedSamples, sampleCount);
+        for (size_t n = 0; n < sampleCount && isValid; n++)
+        {
+            isValid = decodedSamples[n] == samples[n] >> SAMPLE_SHIFT;
+        }
+        if (!isValid && failureCount++ < 5)
+        {
+            fprintf(stderr, "Round trip failed: block = %zu, sample count = %zu, order = %u, Rice parameter = %u\n",
+                i, sampleCount, block[0], block[1]);
+        }
+    }
+    HOST_TEST_CHECK(failureCount == 0);
+}
+
+static size_t createSyntheticSignal(int32_t* samples, size_t sampleCount)
+{
+    // Harmonic tones with a slow envelope, changing every 0.5 s, and a noise floor at about -80 dBFS.
+    srand(2);
+    double phase = 0;
+    for (size_t n = 0; n < sampleCount; n++)
+    {
+        double fundamental = 110.0 * (1 + (n / 22050) % 7);
+        double envelope = 0.25 * (1.2 + sin(2 * M_PI * n / 44100.0));
+        phase += 2 * M_PI * fundamental / 44100.0;
+
+        double value = 0;
+        for (int harmonic = 1; harmonic <= 6; harmonic++)
+        {
+            value += sin(harmonic * phase) / harmonic;
+        }
+        value = envelope * value / 2.5 + ((double)rand() / RAND_MAX - 0.5) * 2e-4;
+        samples[n] = (int32_t)((uint32_t)(int32_t)lrint(value * 8388607) << SAMPLE_SHIFT);
+    }
+    return sampleCount;
+}
+
+static uint32_t readLittleEndian(const uint8_t* data, size_t size)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        value |= (uint32_t)data[i] << (8 * i);
+    }
+    return value;
+}
+
+// Returns the sample count of the first channel, or 0 if the file is not a 16-bit or 24-bit PCM WAV file.
+static size_t readWavFile(const char* path, int32_t** samples)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* data = malloc(fileSize);
+    size_t readSize = fread(data, 1, fileSize, file);
+    fclose(file);
+
+    size_t channelCount = 0;
+    size_t sampleSize = 0;
+    size_t sampleCount = 0;
+    for (size_t offset = 12; offset + 8 <= readSize && readSize >= 12 && memcmp(data, "RIFF", 4) == 0;)
+    {
+        size_t chunkSize = readLittleEndian(data + offset + 4, 4);
+        const uint8_t* chunk = data + offset + 8;
+        if (memcmp(data + offset, "fmt ", 4) == 0 && readLittleEndian(chunk, 2) == 1)
+        {
+            channelCount = readLittleEndian(chunk + 2, 2);
+            sampleSize = readLittleEndian(chunk + 14, 2) / 8;
+        }
+        else if (memcmp(data + offset, "data", 4) == 0 && channelCount > 0 && (sampleSize == 2 || sampleSize == 3))
+        {
+            chunkSize = chunkSize > readSize - offset - 8 ? readSize - offset - 8 : chunkSize;
+            sampleCount = chunkSize / (channelCount * sampleSize);
+            *samples = malloc(sampleCount * sizeof(int32_t));
+            for (size_t n = 0; n < sampleCount; n++)
+            {
+                uint32_t value = readLittleEndian(chunk + n * channelCount * sampleSize, sampleSize);
+                (*samples)[n] = (int32_t)(value << (32 - 8 * sampleSize)) & (int32_t)0xFFFFFF00;
+            }
+            break;
+        }
+        offset += 8 + chunkSize + chunkSize % 2;
+    }
+
+    free(data);
+    return sampleCount;
+}
+
+static void benchmark(const char* name, const int32_t* samples, size_t sampleCount)
+{
+    static uint8_t block[MAX_BLOCK_SIZE];
+    size_t blockCount = sampleCount / BLOCK_SAMPLE_COUNT;
+    size_t iterationCount = getHostBenchmarkIterationCount(1);
+    size_t compressedSize = 0;
+
+    double startTimeS = getHostTestTimeS();
+    for (size_t iteration = 0; iteration < iterationCount; iteration++)
+    {
+        compressedSize = 0;
+        for (size_t i = 0; i < blockCount; i++)
+        {
+            compressedSize += compressSamples(samples + i * BLOCK_SAMPLE_COUNT, BLOCK_SAMPLE_COUNT, block, sizeof(block));
+        }
+    }
+    double durationS = getHostTestTimeS() - startTimeS;
+
+    size_t packedSize = blockCount * BLOCK_SAMPLE_COUNT * 3;
+    printf("%s: %.1f s, compressed size = %.1f %% of the packed 24-bit size, %.1f Msamples/s\n",
+        name,
+        sampleCount / 44100.0,
+        100.0 * compressedSize / packedSize,
+        (double)blockCount * BLOCK_SAMPLE_COUNT * iterationCount / durationS / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    testRoundTrip();
+
+    static int32_t syntheticSamples[SYNTHETIC_SAMPLE_COUNT];
+    benchmark("Synthetic program", syntheticSamples, createSyntheticSignal(syntheticSamples, SYNTHETIC_SAMPLE_COUNT));
+
+    if (argc > 1)
+    {
+        int32_t* samples = NULL;
+        size_t sampleCount = readWavFile(argv[1], &samples);
+        HOST_TEST_CHECK(sampleCount > 0);
+        if (sampleCount > 0)
+        {
+            benchmark(argv[1], samples, sampleCount);
+        }
+        free(samples);
+    }
+
+    return getHostTestResult();
+}
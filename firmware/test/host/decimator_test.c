@@ -0,0 +1,137 @@
+#include "host_test.h"
+#include "sound/decimator.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// Measures the passband and stopband response of the decimator with tones fed in blocks of varying sizes,
+// checks its group delay and frame counts, and benchmarks each decimation factor.
+
+#define BLOCK_FRAME_COUNT CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH
+#define AMPLITUDE 4000000.0
+#define SAMPLE_SHIFT 8
+#define TEST_BLOCK_COUNT 400
+#define WARM_UP_FRAME_COUNT 100
+#define BENCHMARK_BLOCK_COUNT 100000
+
+typedef struct
+{
+    double maxAmplitude; // Relative to the input amplitude
+    double maxDelayedToneError; // Error to the input tone delayed by the group delay, relative to the input amplitude
+} ToneResponse;
+
+static double getTone(double frequency, double frameIndex)
+{
+    return AMPLITUDE * sin(2 * M_PI * frequency * frameIndex);
+}
+
+// The frequency is relative to the input sample frequency. The block sizes vary like the resampler output.
+static ToneResponse measureToneResponse(uint8_t decimationFactor, double frequency)
+{
+    static Decimator decimator;
+    int32_t input[(BLOCK_FRAME_COUNT + 1) * 2];
+    int32_t output[DECIMATOR_MAX_INPUT_FRAME_COUNT * 2];
+    ToneResponse response = { 0, 0 };
+    size_t inputFrameCount = 0;
+    size_t outputFrameCount = 0;
+    int isChannelValid = 1;
+
+    initializeDecimator(&decimator, decimationFactor, 2);
+    double delay = getDecimatorDelay(&decimator);
+    for (size_t block = 0; block < TEST_BLOCK_COUNT; block++)
+    {
+        size_t frameCount = BLOCK_FRAME_COUNT - 1 + block % 3;
+        for (size_t i = 0; i < frameCount; i++)
+        {
+            int32_t sample = (int32_t)lrint(getTone(frequency, (double)(inputFrameCount + i)));
+            input[2 * i] = (int32_t)((uint32_t)sample << SAMPLE_SHIFT);
+            input[2 * i + 1] = (int32_t)((uint32_t)-sample << SAMPLE_SHIFT);
+        }
+        inputFrameCount += frameCount;
+
+        size_t decimatedFrameCount = decimateFrames(&decimator, input, frameCount, output);
+        for (size_t i = 0; i < decimatedFrameCount; i++, outputFrameCount++)
+        {
+            if (outputFrameCount < WARM_UP_FRAME_COUNT)
+            {
+                continue;
+            }
+
+            double sample = output[2 * i] >> SAMPLE_SHIFT;
+            double expectedSample = getTone(frequency, (double)outputFrameCount * decimationFactor - delay);
+            response.maxAmplitude = fmax(response.maxAmplitude, fabs(sample) / AMPLITUDE);
+            response.maxDelayedToneError = fmax(response.maxDelayedToneError, fabs(sample - expectedSample) / AMPLITUDE);
+            isChannelValid &= abs((output[2 * i] >> SAMPLE_SHIFT) + (output[2 * i + 1] >> SAMPLE_SHIFT)) <= 1;
+        }
+    }
+
+    HOST_TEST_CHECK(isChannelValid);
+
+    // The first output frame is computed from the first input frame and the zero history.
+    HOST_TEST_CHECK(outputFrameCount == (inputFrameCount + decimationFactor - 1) / decimationFactor);
+    return response;
+}
+
+static void testResponse()
+{
+    static const uint8_t DECIMATION_FACTORS[] = { 2, 4, 8 };
+
+    for (size_t i = 0; i < sizeof(DECIMATION_FACTORS) / sizeof(DECIMATION_FACTORS[0]); i++)
+    {
+        uint8_t decimationFactor = DECIMATION_FACTORS[i];
+        static Decimator decimator;
+        initializeDecimator(&decimator, decimationFactor, 1);
+
+        // The passband ends at about 0.32 of the output sample frequency, the aliases fold back from above 0.68.
+        ToneResponse passband = measureToneResponse(decimationFactor, 0.3 / decimationFactor);
+        ToneResponse stopband = measureToneResponse(decimationFactor, 0.7 / decimationFactor);
+        printf("Factor %u: delay = %zu frames, passband error = %.1f dB, stopband gain = %.1f dB\n",
+            decimationFactor,
+            getDecimatorDelay(&decimator),
+            20 * log10(passband.maxDelayedToneError),
+            20 * log10(stopband.maxAmplitude));
+
+        HOST_TEST_CHECK(passband.maxDelayedToneError < 0.01);
+        HOST_TEST_CHECK(stopband.maxAmplitude < 0.01);
+    }
+
+    // A factor of 1 copies the frames.
+    ToneResponse response = measureToneResponse(1, 0.45);
+    HOST_TEST_CHECK(response.maxDelayedToneError < 1e-6);
+}
+
+static void benchmark()
+{
+    static const uint8_t DECIMATION_FACTORS[] = { 2, 4, 8 };
+    static Decimator decimator;
+    int32_t input[BLOCK_FRAME_COUNT * 2];
+    int32_t output[DECIMATOR_MAX_INPUT_FRAME_COUNT * 2];
+    size_t blockCount = getHostBenchmarkIterationCount(BENCHMARK_BLOCK_COUNT);
+
+    for (size_t i = 0; i < BLOCK_FRAME_COUNT * 2; i++)
+    {
+        input[i] = (int32_t)((uint32_t)(int32_t)lrint(getTone(0.01, (double)i)) << SAMPLE_SHIFT);
+    }
+
+    printf("Stereo decimation:");
+    for (size_t i = 0; i < sizeof(DECIMATION_FACTORS) / sizeof(DECIMATION_FACTORS[0]); i++)
+    {
+        initializeDecimator(&decimator, DECIMATION_FACTORS[i], 2);
+        double startTimeS = getHostTestTimeS();
+        for (size_t block = 0; block < blockCount; block++)
+        {
+            decimateFrames(&decimator, input, BLOCK_FRAME_COUNT, output);
+        }
+        double durationS = getHostTestTimeS() - startTimeS;
+        printf(" %.1f Mframes/s (factor %u)", (double)blockCount * BLOCK_FRAME_COUNT / durationS / 1e6, DECIMATION_FACTORS[i]);
+    }
+    printf("\n");
+}
+
+int main()
+{
+    testResponse();
+    benchmark();
+
+    return getHostTestResult();
+}
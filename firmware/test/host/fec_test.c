@@ -0,0 +1,197 @@
+#include "host_test.h"
+#include "sound/fec.h"
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Loss simulation of the XOR FEC with a reference receiver, and encode/decode throughput benchmark.
+// The messages are built at 3 bytes from a 32-bit boundary, like the sound data messages.
+
+#define DATA_OFFSET 3
+#define MIN_PACKET_SIZE 17
+// The largest message whose FEC message fits in a streaming packet.
+#define MAX_PACKET_SIZE (CONFIG_STREAMING_PACKET_MAX_SIZE - FEC_MESSAGE_HEADER_SIZE + FEC_PROTECTED_DATA_OFFSET)
+#define SIMULATED_PACKET_COUNT 20000
+#define BENCHMARK_PACKET_COUNT 200000
+
+typedef struct
+{
+    uint8_t buffer[CONFIG_STREAMING_PACKET_MAX_SIZE + DATA_OFFSET] __attribute__((aligned(4)));
+    size_t size;
+    int isReceived;
+} SimulatedPacket;
+
+static SimulatedPacket packets[CONFIG_SOUND_FEC_MAX_GROUP_SIZE];
+
+static size_t getRandomPacketSize()
+{
+    // Compressed messages vary in size, the others have the maximum size.
+    return rand() % 2 == 0 ? MAX_PACKET_SIZE : MIN_PACKET_SIZE + rand() % (MAX_PACKET_SIZE - MIN_PACKET_SIZE);
+}
+
+// The content comes from a cheap LCG, so the simulation is not limited by rand.
+static void writePacket(SimulatedPacket* packet, size_t size)
+{
+    static uint32_t state = 1;
+    uint8_t* data = packet->buffer + DATA_OFFSET;
+    for (size_t i = 0; i < size; i++)
+    {
+        state = state * 1664525u + 1013904223u;
+        data[i] = (uint8_t)(state >> 24);
+    }
+    packet->size = size;
+}
+
+// Rebuilds the lost message of the group like a receiver, returns 0 if its content does not match.
+static int rebuildPacket(const uint8_t* fecMessage, size_t fecSize, size_t groupSize, size_t lostIndex)
+{
+    uint8_t data[CONFIG_STREAMING_PACKET_MAX_SIZE];
+    size_t paritySize = fecSize - FEC_MESSAGE_HEADER_SIZE;
+    uint16_t size = (uint16_t)((fecMessage[12] << 8) | fecMessage[13]);
+
+    memset(data, 0, sizeof(data));
+    memcpy(data + FEC_PROTECTED_DATA_OFFSET, fecMessage + FEC_MESSAGE_HEADER_SIZE, paritySize);
+    for (size_t i = 0; i < groupSize; i++)
+    {
+        if (i != lostIndex)
+        {
+            xorBytes(data + FEC_PROTECTED_DATA_OFFSET,
+                packets[i].buffer + DATA_OFFSET + FEC_PROTECTED_DATA_OFFSET,
+                packets[i].size - FEC_PROTECTED_DATA_OFFSET);
+            size ^= (uint16_t)packets[i].size;
+        }
+    }
+
+    const uint8_t* expectedData = packets[lostIndex].buffer + DATA_OFFSET;
+    return size == packets[lostIndex].size &&
+        memcmp(data + FEC_PROTECTED_DATA_OFFSET,
+            expectedData + FEC_PROTECTED_DATA_OFFSET,
+            size - FEC_PROTECTED_DATA_OFFSET) == 0;
+}
+
+// Returns the residual loss rate of the data messages.
+static double simulateLosses(uint8_t groupSize, double lossRate)
+{
+    static uint8_t fecBuffer[CONFIG_STREAMING_PACKET_MAX_SIZE + DATA_OFFSET] __attribute__((aligned(4)));
+    uint8_t* fecMessage = fecBuffer + DATA_OFFSET;
+    size_t lostCount = 0;
+    size_t invalidCount = 0;
+    size_t groupCount = SIMULATED_PACKET_COUNT / groupSize;
+
+    resetFec(groupSize);
+    for (size_t group = 0; group < groupCount; group++)
+    {
+        size_t groupLostCount = 0;
+        size_t lostIndex = 0;
+        for (size_t i = 0; i < groupSize; i++)
+        {
+            writePacket(&packets[i], getRandomPacketSize());
+            packets[i].isReceived = (double)rand() / RAND_MAX >= lossRate;
+            if (!packets[i].isReceived)
+            {
+                groupLostCount++;
+                lostIndex = i;
+            }
+
+            int isGroupComplete = addFecPacket(packets[i].buffer + DATA_OFFSET, packets[i].size, (uint16_t)(group * groupSize + i));
+            HOST_TEST_CHECK(isGroupComplete == (i == groupSize - 1u));
+        }
+
+        size_t fecSize = writeFecMessage(fecMessage);
+        HOST_TEST_CHECK(fecMessage[10] == groupSize);
+        int isFecReceived = (double)rand() / RAND_MAX >= lossRate;
+        if (groupLostCount == 1 && isFecReceived)
+        {
+            invalidCount += !rebuildPacket(fecMessage, fecSize, groupSize, lostIndex);
+        }
+        else
+        {
+            lostCount += groupLostCount;
+        }
+    }
+
+    HOST_TEST_CHECK(invalidCount == 0);
+    return (double)lostCount / (groupCount * groupSize);
+}
+
+// A message whose FEC message would not fit in a packet is not protected.
+static void testTooLargePacket()
+{
+    resetFec(2);
+    writePacket(&packets[0], MAX_PACKET_SIZE + 1);
+    HOST_TEST_CHECK(!addFecPacket(packets[0].buffer + DATA_OFFSET, packets[0].size, 0));
+    HOST_TEST_CHECK(!addFecPacket(packets[0].buffer + DATA_OFFSET, packets[0].size, 1));
+}
+
+static void testLossSimulation()
+{
+    static const uint8_t GROUP_SIZES[] = { 2, 4, 8, CONFIG_SOUND_FEC_MAX_GROUP_SIZE };
+    static const double LOSS_RATES[] = { 0.001, 0.01, 0.05 };
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(GROUP_SIZES) / sizeof(GROUP_SIZES[0]); i++)
+    {
+        printf("Group size %2u: overhead = %4.1f %%, residual loss =", GROUP_SIZES[i], 100.0 / GROUP_SIZES[i]);
+        for (size_t j = 0; j < sizeof(LOSS_RATES) / sizeof(LOSS_RATES[0]); j++)
+        {
+            double residualLossRate = simulateLosses(GROUP_SIZES[i], LOSS_RATES[j]);
+            printf(" %.3f %% (%.1f %% lost)", 100 * residualLossRate, 100 * LOSS_RATES[j]);
+
+            // One loss per group is always rebuilt, so the FEC must at least halve the small loss rates.
+            HOST_TEST_CHECK(LOSS_RATES[j] * GROUP_SIZES[i] > 0.2 || residualLossRate < LOSS_RATES[j] / 2);
+        }
+        printf("\n");
+    }
+}
+
+static void benchmark()
+{
+    static uint8_t fecBuffer[CONFIG_STREAMING_PACKET_MAX_SIZE + DATA_OFFSET] __attribute__((aligned(4)));
+    static uint8_t rebuiltBuffer[CONFIG_STREAMING_PACKET_MAX_SIZE + DATA_OFFSET] __attribute__((aligned(4)));
+    size_t packetCount = getHostBenchmarkIterationCount(BENCHMARK_PACKET_COUNT);
+    uint8_t groupSize = 8;
+
+    srand(2);
+    for (size_t i = 0; i < groupSize; i++)
+    {
+        writePacket(&packets[i], MAX_PACKET_SIZE);
+    }
+
+    resetFec(groupSize);
+    double startTimeS = getHostTestTimeS();
+    for (size_t i = 0; i < packetCount; i++)
+    {
+        if (addFecPacket(packets[i % groupSize].buffer + DATA_OFFSET, MAX_PACKET_SIZE, (uint16_t)i))
+        {
+            writeFecMessage(fecBuffer + DATA_OFFSET);
+        }
+    }
+    double encodeDurationS = getHostTestTimeS() - startTimeS;
+
+    startTimeS = getHostTestTimeS();
+    for (size_t i = 0; i < packetCount; i++)
+    {
+        xorBytes(rebuiltBuffer + DATA_OFFSET + FEC_PROTECTED_DATA_OFFSET,
+            packets[i % groupSize].buffer + DATA_OFFSET + FEC_PROTECTED_DATA_OFFSET,
+            MAX_PACKET_SIZE - FEC_PROTECTED_DATA_OFFSET);
+    }
+    double decodeDurationS = getHostTestTimeS() - startTimeS;
+
+    double byteCount = (double)packetCount * MAX_PACKET_SIZE;
+    printf("Encode: %.0f MB/s, decode: %.0f MB/s (%u-byte messages, groups of %u)\n",
+        byteCount / encodeDurationS / 1e6,
+        byteCount / decodeDurationS / 1e6,
+        MAX_PACKET_SIZE,
+        groupSize);
+}
+
+int main()
+{
+    initializeFec(DATA_OFFSET);
+    testTooLargePacket();
+    testLossSimulation();
+    benchmark();
+
+    return getHostTestResult();
+}
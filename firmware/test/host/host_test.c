@@ -0,0 +1,35 @@
+#include "host_test.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+int hostTestFailureCount = 0;
+size_t hostHeapCapsAvailableSize = SIZE_MAX;
+
+int getHostTestResult()
+{
+    if (hostTestFailureCount > 0)
+    {
+        fprintf(stderr, "%d check(s) failed\n", hostTestFailureCount);
+        return 1;
+    }
+    return 0;
+}
+
+double getHostTestTimeS()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+size_t getHostBenchmarkIterationCount(size_t iterationCount)
+{
+    const char* scale = getenv("HOST_BENCHMARK_SCALE");
+    if (scale != NULL && atoi(scale) > 0)
+    {
+        return iterationCount * atoi(scale);
+    }
+    return iterationCount;
+}
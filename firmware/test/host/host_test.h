@@ -0,0 +1,28 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+// Minimal checks shared by the host tests and benchmarks. A test returns getHostTestResult() from main.
+extern int hostTestFailureCount;
+
+#define HOST_TEST_CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            hostTestFailureCount++; \
+        } \
+    } while (0)
+
+int getHostTestResult();
+
+// Monotonic time in seconds, used to measure the throughput.
+double getHostTestTimeS();
+
+// The iteration count of the benchmarks is multiplied by the HOST_BENCHMARK_SCALE environment variable.
+// It defaults to 1, which keeps every test under a second.
+size_t getHostBenchmarkIterationCount(size_t iterationCount);
+
+#endif
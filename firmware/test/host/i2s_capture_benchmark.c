@@ -0,0 +1,162 @@
+#include "host_test.h"
+#include "sound/channels.h"
+#include "config.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+// Compares the capture cost of one i2s_read per frame (the former soundTask) with one i2s_read per DMA buffer.
+// The fake I2S driver takes a mutex per call and per DMA buffer, like the receive mutex and the DMA queue of
+// the ESP-IDF driver, and copies from preallocated DMA buffers.
+
+#define I2S_CHANNEL_COUNT 2
+#define I2S_FRAME_SIZE (I2S_CHANNEL_COUNT * sizeof(int32_t))
+#define DMA_BUFFER_SIZE (CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH * I2S_FRAME_SIZE)
+#define FRAME_COUNT ((size_t)CONFIG_SOUND_SAMPLE_FREQUENCY * 10)
+
+typedef struct
+{
+    int32_t dmaBuffers[CONFIG_SOUND_I2S_DMA_BUFFER_COUNT][CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH * I2S_CHANNEL_COUNT];
+    size_t bufferIndex;
+    size_t bufferOffset;
+    pthread_mutex_t readMutex;
+    pthread_mutex_t queueMutex;
+} FakeI2s;
+
+typedef struct
+{
+    int32_t samples[CONFIG_SOUND_MESSAGE_SAMPLE_COUNT];
+    size_t sampleCount;
+    uint64_t checksum;
+    size_t messageCount;
+} FakeMessage;
+
+static FakeI2s i2s;
+
+static void initializeFakeI2s()
+{
+    for (size_t buffer = 0; buffer < CONFIG_SOUND_I2S_DMA_BUFFER_COUNT; buffer++)
+    {
+        for (size_t i = 0; i < CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH * I2S_CHANNEL_COUNT; i++)
+        {
+            i2s.dmaBuffers[buffer][i] = (int32_t)((buffer * 7919 + i * 104729) << 8);
+        }
+    }
+    i2s.bufferIndex = 0;
+    i2s.bufferOffset = 0;
+    pthread_mutex_init(&i2s.readMutex, NULL);
+    pthread_mutex_init(&i2s.queueMutex, NULL);
+}
+
+static void readFakeI2s(void* data, size_t size)
+{
+    uint8_t* output = data;
+
+    pthread_mutex_lock(&i2s.readMutex);
+    while (size > 0)
+    {
+        if (i2s.bufferOffset == DMA_BUFFER_SIZE)
+        {
+            pthread_mutex_lock(&i2s.queueMutex);
+            i2s.bufferIndex = (i2s.bufferIndex + 1) % CONFIG_SOUND_I2S_DMA_BUFFER_COUNT;
+            i2s.bufferOffset = 0;
+            pthread_mutex_unlock(&i2s.queueMutex);
+        }
+
+        size_t copiedSize = DMA_BUFFER_SIZE - i2s.bufferOffset;
+        copiedSize = copiedSize > size ? size : copiedSize;
+        memcpy(output, (uint8_t*)i2s.dmaBuffers[i2s.bufferIndex] + i2s.bufferOffset, copiedSize);
+        i2s.bufferOffset += copiedSize;
+        output += copiedSize;
+        size -= copiedSize;
+    }
+    pthread_mutex_unlock(&i2s.readMutex);
+}
+
+static void sendFakeMessage(FakeMessage* message)
+{
+    for (size_t i = 0; i < CONFIG_SOUND_MESSAGE_SAMPLE_COUNT; i++)
+    {
+        message->checksum = message->checksum * 31 + (uint32_t)message->samples[i];
+    }
+    message->sampleCount = 0;
+    message->messageCount++;
+}
+
+static double capturePerFrame(FakeMessage* message)
+{
+    int32_t i2sFrame[I2S_CHANNEL_COUNT];
+
+    double startTimeS = getHostTestTimeS();
+    for (size_t i = 0; i < FRAME_COUNT; i++)
+    {
+        readFakeI2s(i2sFrame, I2S_FRAME_SIZE);
+        message->samples[message->sampleCount++] = i2sFrame[0];
+        if (message->sampleCount == CONFIG_SOUND_MESSAGE_SAMPLE_COUNT)
+        {
+            sendFakeMessage(message);
+        }
+    }
+    return getHostTestTimeS() - startTimeS;
+}
+
+static double capturePerBlock(FakeMessage* message)
+{
+    int32_t i2sFrames[CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH * I2S_CHANNEL_COUNT];
+    int32_t samples[CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH];
+
+    double startTimeS = getHostTestTimeS();
+    for (size_t i = 0; i < FRAME_COUNT; i += CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH)
+    {
+        readFakeI2s(i2sFrames, DMA_BUFFER_SIZE);
+        extractChannels(i2sFrames, CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH, I2S_CHANNEL_COUNT, 1, samples);
+
+        const int32_t* blockSamples = samples;
+        size_t sampleCount = CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH;
+        while (sampleCount > 0)
+        {
+            size_t copiedSampleCount = CONFIG_SOUND_MESSAGE_SAMPLE_COUNT - message->sampleCount;
+            copiedSampleCount = copiedSampleCount > sampleCount ? sampleCount : copiedSampleCount;
+            memcpy(message->samples + message->sampleCount, blockSamples, copiedSampleCount * sizeof(int32_t));
+            message->sampleCount += copiedSampleCount;
+            blockSamples += copiedSampleCount;
+            sampleCount -= copiedSampleCount;
+
+            if (message->sampleCount == CONFIG_SOUND_MESSAGE_SAMPLE_COUNT)
+            {
+                sendFakeMessage(message);
+            }
+        }
+    }
+    return getHostTestTimeS() - startTimeS;
+}
+
+int main()
+{
+    size_t iterationCount = getHostBenchmarkIterationCount(1);
+    double perFrameDurationS = 0;
+    double perBlockDurationS = 0;
+
+    for (size_t i = 0; i < iterationCount; i++)
+    {
+        FakeMessage perFrameMessage = { 0 };
+        FakeMessage perBlockMessage = { 0 };
+
+        initializeFakeI2s();
+        perFrameDurationS += capturePerFrame(&perFrameMessage);
+        initializeFakeI2s();
+        perBlockDurationS += capturePerBlock(&perBlockMessage);
+
+        HOST_TEST_CHECK(perFrameMessage.messageCount == FRAME_COUNT / CONFIG_SOUND_MESSAGE_SAMPLE_COUNT);
+        HOST_TEST_CHECK(perFrameMessage.messageCount == perBlockMessage.messageCount);
+        HOST_TEST_CHECK(perFrameMessage.checksum == perBlockMessage.checksum);
+    }
+
+    double frameCount = (double)FRAME_COUNT * iterationCount;
+    printf("Per frame capture: %.1f ns/frame\n", perFrameDurationS / frameCount * 1e9);
+    printf("Per block capture: %.1f ns/frame\n", perBlockDurationS / frameCount * 1e9);
+    printf("Speedup: %.1fx\n", perFrameDurationS / perBlockDurationS);
+
+    return getHostTestResult();
+}
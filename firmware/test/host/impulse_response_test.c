@@ -0,0 +1,152 @@
+#include "host_test.h"
+#include "sound/impulse_response.h"
+#include "sound/fft.h"
+
+#include <arpa/inet.h>
+
+#include <math.h>
+#include <string.h>
+
+// Measures a synthetic system that delays and attenuates a full-scale exponential sweep, then checks the lag of the
+// impulse response peak, the flatness of its gain and the message of an unsupported measurement.
+
+#define SAMPLE_FREQUENCY 48000
+#define BLOCK_FRAME_COUNT CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH
+#define CHANNEL_COUNT 2
+#define MEASUREMENT_ID 7
+#define START_FREQUENCY 20
+#define END_FREQUENCY 20000
+#define DURATION_MS 2000
+#define LENGTH 1024
+#define SYSTEM_DELAY 100 // frames
+#define SYSTEM_GAIN 0.5
+#define FLAT_MIN_FREQUENCY 1000
+#define FLAT_MAX_FREQUENCY 18000
+#define MESSAGE_HEADER_SIZE 20
+#define MESSAGE_STATUS_OFFSET 9
+#define MESSAGE_LENGTH_OFFSET 16
+
+static ImpulseResponseRequest createRequest(uint8_t channel)
+{
+    ImpulseResponseRequest request = { 0, 0, 0, 0, MEASUREMENT_ID, channel, START_FREQUENCY, END_FREQUENCY,
+        DURATION_MS, LENGTH };
+    return request;
+}
+
+// The sweep played by the controller, with the phase of the deconvolution.
+static double getSweepSample(int64_t frameIndex)
+{
+    double sweepFrameCount = (double)SAMPLE_FREQUENCY * DURATION_MS / 1000;
+    if (frameIndex < 0 || frameIndex >= sweepFrameCount)
+    {
+        return 0.0;
+    }
+
+    double rate = log((double)END_FREQUENCY / START_FREQUENCY) / sweepFrameCount;
+    double phaseScale = 2.0 * M_PI * START_FREQUENCY / (SAMPLE_FREQUENCY * rate);
+    return sin(phaseScale * expm1(rate * frameIndex));
+}
+
+static float readFloat(const uint8_t* buffer)
+{
+    uint32_t bits = ntohl(*(const uint32_t*)buffer);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// The sweep starts at the sample index 0 and the system output is on the second channel.
+static void testSyntheticSystem()
+{
+    static int32_t frames[BLOCK_FRAME_COUNT * CHANNEL_COUNT];
+    static float response[2 * LENGTH];
+    ImpulseResponseRequest request = createRequest(1);
+    HOST_TEST_CHECK(isImpulseResponseRequestSupported(&request));
+
+    startImpulseResponse(&request, SAMPLE_FREQUENCY, CHANNEL_COUNT, 0);
+    while (!isImpulseResponseFinished())
+    {
+        int64_t frameIndex = getImpulseResponseFrameIndex();
+        size_t frameCount = getImpulseResponseRemainingFrameCount();
+        if (frameCount > BLOCK_FRAME_COUNT)
+        {
+            frameCount = BLOCK_FRAME_COUNT;
+        }
+        for (size_t i = 0; i < frameCount; i++)
+        {
+            double sample = SYSTEM_GAIN * getSweepSample(frameIndex + (int64_t)i - SYSTEM_DELAY);
+            frames[CHANNEL_COUNT * i] = INT32_MAX;
+            frames[CHANNEL_COUNT * i + 1] = (int32_t)lrint(INT32_MAX * sample);
+        }
+        addImpulseResponseFrames(frames, frameCount);
+    }
+
+    size_t size;
+    const uint8_t* message = getImpulseResponseMessage(&size);
+    HOST_TEST_CHECK(size == MESSAGE_HEADER_SIZE + LENGTH * sizeof(float));
+    HOST_TEST_CHECK(ntohl(*(const uint32_t*)message) == IMPULSE_RESPONSE_MESSAGE_ID);
+    HOST_TEST_CHECK(message[MESSAGE_STATUS_OFFSET] == IMPULSE_RESPONSE_STATUS_COMPLETE);
+    HOST_TEST_CHECK(ntohl(*(const uint32_t*)(message + MESSAGE_LENGTH_OFFSET)) == LENGTH);
+
+    size_t peakIndex = 0;
+    for (size_t i = 0; i < LENGTH; i++)
+    {
+        response[2 * i] = readFloat(message + MESSAGE_HEADER_SIZE + i * sizeof(float));
+        response[2 * i + 1] = 0.0f;
+        if (fabsf(response[2 * i]) > fabsf(response[2 * peakIndex]))
+        {
+            peakIndex = i;
+        }
+    }
+    HOST_TEST_CHECK(peakIndex == CONFIG_SOUND_IMPULSE_RESPONSE_LEAD_FRAME_COUNT + SYSTEM_DELAY);
+
+    computeComplexFft(response, LENGTH, 0);
+    double maxGainError = 0.0;
+    for (size_t k = FLAT_MIN_FREQUENCY * LENGTH / SAMPLE_FREQUENCY; k <= FLAT_MAX_FREQUENCY * LENGTH / SAMPLE_FREQUENCY; k++)
+    {
+        double gain = hypot(response[2 * k], response[2 * k + 1]);
+        maxGainError = fmax(maxGainError, fabs(gain / SYSTEM_GAIN - 1.0));
+    }
+    HOST_TEST_CHECK(maxGainError < 0.01);
+    printf("Peak lag = %zu frames, max gain error from %d to %d Hz = %.2f %%\n",
+        peakIndex,
+        FLAT_MIN_FREQUENCY,
+        FLAT_MAX_FREQUENCY,
+        maxGainError * 100);
+
+    releaseImpulseResponse();
+    HOST_TEST_CHECK(!isImpulseResponseActive());
+}
+
+static void testUnsupportedRequests()
+{
+    ImpulseResponseRequest request = createRequest(0);
+    request.length = CONFIG_SOUND_IMPULSE_RESPONSE_MAX_LENGTH + 1;
+    HOST_TEST_CHECK(!isImpulseResponseRequestSupported(&request));
+    request = createRequest(0);
+    request.endFrequency = START_FREQUENCY;
+    HOST_TEST_CHECK(!isImpulseResponseRequestSupported(&request));
+
+    // The channel is not in the history, the measurement is finished at once with a header-only message.
+    request = createRequest(CHANNEL_COUNT);
+    startImpulseResponse(&request, SAMPLE_FREQUENCY, CHANNEL_COUNT, 0);
+    HOST_TEST_CHECK(isImpulseResponseFinished());
+
+    size_t size;
+    const uint8_t* message = getImpulseResponseMessage(&size);
+    HOST_TEST_CHECK(size == MESSAGE_HEADER_SIZE);
+    HOST_TEST_CHECK(message[MESSAGE_STATUS_OFFSET] == IMPULSE_RESPONSE_STATUS_UNSUPPORTED);
+    HOST_TEST_CHECK(ntohl(*(const uint32_t*)(message + MESSAGE_LENGTH_OFFSET)) == 0);
+    releaseImpulseResponse();
+}
+
+int main()
+{
+    initializeFft();
+    HOST_TEST_CHECK(initializeImpulseResponse() == ESP_OK);
+
+    testSyntheticSystem();
+    testUnsupportedRequests();
+
+    return getHostTestResult();
+}
@@ -0,0 +1,206 @@
+#include "host_test.h"
+#include "sound/level_meter.h"
+
+#include <math.h>
+
+// Reference test of the level meter with known signals: full-scale and attenuated sines, the A and C weightings
+// against the nominal values and class 1 tolerances of IEC 61672-1, the decay rates of the time weightings and
+// the Leq of a tone burst.
+
+#define BLOCK_FRAME_COUNT CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH
+#define CHANNEL_COUNT 2
+#define FULL_SCALE 2147483647.0
+#define LEVEL_TOLERANCE_DB 0.05
+
+#define PEAK_INDEX 0
+#define TIME_WEIGHTED_LEVEL_INDEX 1
+#define MAX_TIME_WEIGHTED_LEVEL_INDEX 2
+#define INTERVAL_LEQ_INDEX 3
+#define RUNNING_LEQ_INDEX 4
+
+typedef struct
+{
+    double frequency;
+    double aWeighting;
+    double cWeighting;
+    double minTolerance; // Class 1
+    double maxTolerance;
+} WeightingReference;
+
+// IEC 61672-1, table 3
+static const WeightingReference WEIGHTING_REFERENCES[] =
+{
+    { 31.5, -39.4, -3.0, -1.5, 1.5 },
+    { 100, -19.1, -0.3, -1.0, 1.0 },
+    { 1000, 0.0, 0.0, -0.7, 0.7 },
+    { 4000, 1.0, -0.8, -1.0, 1.0 },
+    { 10000, -2.5, -4.4, -3.0, 2.0 }
+};
+
+typedef struct
+{
+    double amplitude;
+    double frequency;
+    int isBurst; // The tone is on during the first half of every interval
+} Signal;
+
+typedef struct
+{
+    LevelMeterConfiguration configuration;
+    uint32_t sampleFrequency;
+    uint64_t frameIndex;
+    uint8_t message[64];
+} Meter;
+
+static void startMeter(Meter* meter, uint8_t frequencyWeighting, uint8_t timeWeighting, uint16_t intervalMs, uint32_t sampleFrequency)
+{
+    meter->configuration.intervalMs = intervalMs;
+    meter->configuration.frequencyWeighting = frequencyWeighting;
+    meter->configuration.timeWeighting = timeWeighting;
+    meter->configuration.channelCount = CHANNEL_COUNT;
+    meter->sampleFrequency = sampleFrequency;
+    meter->frameIndex = 0;
+    HOST_TEST_CHECK(isLevelMeterConfigurationSupported(&meter->configuration));
+    resetLevelMeter(&meter->configuration, sampleFrequency, 0);
+}
+
+// Feeds the signal on the first channel, the second channel is silent, until a message is complete.
+static void runMeterInterval(Meter* meter, const Signal* signal)
+{
+    static int32_t frames[BLOCK_FRAME_COUNT * CHANNEL_COUNT];
+    uint64_t intervalFrameCount = (uint64_t)meter->sampleFrequency * meter->configuration.intervalMs / 1000;
+    int isComplete = 0;
+
+    while (!isComplete)
+    {
+        for (size_t i = 0; i < BLOCK_FRAME_COUNT; i++, meter->frameIndex++)
+        {
+            int isOn = !signal->isBurst || meter->frameIndex % intervalFrameCount < intervalFrameCount / 2;
+            double value = isOn ? signal->amplitude * sin(2 * M_PI * signal->frequency * meter->frameIndex / meter->sampleFrequency) : 0;
+            frames[i * CHANNEL_COUNT] = (int32_t)lrint(value * FULL_SCALE);
+            frames[i * CHANNEL_COUNT + 1] = 0;
+        }
+        isComplete = addLevelMeterFrames(frames, BLOCK_FRAME_COUNT, CHANNEL_COUNT);
+    }
+    HOST_TEST_CHECK(writeLevelMeterMessage(meter->message) == 22 + CHANNEL_COUNT * 5 * sizeof(int16_t));
+}
+
+static double getLevel(const Meter* meter, size_t channel, size_t index)
+{
+    const uint8_t* level = meter->message + 22 + (channel * 5 + index) * sizeof(int16_t);
+    return (int16_t)((level[0] << 8) | level[1]) / 100.0;
+}
+
+// The levels are read from the second interval, when the filters are settled.
+static double measureLevel(uint8_t frequencyWeighting, double frequency, double amplitude, uint32_t sampleFrequency, size_t index)
+{
+    Meter meter;
+    Signal signal = { amplitude, frequency, 0 };
+    startMeter(&meter, frequencyWeighting, LEVEL_METER_TIME_WEIGHTING_FAST, 1000, sampleFrequency);
+    runMeterInterval(&meter, &signal);
+    runMeterInterval(&meter, &signal);
+    return getLevel(&meter, 0, index);
+}
+
+static void testSineLevels()
+{
+    Meter meter;
+    Signal signal = { 1.0, 1000, 0 };
+    startMeter(&meter, LEVEL_METER_FREQUENCY_WEIGHTING_Z, LEVEL_METER_TIME_WEIGHTING_FAST, 1000, 48000);
+    runMeterInterval(&meter, &signal);
+    runMeterInterval(&meter, &signal);
+
+    // The levels of a full-scale sine are at 0 dB and the silent channel at the minimum level.
+    for (size_t index = PEAK_INDEX; index <= RUNNING_LEQ_INDEX; index++)
+    {
+        HOST_TEST_CHECK(fabs(getLevel(&meter, 0, index)) < LEVEL_TOLERANCE_DB);
+        HOST_TEST_CHECK(getLevel(&meter, 1, index) == INT16_MIN / 100.0);
+    }
+
+    HOST_TEST_CHECK(fabs(measureLevel(LEVEL_METER_FREQUENCY_WEIGHTING_Z, 1000, 0.1, 48000, INTERVAL_LEQ_INDEX) + 20) < LEVEL_TOLERANCE_DB);
+    HOST_TEST_CHECK(fabs(measureLevel(LEVEL_METER_FREQUENCY_WEIGHTING_Z, 1000, 0.001, 48000, INTERVAL_LEQ_INDEX) + 60) < LEVEL_TOLERANCE_DB);
+}
+
+static void testWeightings()
+{
+    static const uint32_t SAMPLE_FREQUENCIES[] = { 44100, 48000, 96000 };
+    double amplitude = 0.5;
+    double referenceLevel = 20 * log10(amplitude);
+
+    for (size_t i = 0; i < sizeof(SAMPLE_FREQUENCIES) / sizeof(SAMPLE_FREQUENCIES[0]); i++)
+    {
+        printf("%u Hz, A/C weighting error:", SAMPLE_FREQUENCIES[i]);
+        for (size_t j = 0; j < sizeof(WEIGHTING_REFERENCES) / sizeof(WEIGHTING_REFERENCES[0]); j++)
+        {
+            const WeightingReference* reference = &WEIGHTING_REFERENCES[j];
+            double aError = measureLevel(LEVEL_METER_FREQUENCY_WEIGHTING_A, reference->frequency, amplitude, SAMPLE_FREQUENCIES[i], INTERVAL_LEQ_INDEX) -
+                referenceLevel - reference->aWeighting;
+            double cError = measureLevel(LEVEL_METER_FREQUENCY_WEIGHTING_C, reference->frequency, amplitude, SAMPLE_FREQUENCIES[i], INTERVAL_LEQ_INDEX) -
+                referenceLevel - reference->cWeighting;
+            printf(" %+.2f/%+.2f dB (%g Hz)", aError, cError, reference->frequency);
+
+            HOST_TEST_CHECK(aError >= reference->minTolerance && aError <= reference->maxTolerance);
+            HOST_TEST_CHECK(cError >= reference->minTolerance && cError <= reference->maxTolerance);
+        }
+        printf("\n");
+    }
+}
+
+// After the tone stops, the time-weighted level decays at 34.7 dB/s with the fast weighting and 4.3 dB/s with the slow one.
+static void testTimeWeightings()
+{
+    static const uint8_t TIME_WEIGHTINGS[] = { LEVEL_METER_TIME_WEIGHTING_FAST, LEVEL_METER_TIME_WEIGHTING_SLOW };
+    static const double DECAY_RATES_DB_PER_S[] = { 34.7, 4.3 };
+    Signal tone = { 0.5, 1000, 0 };
+    Signal silence = { 0, 1000, 0 };
+
+    for (size_t i = 0; i < sizeof(TIME_WEIGHTINGS) / sizeof(TIME_WEIGHTINGS[0]); i++)
+    {
+        Meter meter;
+        startMeter(&meter, LEVEL_METER_FREQUENCY_WEIGHTING_Z, TIME_WEIGHTINGS[i], 100, 48000);
+        for (size_t j = 0; j < 50; j++)
+        {
+            runMeterInterval(&meter, &tone);
+        }
+        double maxLevel = getLevel(&meter, 0, MAX_TIME_WEIGHTED_LEVEL_INDEX);
+
+        runMeterInterval(&meter, &silence);
+        double firstLevel = getLevel(&meter, 0, TIME_WEIGHTED_LEVEL_INDEX);
+        runMeterInterval(&meter, &silence);
+        double decayRate = (firstLevel - getLevel(&meter, 0, TIME_WEIGHTED_LEVEL_INDEX)) / 0.1;
+        printf("Time weighting %u: decay rate = %.2f dB/s\n", TIME_WEIGHTINGS[i], decayRate);
+
+        HOST_TEST_CHECK(fabs(maxLevel - 20 * log10(0.5)) < 0.1);
+        HOST_TEST_CHECK(fabs(decayRate - DECAY_RATES_DB_PER_S[i]) < 0.1 * DECAY_RATES_DB_PER_S[i]);
+    }
+}
+
+// A tone on during half of every interval has an Leq 3 dB below its level, and its peak is the tone peak.
+static void testBurstLeq()
+{
+    Meter meter;
+    Signal burst = { 0.5, 1000, 1 };
+    startMeter(&meter, LEVEL_METER_FREQUENCY_WEIGHTING_Z, LEVEL_METER_TIME_WEIGHTING_FAST, 200, 48000);
+    for (size_t i = 0; i < 10; i++)
+    {
+        runMeterInterval(&meter, &burst);
+    }
+
+    double toneLevel = 20 * log10(0.5);
+    HOST_TEST_CHECK(fabs(getLevel(&meter, 0, PEAK_INDEX) - toneLevel) < LEVEL_TOLERANCE_DB);
+    HOST_TEST_CHECK(fabs(getLevel(&meter, 0, INTERVAL_LEQ_INDEX) - (toneLevel - 10 * log10(2))) < LEVEL_TOLERANCE_DB);
+    HOST_TEST_CHECK(fabs(getLevel(&meter, 0, RUNNING_LEQ_INDEX) - (toneLevel - 10 * log10(2))) < LEVEL_TOLERANCE_DB);
+
+    uint8_t* duration = meter.message + 18;
+    HOST_TEST_CHECK(((duration[0] << 24) | (duration[1] << 16) | (duration[2] << 8) | duration[3]) == 2000);
+}
+
+int main()
+{
+    testSineLevels();
+    testWeightings();
+    testTimeWeightings();
+    testBurstLeq();
+
+    return getHostTestResult();
+}
@@ -0,0 +1,352 @@
+#include "host_test.h"
+#include "network/message_parser.h"
+
+#include <lwip/sockets.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+// Checks the framing of the TCP message parser when the messages have no handler in the current state or are unknown,
+// fuzzes it with valid streams split at random boundaries and with garbled streams, and benchmarks the dispatch
+// of small messages, with and without the recv of the socket path.
+
+#define HEARTBEAT_ID 4
+#define INITIALIZATION_ID 2
+#define RECORD_ID 5
+#define RECORD_FETCH_ID 10
+#define NACK_ID 12
+#define UNKNOWN_ID 99
+
+#define HEADER_SIZE 8
+#define HEARTBEAT_SIZE 4
+#define RECORD_SIZE 16
+#define NACK_MAX_SIZE 64
+
+#define STREAM_MESSAGE_COUNT 20000
+#define GARBLED_STREAM_COUNT 200
+#define BENCHMARK_MESSAGE_COUNT 1000000
+#define MAX_STREAM_SIZE (STREAM_MESSAGE_COUNT * NACK_MAX_SIZE)
+
+static const MessageFormat MESSAGE_FORMATS[] =
+{
+    { INITIALIZATION_ID, 1 },
+    { HEARTBEAT_ID, 0 },
+    { RECORD_ID, 1 },
+    { RECORD_FETCH_ID, 1 },
+    { NACK_ID, 1 }
+};
+
+#define MESSAGE_FORMAT_COUNT (sizeof(MESSAGE_FORMATS) / sizeof(MessageFormat))
+
+typedef struct
+{
+    uint32_t ids[STREAM_MESSAGE_COUNT];
+    uint32_t checksums[STREAM_MESSAGE_COUNT];
+    size_t count;
+    int isAligned;
+} ReceivedMessages;
+
+static ReceivedMessages receivedMessages;
+
+static uint32_t computeChecksum(const uint8_t* message, size_t size)
+{
+    uint32_t checksum = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        checksum = (checksum ^ message[i]) * 16777619u;
+    }
+    return checksum;
+}
+
+static int handleMessage(void* context, uint8_t* message, size_t size)
+{
+    if (receivedMessages.count < STREAM_MESSAGE_COUNT)
+    {
+        receivedMessages.ids[receivedMessages.count] = ntohl(*(uint32_t*)message);
+        receivedMessages.checksums[receivedMessages.count] = computeChecksum(message, size);
+    }
+    receivedMessages.isAligned &= ((uintptr_t)message % 4) == 0;
+    receivedMessages.count++;
+    return MESSAGE_HANDLER_CONTINUE;
+}
+
+static int handleInitialization(void* context, uint8_t* message, size_t size)
+{
+    handleMessage(context, message, size);
+    return MESSAGE_HANDLER_STOP;
+}
+
+static const MessageHandlerEntry PENDING_CONNECTION_HANDLERS[] =
+{
+    { INITIALIZATION_ID, 16, MESSAGE_PARSER_BUFFER_SIZE, handleInitialization }
+};
+
+static const MessageHandlerEntry SESSION_HANDLERS[] =
+{
+    { HEARTBEAT_ID, HEARTBEAT_SIZE, HEARTBEAT_SIZE, handleMessage },
+    { RECORD_ID, RECORD_SIZE, RECORD_SIZE, handleMessage },
+    { NACK_ID, 10, MESSAGE_PARSER_BUFFER_SIZE, handleMessage }
+};
+
+#define PENDING_CONNECTION_HANDLER_COUNT (sizeof(PENDING_CONNECTION_HANDLERS) / sizeof(MessageHandlerEntry))
+#define SESSION_HANDLER_COUNT (sizeof(SESSION_HANDLERS) / sizeof(MessageHandlerEntry))
+
+static void writeWord(uint8_t* data, uint32_t value)
+{
+    value = htonl(value);
+    memcpy(data, &value, sizeof(value));
+}
+
+static size_t writeMessage(uint8_t* data, uint32_t id, size_t payloadSize, uint32_t seed)
+{
+    writeWord(data, id);
+    if (id == HEARTBEAT_ID)
+    {
+        return HEARTBEAT_SIZE;
+    }
+
+    writeWord(data + 4, payloadSize);
+    for (size_t i = 0; i < payloadSize; i++)
+    {
+        data[HEADER_SIZE + i] = (uint8_t)(seed * 31 + i);
+    }
+    return HEADER_SIZE + payloadSize;
+}
+
+// Copies the stream in the parser in chunks of random sizes, like the recv of a socket.
+static int feedParser(MessageParser* parser, const uint8_t* stream, size_t size, size_t maxChunkSize)
+{
+    size_t offset = 0;
+    while (offset < size)
+    {
+        size_t chunkSize = 1 + rand() % maxChunkSize;
+        size_t freeSize = MESSAGE_PARSER_BUFFER_SIZE - parser->size;
+        chunkSize = chunkSize > freeSize ? freeSize : chunkSize;
+        chunkSize = chunkSize > size - offset ? size - offset : chunkSize;
+
+        memcpy(parser->buffer + parser->size, stream + offset, chunkSize);
+        parser->size += chunkSize;
+        offset += chunkSize;
+        if (dispatchMessages(parser, SESSION_HANDLERS, SESSION_HANDLER_COUNT, NULL) == MESSAGE_HANDLER_CLOSE)
+        {
+            return MESSAGE_HANDLER_CLOSE;
+        }
+        if (parser->size > MESSAGE_PARSER_BUFFER_SIZE)
+        {
+            return MESSAGE_HANDLER_CLOSE;
+        }
+    }
+    return MESSAGE_HANDLER_CONTINUE;
+}
+
+static void resetReceivedMessages()
+{
+    memset(&receivedMessages, 0, sizeof(receivedMessages));
+    receivedMessages.isAligned = 1;
+}
+
+static void testUnhandledMessages()
+{
+    static MessageParser parser;
+    uint8_t stream[256] __attribute__((aligned(4)));
+    size_t size = 0;
+
+    // A payload message before the initialization request is skipped by its size.
+    initializeMessageParser(&parser, MESSAGE_FORMATS, MESSAGE_FORMAT_COUNT);
+    size += writeMessage(stream + size, RECORD_FETCH_ID, 12, 1);
+    size += writeMessage(stream + size, NACK_ID, 6, 2);
+    size += writeMessage(stream + size, INITIALIZATION_ID, 8, 3);
+    size += writeMessage(stream + size, HEARTBEAT_ID, 0, 4);
+    memcpy(parser.buffer, stream, size);
+    parser.size = size;
+
+    resetReceivedMessages();
+    HOST_TEST_CHECK(dispatchMessages(&parser, PENDING_CONNECTION_HANDLERS, PENDING_CONNECTION_HANDLER_COUNT, NULL) ==
+        MESSAGE_HANDLER_STOP);
+    HOST_TEST_CHECK(receivedMessages.count == 1 && receivedMessages.ids[0] == INITIALIZATION_ID);
+    HOST_TEST_CHECK(parser.size == HEARTBEAT_SIZE);
+
+    // A second initialization request on a session is skipped too.
+    size = 0;
+    size += writeMessage(stream + size, INITIALIZATION_ID, 8, 5);
+    size += writeMessage(stream + size, RECORD_ID, 8, 7);
+    memcpy(parser.buffer + parser.size, stream, size);
+    parser.size += size;
+
+    resetReceivedMessages();
+    HOST_TEST_CHECK(dispatchMessages(&parser, SESSION_HANDLERS, SESSION_HANDLER_COUNT, NULL) == MESSAGE_HANDLER_CONTINUE);
+    HOST_TEST_CHECK(receivedMessages.count == 2);
+    HOST_TEST_CHECK(receivedMessages.ids[0] == HEARTBEAT_ID && receivedMessages.ids[1] == RECORD_ID);
+    HOST_TEST_CHECK(parser.size == 0);
+
+    // A message larger than the buffer closes the connection.
+    writeWord(parser.buffer, NACK_ID);
+    writeWord(parser.buffer + 4, MESSAGE_PARSER_BUFFER_SIZE);
+    parser.size = HEADER_SIZE;
+    HOST_TEST_CHECK(dispatchMessages(&parser, SESSION_HANDLERS, SESSION_HANDLER_COUNT, NULL) == MESSAGE_HANDLER_CLOSE);
+
+    // An unknown message closes the connection too, since its size is unknown. The messages before it are dispatched.
+    size = 0;
+    size += writeMessage(stream + size, HEARTBEAT_ID, 0, 8);
+    size += writeMessage(stream + size, UNKNOWN_ID, 4, 9);
+    size += writeMessage(stream + size, HEARTBEAT_ID, 0, 10);
+    memcpy(parser.buffer, stream, size);
+    parser.size = size;
+
+    resetReceivedMessages();
+    HOST_TEST_CHECK(dispatchMessages(&parser, SESSION_HANDLERS, SESSION_HANDLER_COUNT, NULL) == MESSAGE_HANDLER_CLOSE);
+    HOST_TEST_CHECK(receivedMessages.count == 1);
+}
+
+// Random valid streams, with messages without handler, are parsed whatever the chunk boundaries.
+static void testSplitStreams()
+{
+    static uint8_t stream[MAX_STREAM_SIZE] __attribute__((aligned(4)));
+    static uint32_t expectedIds[STREAM_MESSAGE_COUNT];
+    static uint32_t expectedChecksums[STREAM_MESSAGE_COUNT];
+    static MessageParser parser;
+    static const uint32_t IDS[] = { HEARTBEAT_ID, RECORD_ID, NACK_ID, RECORD_FETCH_ID, INITIALIZATION_ID };
+
+    srand(1);
+    for (size_t maxChunkSize = 1; maxChunkSize <= 1024; maxChunkSize *= 4)
+    {
+        size_t size = 0;
+        size_t expectedCount = 0;
+        for (size_t i = 0; i < STREAM_MESSAGE_COUNT; i++)
+        {
+            uint32_t id = IDS[rand() % (sizeof(IDS) / sizeof(IDS[0]))];
+            size_t payloadSize = id == RECORD_ID ? RECORD_SIZE - HEADER_SIZE : (size_t)(2 + rand() % (NACK_MAX_SIZE - HEADER_SIZE - 1));
+
+            size_t messageSize = writeMessage(stream + size, id, payloadSize, i);
+            if (id == HEARTBEAT_ID || id == RECORD_ID || id == NACK_ID)
+            {
+                expectedIds[expectedCount] = id;
+                expectedChecksums[expectedCount] = computeChecksum(stream + size, messageSize);
+                expectedCount++;
+            }
+            size += messageSize;
+        }
+
+        resetReceivedMessages();
+        initializeMessageParser(&parser, MESSAGE_FORMATS, MESSAGE_FORMAT_COUNT);
+        HOST_TEST_CHECK(feedParser(&parser, stream, size, maxChunkSize) == MESSAGE_HANDLER_CONTINUE);
+        HOST_TEST_CHECK(parser.size == 0);
+        HOST_TEST_CHECK(receivedMessages.count == expectedCount);
+        HOST_TEST_CHECK(receivedMessages.isAligned);
+        HOST_TEST_CHECK(memcmp(receivedMessages.ids, expectedIds, expectedCount * sizeof(uint32_t)) == 0);
+        HOST_TEST_CHECK(memcmp(receivedMessages.checksums, expectedChecksums, expectedCount * sizeof(uint32_t)) == 0);
+    }
+}
+
+// Garbled streams must never overflow the buffer, they are parsed until the connection is closed.
+static void testGarbledStreams()
+{
+    static uint8_t stream[4096] __attribute__((aligned(4)));
+    static MessageParser parser;
+
+    srand(2);
+    size_t closedCount = 0;
+    for (size_t i = 0; i < GARBLED_STREAM_COUNT; i++)
+    {
+        size_t size = 0;
+        while (size + NACK_MAX_SIZE <= sizeof(stream))
+        {
+            if (rand() % 2 == 0)
+            {
+                size += writeMessage(stream + size, NACK_ID, 2 + rand() % (NACK_MAX_SIZE - HEADER_SIZE - 1), i);
+            }
+            else
+            {
+                // A payload message id followed by random bytes, biased towards small sizes, and truncated.
+                writeWord(stream + size, rand() % 2 == 0 ? NACK_ID : RECORD_FETCH_ID);
+                for (size_t j = 4; j < 8; j++)
+                {
+                    stream[size + j] = rand() % 4 == 0 ? (uint8_t)rand() : (uint8_t)(rand() % 2);
+                }
+                size += 1 + rand() % 8;
+            }
+        }
+
+        resetReceivedMessages();
+        initializeMessageParser(&parser, MESSAGE_FORMATS, MESSAGE_FORMAT_COUNT);
+        closedCount += feedParser(&parser, stream, size, 1 + rand() % 512) == MESSAGE_HANDLER_CLOSE;
+        HOST_TEST_CHECK(parser.size <= MESSAGE_PARSER_BUFFER_SIZE);
+        HOST_TEST_CHECK(receivedMessages.isAligned);
+    }
+    printf("Garbled streams: %zu/%u closed by an invalid size or id\n", closedCount, GARBLED_STREAM_COUNT);
+}
+
+static size_t createBenchmarkStream(uint8_t* stream, size_t streamSize)
+{
+    size_t size = 0;
+    for (size_t i = 0; size + RECORD_SIZE <= streamSize; i++)
+    {
+        size += writeMessage(stream + size, i % 2 == 0 ? HEARTBEAT_ID : RECORD_ID, i % 2 == 0 ? 0 : RECORD_SIZE - HEADER_SIZE, i);
+    }
+    return size;
+}
+
+static void benchmarkDispatch()
+{
+    static MessageParser parser;
+    uint8_t stream[MESSAGE_PARSER_BUFFER_SIZE] __attribute__((aligned(4)));
+    size_t size = createBenchmarkStream(stream, sizeof(stream));
+    size_t messageCount = getHostBenchmarkIterationCount(BENCHMARK_MESSAGE_COUNT);
+
+    initializeMessageParser(&parser, MESSAGE_FORMATS, MESSAGE_FORMAT_COUNT);
+    resetReceivedMessages();
+    double startTimeS = getHostTestTimeS();
+    while (receivedMessages.count < messageCount)
+    {
+        memcpy(parser.buffer, stream, size);
+        parser.size = size;
+        dispatchMessages(&parser, SESSION_HANDLERS, SESSION_HANDLER_COUNT, NULL);
+    }
+    double durationS = getHostTestTimeS() - startTimeS;
+    printf("Dispatch: %.1f Mmessages/s, %.0f ns/message\n",
+        receivedMessages.count / durationS / 1e6,
+        durationS / receivedMessages.count * 1e9);
+}
+
+// One recv reads all the available messages.
+static void benchmarkReceive()
+{
+    static MessageParser parser;
+    uint8_t stream[MESSAGE_PARSER_BUFFER_SIZE] __attribute__((aligned(4)));
+    size_t size = createBenchmarkStream(stream, sizeof(stream));
+    size_t messageCount = getHostBenchmarkIterationCount(BENCHMARK_MESSAGE_COUNT) / 4;
+    int socketHandles[2];
+    HOST_TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, socketHandles) == 0);
+
+    initializeMessageParser(&parser, MESSAGE_FORMATS, MESSAGE_FORMAT_COUNT);
+    resetReceivedMessages();
+    size_t receptionCount = 0;
+    double startTimeS = getHostTestTimeS();
+    while (receivedMessages.count < messageCount)
+    {
+        HOST_TEST_CHECK(send(socketHandles[0], stream, size, 0) == (ssize_t)size);
+        do
+        {
+            receiveMessages(&parser, socketHandles[1], SESSION_HANDLERS, SESSION_HANDLER_COUNT, NULL);
+            receptionCount++;
+        } while (parser.size > 0);
+    }
+    double durationS = getHostTestTimeS() - startTimeS;
+    printf("Receive: %.1f Mmessages/s, %.1f messages/recv\n",
+        receivedMessages.count / durationS / 1e6,
+        (double)receivedMessages.count / receptionCount);
+
+    close(socketHandles[0]);
+    close(socketHandles[1]);
+}
+
+int main()
+{
+    testUnhandledMessages();
+    testSplitStreams();
+    testGarbledStreams();
+    benchmarkDispatch();
+    benchmarkReceive();
+
+    return getHostTestResult();
+}
@@ -0,0 +1,202 @@
+#include "host_test.h"
+#include "packet_ring.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+// Unit test of the packet ring and two-thread stress test and benchmark of the producer/consumer paths.
+// The consumer keeps a retransmission history of HISTORY_SIZE packets, like the streaming task.
+
+#define DATA_OFFSET 3
+#define HISTORY_SIZE 8
+#define MIN_PACKET_SIZE 8
+#define PACKET_COUNT 1000000
+
+typedef struct
+{
+    PacketRing ring;
+    size_t packetCount;
+    int isDroppingWhenFull;
+    uint32_t receivedPacketCount;
+    uint32_t corruptedPacketCount;
+    uint32_t reorderedPacketCount;
+} RingTest;
+
+static RingTest ringTest;
+
+static size_t getPacketSize(uint32_t sequenceId)
+{
+    return MIN_PACKET_SIZE + sequenceId * 97 % (CONFIG_STREAMING_PACKET_MAX_SIZE - MIN_PACKET_SIZE);
+}
+
+// The sequence id is written at both ends of the packet, so the benchmark measures the ring and not the copy.
+static void writePacket(uint8_t* data, uint32_t sequenceId, size_t size)
+{
+    memcpy(data, &sequenceId, sizeof(sequenceId));
+    memcpy(data + size - sizeof(sequenceId), &sequenceId, sizeof(sequenceId));
+}
+
+static int isPacketValid(const PacketRingSlot* slot, uint32_t* sequenceId)
+{
+    uint32_t lastSequenceId;
+    memcpy(sequenceId, slot->data, sizeof(*sequenceId));
+    if (slot->size != getPacketSize(*sequenceId) || slot->sequenceId != *sequenceId)
+    {
+        return 0;
+    }
+
+    memcpy(&lastSequenceId, slot->data + slot->size - sizeof(lastSequenceId), sizeof(lastSequenceId));
+    return lastSequenceId == *sequenceId;
+}
+
+static void* produce(void* parameters)
+{
+    for (uint32_t sequenceId = 0; sequenceId < ringTest.packetCount; sequenceId++)
+    {
+        PacketRingSlot* slot = acquirePacketRingSlot(&ringTest.ring);
+        while (!ringTest.isDroppingWhenFull && slot == &ringTest.ring.overflowSlot)
+        {
+            sched_yield();
+            slot = acquirePacketRingSlot(&ringTest.ring);
+        }
+
+        size_t size = getPacketSize(sequenceId);
+        writePacket(slot->data, sequenceId, size);
+        slot->sequenceId = sequenceId;
+        commitPacketRingSlot(&ringTest.ring, slot, size);
+    }
+    return NULL;
+}
+
+static void consumePacket(PacketRingSlot* slot, int64_t* lastSequenceId)
+{
+    uint32_t sequenceId;
+    if (!isPacketValid(slot, &sequenceId))
+    {
+        ringTest.corruptedPacketCount++;
+    }
+    else if ((int64_t)sequenceId <= *lastSequenceId ||
+        (!ringTest.isDroppingWhenFull && sequenceId != *lastSequenceId + 1))
+    {
+        ringTest.reorderedPacketCount++;
+    }
+    *lastSequenceId = sequenceId;
+    ringTest.receivedPacketCount++;
+
+    popPacketRing(&ringTest.ring);
+    while (getPacketRingHistorySize(&ringTest.ring) > HISTORY_SIZE)
+    {
+        releasePacketRingSlot(&ringTest.ring);
+    }
+}
+
+static void* consume(void* parameters)
+{
+    int64_t lastSequenceId = -1;
+    while (1)
+    {
+        PacketRingSlot* slot = peekPacketRing(&ringTest.ring);
+        if (slot != NULL)
+        {
+            consumePacket(slot, &lastSequenceId);
+        }
+        else if (ringTest.receivedPacketCount == atomic_load(&ringTest.ring.pushedPacketCount) &&
+            atomic_load(&ringTest.ring.pushedPacketCount) + atomic_load(&ringTest.ring.droppedPacketCount) ==
+            ringTest.packetCount)
+        {
+            break;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static double runTwoThreads(size_t packetCount, int isDroppingWhenFull)
+{
+    memset(&ringTest, 0, sizeof(ringTest));
+    initializePacketRing(&ringTest.ring, DATA_OFFSET);
+    ringTest.packetCount = packetCount;
+    ringTest.isDroppingWhenFull = isDroppingWhenFull;
+
+    pthread_t producer;
+    pthread_t consumer;
+    double startTimeS = getHostTestTimeS();
+    pthread_create(&consumer, NULL, consume, NULL);
+    pthread_create(&producer, NULL, produce, NULL);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    double durationS = getHostTestTimeS() - startTimeS;
+
+    HOST_TEST_CHECK(ringTest.corruptedPacketCount == 0);
+    HOST_TEST_CHECK(ringTest.reorderedPacketCount == 0);
+    HOST_TEST_CHECK(ringTest.receivedPacketCount == atomic_load(&ringTest.ring.pushedPacketCount));
+    HOST_TEST_CHECK(atomic_load(&ringTest.ring.maxOccupancy) <= PACKET_RING_CAPACITY);
+    return durationS;
+}
+
+static void testSingleThread()
+{
+    static PacketRing ring;
+    initializePacketRing(&ring, DATA_OFFSET);
+
+    HOST_TEST_CHECK(peekPacketRing(&ring) == NULL);
+    HOST_TEST_CHECK(((uintptr_t)ring.slots[1].buffer % PACKET_RING_SLOT_ALIGNMENT) == 0);
+    HOST_TEST_CHECK(ring.slots[1].data == ring.slots[1].buffer + DATA_OFFSET);
+
+    for (size_t i = 0; i < PACKET_RING_CAPACITY; i++)
+    {
+        PacketRingSlot* slot = acquirePacketRingSlot(&ring);
+        HOST_TEST_CHECK(slot == &ring.slots[i]);
+        commitPacketRingSlot(&ring, slot, i + 1);
+    }
+    HOST_TEST_CHECK(getPacketRingOccupancy(&ring) == PACKET_RING_CAPACITY);
+
+    // The ring is full, the packet of the overflow slot is dropped on commit.
+    PacketRingSlot* overflowSlot = acquirePacketRingSlot(&ring);
+    HOST_TEST_CHECK(overflowSlot == &ring.overflowSlot);
+    commitPacketRingSlot(&ring, overflowSlot, 1);
+    HOST_TEST_CHECK(atomic_load(&ring.droppedPacketCount) == 1);
+
+    // The popped slots stay in the history until they are released.
+    for (size_t i = 0; i < 4; i++)
+    {
+        HOST_TEST_CHECK(peekPacketRing(&ring)->size == i + 1);
+        popPacketRing(&ring);
+    }
+    HOST_TEST_CHECK(getPacketRingHistorySize(&ring) == 4);
+    HOST_TEST_CHECK(getPacketRingHistorySlot(&ring, 1)->size == 2);
+    HOST_TEST_CHECK(acquirePacketRingSlot(&ring) == &ring.overflowSlot);
+
+    releasePacketRingSlot(&ring);
+    HOST_TEST_CHECK(acquirePacketRingSlot(&ring) == &ring.slots[0]);
+
+    // An oversized packet is dropped.
+    commitPacketRingSlot(&ring, acquirePacketRingSlot(&ring), CONFIG_STREAMING_PACKET_MAX_SIZE + 1);
+    HOST_TEST_CHECK(atomic_load(&ring.droppedPacketCount) == 2);
+    HOST_TEST_CHECK(atomic_load(&ring.pushedPacketCount) == PACKET_RING_CAPACITY);
+    HOST_TEST_CHECK(atomic_load(&ring.maxOccupancy) == PACKET_RING_CAPACITY);
+}
+
+int main()
+{
+    testSingleThread();
+
+    size_t packetCount = getHostBenchmarkIterationCount(PACKET_COUNT);
+    double durationS = runTwoThreads(packetCount, 0);
+    printf("Lossless: %.2f Mpackets/s, %.0f ns/packet, max occupancy = %u/%u\n",
+        packetCount / durationS / 1e6,
+        durationS / packetCount * 1e9,
+        atomic_load(&ringTest.ring.maxOccupancy),
+        PACKET_RING_CAPACITY);
+
+    runTwoThreads(packetCount, 1);
+    printf("Dropping when full: pushed = %u, dropped = %u\n",
+        atomic_load(&ringTest.ring.pushedPacketCount),
+        atomic_load(&ringTest.ring.droppedPacketCount));
+
+    return getHostTestResult();
+}
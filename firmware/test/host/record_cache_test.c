@@ -0,0 +1,165 @@
+#include "host_test.h"
+#include "network/record_cache.h"
+#include "config.h"
+
+#include <esp_heap_caps.h>
+
+// Fills the record cache like the upload task, with records received in several messages, and checks the LRU
+// eviction, the growth of the entry being filled, the records larger than the cache, the records uploaded at the
+// same time and the cache without memory.
+
+#define MESSAGE_SIZE 1000
+#define RECORD_SIZE 10000
+
+static void addRecord(uint8_t recordId, size_t size, uint8_t status)
+{
+    uint8_t message[MESSAGE_SIZE];
+
+    startRecordCacheEntry(recordId);
+    for (size_t offset = 0; offset < size; offset += MESSAGE_SIZE)
+    {
+        size_t messageSize = size - offset < MESSAGE_SIZE ? size - offset : MESSAGE_SIZE;
+        for (size_t i = 0; i < messageSize; i++)
+        {
+            message[i] = (uint8_t)(recordId + offset + i);
+        }
+        appendRecordCacheEntry(message, messageSize);
+    }
+    finishRecordCacheEntry(recordId, status);
+}
+
+static int isRecordCached(uint8_t recordId, size_t expectedSize)
+{
+    size_t size;
+    uint8_t status;
+    const uint8_t* data = findRecordCacheEntry(recordId, &size, &status);
+    if (data == NULL || size != expectedSize || status != recordId % 2)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if (data[i] != (uint8_t)(recordId + i))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void testEviction()
+{
+    addRecord(1, RECORD_SIZE, 1);
+    addRecord(2, RECORD_SIZE, 0);
+    addRecord(3, RECORD_SIZE, 1);
+    HOST_TEST_CHECK(isRecordCached(1, RECORD_SIZE));
+
+    // The record 2 is the least recently used one.
+    addRecord(4, RECORD_SIZE, 0);
+    HOST_TEST_CHECK(!isRecordCached(2, RECORD_SIZE));
+    HOST_TEST_CHECK(isRecordCached(1, RECORD_SIZE));
+    HOST_TEST_CHECK(isRecordCached(3, RECORD_SIZE));
+    HOST_TEST_CHECK(isRecordCached(4, RECORD_SIZE));
+
+    // The entry count is limited too.
+    addRecord(5, 100, 1);
+    addRecord(6, 100, 0);
+    HOST_TEST_CHECK(isRecordCached(5, 100));
+    HOST_TEST_CHECK(isRecordCached(6, 100));
+}
+
+static void testGrowth()
+{
+    // The record being filled evicts the others until it has the whole cache.
+    addRecord(7, CONFIG_UPLOAD_RECORD_CACHE_SIZE, 1);
+    HOST_TEST_CHECK(isRecordCached(7, CONFIG_UPLOAD_RECORD_CACHE_SIZE));
+    for (uint8_t recordId = 1; recordId < 7; recordId++)
+    {
+        HOST_TEST_CHECK(!isRecordCached(recordId, RECORD_SIZE));
+    }
+
+    addRecord(8, RECORD_SIZE, 0);
+    addRecord(9, CONFIG_UPLOAD_RECORD_CACHE_SIZE - RECORD_SIZE, 1);
+    HOST_TEST_CHECK(isRecordCached(8, RECORD_SIZE));
+    HOST_TEST_CHECK(isRecordCached(9, CONFIG_UPLOAD_RECORD_CACHE_SIZE - RECORD_SIZE));
+}
+
+static void testTooLargeRecord()
+{
+    addRecord(10, CONFIG_UPLOAD_RECORD_CACHE_SIZE + 1, 0);
+    HOST_TEST_CHECK(!isRecordCached(10, CONFIG_UPLOAD_RECORD_CACHE_SIZE + 1));
+    HOST_TEST_CHECK(isRecordTooLargeForCache(10));
+    HOST_TEST_CHECK(!isRecordTooLargeForCache(8));
+
+    // A new record with the same id clears the state.
+    addRecord(10, RECORD_SIZE, 0);
+    HOST_TEST_CHECK(isRecordCached(10, RECORD_SIZE));
+    HOST_TEST_CHECK(!isRecordTooLargeForCache(10));
+}
+
+static void testIncompleteUpload()
+{
+    uint8_t message[MESSAGE_SIZE] = { 0 };
+    startRecordCacheEntry(11);
+    appendRecordCacheEntry(message, MESSAGE_SIZE);
+    HOST_TEST_CHECK(findRecordCacheEntry(11, &(size_t){ 0 }, &(uint8_t){ 0 }) == NULL);
+
+    // The status of another record does not finish the entry.
+    finishRecordCacheEntry(12, 0);
+    HOST_TEST_CHECK(findRecordCacheEntry(11, &(size_t){ 0 }, &(uint8_t){ 0 }) == NULL);
+    HOST_TEST_CHECK(findRecordCacheEntry(12, &(size_t){ 0 }, &(uint8_t){ 0 }) == NULL);
+}
+
+// The upload task skips a record uploaded while another one is being filled.
+static void testSkippedRecord()
+{
+    uint8_t message[MESSAGE_SIZE];
+    for (size_t i = 0; i < MESSAGE_SIZE; i++)
+    {
+        message[i] = (uint8_t)(13 + i);
+    }
+
+    addRecord(14, RECORD_SIZE, 0);
+    startRecordCacheEntry(13);
+    appendRecordCacheEntry(message, MESSAGE_SIZE);
+    skipRecordCacheEntry(14);
+    finishRecordCacheEntry(14, 0);
+    HOST_TEST_CHECK(findRecordCacheEntry(13, &(size_t){ 0 }, &(uint8_t){ 0 }) == NULL);
+
+    // The status of the skipped record does not finish the entry being filled, and its previous data is replaced.
+    finishRecordCacheEntry(13, 1);
+    HOST_TEST_CHECK(isRecordCached(13, MESSAGE_SIZE));
+    HOST_TEST_CHECK(!isRecordCached(14, RECORD_SIZE));
+    HOST_TEST_CHECK(isRecordSkippedByCache(14));
+    HOST_TEST_CHECK(!isRecordSkippedByCache(13));
+
+    addRecord(14, RECORD_SIZE, 0);
+    HOST_TEST_CHECK(isRecordCached(14, RECORD_SIZE));
+    HOST_TEST_CHECK(!isRecordSkippedByCache(14));
+}
+
+static void testAllocationFailure()
+{
+    hostHeapCapsAvailableSize = CONFIG_UPLOAD_RECORD_CACHE_SIZE - 1;
+    HOST_TEST_CHECK(initializeRecordCache() == ESP_ERR_NO_MEM);
+    hostHeapCapsAvailableSize = SIZE_MAX;
+
+    addRecord(1, RECORD_SIZE, 1);
+    HOST_TEST_CHECK(!isRecordCached(1, RECORD_SIZE));
+    HOST_TEST_CHECK(!isRecordTooLargeForCache(1));
+}
+
+int main()
+{
+    testAllocationFailure();
+    HOST_TEST_CHECK(initializeRecordCache() == ESP_OK);
+    testEviction();
+    testGrowth();
+    testTooLargeRecord();
+    testIncompleteUpload();
+    testSkippedRecord();
+
+    logRecordCacheStatistics();
+    return getHostTestResult();
+}
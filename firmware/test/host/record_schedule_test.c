@@ -0,0 +1,146 @@
+#include "host_test.h"
+#include "sound/record_schedule.h"
+#include "config.h"
+
+// Drives the record scheduling of recordSound and the sound task across the minute, hour and midnight boundaries.
+// The wall-clock start is converted once to a sample index and the sound task pops the record in the block
+// containing its start sample.
+
+#define SAMPLE_FREQUENCY 44100
+#define BLOCK_FRAME_COUNT CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH
+#define US_IN_MS_COUNT 1000
+
+typedef struct
+{
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+    uint16_t ms;
+} TimeOfDay;
+
+static int64_t getTimeOfDayUsFromTime(const TimeOfDay* time)
+{
+    return getTimeOfDayUs(time->hour, time->minute, time->second, (uint32_t)time->ms * US_IN_MS_COUNT);
+}
+
+// The sample 0 is captured at the current time.
+static int64_t computeStartSampleIndex(const TimeOfDay* currentTime, const TimeOfDay* requestedTime)
+{
+    int64_t delayUs = getTimeOfDayDelayUs(getTimeOfDayUsFromTime(currentTime), getTimeOfDayUsFromTime(requestedTime));
+    return delayUs * SAMPLE_FREQUENCY / 1000000;
+}
+
+// Returns the end index of the block in which the record is popped.
+static int64_t runUntilDue(RecordRequest* request)
+{
+    for (int64_t endSampleIndex = BLOCK_FRAME_COUNT; endSampleIndex < 2 * 3600LL * SAMPLE_FREQUENCY;
+        endSampleIndex += BLOCK_FRAME_COUNT)
+    {
+        if (popDueRecord(endSampleIndex, request))
+        {
+            return endSampleIndex;
+        }
+    }
+    return -1;
+}
+
+static void testBoundary(TimeOfDay currentTime, TimeOfDay requestedTime, int64_t expectedDelayMs)
+{
+    int64_t expectedStartSampleIndex = expectedDelayMs * SAMPLE_FREQUENCY / 1000;
+    RecordRequest request = { computeStartSampleIndex(&currentTime, &requestedTime), SAMPLE_FREQUENCY, 1 };
+    HOST_TEST_CHECK(request.startSampleIndex == expectedStartSampleIndex);
+    HOST_TEST_CHECK(scheduleRecord(&request));
+
+    RecordRequest dueRequest;
+    int64_t endSampleIndex = runUntilDue(&dueRequest);
+    HOST_TEST_CHECK(dueRequest.startSampleIndex == expectedStartSampleIndex);
+    if (expectedStartSampleIndex < 0)
+    {
+        // A passed start is popped in the first block and the record is read from the history.
+        HOST_TEST_CHECK(endSampleIndex == BLOCK_FRAME_COUNT);
+    }
+    else
+    {
+        HOST_TEST_CHECK(endSampleIndex - BLOCK_FRAME_COUNT <= expectedStartSampleIndex);
+        HOST_TEST_CHECK(expectedStartSampleIndex < endSampleIndex);
+    }
+    HOST_TEST_CHECK(getScheduledRecordCount() == 0);
+}
+
+static void testTimeOfDay()
+{
+    HOST_TEST_CHECK(getTimeOfDayUs(23, 59, 59, 999999) == US_IN_DAY_COUNT - 1);
+    HOST_TEST_CHECK(getTimeOfDayDelayUs(0, US_IN_DAY_COUNT - 1) == -1);
+    HOST_TEST_CHECK(getTimeOfDayDelayUs(US_IN_DAY_COUNT - 1, 0) == 1);
+    HOST_TEST_CHECK(getTimeOfDayDelayUs(getTimeOfDayUs(10, 5, 0, 0), getTimeOfDayUs(9, 59, 0, 0)) == -360000000LL);
+
+    // The delays are wrapped in [-12 h, 12 h).
+    HOST_TEST_CHECK(getTimeOfDayDelayUs(0, US_IN_DAY_COUNT / 2) == -US_IN_DAY_COUNT / 2);
+    HOST_TEST_CHECK(getTimeOfDayDelayUs(0, US_IN_DAY_COUNT / 2 - 1) == US_IN_DAY_COUNT / 2 - 1);
+}
+
+static void testBoundaries()
+{
+    // Minute
+    testBoundary((TimeOfDay){ 12, 30, 59, 999 }, (TimeOfDay){ 12, 31, 0, 0 }, 1);
+    testBoundary((TimeOfDay){ 12, 31, 0, 1 }, (TimeOfDay){ 12, 30, 59, 999 }, -2);
+    // Hour
+    testBoundary((TimeOfDay){ 10, 59, 59, 950 }, (TimeOfDay){ 11, 0, 0, 0 }, 50);
+    testBoundary((TimeOfDay){ 10, 5, 0, 0 }, (TimeOfDay){ 9, 59, 0, 0 }, -360000);
+    // Midnight
+    testBoundary((TimeOfDay){ 23, 59, 59, 900 }, (TimeOfDay){ 0, 0, 0, 100 }, 200);
+    testBoundary((TimeOfDay){ 0, 0, 0, 100 }, (TimeOfDay){ 23, 59, 59, 900 }, -200);
+    testBoundary((TimeOfDay){ 23, 30, 0, 0 }, (TimeOfDay){ 0, 30, 0, 0 }, 3600000);
+}
+
+static void testOrder()
+{
+    RecordRequest requests[] =
+    {
+        { 1000, 10, 1 },
+        { 10, 10, 2 },
+        { 1000, 10, 3 },
+        { -5, 10, 4 }
+    };
+    for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++)
+    {
+        HOST_TEST_CHECK(scheduleRecord(&requests[i]));
+    }
+
+    // The records with the same start keep their request order.
+    uint8_t expectedRecordIds[] = { 4, 2, 1, 3 };
+    RecordRequest request;
+    HOST_TEST_CHECK(!popDueRecord(-5, &request));
+    for (size_t i = 0; i < sizeof(expectedRecordIds); i++)
+    {
+        HOST_TEST_CHECK(popDueRecord(1001, &request));
+        HOST_TEST_CHECK(request.recordId == expectedRecordIds[i]);
+    }
+    HOST_TEST_CHECK(!popDueRecord(INT64_MAX, &request));
+}
+
+static void testFullSchedule()
+{
+    RecordRequest request = { 0, 1, 0 };
+    for (size_t i = 0; i < CONFIG_SOUND_RECORD_SCHEDULE_SIZE; i++)
+    {
+        HOST_TEST_CHECK(scheduleRecord(&request));
+    }
+    HOST_TEST_CHECK(!scheduleRecord(&request));
+    HOST_TEST_CHECK(getScheduledRecordCount() == CONFIG_SOUND_RECORD_SCHEDULE_SIZE);
+
+    while (popDueRecord(1, &request))
+    {
+    }
+    HOST_TEST_CHECK(getScheduledRecordCount() == 0);
+}
+
+int main()
+{
+    testTimeOfDay();
+    testBoundaries();
+    testOrder();
+    testFullSchedule();
+
+    return getHostTestResult();
+}
@@ -0,0 +1,126 @@
+#include "host_test.h"
+#include "sound/resampler.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// Compares the resampled tones with the tones evaluated at the exact resampled positions, with fixed ratios and
+// with a ratio changed at every block like the drift correction, and benchmarks the stereo throughput.
+
+#define BLOCK_FRAME_COUNT RESAMPLER_MAX_INPUT_FRAME_COUNT
+#define SAMPLE_FREQUENCY 44100.0
+#define AMPLITUDE (0.5 * 8388607)
+#define SAMPLE_SHIFT 8
+#define POSITION_ONE 4294967296.0
+#define INITIAL_POSITION -2.0 // The first output frame is at the first frame of history
+#define WARM_UP_FRAME_COUNT 8
+#define TEST_BLOCK_COUNT 4000
+#define BENCHMARK_BLOCK_COUNT 200000
+
+static double getTone(double frequency, double position)
+{
+    return AMPLITUDE * sin(2 * M_PI * frequency * position / SAMPLE_FREQUENCY);
+}
+
+// Returns the maximum error in dBFS. The ratio changes at every block when ratioVariation is not zero.
+static double measureMaxError(double frequency, double ratio, double ratioVariation)
+{
+    static Resampler resampler;
+    int32_t input[BLOCK_FRAME_COUNT * 2];
+    int32_t output[RESAMPLER_MAX_OUTPUT_FRAME_COUNT * 2];
+    double position = INITIAL_POSITION;
+    double maxError = 0;
+    size_t inputFrameCount = 0;
+    size_t outputFrameCount = 0;
+    int isChannelValid = 1;
+
+    initializeResampler(&resampler, 2);
+    for (size_t block = 0; block < TEST_BLOCK_COUNT; block++)
+    {
+        setResamplerRatio(&resampler, ratio + ratioVariation * sin(block * 0.01));
+        double step = (double)resampler.step / POSITION_ONE;
+
+        for (size_t i = 0; i < BLOCK_FRAME_COUNT; i++)
+        {
+            int32_t sample = (int32_t)lrint(getTone(frequency, (double)(inputFrameCount + i)));
+            input[2 * i] = (int32_t)((uint32_t)sample << SAMPLE_SHIFT);
+            input[2 * i + 1] = (int32_t)((uint32_t)-sample << SAMPLE_SHIFT);
+        }
+        inputFrameCount += BLOCK_FRAME_COUNT;
+
+        size_t frameCount = resampleFrames(&resampler, input, BLOCK_FRAME_COUNT, output);
+        for (size_t i = 0; i < frameCount; i++, outputFrameCount++, position += step)
+        {
+            if (outputFrameCount < WARM_UP_FRAME_COUNT)
+            {
+                continue;
+            }
+            double error = fabs((output[2 * i] >> SAMPLE_SHIFT) - getTone(frequency, position));
+            maxError = error > maxError ? error : maxError;
+            isChannelValid &= abs((output[2 * i] >> SAMPLE_SHIFT) + (output[2 * i + 1] >> SAMPLE_SHIFT)) <= 1;
+        }
+    }
+
+    HOST_TEST_CHECK(isChannelValid);
+    HOST_TEST_CHECK(fabs(INITIAL_POSITION + outputFrameCount * ratio - inputFrameCount) < 2 + ratioVariation * outputFrameCount);
+    return 20 * log10(maxError / 8388608);
+}
+
+static void testAccuracy()
+{
+    static const double FREQUENCIES[] = { 100, 440, 1000, 4000, 10000 };
+    static const double RATIOS[] = { 1.0005, 0.9995 };
+
+    for (size_t i = 0; i < sizeof(FREQUENCIES) / sizeof(FREQUENCIES[0]); i++)
+    {
+        printf("%5.0f Hz: max error =", FREQUENCIES[i]);
+        for (size_t j = 0; j < sizeof(RATIOS) / sizeof(RATIOS[0]); j++)
+        {
+            double maxErrorDb = measureMaxError(FREQUENCIES[i], RATIOS[j], 0);
+            printf(" %6.1f dBFS (ratio %.4f)", maxErrorDb, RATIOS[j]);
+
+            // The error of the cubic interpolation grows with the fourth power of the frequency, it stays below
+            // -80 dBFS up to 1 kHz.
+            HOST_TEST_CHECK(FREQUENCIES[i] > 1000 || maxErrorDb < -80);
+        }
+
+        double maxErrorDb = measureMaxError(FREQUENCIES[i], 1, 0.001);
+        printf(" %6.1f dBFS (variable ratio)\n", maxErrorDb);
+        HOST_TEST_CHECK(FREQUENCIES[i] > 1000 || maxErrorDb < -80);
+    }
+}
+
+static void benchmark()
+{
+    static Resampler resampler;
+    int32_t input[BLOCK_FRAME_COUNT * 2];
+    int32_t output[RESAMPLER_MAX_OUTPUT_FRAME_COUNT * 2];
+    size_t blockCount = getHostBenchmarkIterationCount(BENCHMARK_BLOCK_COUNT);
+    size_t outputFrameCount = 0;
+
+    for (size_t i = 0; i < BLOCK_FRAME_COUNT * 2; i++)
+    {
+        input[i] = (int32_t)((uint32_t)(rand() % (1 << 24) - (1 << 23)) << SAMPLE_SHIFT);
+    }
+
+    initializeResampler(&resampler, 2);
+    setResamplerRatio(&resampler, 1.0001);
+    double startTimeS = getHostTestTimeS();
+    for (size_t block = 0; block < blockCount; block++)
+    {
+        outputFrameCount += resampleFrames(&resampler, input, BLOCK_FRAME_COUNT, output);
+    }
+    double durationS = getHostTestTimeS() - startTimeS;
+
+    printf("Stereo resampling: %.1f Mframes/s, %.0fx the real time at 96 kHz\n",
+        outputFrameCount / durationS / 1e6,
+        outputFrameCount / durationS / 96000);
+}
+
+int main()
+{
+    testAccuracy();
+    benchmark();
+
+    return getHostTestResult();
+}
@@ -0,0 +1,108 @@
+#include "host_test.h"
+#include "config.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+// Feeds the sample clock with the DMA blocks of an ADC running off its nominal frequency, read with a jittered
+// system clock, and checks the estimated sample frequency and the sample timestamps. Also checks that a step of
+// the system clock restarts the tracking.
+//
+// The module is included with gettimeofday replaced by the simulated clock.
+
+#define NOMINAL_SAMPLE_FREQUENCY 44100
+#define ADC_ERROR_PPM 100
+#define MAX_READ_JITTER_US 300
+#define BLOCK_FRAME_COUNT CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH
+#define SIMULATED_DURATION_S 120
+#define CONVERGENCE_DURATION_S 30
+#define CLOCK_STEP_US 1000000
+
+static int getSimulatedTime(struct timeval* tv, void* timezone);
+
+#define gettimeofday getSimulatedTime
+#include "../../src/sound/sample_clock.c"
+#undef gettimeofday
+
+static int64_t startTimeUs = 1700000000000000LL;
+static int64_t clockStepUs = 0;
+static int64_t currentTimeUs;
+
+// The read is delayed by the task scheduling, so the jitter is only positive.
+static int getSimulatedTime(struct timeval* tv, void* timezone)
+{
+    int64_t timeUs = currentTimeUs + clockStepUs + rand() % MAX_READ_JITTER_US;
+    tv->tv_sec = timeUs / US_IN_S_COUNT;
+    tv->tv_usec = timeUs % US_IN_S_COUNT;
+    return 0;
+}
+
+static int64_t getCaptureTimeUs(uint64_t sampleIndex, double sampleFrequency)
+{
+    return startTimeUs + (int64_t)llround(sampleIndex * US_IN_S_COUNT / sampleFrequency);
+}
+
+static void testTracking()
+{
+    double sampleFrequency = NOMINAL_SAMPLE_FREQUENCY * (1 + ADC_ERROR_PPM * 1e-6);
+    double maxFrequencyErrorPpm = 0;
+    int64_t maxTimeErrorUs = 0;
+
+    srand(1);
+    currentTimeUs = startTimeUs;
+    initializeSampleClock(NOMINAL_SAMPLE_FREQUENCY);
+
+    uint64_t blockCount = (uint64_t)(SIMULATED_DURATION_S * sampleFrequency / BLOCK_FRAME_COUNT);
+    for (uint64_t block = 1; block <= blockCount; block++)
+    {
+        uint64_t nextSampleIndex = block * BLOCK_FRAME_COUNT;
+        currentTimeUs = getCaptureTimeUs(nextSampleIndex, sampleFrequency);
+        updateSampleClock(nextSampleIndex);
+
+        if (currentTimeUs - startTimeUs > CONVERGENCE_DURATION_S * US_IN_S_COUNT)
+        {
+            double frequencyErrorPpm = fabs(getEstimatedSampleFrequency() / sampleFrequency - 1) * 1e6;
+            int64_t timeErrorUs = llabs(convertSampleIndexToTime(nextSampleIndex) - currentTimeUs);
+            maxFrequencyErrorPpm = frequencyErrorPpm > maxFrequencyErrorPpm ? frequencyErrorPpm : maxFrequencyErrorPpm;
+            maxTimeErrorUs = timeErrorUs > maxTimeErrorUs ? timeErrorUs : maxTimeErrorUs;
+        }
+    }
+
+    printf("ADC at %+d ppm: max frequency error = %.1f ppm, max timestamp error = %lld us (after %d s)\n",
+        ADC_ERROR_PPM,
+        maxFrequencyErrorPpm,
+        (long long)maxTimeErrorUs,
+        CONVERGENCE_DURATION_S);
+
+    // The estimate is reported with its error, the uncorrected drift is ADC_ERROR_PPM.
+    HOST_TEST_CHECK(maxFrequencyErrorPpm < ADC_ERROR_PPM / 2);
+    HOST_TEST_CHECK(maxTimeErrorUs < MAX_READ_JITTER_US);
+
+    int64_t timeUs = convertSampleIndexToTime(blockCount * BLOCK_FRAME_COUNT);
+    HOST_TEST_CHECK(llabs(convertTimeToSampleIndex(timeUs) - (int64_t)(blockCount * BLOCK_FRAME_COUNT)) <= 1);
+}
+
+static void testClockStep()
+{
+    double sampleFrequency = getEstimatedSampleFrequency();
+    uint64_t nextSampleIndex = (uint64_t)(SIMULATED_DURATION_S * sampleFrequency) / BLOCK_FRAME_COUNT * BLOCK_FRAME_COUNT;
+    uint64_t anchorIntervalFrameCount = NOMINAL_SAMPLE_FREQUENCY * CONFIG_SOUND_SAMPLE_CLOCK_ANCHOR_INTERVAL_MS / 1000;
+
+    clockStepUs = CLOCK_STEP_US;
+    nextSampleIndex += anchorIntervalFrameCount;
+    currentTimeUs = getCaptureTimeUs(nextSampleIndex, sampleFrequency);
+    HOST_TEST_CHECK(!updateSampleClock(nextSampleIndex));
+    HOST_TEST_CHECK(getEstimatedSampleFrequency() == NOMINAL_SAMPLE_FREQUENCY);
+    HOST_TEST_CHECK(llabs(convertSampleIndexToTime(nextSampleIndex) - (currentTimeUs + CLOCK_STEP_US)) < MAX_READ_JITTER_US);
+}
+
+int main()
+{
+    testTracking();
+    testClockStep();
+
+    return getHostTestResult();
+}
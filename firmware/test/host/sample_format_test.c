@@ -0,0 +1,107 @@
+#include "host_test.h"
+#include "sound/sample_format.h"
+#include "config.h"
+
+#include <string.h>
+
+// Checks the packed 24-bit format against a byte-wise reference and benchmarks the packing throughput
+// of the word path (aligned output), the byte path (unaligned output) and the 32-bit copy.
+
+#define MAX_SAMPLE_COUNT 19
+#define BENCHMARK_SAMPLE_COUNT CONFIG_SOUND_MESSAGE_SAMPLE_COUNT
+#define BENCHMARK_BLOCK_COUNT 200000
+
+static int32_t createSample(size_t i)
+{
+    return (int32_t)((uint32_t)((i + 7) * 2654435761u) & 0xFFFFFF00);
+}
+
+static void packReferenceSamples24(const int32_t* samples, size_t sampleCount, uint8_t* output)
+{
+    for (size_t i = 0; i < sampleCount; i++)
+    {
+        uint32_t value = (uint32_t)samples[i];
+        output[3 * i] = (uint8_t)(value >> 24);
+        output[3 * i + 1] = (uint8_t)(value >> 16);
+        output[3 * i + 2] = (uint8_t)(value >> 8);
+    }
+}
+
+static void testPacking()
+{
+    int32_t samples[MAX_SAMPLE_COUNT];
+    uint8_t expectedOutput[MAX_SAMPLE_COUNT * SAMPLE_FORMAT_SIGNED_24_SIZE];
+    uint8_t output[MAX_SAMPLE_COUNT * SAMPLE_FORMAT_SIGNED_24_SIZE + 8] __attribute__((aligned(4)));
+
+    for (size_t i = 0; i < MAX_SAMPLE_COUNT; i++)
+    {
+        samples[i] = createSample(i);
+    }
+    samples[0] = INT32_MIN;
+    samples[1] = (int32_t)0x7FFFFF00;
+    samples[2] = -256;
+
+    for (size_t sampleCount = 0; sampleCount <= MAX_SAMPLE_COUNT; sampleCount++)
+    {
+        packReferenceSamples24(samples, sampleCount, expectedOutput);
+        for (size_t offset = 0; offset < 4; offset++)
+        {
+            memset(output, 0xAA, sizeof(output));
+            packSamples24(samples, sampleCount, output + offset);
+
+            HOST_TEST_CHECK(memcmp(output + offset, expectedOutput, sampleCount * SAMPLE_FORMAT_SIGNED_24_SIZE) == 0);
+            HOST_TEST_CHECK(output[offset + sampleCount * SAMPLE_FORMAT_SIGNED_24_SIZE] == 0xAA);
+        }
+    }
+
+    writeSamples(CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32, samples, MAX_SAMPLE_COUNT, output);
+    HOST_TEST_CHECK(memcmp(output, samples, MAX_SAMPLE_COUNT * sizeof(int32_t)) == 0);
+    writeSamples(CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24, samples, MAX_SAMPLE_COUNT, output);
+    HOST_TEST_CHECK(memcmp(output, expectedOutput, sizeof(expectedOutput)) == 0);
+}
+
+static void testFormats()
+{
+    HOST_TEST_CHECK(isSampleFormatSupported(CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24));
+    HOST_TEST_CHECK(isSampleFormatSupported(CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32));
+    HOST_TEST_CHECK(!isSampleFormatSupported(0));
+    HOST_TEST_CHECK(!isSampleFormatSupported(3));
+    HOST_TEST_CHECK(getSampleSize(CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24) == SAMPLE_FORMAT_SIGNED_24_SIZE);
+    HOST_TEST_CHECK(getSampleSize(CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32) == SAMPLE_FORMAT_SIGNED_32_SIZE);
+}
+
+static double benchmarkWriteSamples(uint32_t sampleFormat, size_t outputOffset, size_t blockCount)
+{
+    static int32_t samples[BENCHMARK_SAMPLE_COUNT];
+    static uint8_t output[BENCHMARK_SAMPLE_COUNT * sizeof(int32_t) + 4] __attribute__((aligned(4)));
+    for (size_t i = 0; i < BENCHMARK_SAMPLE_COUNT; i++)
+    {
+        samples[i] = createSample(i);
+    }
+
+    double startTimeS = getHostTestTimeS();
+    for (size_t i = 0; i < blockCount; i++)
+    {
+        samples[0] = (int32_t)(i << 8);
+        writeSamples(sampleFormat, samples, BENCHMARK_SAMPLE_COUNT, output + outputOffset);
+        __asm__ volatile("" : : "r"(output) : "memory");
+    }
+    double durationS = getHostTestTimeS() - startTimeS;
+    return (double)blockCount * BENCHMARK_SAMPLE_COUNT / durationS / 1e6;
+}
+
+int main()
+{
+    testFormats();
+    testPacking();
+
+    size_t blockCount = getHostBenchmarkIterationCount(BENCHMARK_BLOCK_COUNT);
+    printf("Packed 24 bits, aligned output: %.0f Msamples/s\n",
+        benchmarkWriteSamples(CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24, 0, blockCount));
+    printf("Packed 24 bits, unaligned output: %.0f Msamples/s\n",
+        benchmarkWriteSamples(CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_24, 1, blockCount));
+    printf("32 bits copy: %.0f Msamples/s\n",
+        benchmarkWriteSamples(CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32, 0, blockCount));
+
+    return getHostTestResult();
+}
@@ -0,0 +1,99 @@
+#include "host_test.h"
+#include "sound/sample_history.h"
+
+#include <esp_heap_caps.h>
+
+// Checks the frame indexing and wrap-around of the sample history, that a reader expecting another channel
+// count is rejected after a reset instead of copying frames of the new size, and that a history without memory
+// rejects every read.
+
+#define SAMPLE_CAPACITY 100
+#define WRITE_FRAME_COUNT 37
+
+static void writeFrames(uint64_t* frameIndex, size_t frameCount, size_t channelCount)
+{
+    int32_t frames[WRITE_FRAME_COUNT * 2];
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        for (size_t channel = 0; channel < channelCount; channel++)
+        {
+            frames[i * channelCount + channel] = (int32_t)(*frameIndex + i) * (channel == 0 ? 1 : -1);
+        }
+    }
+    writeSampleHistory(frames, frameCount);
+    *frameIndex += frameCount;
+}
+
+static void testWrapAround()
+{
+    int32_t frames[SAMPLE_CAPACITY];
+    uint64_t frameIndex = 10;
+
+    resetSampleHistory(frameIndex, 2);
+    for (size_t i = 0; i < 10; i++)
+    {
+        writeFrames(&frameIndex, WRITE_FRAME_COUNT, 2);
+    }
+
+    HOST_TEST_CHECK(getSampleHistoryEndIndex() == frameIndex);
+    HOST_TEST_CHECK(getSampleHistoryBeginIndex() == frameIndex - SAMPLE_CAPACITY / 2);
+    HOST_TEST_CHECK(readSampleHistory(frameIndex - SAMPLE_CAPACITY / 2, SAMPLE_CAPACITY / 2, 2, frames));
+    for (size_t i = 0; i < SAMPLE_CAPACITY / 2; i++)
+    {
+        int32_t expectedValue = (int32_t)(frameIndex - SAMPLE_CAPACITY / 2 + i);
+        HOST_TEST_CHECK(frames[2 * i] == expectedValue && frames[2 * i + 1] == -expectedValue);
+    }
+
+    HOST_TEST_CHECK(!readSampleHistory(frameIndex - SAMPLE_CAPACITY / 2 - 1, 2, 2, frames));
+    HOST_TEST_CHECK(!readSampleHistory(frameIndex - 1, 2, 2, frames));
+}
+
+static void testChannelCountChange()
+{
+    int32_t frames[SAMPLE_CAPACITY + 1];
+    uint64_t frameIndex = 0;
+
+    resetSampleHistory(frameIndex, 1);
+    writeFrames(&frameIndex, WRITE_FRAME_COUNT, 1);
+    HOST_TEST_CHECK(readSampleHistory(0, WRITE_FRAME_COUNT, 1, frames));
+
+    // A mono reader would overrun a buffer sized for its frames if it copied stereo frames.
+    resetSampleHistory(frameIndex, 2);
+    writeFrames(&frameIndex, WRITE_FRAME_COUNT, 2);
+    frames[WRITE_FRAME_COUNT] = 12345;
+    HOST_TEST_CHECK(!readSampleHistory(WRITE_FRAME_COUNT, WRITE_FRAME_COUNT, 1, frames));
+    HOST_TEST_CHECK(frames[WRITE_FRAME_COUNT] == 12345);
+
+    HOST_TEST_CHECK(getSampleHistoryChannelCount() == 2);
+    HOST_TEST_CHECK(getSampleHistoryBeginIndex() == WRITE_FRAME_COUNT);
+    HOST_TEST_CHECK(readSampleHistory(WRITE_FRAME_COUNT, WRITE_FRAME_COUNT, 2, frames));
+    HOST_TEST_CHECK(frames[2] == WRITE_FRAME_COUNT + 1 && frames[3] == -(WRITE_FRAME_COUNT + 1));
+}
+
+// Without memory for the history, the writes are dropped and every read is rejected.
+static void testAllocationFailure()
+{
+    int32_t frames[WRITE_FRAME_COUNT * 2];
+    uint64_t frameIndex = 0;
+
+    hostHeapCapsAvailableSize = SAMPLE_CAPACITY * sizeof(int32_t) - 1;
+    HOST_TEST_CHECK(initializeSampleHistory(4 * SAMPLE_CAPACITY, SAMPLE_CAPACITY) == ESP_ERR_NO_MEM);
+    hostHeapCapsAvailableSize = SIZE_MAX;
+
+    resetSampleHistory(0, 1);
+    writeFrames(&frameIndex, WRITE_FRAME_COUNT, 1);
+    HOST_TEST_CHECK(!readSampleHistory(0, WRITE_FRAME_COUNT, 1, frames));
+    HOST_TEST_CHECK(!readSampleHistory(0, 0, 1, frames));
+}
+
+int main()
+{
+    testAllocationFailure();
+
+    // The host has no PSRAM, so the history takes the internal capacity.
+    HOST_TEST_CHECK(initializeSampleHistory(4 * SAMPLE_CAPACITY, SAMPLE_CAPACITY) == ESP_OK);
+    testWrapAround();
+    testChannelCountChange();
+
+    return getHostTestResult();
+}
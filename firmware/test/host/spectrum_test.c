@@ -0,0 +1,199 @@
+#include "host_test.h"
+#include "sound/spectrum.h"
+
+#include <arpa/inet.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compares the FFT with a direct DFT, checks the levels of the spectrum messages with a full-scale sine, and
+// benchmarks the real FFT of the largest size.
+
+#define SAMPLE_FREQUENCY 48000
+#define BLOCK_FRAME_COUNT CONFIG_SOUND_I2S_DMA_BUFFER_LENGTH
+#define CHANNEL_COUNT 2
+#define SINE_BIN 64
+#define SINE_BAND 22 // 1/3-octave band centered on 3162 Hz
+#define FAR_BAND 17 // 1 kHz
+#define MESSAGE_HEADER_SIZE 28
+#define MESSAGE_WINDOW_COUNT_OFFSET 22
+#define MESSAGE_BIN_COUNT_OFFSET 24
+#define MESSAGE_BAND_COUNT_OFFSET 26
+#define LEVEL_TOLERANCE 10 // 0.1 dB
+#define BENCHMARK_FFT_COUNT 20000
+
+static double getMaxError(const double* expected, const float* actual, size_t count, double scale)
+{
+    double maxError = 0.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        maxError = fmax(maxError, fabs(expected[i] - actual[i]) / scale);
+    }
+    return maxError;
+}
+
+static void computeDft(const float* data, size_t size, double* output)
+{
+    for (size_t k = 0; k < size; k++)
+    {
+        double real = 0.0;
+        double imaginary = 0.0;
+        for (size_t n = 0; n < size; n++)
+        {
+            double phase = -2.0 * M_PI * (double)(k * n % size) / size;
+            real += data[2 * n] * cos(phase) - data[2 * n + 1] * sin(phase);
+            imaginary += data[2 * n] * sin(phase) + data[2 * n + 1] * cos(phase);
+        }
+        output[2 * k] = real;
+        output[2 * k + 1] = imaginary;
+    }
+}
+
+static void testFft()
+{
+    static float data[2 * FFT_MAX_SIZE];
+    static float samples[FFT_MAX_SIZE];
+    static float power[FFT_MAX_SIZE / 2 + 1];
+    static double expected[2 * FFT_MAX_SIZE];
+    static double expectedPower[FFT_MAX_SIZE / 2 + 1];
+
+    for (size_t size = 4; size <= FFT_MAX_SIZE / 2; size *= 2)
+    {
+        for (size_t i = 0; i < 2 * size; i++)
+        {
+            data[i] = (float)rand() / RAND_MAX - 0.5f;
+        }
+        computeDft(data, size, expected);
+        computeComplexFft(data, size, 0);
+        HOST_TEST_CHECK(getMaxError(expected, data, 2 * size, sqrt((double)size)) < 1e-5);
+    }
+
+    for (size_t size = 4; size <= FFT_MAX_SIZE; size *= 2)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            samples[i] = (float)rand() / RAND_MAX - 0.5f;
+            data[2 * i] = samples[i];
+            data[2 * i + 1] = 0.0f;
+        }
+        computeDft(data, size, expected);
+        for (size_t k = 0; k <= size / 2; k++)
+        {
+            expectedPower[k] = expected[2 * k] * expected[2 * k] + expected[2 * k + 1] * expected[2 * k + 1];
+        }
+        computeRealFftPower(samples, size, power);
+        HOST_TEST_CHECK(getMaxError(expectedPower, power, size / 2 + 1, size) < 1e-5);
+    }
+}
+
+static void testConfigurations()
+{
+    SpectrumConfiguration configuration = { 1024, 512, 100, SPECTRUM_CONTENT_BINS, 0 };
+    HOST_TEST_CHECK(isSpectrumConfigurationSupported(&configuration));
+
+    SpectrumConfiguration disabledConfiguration = { 0, 0, 0, 0, 0 };
+    HOST_TEST_CHECK(isSpectrumConfigurationSupported(&disabledConfiguration));
+
+    SpectrumConfiguration invalidConfiguration = configuration;
+    invalidConfiguration.fftSize = 32;
+    HOST_TEST_CHECK(!isSpectrumConfigurationSupported(&invalidConfiguration));
+    invalidConfiguration = configuration;
+    invalidConfiguration.hopSize = 128;
+    HOST_TEST_CHECK(!isSpectrumConfigurationSupported(&invalidConfiguration));
+    invalidConfiguration = configuration;
+    invalidConfiguration.intervalMs = CONFIG_SOUND_SPECTRUM_MIN_INTERVAL_MS - 1;
+    HOST_TEST_CHECK(!isSpectrumConfigurationSupported(&invalidConfiguration));
+    invalidConfiguration = configuration;
+    invalidConfiguration.content = 4;
+    HOST_TEST_CHECK(!isSpectrumConfigurationSupported(&invalidConfiguration));
+    invalidConfiguration = configuration;
+    invalidConfiguration.channel = CONFIG_SOUND_MAX_CHANNEL_COUNT;
+    HOST_TEST_CHECK(!isSpectrumConfigurationSupported(&invalidConfiguration));
+}
+
+static int16_t readLevel(const uint8_t* message, size_t index)
+{
+    return (int16_t)ntohs(*(uint16_t*)(message + MESSAGE_HEADER_SIZE + index * sizeof(int16_t)));
+}
+
+// A full-scale sine centered on a bin is analyzed on the second channel, the first one is silent.
+static void testSineLevels()
+{
+    static uint8_t message[CONFIG_STREAMING_PACKET_MAX_SIZE] __attribute__((aligned(4)));
+    int32_t frames[BLOCK_FRAME_COUNT * CHANNEL_COUNT];
+    SpectrumConfiguration configuration = { 1024, 512, 100, SPECTRUM_CONTENT_BINS | SPECTRUM_CONTENT_BANDS, 1 };
+    double frequency = (double)SAMPLE_FREQUENCY * SINE_BIN / configuration.fftSize;
+
+    resetSpectrum(&configuration, SAMPLE_FREQUENCY, 0);
+    size_t messageSize = 0;
+    for (size_t frameIndex = 0; messageSize == 0; frameIndex += BLOCK_FRAME_COUNT)
+    {
+        for (size_t i = 0; i < BLOCK_FRAME_COUNT; i++)
+        {
+            frames[CHANNEL_COUNT * i] = 0;
+            frames[CHANNEL_COUNT * i + 1] = (int32_t)lrint(INT32_MAX * sin(2 * M_PI * frequency * (frameIndex + i) / SAMPLE_FREQUENCY));
+        }
+        if (addSpectrumFrames(frames, BLOCK_FRAME_COUNT, CHANNEL_COUNT))
+        {
+            messageSize = writeSpectrumMessage(message);
+        }
+    }
+
+    size_t binCount = ntohs(*(uint16_t*)(message + MESSAGE_BIN_COUNT_OFFSET));
+    size_t bandCount = ntohs(*(uint16_t*)(message + MESSAGE_BAND_COUNT_OFFSET));
+    HOST_TEST_CHECK(ntohl(*(uint32_t*)message) == SPECTRUM_MESSAGE_ID);
+    HOST_TEST_CHECK(binCount == configuration.fftSize / 2 + 1u);
+    HOST_TEST_CHECK(bandCount == SPECTRUM_MAX_BAND_COUNT);
+    HOST_TEST_CHECK(messageSize == MESSAGE_HEADER_SIZE + (binCount + bandCount) * sizeof(int16_t));
+    HOST_TEST_CHECK(ntohs(*(uint16_t*)(message + MESSAGE_WINDOW_COUNT_OFFSET)) >= 8);
+
+    // The Hann window spreads the sine over three bins, their sum is the sine power.
+    double sinePower = 0.0;
+    for (size_t k = SINE_BIN - 1; k <= SINE_BIN + 1; k++)
+    {
+        sinePower += pow(10.0, readLevel(message, k) / 1000.0);
+    }
+    double sineLevel = 1000.0 * log10(sinePower);
+    double bandLevel = readLevel(message, binCount + SINE_BAND);
+    double farBandLevel = readLevel(message, binCount + FAR_BAND);
+    HOST_TEST_CHECK(fabs(sineLevel) < LEVEL_TOLERANCE);
+    HOST_TEST_CHECK(fabs(bandLevel) < LEVEL_TOLERANCE);
+    HOST_TEST_CHECK(farBandLevel < -8000);
+    printf("Full-scale sine: bins = %.2f dB, band = %.2f dB, 1 kHz band = %.2f dB\n",
+        sineLevel / 100.0,
+        bandLevel / 100.0,
+        farBandLevel / 100.0);
+}
+
+static void benchmarkRealFft()
+{
+    static float samples[FFT_MAX_SIZE];
+    static float power[FFT_MAX_SIZE / 2 + 1];
+    size_t fftCount = getHostBenchmarkIterationCount(BENCHMARK_FFT_COUNT);
+
+    double startTimeS = getHostTestTimeS();
+    for (size_t i = 0; i < fftCount; i++)
+    {
+        for (size_t j = 0; j < FFT_MAX_SIZE; j++)
+        {
+            samples[j] = (float)((i + j) % 64) - 32.0f;
+        }
+        computeRealFftPower(samples, FFT_MAX_SIZE, power);
+        __asm__ volatile("" : : "r"(power) : "memory");
+    }
+    double durationS = getHostTestTimeS() - startTimeS;
+    printf("Real FFT power of %d samples: %.1f us\n", FFT_MAX_SIZE, durationS / fftCount * 1e6);
+}
+
+int main()
+{
+    initializeSpectrum();
+
+    testFft();
+    testConfigurations();
+    testSineLevels();
+    benchmarkRealFft();
+
+    return getHostTestResult();
+}
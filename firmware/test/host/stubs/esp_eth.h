@@ -0,0 +1,6 @@
+#ifndef HOST_STUBS_ESP_ETH_H
+#define HOST_STUBS_ESP_ETH_H
+
+// Only included by config.h, the Ethernet configuration is not used on the host.
+
+#endif
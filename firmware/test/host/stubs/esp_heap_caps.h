@@ -0,0 +1,35 @@
+#ifndef HOST_STUBS_ESP_HEAP_CAPS_H
+#define HOST_STUBS_ESP_HEAP_CAPS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+// The host has no PSRAM, every allocation succeeds unless the test limits the heap.
+extern size_t hostHeapCapsAvailableSize;
+
+static inline void* heap_caps_malloc(size_t size, uint32_t caps)
+{
+    if ((caps & MALLOC_CAP_SPIRAM) != 0 || size > hostHeapCapsAvailableSize)
+    {
+        return NULL;
+    }
+    return malloc(size);
+}
+
+static inline size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) != 0 ? 0 : hostHeapCapsAvailableSize;
+}
+
+static inline void heap_caps_free(void* pointer)
+{
+    free(pointer);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef HOST_STUBS_ESP_LOG_H
+#define HOST_STUBS_ESP_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+typedef enum
+{
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+// Only the errors and the warnings are printed, the format is checked for every level.
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ((void)(tag), (void)snprintf(NULL, 0, format, ##__VA_ARGS__))
+#define ESP_LOGD(tag, format, ...) ((void)(tag), (void)snprintf(NULL, 0, format, ##__VA_ARGS__))
+
+#define esp_log_level_set(tag, level) ((void)(tag), (void)(level))
+
+// Milliseconds since an arbitrary start, like the time since boot.
+static inline uint32_t esp_log_timestamp()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint32_t)(time.tv_sec * 1000 + time.tv_nsec / 1000000);
+}
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_STUBS_ETH_PHY_PHY_LAN8720_H
+#define HOST_STUBS_ETH_PHY_PHY_LAN8720_H
+
+// Only included by config.h, the PHY configuration is not used on the host.
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef HOST_STUBS_FREERTOS_FREERTOS_H
+#define HOST_STUBS_FREERTOS_FREERTOS_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define portMAX_DELAY UINT32_MAX
+#define portTICK_PERIOD_MS 1
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+// The critical sections are mutexes on the host.
+typedef pthread_mutex_t portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
+
+#endif
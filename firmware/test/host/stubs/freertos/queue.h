@@ -0,0 +1,73 @@
+#ifndef HOST_STUBS_FREERTOS_QUEUE_H
+#define HOST_STUBS_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Only the sends and receptions without timeout are supported.
+typedef struct
+{
+    pthread_mutex_t mutex;
+    size_t itemSize;
+    size_t capacity;
+    size_t count;
+    size_t head;
+    uint8_t* items;
+} HostQueue;
+
+typedef HostQueue* QueueHandle_t;
+
+static inline QueueHandle_t xQueueCreate(size_t capacity, size_t itemSize)
+{
+    QueueHandle_t queue = malloc(sizeof(HostQueue));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->items = malloc(capacity * itemSize);
+    if (queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->mutex, NULL);
+    queue->itemSize = itemSize;
+    queue->capacity = capacity;
+    queue->count = 0;
+    queue->head = 0;
+    return queue;
+}
+
+static inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t timeout)
+{
+    BaseType_t result = pdFALSE;
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count < queue->capacity)
+    {
+        size_t index = (queue->head + queue->count) % queue->capacity;
+        memcpy(queue->items + index * queue->itemSize, item, queue->itemSize);
+        queue->count++;
+        result = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return result;
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t timeout)
+{
+    BaseType_t result = pdFALSE;
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count > 0)
+    {
+        memcpy(item, queue->items + queue->head * queue->itemSize, queue->itemSize);
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        result = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return result;
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef HOST_STUBS_FREERTOS_RINGBUF_H
+#define HOST_STUBS_FREERTOS_RINGBUF_H
+
+#include "freertos/FreeRTOS.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// FIFO of copied items, with the size accounting of a no-split ring buffer. The sends never block.
+#define RINGBUF_TYPE_NOSPLIT 0
+#define HOST_RINGBUF_ITEM_HEADER_SIZE 8
+
+typedef struct HostRingbufItem
+{
+    struct HostRingbufItem* next;
+    size_t size;
+    uint8_t data[];
+} HostRingbufItem;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    size_t size;
+    size_t usedSize;
+    HostRingbufItem* first;
+    HostRingbufItem* last;
+} HostRingbuf;
+
+typedef HostRingbuf* RingbufHandle_t;
+
+static inline size_t getHostRingbufItemSize(size_t size)
+{
+    return HOST_RINGBUF_ITEM_HEADER_SIZE + (size + 3) / 4 * 4;
+}
+
+static inline RingbufHandle_t xRingbufferCreate(size_t size, int type)
+{
+    RingbufHandle_t ringbuf = calloc(1, sizeof(HostRingbuf));
+    if (ringbuf != NULL)
+    {
+        pthread_mutex_init(&ringbuf->mutex, NULL);
+        pthread_cond_init(&ringbuf->condition, NULL);
+        ringbuf->size = size;
+    }
+    return ringbuf;
+}
+
+static inline BaseType_t xRingbufferSend(RingbufHandle_t ringbuf, const void* data, size_t size, TickType_t timeout)
+{
+    BaseType_t result = pdFALSE;
+    pthread_mutex_lock(&ringbuf->mutex);
+    if (ringbuf->usedSize + getHostRingbufItemSize(size) <= ringbuf->size)
+    {
+        HostRingbufItem* item = malloc(sizeof(HostRingbufItem) + size);
+        memcpy(item->data, data, size);
+        item->size = size;
+        item->next = NULL;
+        if (ringbuf->last == NULL)
+        {
+            ringbuf->first = item;
+        }
+        else
+        {
+            ringbuf->last->next = item;
+        }
+        ringbuf->last = item;
+        ringbuf->usedSize += getHostRingbufItemSize(size);
+        pthread_cond_signal(&ringbuf->condition);
+        result = pdTRUE;
+    }
+    pthread_mutex_unlock(&ringbuf->mutex);
+    return result;
+}
+
+// The item keeps its space until it is returned.
+static inline void* xRingbufferReceive(RingbufHandle_t ringbuf, size_t* size, TickType_t timeout)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout * portTICK_PERIOD_MS / 1000;
+    deadline.tv_nsec += (long)(timeout * portTICK_PERIOD_MS % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&ringbuf->mutex);
+    int result = 0;
+    while (ringbuf->first == NULL && result != ETIMEDOUT)
+    {
+        result = pthread_cond_timedwait(&ringbuf->condition, &ringbuf->mutex, &deadline);
+    }
+
+    HostRingbufItem* item = ringbuf->first;
+    if (item != NULL)
+    {
+        ringbuf->first = item->next;
+        if (ringbuf->first == NULL)
+        {
+            ringbuf->last = NULL;
+        }
+        *size = item->size;
+    }
+    pthread_mutex_unlock(&ringbuf->mutex);
+    return item != NULL ? item->data : NULL;
+}
+
+static inline void vRingbufferReturnItem(RingbufHandle_t ringbuf, void* data)
+{
+    HostRingbufItem* item = (HostRingbufItem*)((uint8_t*)data - offsetof(HostRingbufItem, data));
+    pthread_mutex_lock(&ringbuf->mutex);
+    ringbuf->usedSize -= getHostRingbufItemSize(item->size);
+    pthread_mutex_unlock(&ringbuf->mutex);
+    free(item);
+}
+
+static inline size_t xRingbufferGetCurFreeSize(RingbufHandle_t ringbuf)
+{
+    pthread_mutex_lock(&ringbuf->mutex);
+    size_t freeSize = ringbuf->size - ringbuf->usedSize;
+    pthread_mutex_unlock(&ringbuf->mutex);
+    return freeSize;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HOST_STUBS_FREERTOS_SEMPHR_H
+#define HOST_STUBS_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+
+#include <stdlib.h>
+
+// Only the mutexes taken without timeout are supported.
+typedef pthread_mutex_t* SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    SemaphoreHandle_t mutex = malloc(sizeof(pthread_mutex_t));
+    if (mutex != NULL)
+    {
+        pthread_mutex_init(mutex, NULL);
+    }
+    return mutex;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t timeout)
+{
+    return pthread_mutex_lock(mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    return pthread_mutex_unlock(mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+#endif
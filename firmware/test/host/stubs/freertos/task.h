@@ -0,0 +1,58 @@
+#ifndef HOST_STUBS_FREERTOS_TASK_H
+#define HOST_STUBS_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+// The tasks are detached threads, the stack size and the priority are ignored.
+typedef void (*TaskFunction_t)(void* parameters);
+typedef pthread_t TaskHandle_t;
+
+typedef struct
+{
+    TaskFunction_t task;
+    void* parameters;
+} HostTask;
+
+static inline void* runHostTask(void* hostTask)
+{
+    HostTask task = *(HostTask*)hostTask;
+    free(hostTask);
+    task.task(task.parameters);
+    return NULL;
+}
+
+static inline BaseType_t xTaskCreate(TaskFunction_t task,
+    const char* name,
+    uint32_t stackSize,
+    void* parameters,
+    unsigned int priority,
+    TaskHandle_t* handle)
+{
+    pthread_t thread;
+    HostTask* hostTask = malloc(sizeof(HostTask));
+    hostTask->task = task;
+    hostTask->parameters = parameters;
+    if (pthread_create(&thread, NULL, runHostTask, hostTask) != 0)
+    {
+        free(hostTask);
+        return pdFALSE;
+    }
+    pthread_detach(thread);
+    if (handle != NULL)
+    {
+        *handle = thread;
+    }
+    return pdPASS;
+}
+
+static inline void vTaskDelay(TickType_t tickCount)
+{
+    usleep(tickCount * portTICK_PERIOD_MS * 1000);
+}
+
+#define vTaskDelete(task) pthread_exit(NULL)
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_STUBS_LWIP_APPS_SNTP_H
+#define HOST_STUBS_LWIP_APPS_SNTP_H
+
+// Only included by config.h, the SNTP client is not used on the host.
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef HOST_STUBS_LWIP_ERR_H
+#define HOST_STUBS_LWIP_ERR_H
+
+#include <errno.h>
+
+#endif
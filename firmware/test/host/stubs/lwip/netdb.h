@@ -0,0 +1,6 @@
+#ifndef HOST_STUBS_LWIP_NETDB_H
+#define HOST_STUBS_LWIP_NETDB_H
+
+#include <netdb.h>
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef HOST_STUBS_LWIP_SOCKETS_H
+#define HOST_STUBS_LWIP_SOCKETS_H
+
+// The lwIP socket API follows the POSIX one.
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#endif
@@ -0,0 +1,4 @@
+#ifndef HOST_STUBS_LWIP_SYS_H
+#define HOST_STUBS_LWIP_SYS_H
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef HOST_STUBS_TCPIP_ADAPTER_H
+#define HOST_STUBS_TCPIP_ADAPTER_H
+
+#include "esp_err.h"
+
+#include <arpa/inet.h>
+#include <stdint.h>
+
+typedef enum
+{
+    TCPIP_ADAPTER_IF_STA,
+    TCPIP_ADAPTER_IF_AP,
+    TCPIP_ADAPTER_IF_ETH
+} tcpip_adapter_if_t;
+
+typedef struct
+{
+    uint32_t addr;
+} ip4_addr_t;
+
+typedef struct
+{
+    ip4_addr_t ip;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+
+// Every interface is the loopback one on the host.
+static inline esp_err_t tcpip_adapter_get_ip_info(tcpip_adapter_if_t interface, tcpip_adapter_ip_info_t* ipInfo)
+{
+    ipInfo->ip.addr = htonl(INADDR_LOOPBACK);
+    ipInfo->netmask.addr = htonl(0xFF000000);
+    ipInfo->gw.addr = htonl(INADDR_LOOPBACK);
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,296 @@
+#include "host_test.h"
+#include "config.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <lwip/sockets.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+// Loopback stand-in of the time synchronization: the slave code exchanges with the master code of the same
+// module over UDP, every packet is delayed by a random amount, and the slave clock is simulated with an initial
+// offset, a drift and the slewing of adjtime. Also checks that a stream of unrelated packets cannot extend an
+// exchange past its timeout.
+//
+// The module is included with its clock and send functions replaced, so the host clock is never changed.
+
+#define SIMULATED_EPOCH_US 1700000000000000LL
+#define INITIAL_OFFSET_US 250000
+#define DRIFT_PPM 50
+#define SLEW_RATE 0.01 // The simulated adjtime corrects 1 ms per 100 ms
+#define MIN_DELAY_US 100
+#define MAX_JITTER_US 300
+#define SYNCHRONIZATION_COUNT 40
+#define WARM_UP_SYNCHRONIZATION_COUNT 10
+#define SYNCHRONIZATION_INTERVAL_US 10000
+#define FLOOD_INTERVAL_US 1000
+#define TIMEOUT_MARGIN_US 20000
+
+static int getSimulatedTime(struct timeval* tv, void* timezone);
+static int setSimulatedTime(const struct timeval* tv, const void* timezone);
+static int adjustSimulatedTime(const struct timeval* delta, struct timeval* oldDelta);
+static ssize_t sendDelayed(int socketHandle,
+    const void* data,
+    size_t size,
+    int flags,
+    const struct sockaddr* address,
+    socklen_t addressSize);
+
+#undef CONFIG_PROBE_IS_MASTER
+#define CONFIG_PROBE_IS_MASTER 0
+#undef CONFIG_TIME_SYNC_MASTER_ADDRESS
+#define CONFIG_TIME_SYNC_MASTER_ADDRESS "127.0.0.1"
+
+#define gettimeofday getSimulatedTime
+#define settimeofday setSimulatedTime
+#define adjtime adjustSimulatedTime
+#define sendto sendDelayed
+#include "../../src/network/time_sync.c"
+#undef gettimeofday
+#undef settimeofday
+#undef adjtime
+#undef sendto
+
+static pthread_mutex_t clockMutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread int isMasterThread = 0;
+static __thread unsigned int delaySeed = 1;
+static double slaveOffsetUs = INITIAL_OFFSET_US;
+static double remainingSlewUs = 0;
+static int64_t lastUpdateUs = 0;
+
+static atomic_int isMasterRunning;
+static atomic_int isFlooding;
+
+static int64_t getMasterTimeUs()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return SIMULATED_EPOCH_US + (int64_t)time.tv_sec * US_IN_S_COUNT + time.tv_nsec / 1000;
+}
+
+static void updateSlaveClock(int64_t masterTimeUs)
+{
+    double elapsedUs = lastUpdateUs == 0 ? 0 : (double)(masterTimeUs - lastUpdateUs);
+    double slewUs = elapsedUs * SLEW_RATE;
+    lastUpdateUs = masterTimeUs;
+
+    if (fabs(remainingSlewUs) <= slewUs)
+    {
+        slaveOffsetUs += remainingSlewUs;
+        remainingSlewUs = 0;
+    }
+    else
+    {
+        slewUs = copysign(slewUs, remainingSlewUs);
+        slaveOffsetUs += slewUs;
+        remainingSlewUs -= slewUs;
+    }
+    slaveOffsetUs += elapsedUs * DRIFT_PPM * 1e-6;
+}
+
+static void writeTimeval(struct timeval* tv, int64_t timeUs)
+{
+    tv->tv_sec = timeUs / US_IN_S_COUNT;
+    tv->tv_usec = timeUs % US_IN_S_COUNT;
+}
+
+static int64_t readTimeval(const struct timeval* tv)
+{
+    return (int64_t)tv->tv_sec * US_IN_S_COUNT + tv->tv_usec;
+}
+
+static int getSimulatedTime(struct timeval* tv, void* timezone)
+{
+    pthread_mutex_lock(&clockMutex);
+    int64_t timeUs = getMasterTimeUs();
+    if (!isMasterThread)
+    {
+        updateSlaveClock(timeUs);
+        timeUs += llround(slaveOffsetUs);
+    }
+    pthread_mutex_unlock(&clockMutex);
+
+    writeTimeval(tv, timeUs);
+    return 0;
+}
+
+// A step cancels the slewing in progress.
+static int setSimulatedTime(const struct timeval* tv, const void* timezone)
+{
+    pthread_mutex_lock(&clockMutex);
+    int64_t masterTimeUs = getMasterTimeUs();
+    updateSlaveClock(masterTimeUs);
+    slaveOffsetUs = (double)(readTimeval(tv) - masterTimeUs);
+    remainingSlewUs = 0;
+    pthread_mutex_unlock(&clockMutex);
+    return 0;
+}
+
+static int adjustSimulatedTime(const struct timeval* delta, struct timeval* oldDelta)
+{
+    pthread_mutex_lock(&clockMutex);
+    updateSlaveClock(getMasterTimeUs());
+    remainingSlewUs = (double)readTimeval(delta);
+    pthread_mutex_unlock(&clockMutex);
+    return 0;
+}
+
+static double getSlaveOffsetUs()
+{
+    pthread_mutex_lock(&clockMutex);
+    updateSlaveClock(getMasterTimeUs());
+    double offsetUs = slaveOffsetUs;
+    pthread_mutex_unlock(&clockMutex);
+    return offsetUs;
+}
+
+// The delay is applied after the send time is read, like the network path delay.
+static ssize_t sendDelayed(int socketHandle,
+    const void* data,
+    size_t size,
+    int flags,
+    const struct sockaddr* address,
+    socklen_t addressSize)
+{
+    usleep(MIN_DELAY_US + rand_r(&delaySeed) % MAX_JITTER_US);
+    return sendto(socketHandle, data, size, flags, address, addressSize);
+}
+
+static int compareDoubles(const void* a, const void* b)
+{
+    double difference = *(const double*)a - *(const double*)b;
+    return (difference > 0) - (difference < 0);
+}
+
+static struct sockaddr_in createLoopbackAddress(uint16_t port)
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return address;
+}
+
+static void* runMaster(void* parameters)
+{
+    int socketHandle = *(int*)parameters;
+    isMasterThread = 1;
+    delaySeed = 2;
+    while (atomic_load(&isMasterRunning) && handleTimeSyncRequest(socketHandle));
+    return NULL;
+}
+
+// Sends responses of another exchange, which the slave must skip.
+static void* flood(void* parameters)
+{
+    struct sockaddr_in slaveAddress = *(struct sockaddr_in*)parameters;
+    int socketHandle = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    uint8_t response[TIME_SYNC_RESPONSE_SIZE] __attribute__((aligned(4)));
+    memset(response, 0, sizeof(response));
+    *(uint32_t*)response = htonl(TIME_SYNC_RESPONSE_ID);
+
+    while (atomic_load(&isFlooding))
+    {
+        sendto(socketHandle, response, sizeof(response), 0, (struct sockaddr*)&slaveAddress, sizeof(slaveAddress));
+        usleep(FLOOD_INTERVAL_US);
+    }
+    close(socketHandle);
+    return NULL;
+}
+
+static void testSynchronization(int slaveSocketHandle)
+{
+    static double absOffsetsUs[SYNCHRONIZATION_COUNT];
+    double delaySumUs = 0;
+    size_t measuredCount = 0;
+
+    for (size_t i = 0; i < SYNCHRONIZATION_COUNT; i++)
+    {
+        synchronizeClock(slaveSocketHandle);
+        usleep(SYNCHRONIZATION_INTERVAL_US);
+        if (i >= WARM_UP_SYNCHRONIZATION_COUNT)
+        {
+            absOffsetsUs[measuredCount++] = fabs(getSlaveOffsetUs());
+            delaySumUs += lastDelayUs;
+        }
+    }
+
+    qsort(absOffsetsUs, measuredCount, sizeof(double), compareDoubles);
+    printf("Synchronized offset: median = %.0f us, max = %.0f us, mean delay = %.0f us, "
+        "exchanges = %u, timeouts = %u, steps = %u\n",
+        absOffsetsUs[measuredCount / 2],
+        absOffsetsUs[measuredCount - 1],
+        delaySumUs / measuredCount,
+        exchangeCount,
+        timeoutCount,
+        stepCount);
+
+    HOST_TEST_CHECK(stepCount == 1);
+    HOST_TEST_CHECK(exchangeCount > 0);
+    HOST_TEST_CHECK(absOffsetsUs[measuredCount / 2] < 100);
+}
+
+static void testExchangeDeadline(int slaveSocketHandle)
+{
+    struct sockaddr_in slaveAddress;
+    socklen_t addressSize = sizeof(slaveAddress);
+    getsockname(slaveSocketHandle, (struct sockaddr*)&slaveAddress, &addressSize);
+    slaveAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    pthread_t floodThread;
+    atomic_store(&isFlooding, 1);
+    pthread_create(&floodThread, NULL, flood, &slaveAddress);
+
+    // The master is stopped, so only the flood is received.
+    int64_t offsetUs;
+    int64_t delayUs;
+    struct timespec startTime;
+    struct timespec endTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    HOST_TEST_CHECK(!exchangeTimeSyncMessages(slaveSocketHandle, UINT32_MAX, &offsetUs, &delayUs));
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+
+    atomic_store(&isFlooding, 0);
+    pthread_join(floodThread, NULL);
+
+    double durationUs = (endTime.tv_sec - startTime.tv_sec) * 1e6 + (endTime.tv_nsec - startTime.tv_nsec) / 1e3;
+    printf("Exchange during a flood: %.0f us (timeout = %d ms)\n", durationUs, CONFIG_TIME_SYNC_TIMEOUT_MS);
+    HOST_TEST_CHECK(durationUs < CONFIG_TIME_SYNC_TIMEOUT_MS * 1000 + TIMEOUT_MARGIN_US);
+}
+
+int main()
+{
+    initializeTimeSync();
+
+    int masterSocketHandle = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    struct sockaddr_in masterBindAddress = createLoopbackAddress(CONFIG_TIME_SYNC_PORT);
+    HOST_TEST_CHECK(bind(masterSocketHandle, (struct sockaddr*)&masterBindAddress, sizeof(masterBindAddress)) == 0);
+
+    pthread_t masterThread;
+    atomic_init(&isMasterRunning, 1);
+    atomic_init(&isFlooding, 0);
+    pthread_create(&masterThread, NULL, runMaster, &masterSocketHandle);
+
+    int slaveSocketHandle = createSocket();
+    HOST_TEST_CHECK(slaveSocketHandle >= 0);
+    testSynchronization(slaveSocketHandle);
+
+    // An ignored packet wakes the master up, so it sees the stop.
+    atomic_store(&isMasterRunning, 0);
+    uint8_t wakeUp = 0;
+    sendto(slaveSocketHandle, &wakeUp, sizeof(wakeUp), 0, (struct sockaddr*)&masterBindAddress, sizeof(masterBindAddress));
+    pthread_join(masterThread, NULL);
+
+    testExchangeDeadline(slaveSocketHandle);
+
+    freeSocket(slaveSocketHandle);
+    close(masterSocketHandle);
+    return getHostTestResult();
+}
@@ -0,0 +1,236 @@
+#include "host_test.h"
+#include "network/communication.h"
+#include "network/session.h"
+#include "network/streaming.h"
+#include "network/upload.h"
+#include "config.h"
+
+#include <lwip/sockets.h>
+
+#include <signal.h>
+#include <string.h>
+
+// Runs the communication event loop with the upload task against the POSIX sockets of the loopback interface, and
+// checks the replies queued as small upload messages and the routing of the bulk record and impulse response data
+// to the sessions.
+
+#define INITIALIZATION_REQUEST_SIZE 16
+#define INITIALIZATION_RESPONSE_SIZE 14
+#define INITIALIZATION_RESPONSE_IS_COMPATIBLE_OFFSET 8
+#define RECORD_REQUEST_SIZE 16
+#define RECORD_RESPONSE_HEADER_SIZE 9
+#define RECORD_STATUS_SIZE 10
+#define RECORD_STATUS_REJECTED 2
+#define IMPULSE_RESPONSE_REQUEST_SIZE 24
+#define IMPULSE_RESPONSE_REJECTED_SIZE 20
+#define IMPULSE_RESPONSE_STATUS_REJECTED 3
+#define MEASUREMENT_ID 4
+#define CONNECTION_TIMEOUT_MS 2000
+#define POLL_INTERVAL_US 100
+
+static int handleInitialization(const SoundConfiguration* configuration)
+{
+    return 1;
+}
+
+// The even record ids are accepted.
+static int handleRecord(uint8_t recordHour,
+    uint8_t recordMinute,
+    uint8_t recordSecond,
+    uint16_t recordMs,
+    uint16_t durationMs,
+    uint8_t recordId)
+{
+    return recordId % 2 == 0;
+}
+
+static int handleSpectrum(const SpectrumConfiguration* configuration)
+{
+    return 1;
+}
+
+static int handleLevelMeter(const LevelMeterConfiguration* configuration)
+{
+    return 1;
+}
+
+static int handleImpulseResponse(const ImpulseResponseRequest* request)
+{
+    return 0;
+}
+
+int requestStreamingRetransmission(uint32_t sessionId, uint16_t sequenceId)
+{
+    return 1;
+}
+
+static int receiveAll(int socketHandle, uint8_t* buffer, size_t size)
+{
+    size_t receivedSize = 0;
+    while (receivedSize < size)
+    {
+        ssize_t result = recv(socketHandle, buffer + receivedSize, size - receivedSize, 0);
+        if (result <= 0)
+        {
+            return 0;
+        }
+        receivedSize += result;
+    }
+    return 1;
+}
+
+static int waitForSessionCount(size_t sessionCount)
+{
+    double startTimeS = getHostTestTimeS();
+    while (getSessionCount() != sessionCount)
+    {
+        if (getHostTestTimeS() - startTimeS > CONNECTION_TIMEOUT_MS / 1000.0)
+        {
+            return 0;
+        }
+        usleep(POLL_INTERVAL_US);
+    }
+    return 1;
+}
+
+// Returns the socket of a new session, or -1. The receptions time out, so a missing reply fails the test.
+static int connectClient()
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(CONFIG_COMMUNICATION_TCP_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int socketHandle = -1;
+    double startTimeS = getHostTestTimeS();
+    while (socketHandle < 0 && getHostTestTimeS() - startTimeS < CONNECTION_TIMEOUT_MS / 1000.0)
+    {
+        socketHandle = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(socketHandle, (struct sockaddr*)&address, sizeof(address)) < 0)
+        {
+            close(socketHandle);
+            socketHandle = -1;
+            usleep(10 * POLL_INTERVAL_US);
+        }
+    }
+    if (socketHandle < 0)
+    {
+        return -1;
+    }
+
+    struct timeval timeout = { CONNECTION_TIMEOUT_MS / 1000, 0 };
+    setsockopt(socketHandle, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t request[INITIALIZATION_REQUEST_SIZE] =
+    {
+        0, 0, 0, 2,
+        0, 0, 0, INITIALIZATION_REQUEST_SIZE - 8,
+        0, 0, 0xAC, 0x44,
+        0, 0, 0, CONFIG_SOUND_SAMPLE_FORMAT_SIGNED_32
+    };
+    uint8_t response[INITIALIZATION_RESPONSE_SIZE];
+    if (send(socketHandle, request, sizeof(request), 0) != sizeof(request) ||
+        !receiveAll(socketHandle, response, sizeof(response)) ||
+        !response[INITIALIZATION_RESPONSE_IS_COMPATIBLE_OFFSET])
+    {
+        close(socketHandle);
+        return -1;
+    }
+    return socketHandle;
+}
+
+static void sendRecordRequest(int socketHandle, uint8_t recordId)
+{
+    uint8_t request[RECORD_REQUEST_SIZE] =
+    {
+        0, 0, 0, 5,
+        0, 0, 0, RECORD_REQUEST_SIZE - 8,
+        12, 0, 0, 0, 0, 0, 100, recordId
+    };
+    HOST_TEST_CHECK(send(socketHandle, request, sizeof(request), 0) == sizeof(request));
+}
+
+static void testRejectedRecord(int socketHandle)
+{
+    uint8_t expectedStatus[RECORD_STATUS_SIZE] = { 0, 0, 0, 9, 0, 0, 0, RECORD_STATUS_SIZE - 8, 3, RECORD_STATUS_REJECTED };
+    uint8_t status[RECORD_STATUS_SIZE];
+
+    sendRecordRequest(socketHandle, 3);
+    HOST_TEST_CHECK(receiveAll(socketHandle, status, sizeof(status)));
+    HOST_TEST_CHECK(memcmp(status, expectedStatus, sizeof(status)) == 0);
+}
+
+// The rejected impulse response status is the largest small message.
+static void testRejectedImpulseResponse(int socketHandle)
+{
+    uint8_t request[IMPULSE_RESPONSE_REQUEST_SIZE] =
+    {
+        0, 0, 0, 21,
+        0, 0, 0, IMPULSE_RESPONSE_REQUEST_SIZE - 8,
+        12, 0, 0, 0, 0, MEASUREMENT_ID, 0, 0,
+        0, 20, 0x4E, 0x20, 0x03, 0xE8, 0x10, 0x00
+    };
+    uint8_t expectedResponse[IMPULSE_RESPONSE_REJECTED_SIZE] =
+    {
+        0, 0, 0, 22,
+        0, 0, 0, IMPULSE_RESPONSE_REJECTED_SIZE - 8,
+        MEASUREMENT_ID, IMPULSE_RESPONSE_STATUS_REJECTED
+    };
+    uint8_t response[IMPULSE_RESPONSE_REJECTED_SIZE];
+
+    HOST_TEST_CHECK(send(socketHandle, request, sizeof(request), 0) == sizeof(request));
+    HOST_TEST_CHECK(receiveAll(socketHandle, response, sizeof(response)));
+    HOST_TEST_CHECK(memcmp(response, expectedResponse, sizeof(response)) == 0);
+}
+
+// The bulk record messages go to the session that requested the record, and the impulse responses to the session
+// that requested the measurement, even if a record has the same id.
+static void testRecordUpload(int socketHandle, int otherSocketHandle)
+{
+    uint8_t record[RECORD_RESPONSE_HEADER_SIZE + 4] = { 0, 0, 0, 6, 0, 0, 0, 5, MEASUREMENT_ID, 1, 2, 3, 4 };
+    uint8_t status[RECORD_STATUS_SIZE] = { 0, 0, 0, 9, 0, 0, 0, RECORD_STATUS_SIZE - 8, MEASUREMENT_ID, 0 };
+    uint8_t impulseResponse[12] = { 0, 0, 0, 22, 0, 0, 0, 4, MEASUREMENT_ID, 0, 5, 6 };
+    uint8_t received[sizeof(record) + sizeof(status)];
+
+    sendRecordRequest(otherSocketHandle, MEASUREMENT_ID);
+    usleep(20000);
+    HOST_TEST_CHECK(queueUploadData(record, sizeof(record)));
+    HOST_TEST_CHECK(queueUploadData(impulseResponse, sizeof(impulseResponse)));
+    HOST_TEST_CHECK(queueUploadData(status, sizeof(status)));
+
+    HOST_TEST_CHECK(receiveAll(otherSocketHandle, received, sizeof(received)));
+    HOST_TEST_CHECK(memcmp(received, record, sizeof(record)) == 0);
+    HOST_TEST_CHECK(memcmp(received + sizeof(record), status, sizeof(status)) == 0);
+
+    HOST_TEST_CHECK(receiveAll(socketHandle, received, sizeof(impulseResponse)));
+    HOST_TEST_CHECK(memcmp(received, impulseResponse, sizeof(impulseResponse)) == 0);
+}
+
+int main()
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    initializeUpload();
+    initializeCommunication(handleInitialization, handleRecord, handleSpectrum, handleLevelMeter, handleImpulseResponse);
+    startUpload();
+    startCommunication();
+
+    int socketHandle = connectClient();
+    int otherSocketHandle = connectClient();
+    HOST_TEST_CHECK(socketHandle >= 0 && otherSocketHandle >= 0);
+    if (socketHandle < 0 || otherSocketHandle < 0)
+    {
+        return getHostTestResult();
+    }
+    HOST_TEST_CHECK(waitForSessionCount(2));
+
+    testRejectedRecord(socketHandle);
+    testRejectedImpulseResponse(socketHandle);
+    testRecordUpload(socketHandle, otherSocketHandle);
+
+    close(socketHandle);
+    close(otherSocketHandle);
+    HOST_TEST_CHECK(waitForSessionCount(0));
+    return getHostTestResult();
+}